@@ -338,3 +338,331 @@ unsigned char HammingPackedTableDecode(unsigned char code)
     return decoded;
 }
 
+
+/***************************************************************************
+*                            BUFFER FUNCTIONS
+*
+*   Codes are systematic: the low nibble of a code is its data and bits 4
+*   to 6 are parity.  The syndrome of a code is linear in its bits, and
+*   the parity bits contribute their own value, so it is
+*   syndromeLow[code & 0x0F] ^ ((code >> 4) & 0x07).  The data is then
+*   corrected by XORing in the data half of syndromeMask.  Both tables
+*   have at most 16 entries, so on x86 they are looked up 16 or 32 codes
+*   at a time with PSHUFB.  Bit 7 of a code is ignored.
+***************************************************************************/
+
+/* syndrome of the data nibble of a code */
+const unsigned char syndromeLow[DATA_VALUES] =
+{
+    0x00, 0x07, 0x06, 0x01, 0x05, 0x02, 0x03, 0x04,     /* 0x00 to 0x07 */
+    0x03, 0x04, 0x05, 0x02, 0x06, 0x01, 0x00, 0x07      /* 0x08 to 0x0F */
+};
+
+/***************************************************************************
+*   Function   : HammingScalarEncode
+*   Description: This function encodes a buffer one nibble at a time using
+*                the lookup table hammingCodes.
+*   Parameters : code - buffer of 2 * n codes to be written.
+*                data - buffer of n bytes to encode.
+*                n - number of bytes of data.
+*   Effects    : code is filled with the codes for data.
+*   Returned   : None
+***************************************************************************/
+static void HammingScalarEncode(unsigned char *code, const unsigned char *data,
+    size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+    {
+        code[2 * i] = hammingCodes[data[i] >> DATA_BITS];
+        code[2 * i + 1] = hammingCodes[data[i] & (0xFF >> DATA_BITS)];
+    }
+}
+
+/***************************************************************************
+*   Function   : HammingScalarDecode
+*   Description: This function decodes a buffer one code at a time using
+*                the syndrome tables above.
+*   Parameters : data - buffer of n bytes to be written.
+*                code - buffer of 2 * n codes to decode.
+*                n - number of bytes of data.
+*   Effects    : data is filled with the nearest values to the codes.
+*   Returned   : Number of codes that had an error corrected.
+***************************************************************************/
+static size_t HammingScalarDecode(unsigned char *data,
+    const unsigned char *code, size_t n)
+{
+    size_t i, errors;
+    unsigned char hi, lo;
+
+    errors = 0;
+
+    for (i = 0; i < n; i++)
+    {
+        hi = syndromeLow[code[2 * i] & 0x0F] ^ ((code[2 * i] >> 4) & 0x07);
+        lo = syndromeLow[code[2 * i + 1] & 0x0F] ^
+            ((code[2 * i + 1] >> 4) & 0x07);
+        errors += (hi != 0) + (lo != 0);
+
+        hi = (code[2 * i] ^ syndromeMask[hi]) & 0x0F;
+        lo = (code[2 * i + 1] ^ syndromeMask[lo]) & 0x0F;
+        data[i] = (hi << DATA_BITS) | lo;
+    }
+
+    return errors;
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAMMING_X86
+
+/***************************************************************************
+*   Function   : HammingSSSE3Encode
+*   Description: This function encodes 16 bytes of data at a time by
+*                splitting them into nibbles and looking all of them up in
+*                hammingCodes at once with PSHUFB.  Codes for the high and
+*                low nibbles are then interleaved.
+*   Parameters : code - buffer of 2 * n codes to be written.
+*                data - buffer of n bytes to encode.
+*                n - number of bytes of data.
+*   Effects    : code is filled with the codes for data.
+*   Returned   : None
+***************************************************************************/
+__attribute__((target("ssse3")))
+static void HammingSSSE3Encode(unsigned char *code, const unsigned char *data,
+    size_t n)
+{
+    __m128i table, nibble, d, hi, lo;
+    size_t i;
+
+    table = _mm_loadu_si128((const __m128i *)hammingCodes);
+    nibble = _mm_set1_epi8(0x0F);
+
+    for (i = 0; i + 16 <= n; i += 16)
+    {
+        d = _mm_loadu_si128((const __m128i *)(data + i));
+        hi = _mm_shuffle_epi8(table,
+            _mm_and_si128(_mm_srli_epi16(d, DATA_BITS), nibble));
+        lo = _mm_shuffle_epi8(table, _mm_and_si128(d, nibble));
+        _mm_storeu_si128((__m128i *)(code + 2 * i),
+            _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128((__m128i *)(code + 2 * i + 16),
+            _mm_unpackhi_epi8(hi, lo));
+    }
+
+    HammingScalarEncode(code + 2 * i, data + i, n - i);
+}
+
+/***************************************************************************
+*   Function   : HammingSSSE3Decode16
+*   Description: This function computes the syndromes and corrected data
+*                nibbles of 16 codes with PSHUFB.
+*   Parameters : c - 16 codes.
+*                errors - incremented by the number of codes with errors.
+*   Effects    : None
+*   Returned   : 16 corrected data nibbles, one to a byte.
+***************************************************************************/
+__attribute__((target("ssse3")))
+static __m128i HammingSSSE3Decode16(__m128i c, size_t *errors)
+{
+    __m128i nibble, syndrome, lo;
+
+    nibble = _mm_set1_epi8(0x0F);
+    lo = _mm_and_si128(c, nibble);
+    syndrome = _mm_xor_si128(
+        _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)syndromeLow), lo),
+        _mm_and_si128(_mm_srli_epi16(c, 4), _mm_set1_epi8(0x07)));
+
+    *errors += 16 - __builtin_popcount(_mm_movemask_epi8(
+        _mm_cmpeq_epi8(syndrome, _mm_setzero_si128())));
+
+    /* syndromeMask has 8 entries; the upper 8 lanes are never selected */
+    return _mm_and_si128(_mm_xor_si128(lo,
+        _mm_shuffle_epi8(_mm_loadl_epi64((const __m128i *)syndromeMask),
+        syndrome)), nibble);
+}
+
+/***************************************************************************
+*   Function   : HammingSSSE3Decode
+*   Description: This function decodes 32 codes at a time using
+*                HammingSSSE3Decode16, then packs pairs of nibbles into
+*                bytes with PMADDUBSW (high * 16 + low) and PACKUSWB.
+*   Parameters : data - buffer of n bytes to be written.
+*                code - buffer of 2 * n codes to decode.
+*                n - number of bytes of data.
+*   Effects    : data is filled with the nearest values to the codes.
+*   Returned   : Number of codes that had an error corrected.
+***************************************************************************/
+__attribute__((target("ssse3")))
+static size_t HammingSSSE3Decode(unsigned char *data,
+    const unsigned char *code, size_t n)
+{
+    __m128i weights, d0, d1;
+    size_t i, errors;
+
+    weights = _mm_set1_epi16(0x0110);
+    errors = 0;
+
+    for (i = 0; i + 16 <= n; i += 16)
+    {
+        d0 = HammingSSSE3Decode16(
+            _mm_loadu_si128((const __m128i *)(code + 2 * i)), &errors);
+        d1 = HammingSSSE3Decode16(
+            _mm_loadu_si128((const __m128i *)(code + 2 * i + 16)), &errors);
+        _mm_storeu_si128((__m128i *)(data + i),
+            _mm_packus_epi16(_mm_maddubs_epi16(d0, weights),
+            _mm_maddubs_epi16(d1, weights)));
+    }
+
+    return errors + HammingScalarDecode(data + i, code + 2 * i, n - i);
+}
+
+/***************************************************************************
+*   Function   : HammingAVX2Encode
+*   Description: This function is HammingSSSE3Encode 32 bytes at a time.
+*                AVX2 interleaves within 128 bit lanes, so the halves are
+*                put back in order with VPERM2I128.
+*   Parameters : code - buffer of 2 * n codes to be written.
+*                data - buffer of n bytes to encode.
+*                n - number of bytes of data.
+*   Effects    : code is filled with the codes for data.
+*   Returned   : None
+***************************************************************************/
+__attribute__((target("avx2")))
+static void HammingAVX2Encode(unsigned char *code, const unsigned char *data,
+    size_t n)
+{
+    __m256i table, nibble, d, hi, lo, a, b;
+    size_t i;
+
+    table = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i *)hammingCodes));
+    nibble = _mm256_set1_epi8(0x0F);
+
+    for (i = 0; i + 32 <= n; i += 32)
+    {
+        d = _mm256_loadu_si256((const __m256i *)(data + i));
+        hi = _mm256_shuffle_epi8(table,
+            _mm256_and_si256(_mm256_srli_epi16(d, DATA_BITS), nibble));
+        lo = _mm256_shuffle_epi8(table, _mm256_and_si256(d, nibble));
+        a = _mm256_unpacklo_epi8(hi, lo);
+        b = _mm256_unpackhi_epi8(hi, lo);
+        _mm256_storeu_si256((__m256i *)(code + 2 * i),
+            _mm256_permute2x128_si256(a, b, 0x20));
+        _mm256_storeu_si256((__m256i *)(code + 2 * i + 32),
+            _mm256_permute2x128_si256(a, b, 0x31));
+    }
+
+    HammingSSSE3Encode(code + 2 * i, data + i, n - i);
+}
+
+/***************************************************************************
+*   Function   : HammingAVX2Decode
+*   Description: This function is HammingSSSE3Decode 64 codes at a time.
+*                VPACKUSWB packs within 128 bit lanes, so the quarters are
+*                put back in order with VPERMQ.
+*   Parameters : data - buffer of n bytes to be written.
+*                code - buffer of 2 * n codes to decode.
+*                n - number of bytes of data.
+*   Effects    : data is filled with the nearest values to the codes.
+*   Returned   : Number of codes that had an error corrected.
+***************************************************************************/
+__attribute__((target("avx2")))
+static size_t HammingAVX2Decode(unsigned char *data,
+    const unsigned char *code, size_t n)
+{
+    __m256i nibble, low3, syndromes, masks, weights, c, lo, syndrome, d[2];
+    size_t i, errors;
+    int j;
+
+    nibble = _mm256_set1_epi8(0x0F);
+    low3 = _mm256_set1_epi8(0x07);
+    syndromes = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i *)syndromeLow));
+    masks = _mm256_broadcastsi128_si256(
+        _mm_loadl_epi64((const __m128i *)syndromeMask));
+    weights = _mm256_set1_epi16(0x0110);
+    errors = 0;
+
+    for (i = 0; i + 32 <= n; i += 32)
+    {
+        for (j = 0; j < 2; j++)
+        {
+            c = _mm256_loadu_si256((const __m256i *)(code + 2 * i + 32 * j));
+            lo = _mm256_and_si256(c, nibble);
+            syndrome = _mm256_xor_si256(_mm256_shuffle_epi8(syndromes, lo),
+                _mm256_and_si256(_mm256_srli_epi16(c, 4), low3));
+            errors += 32 - __builtin_popcount((unsigned)_mm256_movemask_epi8(
+                _mm256_cmpeq_epi8(syndrome, _mm256_setzero_si256())));
+            d[j] = _mm256_maddubs_epi16(_mm256_and_si256(_mm256_xor_si256(lo,
+                _mm256_shuffle_epi8(masks, syndrome)), nibble), weights);
+        }
+
+        _mm256_storeu_si256((__m256i *)(data + i), _mm256_permute4x64_epi64(
+            _mm256_packus_epi16(d[0], d[1]), 0xD8));
+    }
+
+    return errors + HammingSSSE3Decode(data + i, code + 2 * i, n - i);
+}
+#endif
+
+/***************************************************************************
+*   Function   : HammingBufferEncode
+*   Description: This function encodes a buffer of data, two codes to a
+*                byte with the code for the high nibble first.  It uses
+*                AVX2 or SSSE3 if the processor has them and the table
+*                lookup otherwise.
+*   Parameters : code - buffer of 2 * n codes to be written.
+*                data - buffer of n bytes to encode.
+*                n - number of bytes of data.
+*   Effects    : code is filled with the codes for data.
+*   Returned   : None
+***************************************************************************/
+void HammingBufferEncode(unsigned char *code, const unsigned char *data,
+    size_t n)
+{
+#ifdef HAMMING_X86
+    if (__builtin_cpu_supports("avx2"))
+    {
+        HammingAVX2Encode(code, data, n);
+        return;
+    }
+    else if (__builtin_cpu_supports("ssse3"))
+    {
+        HammingSSSE3Encode(code, data, n);
+        return;
+    }
+#endif
+
+    HammingScalarEncode(code, data, n);
+}
+
+/***************************************************************************
+*   Function   : HammingBufferDecode
+*   Description: This function decodes a buffer of codes written by
+*                HammingBufferEncode, correcting any single bit error in
+*                each code.  It uses AVX2 or SSSE3 if the processor has
+*                them and the syndrome tables otherwise.
+*   Parameters : data - buffer of n bytes to be written.
+*                code - buffer of 2 * n codes to decode.
+*                n - number of bytes of data.
+*   Effects    : data is filled with the nearest values to the codes.
+*   Returned   : Number of codes that had an error corrected.
+***************************************************************************/
+size_t HammingBufferDecode(unsigned char *data, const unsigned char *code,
+    size_t n)
+{
+#ifdef HAMMING_X86
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return HammingAVX2Decode(data, code, n);
+    }
+    else if (__builtin_cpu_supports("ssse3"))
+    {
+        return HammingSSSE3Decode(data, code, n);
+    }
+#endif
+
+    return HammingScalarDecode(data, code, n);
+}
@@ -48,6 +48,7 @@
 *                             INCLUDED FILES
 ***************************************************************************/
 #include <limits.h>
+#include <stddef.h>
 
 /***************************************************************************
 *                                CONSTANTS
@@ -80,4 +81,12 @@ unsigned char HammingMatrixDecode(unsigned char code);
 unsigned char HammingTableDecode(unsigned char code);
 unsigned char HammingPackedTableDecode(unsigned char code);
 
+/* encode n bytes of data as 2n codes, high nibble first */
+void HammingBufferEncode(unsigned char *code, const unsigned char *data,
+    size_t n);
+
+/* decode 2n codes into n bytes of data, returns number of codes corrected */
+size_t HammingBufferDecode(unsigned char *data, const unsigned char *code,
+    size_t n);
+
 #endif      /* ndef _HAMMING_H */
@@ -60,14 +60,25 @@
 *                             INCLUDED FILES
 ***************************************************************************/
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include "hamming.h"
 
+/***************************************************************************
+*                                CONSTANTS
+***************************************************************************/
+#define BENCH_BYTES     (1 << 20)   /* bytes of data per benchmark pass */
+#define BENCH_PASSES    64
+
 /***************************************************************************
 *                               PROTOTYPES
 ***************************************************************************/
 void TestAll(void);
 void BuildCodeTable(void);
 void BuildDecodeTables(void);
+void TestBuffers(void);
+void Benchmark(void);
 
 /***************************************************************************
 *                                FUNCTIONS
@@ -84,11 +95,14 @@ void BuildDecodeTables(void);
 *                this function will call a routine that writes a table of
 *                encoded values to stdout.  When called with the D option
 *                this functions will call a routine that writes standard
-*                and packed tables of decode values to stdout.
+*                and packed tables of decode values to stdout.  When
+*                called with the B option, this function will time the
+*                buffer functions against the table functions.
 *   Parameters : argc - number of command line arguements
 *                argv - command line arguments.
 *                       argv[1][0] == 'E' outputs encode table
 *                       argv[1][0] == 'D' outputs decode table
+*                       argv[1][0] == 'B' runs benchmark
 *   Effects    : Results of verify are written to stdout
 *   Returned   : This function always returns 0.
 ***************************************************************************/
@@ -107,12 +121,18 @@ int main(int argc, char *argv[])
             /* use matrix to dump decode tables to stdout */
             BuildDecodeTables();
         }
+        else if (('b' == argv[1][0]) || ('B' == argv[1][0]))
+        {
+            /* time buffer functions against table functions */
+            Benchmark();
+        }
 
         return 0;
     }
 
     /* test every function */
     TestAll();
+    TestBuffers();
 
     return 0;
 }
@@ -209,6 +229,191 @@ void TestAll(void)
     }
 }
 
+/***************************************************************************
+*   Function   : TestBuffers
+*   Description: This function verifies that the buffer encode function
+*                produces the same codes as the table encode function, and
+*                that the buffer decode function recovers the data and
+*                counts the errors when a single bit error is made in some
+*                of the codes.  Buffers of every length up to 256 bytes are
+*                tried so that the SIMD loops and their scalar tails are
+*                all exercised.
+*   Parameters : None
+*   Effects    : Results of verify are written to stdout
+*   Returned   : None
+***************************************************************************/
+void TestBuffers(void)
+{
+    unsigned char data[256], code[512], decoded[256];
+    size_t n, i, errors, expected;
+    int failed;
+
+    printf("\nVerifying Buffer Encode/Decode ...\n");
+    failed = 0;
+
+    for (i = 0; i < 256; i++)
+    {
+        data[i] = (unsigned char)(i * 97 + 13);
+    }
+
+    for (n = 0; n <= 256; n++)
+    {
+        memset(code, 0xAA, sizeof(code));
+        HammingBufferEncode(code, data, n);
+
+        for (i = 0; i < n; i++)
+        {
+            if ((code[2 * i] != HammingTableEncode(data[i] >> DATA_BITS)) ||
+                (code[2 * i + 1] != HammingTableEncode(data[i] & 0x0F)))
+            {
+                printf("*** Error Buffer Encoding: %02X ****\n", data[i]);
+                failed = 1;
+            }
+        }
+
+        if ((n < 256) && (code[2 * n] != 0xAA))
+        {
+            printf("*** Buffer Encode Overrun: %u ****\n", (unsigned)n);
+            failed = 1;
+        }
+
+        /* flip one bit in every third code, cycling through the 7 bits */
+        expected = 0;
+        for (i = 0; i < 2 * n; i += 3)
+        {
+            code[i] ^= (unsigned char)(1 << (i % CODE_BITS));
+            expected++;
+        }
+
+        errors = HammingBufferDecode(decoded, code, n);
+
+        if ((errors != expected) || memcmp(decoded, data, n))
+        {
+            printf("*** Error Buffer Decoding: length %u ****\n", (unsigned)n);
+            failed = 1;
+        }
+    }
+
+    printf("%s\n", failed ? "Failed" : "Passed");
+}
+
+/***************************************************************************
+*   Function   : Seconds
+*   Description: This function converts an interval measured with clock()
+*                to seconds.
+*   Parameters : start - clock() at the start of the interval.
+*   Effects    : None
+*   Returned   : Seconds since start.
+***************************************************************************/
+static double Seconds(clock_t start)
+{
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/***************************************************************************
+*   Function   : Benchmark
+*   Description: This function encodes and decodes BENCH_PASSES buffers of
+*                BENCH_BYTES random bytes, once with a loop calling the
+*                table functions for each nibble and once with the buffer
+*                functions, and writes the throughput of each to stdout.
+*   Parameters : None
+*   Effects    : Results of benchmark are written to stdout
+*   Returned   : None
+***************************************************************************/
+void Benchmark(void)
+{
+    unsigned char *data, *code, *decoded;
+    size_t i, errors;
+    int pass;
+    clock_t start;
+    double mb;
+
+    data = malloc(BENCH_BYTES);
+    code = malloc(2 * BENCH_BYTES);
+    decoded = malloc(BENCH_BYTES);
+
+    if ((NULL == data) || (NULL == code) || (NULL == decoded))
+    {
+        printf("*** Out of memory ***\n");
+        free(data);
+        free(code);
+        free(decoded);
+        return;
+    }
+
+    for (i = 0; i < BENCH_BYTES; i++)
+    {
+        data[i] = (unsigned char)rand();
+    }
+
+    mb = (double)BENCH_BYTES * BENCH_PASSES / (1 << 20);
+    printf("Throughput in MB of data per second\n");
+
+    start = clock();
+    for (pass = 0; pass < BENCH_PASSES; pass++)
+    {
+        for (i = 0; i < BENCH_BYTES; i++)
+        {
+            code[2 * i] = HammingTableEncode(data[i] >> DATA_BITS);
+            code[2 * i + 1] = HammingTableEncode(data[i] & 0x0F);
+        }
+    }
+    printf("Table Encode\t%8.1f\n", mb / Seconds(start));
+
+    start = clock();
+    for (pass = 0; pass < BENCH_PASSES; pass++)
+    {
+        HammingBufferEncode(code, data, BENCH_BYTES);
+    }
+    printf("Buffer Encode\t%8.1f\n", mb / Seconds(start));
+
+    /* one error in every 16 codes */
+    for (i = 0; i < 2 * BENCH_BYTES; i += 16)
+    {
+        code[i] ^= (unsigned char)(1 << (i / 16 % CODE_BITS));
+    }
+
+    start = clock();
+    for (pass = 0; pass < BENCH_PASSES; pass++)
+    {
+        for (i = 0; i < BENCH_BYTES; i++)
+        {
+            decoded[i] = (HammingTableDecode(code[2 * i]) << DATA_BITS) |
+                HammingTableDecode(code[2 * i + 1]);
+        }
+    }
+    printf("Table Decode\t%8.1f\n", mb / Seconds(start));
+
+    start = clock();
+    for (pass = 0; pass < BENCH_PASSES; pass++)
+    {
+        for (i = 0; i < BENCH_BYTES; i++)
+        {
+            decoded[i] = (HammingPackedTableDecode(code[2 * i]) << DATA_BITS) |
+                HammingPackedTableDecode(code[2 * i + 1]);
+        }
+    }
+    printf("Packed Decode\t%8.1f\n", mb / Seconds(start));
+
+    start = clock();
+    errors = 0;
+    for (pass = 0; pass < BENCH_PASSES; pass++)
+    {
+        errors = HammingBufferDecode(decoded, code, BENCH_BYTES);
+    }
+    printf("Buffer Decode\t%8.1f\t(%lu errors corrected per pass)\n",
+        mb / Seconds(start), (unsigned long)errors);
+
+    if (memcmp(decoded, data, BENCH_BYTES))
+    {
+        printf("*** Error Buffer Decoding ****\n");
+    }
+
+    free(data);
+    free(code);
+    free(decoded);
+}
+
 /***************************************************************************
 *   Function   : BuildCodeTable
 *   Description: This function uses HammingMatrixEncode to output text
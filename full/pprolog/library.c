@@ -19,6 +19,19 @@
 #define L_OPENIN 12
 #define L_CLOSEIN 13
 #define L_FLUSH 14
+#define L_CPUTIME 15
+#define L_SPAWN 16
+#define L_WAITALL 17
+#define L_OPENOUT 18
+#define L_TEMPNAME 19
+#define L_REMOVEFILE 20
+#define L_CLOSEOUT 21
+#define L_GETBLOCK 22
+#define L_PUTBLOCK 23
+#define L_NEWJOBS 24
+#define L_NEXTJOB 25
+#define L_INPOS 26
+#define L_SEEKIN 27
 
 PUBLIC tree lib_call(def d, tree args)
 {
@@ -75,9 +88,19 @@ PUBLIC tree lib_call(def d, tree args)
 	  }
 
      case L_ARGC:
+     case L_CPUTIME:
+     case L_SPAWN:
+     case L_WAITALL:
+     case L_NEWJOBS:
+     case L_NEXTJOB:
 	  ok = (n_args == 0);
 	  break;
 
+     case L_TEMPNAME:
+     case L_REMOVEFILE:
+	  ok = (n_args == 1 && is_string_type(car(args)->t_type));
+	  break;
+
      case L_ARGV:
 	  ok = (n_args == 2
 		&& same_type(car(args)->t_type, int_type)
@@ -85,15 +108,32 @@ PUBLIC tree lib_call(def d, tree args)
 	  break;
 
      case L_OPENIN:
+     case L_OPENOUT:
 	  ok = (n_args == 2
 		&& same_type(car(args)->t_type, text_type)
 		&& is_string_type(cadr(args)->t_type));
 	  break;
 
      case L_CLOSEIN:
+     case L_CLOSEOUT:
+     case L_INPOS:
 	  ok = (n_args == 1 && same_type(car(args)->t_type, text_type));
 	  break;
 
+     case L_SEEKIN:
+	  ok = (n_args == 2
+		&& same_type(car(args)->t_type, text_type)
+		&& same_type(cadr(args)->t_type, int_type));
+	  break;
+
+     case L_GETBLOCK:
+     case L_PUTBLOCK:
+	  ok = (n_args == 3
+		&& same_type(car(args)->t_type, text_type)
+		&& cadr(args)->t_type->x_kind == ARRAY
+		&& same_type(car(cdr(cdr(args)))->t_type, int_type));
+	  break;
+
      default:
 	  ok = FALSE;
 	  t = err_type;
@@ -216,4 +256,17 @@ PUBLIC void init_lib(void)
      built_in("argv", void_type, L_ARGV);
      built_in("openin", bool_type, L_OPENIN);
      built_in("closein", void_type, L_CLOSEIN);
+     built_in("cputime", int_type, L_CPUTIME);
+     built_in("spawn", int_type, L_SPAWN);
+     built_in("waitall", void_type, L_WAITALL);
+     built_in("openout", bool_type, L_OPENOUT);
+     built_in("closeout", void_type, L_CLOSEOUT);
+     built_in("getblock", bool_type, L_GETBLOCK);
+     built_in("putblock", bool_type, L_PUTBLOCK);
+     built_in("tempname", void_type, L_TEMPNAME);
+     built_in("removefile", void_type, L_REMOVEFILE);
+     built_in("newjobs", bool_type, L_NEWJOBS);
+     built_in("nextjob", int_type, L_NEXTJOB);
+     built_in("inpos", int_type, L_INPOS);
+     built_in("seekin", void_type, L_SEEKIN);
 }
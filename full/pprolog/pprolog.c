@@ -4,13 +4,14 @@
 
 boolean run;
 boolean dflag;
+boolean cflag;
 
 typedef integer permstring;
 
 typedef char tempstring[128];
 
 integer charptr;
-char charbuf[2048];
+char charbuf[16777216];
 
 integer StringLength(s)
 tempstring s;
@@ -33,7 +34,7 @@ tempstring s;
 
      permstring __R__;
 
-     if ((((charptr + StringLength(s)) + 1) > 2048)) {
+     if ((((charptr + StringLength(s)) + 1) > 16777216)) {
           putc('\n', output);
           fprintf(output, "Panic: out of string space\n");
           halt();
@@ -76,8 +77,34 @@ permstring s;
      }
 }
 
+void WriteTemp(s)
+tempstring s;
+{
+     integer i;
+
+     i = 1;
+     while ((s[i - 1] != chr(0))) {
+          putc(s[i - 1], output);
+          i = (i + 1);
+     }
+}
+
 integer lsp, gsp, hp, hmark;
-integer mem[1000000];
+integer mem[134217728];
+integer memlimit;
+integer nexpand;
+
+void Expand(n)
+integer n;
+{
+     while (((memlimit < n) && (memlimit < 134217728))) {
+          if ((memlimit > (134217728 / 2)))
+               memlimit = 134217728;
+          else
+               memlimit = (2 * memlimit);
+          nexpand = (nexpand + 1);
+     }
+}
 
 integer LocAlloc(size)
 integer size;
@@ -119,17 +146,20 @@ integer size;
 {
      integer __R__;
 
-     if (((hp + size) > 1000000)) {
+     if (((hp + size) > 134217728)) {
           putc('\n', output);
           fprintf(output, "Panic: out of heap space\n");
           halt();
      }
+     if ((((hp + size) + 50000) > memlimit))
+          Expand(((hp + size) + 50000));
      __R__ = (hp + 1);
      hp = (hp + size);
      return __R__;
 }
 
 boolean interacting;
+boolean batching;
 char pbchar;
 text infile;
 integer lineno;
@@ -179,10 +209,12 @@ char ch;
 
 integer current;
 integer call;
+integer callkey;
 integer goalframe;
 integer choice;
 integer base;
 integer proc;
+integer alt;
 
 integer Deref(t, e)
 integer t;
@@ -196,7 +228,7 @@ integer e;
           halt();
      }
      if ((((mem[t - 1] / 256) == 5) && (e != 0)))
-          t = ((e + 7) + ((mem[(t + 2) - 1] - 1) * 3));
+          t = ((e + 9) + ((mem[(t + 2) - 1] - 1) * 3));
      while ((((mem[t - 1] / 256) == 4) && (mem[(t + 2) - 1] != 0)))
           t = mem[(t + 2) - 1];
      __R__ = t;
@@ -211,53 +243,110 @@ boolean DoBuiltin();
 
 void Collect();
 
+void GCReport();
+
+void ResetTables();
+
 integer Key();
 
+integer CompileHead();
+
 typedef integer symbol;
 
 integer nsymbols;
+integer hashsize;
+integer hashtab[2097152];
 struct {
      integer name;
      integer arity;
      integer action;
      integer proc;
-} symtab[511];
+     integer last;
+     integer nclauses;
+     integer index;
+     integer table;
+} symtab[1048576];
 symbol cons, eqsym, cutsym, nilsym, notsym;
+symbol tablesym, tblsym, tblget, tblnext;
+
+integer HashName(s)
+permstring s;
+{
+     integer h;
+
+     integer __R__;
+
+     h = 0;
+     while ((charbuf[s - 1] != chr(0))) {
+          h = (((5 * h) + ord(charbuf[s - 1])) % hashsize);
+          s = (s + 1);
+     }
+     __R__ = h;
+     return __R__;
+}
+
+void Rehash()
+{
+     integer i, p;
+
+     hashsize = (2 * hashsize);
+     for (i = 1; i <= hashsize; i++)
+          hashtab[i - 1] = 0;
+     for (i = 1; i <= nsymbols; i++) {
+          p = (HashName(symtab[i - 1].name) + 1);
+          while ((hashtab[p - 1] != 0)) {
+               p = (p - 1);
+               if ((p == 0))
+                    p = hashsize;
+          }
+          hashtab[p - 1] = i;
+     }
+}
 
 symbol Lookup(name)
 tempstring name;
 {
      integer h, i;
-     symbol p;
+     integer p;
+     symbol s;
 
      symbol __R__;
 
      h = 0;
      i = 1;
      while ((name[i - 1] != chr(0))) {
-          h = (((5 * h) + ord(name[i - 1])) % 511);
+          h = (((5 * h) + ord(name[i - 1])) % hashsize);
           i = (i + 1);
      }
      p = (h + 1);
-     while ((symtab[p - 1].name != (- 1))) {
-          if (StringEqual(name, symtab[p - 1].name))
+     while ((hashtab[p - 1] != 0)) {
+          s = hashtab[p - 1];
+          if (StringEqual(name, symtab[s - 1].name))
                goto L1;
           p = (p - 1);
           if ((p == 0))
-               p = 511;
+               p = hashsize;
      }
-     if ((nsymbols >= ((511 / 10) * (90 / 10)))) {
+     if ((nsymbols >= 1048576)) {
           putc('\n', output);
           fprintf(output, "Panic: out of symbol space\n");
           halt();
      }
      nsymbols = (nsymbols + 1);
-     symtab[p - 1].name = SaveString(name);
-     symtab[p - 1].arity = (- 1);
-     symtab[p - 1].action = 0;
-     symtab[p - 1].proc = 0;
+     s = nsymbols;
+     hashtab[p - 1] = s;
+     symtab[s - 1].name = SaveString(name);
+     symtab[s - 1].arity = (- 1);
+     symtab[s - 1].action = 0;
+     symtab[s - 1].proc = 0;
+     symtab[s - 1].last = 0;
+     symtab[s - 1].nclauses = 0;
+     symtab[s - 1].index = 0;
+     symtab[s - 1].table = 0;
+     if ((nsymbols >= ((hashsize / 10) * (90 / 10))))
+          Rehash();
 L1:
-     __R__ = p;
+     __R__ = s;
      return __R__;
 }
 
@@ -293,8 +382,9 @@ void InitSymbols()
      symbol dummy;
 
      nsymbols = 0;
-     for (i = 1; i <= 511; i++)
-          symtab[i - 1].name = (- 1);
+     hashsize = 512;
+     for (i = 1; i <= hashsize; i++)
+          hashtab[i - 1] = 0;
      cons = Enter(":       ", 2, 0);
      cutsym = Enter("!       ", 0, 1);
      eqsym = Enter("=       ", 2, 8);
@@ -308,16 +398,132 @@ void InitSymbols()
      dummy = Enter("false   ", 0, 9);
      dummy = Enter("print   ", 1, 10);
      dummy = Enter("nl      ", 0, 11);
+     dummy = Enter("stats   ", 0, 12);
+     tablesym = Enter("table   ", (- 1), 0);
+     tblsym = Enter("$tbl    ", 2, 0);
+     tblget = Enter("$get    ", 2, 14);
+     tblnext = Enter("$next   ", 2, 15);
+}
+
+void Append(c, ch)
+integer c;
+integer ch;
+{
+     mem[(c + 5) - 1] = 0;
+     if ((mem[ch - 1] == 0))
+          mem[ch - 1] = c;
+     else
+          mem[(mem[(ch + 1) - 1] + 5) - 1] = c;
+     mem[(ch + 1) - 1] = c;
+}
+
+integer NewIndex(n)
+integer n;
+{
+     integer x;
+     integer j;
+
+     integer __R__;
+
+     x = HeapAlloc((4 + (3 * n)));
+     mem[x - 1] = n;
+     mem[(x + 1) - 1] = 0;
+     mem[(x + 2) - 1] = 0;
+     mem[((x + 2) + 1) - 1] = 0;
+     for (j = 0; j <= (n - 1); j++)
+          mem[((x + (3 * j)) + 5) - 1] = 0;
+     __R__ = x;
+     return __R__;
+}
+
+integer FindSlot(x, k)
+integer x;
+integer k;
+{
+     integer j;
+
+     integer __R__;
+
+     j = (k % mem[x - 1]);
+     if ((j < 0))
+          j = (j + mem[x - 1]);
+     while (((mem[((x + (3 * j)) + 5) - 1] != 0) && (mem[((x + (3 *
+               j)) + 4) - 1] != k)))
+          j = ((j + 1) % mem[x - 1]);
+     __R__ = j;
+     return __R__;
+}
+
+integer GrowIndex(x)
+integer x;
+{
+     integer y;
+     integer i, j;
+
+     integer __R__;
+
+     y = NewIndex((2 * mem[x - 1]));
+     mem[(y + 1) - 1] = mem[(x + 1) - 1];
+     mem[(y + 2) - 1] = mem[(x + 2) - 1];
+     mem[((y + 2) + 1) - 1] = mem[((x + 2) + 1) - 1];
+     for (i = 0; i <= (mem[x - 1] - 1); i++)
+          if ((mem[((x + (3 * i)) + 5) - 1] != 0)) {
+               j = FindSlot(y, mem[((x + (3 * i)) + 4) - 1]);
+               mem[((y + (3 * j)) + 4) - 1] = mem[((x + (3 * i)) + 4)
+                         - 1];
+               mem[((y + (3 * j)) + 5) - 1] = mem[((x + (3 * i)) + 5)
+                         - 1];
+               mem[(((y + (3 * j)) + 5) + 1) - 1] = mem[(((x + (3 *
+                         i)) + 5) + 1) - 1];
+          }
+     __R__ = y;
+     return __R__;
+}
+
+void IndexClause(s, c)
+symbol s;
+integer c;
+{
+     integer x;
+     integer j;
+
+     if ((mem[(c + 1) - 1] == 0))
+          Append(c, (symtab[s - 1].index + 2));
+     else {
+          if (((3 * (mem[(symtab[s - 1].index + 1) - 1] + 1)) > (2 *
+                    mem[symtab[s - 1].index - 1])))
+               symtab[s - 1].index = GrowIndex(symtab[s - 1].index);
+          x = symtab[s - 1].index;
+          j = FindSlot(x, mem[(c + 1) - 1]);
+          if ((mem[((x + (3 * j)) + 5) - 1] == 0)) {
+               mem[((x + (3 * j)) + 4) - 1] = mem[(c + 1) - 1];
+               mem[(x + 1) - 1] = (mem[(x + 1) - 1] + 1);
+          }
+          Append(c, ((x + (3 * j)) + 5));
+     }
+}
+
+void MakeIndex(s)
+symbol s;
+{
+     integer p;
+
+     symtab[s - 1].index = NewIndex(16);
+     p = symtab[s - 1].proc;
+     while ((p != 0)) {
+          IndexClause(s, p);
+          p = mem[(p + 2) - 1];
+     }
 }
 
 void AddClause(c)
 integer c;
 {
      symbol s;
-     integer p;
 
      s = mem[(mem[(c + 3) - 1] + 2) - 1];
-     if ((symtab[s - 1].action != 0)) {
+     if (((symtab[s - 1].action != 0) && (symtab[s - 1].action !=
+               13))) {
           {
                putc('\n', output);
                fprintf(output,
@@ -326,13 +532,17 @@ integer c;
           }
           WriteString(symtab[s - 1].name);
      }
-     else if ((symtab[s - 1].proc == 0))
-          symtab[s - 1].proc = c;
      else {
-          p = symtab[s - 1].proc;
-          while ((mem[(p + 2) - 1] != 0))
-               p = mem[(p + 2) - 1];
-          mem[(p + 2) - 1] = c;
+          if ((symtab[s - 1].proc == 0))
+               symtab[s - 1].proc = c;
+          else
+               mem[(symtab[s - 1].last + 2) - 1] = c;
+          symtab[s - 1].last = c;
+          symtab[s - 1].nclauses = (symtab[s - 1].nclauses + 1);
+          if ((symtab[s - 1].index != 0))
+               IndexClause(s, c);
+          else if ((symtab[s - 1].nclauses == 8))
+               MakeIndex(s);
      }
 }
 
@@ -440,17 +650,21 @@ integer nbody;
 
      integer __R__;
 
-     p = HeapAlloc(((4 + nbody) + 1));
+     p = HeapAlloc(((6 + nbody) + 1));
      mem[p - 1] = nvars;
      mem[(p + 2) - 1] = 0;
      mem[(p + 3) - 1] = head;
      for (i = 1; i <= nbody; i++)
-          mem[(((p + 4) + i) - 1) - 1] = body[i - 1];
-     mem[((((p + 4) + nbody) + 1) - 1) - 1] = 0;
+          mem[(((p + 6) + i) - 1) - 1] = body[i - 1];
+     mem[((((p + 6) + nbody) + 1) - 1) - 1] = 0;
+     mem[(p + 4) - 1] = 0;
      if ((head == 0))
           mem[(p + 1) - 1] = 0;
-     else
+     else {
           mem[(p + 1) - 1] = Key(head, 0);
+          if (cflag)
+               mem[(p + 4) - 1] = CompileHead(p);
+     }
      __R__ = p;
      return __R__;
 }
@@ -568,7 +782,8 @@ integer prio;
                break;
           case 4:
                if ((t >= gsp))
-                    fprintf(output, "%c%d", 'G', ((1000000 - t) / 3));
+                    fprintf(output, "%c%d", 'G', ((134217728 - t) /
+                              3));
                else
                     fprintf(output, "%c%d", 'L', ((t - hp) / 3));
                break;
@@ -595,12 +810,12 @@ integer c;
                putc(' ', output);
           }
           fprintf(output, ":- ");
-          if ((mem[(((c + 4) + 1) - 1) - 1] != 0)) {
-               PrintTerm(mem[(((c + 4) + 1) - 1) - 1], 0, 2);
+          if ((mem[(((c + 6) + 1) - 1) - 1] != 0)) {
+               PrintTerm(mem[(((c + 6) + 1) - 1) - 1], 0, 2);
                i = 2;
-               while ((mem[(((c + 4) + i) - 1) - 1] != 0)) {
+               while ((mem[(((c + 6) + i) - 1) - 1] != 0)) {
                     fprintf(output, ", ");
-                    PrintTerm(mem[(((c + 4) + i) - 1) - 1], 0, 2);
+                    PrintTerm(mem[(((c + 6) + i) - 1) - 1], 0, 2);
                     i = (i + 1);
                }
           }
@@ -904,7 +1119,7 @@ integer bindings;
                putc('\n', output);
                WriteString(symtab[vartable[i - 1] - 1].name);
                fprintf(output, " = ");
-               PrintTerm(((bindings + 7) + ((i - 1) * 3)), 0, (2 -
+               PrintTerm(((bindings + 9) + ((i - 1) * 3)), 0, (2 -
                          1));
           }
           if ((! interacting)) {
@@ -1113,9 +1328,50 @@ L3:
      return __R__;
 }
 
+void ParseDirective()
+{
+     integer t;
+     symbol s;
+
+     Eat(6);
+     if (((token != 1) || (tokval != tablesym))) {
+          if ((! errflag)) {
+               ShowError();
+               fprintf(output, "unknown directive\n");
+               Recover();
+          }
+     }
+     else {
+          Eat(1);
+          while (TRUE) {
+               t = ParseTerm();
+               CheckAtom(t);
+               if ((! errflag)) {
+                    s = mem[(t + 2) - 1];
+                    if ((symtab[s - 1].action == 0))
+                         symtab[s - 1].action = 13;
+                    else if ((symtab[s - 1].action != 13)) {
+                         if ((! errflag)) {
+                              ShowError();
+                              fprintf(output,
+                                        "can\'t table a built-in relation\n");
+                              Recover();
+                         }
+                    }
+               }
+               if ((token != 9))
+                    goto L3;
+               Eat(9);
+          }
+     }
+L3:
+     Eat(10);
+}
+
 integer ReadClause()
 {
      integer c;
+     boolean directive;
 
      integer __R__;
 
@@ -1129,23 +1385,32 @@ integer ReadClause()
                flush();
           }
           Scan();
+          directive = FALSE;
           if ((token == 14))
                c = 0;
+          else if ((((token == 6) && (! interacting)) && (!
+                    batching))) {
+               ParseDirective();
+               directive = TRUE;
+               c = 0;
+          }
           else
-               c = ParseClause(interacting);
-     } while (! (((! errflag) || (token == 14))));
+               c = ParseClause((interacting || batching));
+     } while (! ((((! errflag) && (! directive)) || (token == 14))));
      __R__ = c;
      return __R__;
 }
 
 integer trhead;
+integer gcmark;
 
 void Save(v)
 integer v;
 {
      integer p;
 
-     if (((v < choice) || (v >= mem[(choice + 4) - 1]))) {
+     if ((((v < choice) || (v >= mem[(choice + 4) - 1])) || (v >=
+               gcmark))) {
           p = GloAlloc(6, 4);
           mem[(p + 2) - 1] = v;
           mem[(p + 3) - 1] = trhead;
@@ -1176,9 +1441,9 @@ void Commit()
           run = FALSE;
      }
      while (((p != 0) && (p < mem[(choice + 4) - 1]))) {
-          if (((mem[(p + 2) - 1] != 0) && (! ((mem[(p + 2) - 1] <
+          if (((mem[(p + 2) - 1] != 0) && (! (((mem[(p + 2) - 1] <
                     choice) || (mem[(p + 2) - 1] >= mem[(choice + 4)
-                    - 1])))))
+                    - 1])) || (mem[(p + 2) - 1] >= gcmark)))))
                mem[(p + 2) - 1] = 0;
           p = mem[(p + 3) - 1];
      }
@@ -1370,16 +1635,12 @@ integer e;
      return __R__;
 }
 
-integer Search(t, e, p)
-integer t;
-integer e;
+integer Search(k, p)
+integer k;
 integer p;
 {
-     integer k;
-
      integer __R__;
 
-     k = Key(t, e);
      if ((k != 0))
           while ((((p != 0) && (mem[(p + 1) - 1] != 0)) && (mem[(p +
                     1) - 1] != k)))
@@ -1388,126 +1649,783 @@ integer p;
      return __R__;
 }
 
-boolean ok;
-
-void PushFrame(nvars, retry)
-integer nvars;
-integer retry;
+void Order(p, q, first, second)
+integer p;
+integer q;
+integer (*first);
+integer (*second);
 {
-     integer f;
-     integer i;
-
-     f = LocAlloc((7 + (nvars * 3)));
-     mem[f - 1] = current;
-     mem[(f + 1) - 1] = goalframe;
-     mem[(f + 2) - 1] = retry;
-     mem[(f + 3) - 1] = choice;
-     mem[(f + 4) - 1] = gsp;
-     mem[(f + 5) - 1] = trhead;
-     mem[(f + 6) - 1] = nvars;
-     for (i = 1; i <= nvars; i++) {
-          mem[((f + 7) + ((i - 1) * 3)) - 1] = ((256 * 4) + 3);
-          mem[(((f + 7) + ((i - 1) * 3)) + 2) - 1] = 0;
+     if (((p == 0) || ((q != 0) && (q < p)))) {
+          *first = q;
+          *second = p;
+     }
+     else {
+          *first = p;
+          *second = q;
      }
-     goalframe = f;
-     if ((retry != 0))
-          choice = goalframe;
 }
 
-void TroStep()
+void FirstClause(t, k)
+integer t;
+integer k;
 {
-     integer temp;
-     integer oldsize, newsize, i;
+     symbol s;
+     integer x;
 
-     if (dflag)
-          fprintf(output, "(TRO)\n");
-     oldsize = (7 + (mem[(goalframe + 6) - 1] * 3));
-     newsize = (7 + (mem[proc - 1] * 3));
-     temp = LocAlloc(newsize);
-     temp = (goalframe + newsize);
-     for (i = (oldsize - 1); i >= 0; i--)
-          mem[(temp + i) - 1] = mem[(goalframe + i) - 1];
-     for (i = 1; i <= mem[(goalframe + 6) - 1]; i++) {
-          if ((((((mem[((temp + 7) + ((i - 1) * 3)) - 1] / 256) == 4)
-                    && (mem[(((temp + 7) + ((i - 1) * 3)) + 2) - 1]
-                    != 0)) && (goalframe <= mem[(((temp + 7) + ((i -
-                    1) * 3)) + 2) - 1])) && (mem[(((temp + 7) + ((i -
-                    1) * 3)) + 2) - 1] < (goalframe + oldsize))))
-               mem[(((temp + 7) + ((i - 1) * 3)) + 2) - 1] =
-                         (mem[(((temp + 7) + ((i - 1) * 3)) + 2) - 1]
-                         + newsize);
-     }
-     mem[(goalframe + 6) - 1] = mem[proc - 1];
-     for (i = 1; i <= mem[(goalframe + 6) - 1]; i++) {
-          mem[((goalframe + 7) + ((i - 1) * 3)) - 1] = ((256 * 4) +
-                    3);
-          mem[(((goalframe + 7) + ((i - 1) * 3)) + 2) - 1] = 0;
+     s = mem[(t + 2) - 1];
+     x = symtab[s - 1].index;
+     if (((x == 0) || (k == 0))) {
+          proc = Search(k, symtab[s - 1].proc);
+          alt = 0;
      }
-     ok = Unify(call, temp, mem[(proc + 3) - 1], goalframe);
-     current = (proc + 4);
-     lsp = (temp - 1);
+     else
+          Order(mem[((x + (3 * FindSlot(x, k))) + 5) - 1], mem[(x +
+                    2) - 1], &proc, &alt);
 }
 
-void Step()
+integer occurs[63];
+boolean seen[63];
+integer depth, maxdepth;
+integer vmterm[256];
+integer vmenv[256];
+
+void CountVars(t)
+integer t;
 {
-     integer retry;
+     integer i;
 
-     if ((symtab[mem[(call + 2) - 1] - 1].action != 0))
-          ok = DoBuiltin(symtab[mem[(call + 2) - 1] - 1].action);
-     else if ((proc == 0))
-          ok = FALSE;
-     else {
-          retry = Search(call, goalframe, mem[(proc + 2) - 1]);
-          if (((((mem[(current + 1) - 1] == 0) && (choice <
-                    goalframe)) && (retry == 0)) && (goalframe !=
-                    base)))
-               TroStep();
-          else {
-               PushFrame(mem[proc - 1], retry);
-               ok = Unify(call, mem[(goalframe + 1) - 1], mem[(proc +
-                         3) - 1], goalframe);
-               current = (proc + 4);
-               /* skip */;
+     switch ((mem[t - 1] / 256)) {
+     case 1:
+          for (i = 1; i <= symtab[mem[(t + 2) - 1] - 1].arity; i++)
+               CountVars(mem[((t + i) + 2) - 1]);
+          break;
+     case 5:
+          occurs[mem[(t + 2) - 1] - 1] = (occurs[mem[(t + 2) - 1] -
+                    1] + 1);
+          break;
+     case 2:
+     case 3:
+          /* skip */;
+          break;
+     default:
+          {
+               putc('\n', output);
+               fprintf(output, "Panic: bad tag %d in CountVars\n",
+                         (mem[t - 1] / 256));
+               halt();
           }
      }
 }
 
-void Unwind()
+void Emit(w)
+integer w;
 {
-     while (((mem[current - 1] == 0) && (goalframe != base))) {
-          if (dflag) {
-               fprintf(output, "Exit: ");
-               PrintTerm(mem[mem[goalframe - 1] - 1], mem[(goalframe
-                         + 1) - 1], 2);
+     integer p;
+
+     p = HeapAlloc(1);
+     mem[p - 1] = w;
+}
+
+void CompileArg(t)
+integer t;
+{
+     integer i, n;
+     integer p;
+
+     depth = (depth - 1);
+     switch ((mem[t - 1] / 256)) {
+     case 1:
+          {
+               n = symtab[mem[(t + 2) - 1] - 1].arity;
+               if ((n == 0)) {
+                    Emit(1);
+                    Emit(t);
+               }
+               else {
+                    p = (hp + 1);
+                    Emit(4);
+                    Emit(t);
+                    Emit(0);
+                    depth = (depth + n);
+                    if ((depth > maxdepth))
+                         maxdepth = depth;
+                    for (i = 1; i <= n; i++)
+                         CompileArg(mem[((t + i) + 2) - 1]);
+                    mem[(p + 2) - 1] = (hp + 1);
+               }
+          }
+          break;
+     case 2:
+          {
+               Emit(2);
+               Emit(t);
+          }
+          break;
+     case 3:
+          {
+               Emit(3);
+               Emit(t);
+          }
+          break;
+     case 5:
+          if ((occurs[mem[(t + 2) - 1] - 1] == 1))
+               Emit(7);
+          else if ((! seen[mem[(t + 2) - 1] - 1])) {
+               Emit(5);
+               Emit(mem[(t + 2) - 1]);
+               seen[mem[(t + 2) - 1] - 1] = TRUE;
+          }
+          else {
+               Emit(6);
+               Emit(mem[(t + 2) - 1]);
+          }
+          break;
+     default:
+          {
                putc('\n', output);
+               fprintf(output, "Panic: bad tag %d in CompileArg\n",
+                         (mem[t - 1] / 256));
+               halt();
           }
-          current = (mem[goalframe - 1] + 1);
-          if ((goalframe > choice))
-               lsp = (goalframe - 1);
-          goalframe = mem[(goalframe + 1) - 1];
      }
 }
 
-void Backtrack()
+integer CompileHead(c)
+integer c;
 {
-     Restore();
-     current = mem[choice - 1];
-     goalframe = mem[(choice + 1) - 1];
-     call = Deref(mem[current - 1], goalframe);
-     proc = mem[(choice + 2) - 1];
-     gsp = mem[(choice + 4) - 1];
-     lsp = (choice - 1);
-     choice = mem[(choice + 3) - 1];
-     if (dflag) {
-          fprintf(output, "Redo: ");
-          PrintTerm(call, goalframe, 2);
-          putc('\n', output);
+     integer i, n;
+     integer code;
+
+     integer __R__;
+
+     for (i = 1; i <= mem[c - 1]; i++) {
+          occurs[i - 1] = 0;
+          seen[i - 1] = FALSE;
      }
-     /* skip */;
+     CountVars(mem[(c + 3) - 1]);
+     i = 1;
+     while ((mem[(((c + 6) + i) - 1) - 1] != 0)) {
+          CountVars(mem[(((c + 6) + i) - 1) - 1]);
+          i = (i + 1);
+     }
+     n = symtab[mem[(mem[(c + 3) - 1] + 2) - 1] - 1].arity;
+     code = (hp + 1);
+     depth = n;
+     maxdepth = n;
+     for (i = 1; i <= n; i++)
+          CompileArg(mem[((mem[(c + 3) - 1] + i) + 2) - 1]);
+     Emit(8);
+     if ((maxdepth > 256)) {
+          hp = (code - 1);
+          code = 0;
+     }
+     __R__ = code;
+     return __R__;
 }
 
-void Resume()
-{
+boolean Match(t, e1, c, e2)
+integer t;
+integer e1;
+integer c;
+integer e2;
+{
+     integer pc;
+     integer sp, i;
+     integer e;
+     integer v;
+
+     boolean __R__;
+
+     __R__ = FALSE;
+     if ((mem[(c + 4) - 1] == 0)) {
+          __R__ = Unify(t, e1, mem[(c + 3) - 1], e2);
+          goto L2;
+     }
+     sp = 0;
+     for (i = symtab[mem[(t + 2) - 1] - 1].arity; i >= 1; i--) {
+          sp = (sp + 1);
+          vmterm[sp - 1] = mem[((t + i) + 2) - 1];
+          vmenv[sp - 1] = e1;
+     }
+     pc = mem[(c + 4) - 1];
+     while ((mem[pc - 1] != 8)) {
+          if ((mem[pc - 1] == 7)) {
+               sp = (sp - 1);
+               pc = (pc + 1);
+          }
+          else {
+               e = vmenv[sp - 1];
+               t = Deref(vmterm[sp - 1], e);
+               sp = (sp - 1);
+               switch (mem[pc - 1]) {
+               case 1:
+                    {
+                         if (((mem[t - 1] / 256) == 4)) {
+                              Save(t);
+                              mem[(t + 2) - 1] = mem[(pc + 1) - 1];
+                         }
+                         else if (((mem[t - 1] / 256) != 1))
+                              goto L2;
+                         else if ((mem[(t + 2) - 1] != mem[(mem[(pc +
+                                   1) - 1] + 2) - 1]))
+                              goto L2;
+                         pc = (pc + 2);
+                    }
+                    break;
+               case 2:
+                    {
+                         if (((mem[t - 1] / 256) == 4)) {
+                              Save(t);
+                              mem[(t + 2) - 1] = mem[(pc + 1) - 1];
+                         }
+                         else if (((mem[t - 1] / 256) != 2))
+                              goto L2;
+                         else if ((mem[(t + 2) - 1] != mem[(mem[(pc +
+                                   1) - 1] + 2) - 1]))
+                              goto L2;
+                         pc = (pc + 2);
+                    }
+                    break;
+               case 3:
+                    {
+                         if (((mem[t - 1] / 256) == 4)) {
+                              Save(t);
+                              mem[(t + 2) - 1] = mem[(pc + 1) - 1];
+                         }
+                         else if (((mem[t - 1] / 256) != 3))
+                              goto L2;
+                         else if ((mem[(t + 2) - 1] != mem[(mem[(pc +
+                                   1) - 1] + 2) - 1]))
+                              goto L2;
+                         pc = (pc + 2);
+                    }
+                    break;
+               case 4:
+                    if (((mem[t - 1] / 256) == 4)) {
+                         Save(t);
+                         mem[(t + 2) - 1] = GloCopy(mem[(pc + 1) -
+                                   1], e2);
+                         pc = mem[(pc + 2) - 1];
+                    }
+                    else if (((mem[t - 1] / 256) != 1))
+                         goto L2;
+                    else if ((mem[(t + 2) - 1] != mem[(mem[(pc + 1) -
+                              1] + 2) - 1]))
+                         goto L2;
+                    else {
+                         for (i = symtab[mem[(t + 2) - 1] - 1].arity;
+                                   i >= 1; i--) {
+                              sp = (sp + 1);
+                              vmterm[sp - 1] = mem[((t + i) + 2) - 1];
+                              vmenv[sp - 1] = e;
+                         }
+                         pc = (pc + 3);
+                    }
+                    break;
+               case 5:
+                    {
+                         v = ((e2 + 9) + ((mem[(pc + 1) - 1] - 1) *
+                                   3));
+                         if (((mem[t - 1] / 256) == 4))
+                              Share(t, v);
+                         else {
+                              Save(v);
+                              mem[(v + 2) - 1] = GloCopy(t, e);
+                         }
+                         pc = (pc + 2);
+                    }
+                    break;
+               case 6:
+                    {
+                         if ((! Unify(t, e, ((e2 + 9) + ((mem[(pc +
+                                   1) - 1] - 1) * 3)), e2)))
+                              goto L2;
+                         pc = (pc + 2);
+                    }
+                    break;
+               default:
+                    {
+                         putc('\n', output);
+                         fprintf(output,
+                                   "Panic: bad tag %d in Match\n",
+                                   mem[pc - 1]);
+                         halt();
+                    }
+               }
+          }
+     }
+     __R__ = TRUE;
+L2:
+     /* skip */;
+     return __R__;
+}
+
+boolean pflag;
+tempstring profname;
+text pfile;
+integer pcalls[1048576], pexits[1048576], predos[1048576],
+          pfails[1048576];
+integer ptries[1048576], pmatches[1048576];
+integer ptime[1048576];
+integer pstamp[1048576];
+symbol porder[1048576];
+integer pgoal;
+integer pgframe;
+integer nsample;
+integer ptick;
+integer plast;
+integer ncct;
+integer cnparent[65536], cndepth[65536];
+symbol cnsym[65536];
+integer cntime[65536];
+integer cnhash[131071];
+
+integer Elapsed(start)
+integer start;
+{
+     integer t;
+
+     integer __R__;
+
+     t = (cputime() - start);
+     if ((t < 0))
+          t = ((t + 2147483647) + 1);
+     __R__ = t;
+     return __R__;
+}
+
+void ResetProfile()
+{
+     integer i;
+
+     for (i = 1; i <= nsymbols; i++) {
+          pcalls[i - 1] = 0;
+          pexits[i - 1] = 0;
+          predos[i - 1] = 0;
+          pfails[i - 1] = 0;
+          ptries[i - 1] = 0;
+          pmatches[i - 1] = 0;
+          ptime[i - 1] = 0;
+          pstamp[i - 1] = 0;
+     }
+     for (i = 1; i <= 131071; i++)
+          cnhash[i - 1] = 0;
+     ncct = 0;
+     nsample = 0;
+     ptick = 64;
+     plast = cputime();
+     pgoal = 0;
+     pgframe = 0;
+}
+
+boolean Hidden(s)
+symbol s;
+{
+     boolean __R__;
+
+     __R__ = (charbuf[symtab[s - 1].name - 1] == '$');
+     return __R__;
+}
+
+symbol FrameRel(f)
+integer f;
+{
+     symbol __R__;
+
+     __R__ = mem[(Deref(mem[mem[f - 1] - 1], mem[(f + 1) - 1]) + 2) -
+               1];
+     return __R__;
+}
+
+integer ProfNode(p, s)
+integer p;
+symbol s;
+{
+     integer h, q;
+
+     integer __R__;
+
+     if ((p > 0)) {
+          if (((cnsym[p - 1] == s) || (cndepth[p - 1] >= 1024))) {
+               __R__ = p;
+               goto L2;
+          }
+     }
+     h = ((((p * 499) + s) % 131071) + 1);
+     while ((cnhash[h - 1] != 0)) {
+          q = cnhash[h - 1];
+          if (((cnparent[q - 1] == p) && (cnsym[q - 1] == s))) {
+               __R__ = q;
+               goto L2;
+          }
+          h = ((h % 131071) + 1);
+     }
+     if ((ncct >= 65536))
+          __R__ = p;
+     else {
+          ncct = (ncct + 1);
+          cnparent[ncct - 1] = p;
+          cnsym[ncct - 1] = s;
+          if ((p == 0))
+               cndepth[ncct - 1] = 1;
+          else
+               cndepth[ncct - 1] = (cndepth[p - 1] + 1);
+          cntime[ncct - 1] = 0;
+          cnhash[h - 1] = ncct;
+          __R__ = ncct;
+     }
+L2:
+     /* skip */;
+     return __R__;
+}
+
+void ProfSample()
+{
+     integer node, dt;
+
+     dt = Elapsed(plast);
+     plast = cputime();
+     nsample = (nsample + 1);
+     node = ProfNode((mem[(goalframe + 7) - 1] / 2), mem[(call + 2) -
+               1]);
+     if ((node > 0))
+          cntime[node - 1] = (cntime[node - 1] + dt);
+}
+
+void ProfCall()
+{
+     pcalls[mem[(call + 2) - 1] - 1] = (pcalls[mem[(call + 2) - 1] -
+               1] + 1);
+     pgoal = current;
+     pgframe = goalframe;
+     ptick = (ptick - 1);
+     if ((ptick == 0)) {
+          ProfSample();
+          ptick = 64;
+     }
+}
+
+void PadInt(n, w)
+integer n;
+integer w;
+{
+     integer k, m;
+
+     k = 1;
+     m = n;
+     while ((m >= 10)) {
+          m = (m / 10);
+          k = (k + 1);
+     }
+     while ((k < w)) {
+          putc(' ', output);
+          k = (k + 1);
+     }
+     fprintf(output, "%d", n);
+}
+
+boolean ProfBefore(a, b)
+symbol a;
+symbol b;
+{
+     boolean __R__;
+
+     if ((ptime[a - 1] != ptime[b - 1]))
+          __R__ = (ptime[a - 1] > ptime[b - 1]);
+     else
+          __R__ = (pcalls[a - 1] > pcalls[b - 1]);
+     return __R__;
+}
+
+boolean WritePath(p)
+integer p;
+{
+     integer i;
+     boolean any;
+
+     boolean __R__;
+
+     any = FALSE;
+     if ((cnparent[p - 1] != 0))
+          any = WritePath(cnparent[p - 1]);
+     if ((! Hidden(cnsym[p - 1]))) {
+          if (any)
+               putc(';', pfile);
+          i = symtab[cnsym[p - 1] - 1].name;
+          while ((charbuf[i - 1] != chr(0))) {
+               putc(charbuf[i - 1], pfile);
+               i = (i + 1);
+          }
+          fprintf(pfile, "%c%d", '/', symtab[cnsym[p - 1] - 1].arity);
+          any = TRUE;
+     }
+     __R__ = any;
+     return __R__;
+}
+
+void ProfReport()
+{
+     integer i, j, n, h;
+     symbol s;
+     boolean more;
+
+     for (i = 1; i <= ncct; i++) {
+          if ((cntime[i - 1] > 0))
+               j = i;
+          else
+               j = 0;
+          while ((j != 0)) {
+               s = cnsym[j - 1];
+               if ((pstamp[s - 1] != i)) {
+                    pstamp[s - 1] = i;
+                    ptime[s - 1] = (ptime[s - 1] + cntime[i - 1]);
+               }
+               j = cnparent[j - 1];
+          }
+     }
+     n = 0;
+     for (i = 1; i <= nsymbols; i++)
+          if ((((pcalls[i - 1] + predos[i - 1]) > 0) && (!
+                    Hidden(i)))) {
+               n = (n + 1);
+               porder[n - 1] = i;
+          }
+     h = 1;
+     while ((h < (n / 3)))
+          h = ((3 * h) + 1);
+     while ((h >= 1)) {
+          for (i = (h + 1); i <= n; i++) {
+               s = porder[i - 1];
+               j = i;
+               more = TRUE;
+               while (more) {
+                    if ((j <= h))
+                         more = FALSE;
+                    else if ((! ProfBefore(s, porder[(j - h) - 1])))
+                         more = FALSE;
+                    else {
+                         porder[j - 1] = porder[(j - h) - 1];
+                         j = (j - h);
+                    }
+               }
+               porder[j - 1] = s;
+          }
+          h = (h / 3);
+     }
+     putc('\n', output);
+     putc('\n', output);
+     fprintf(output,
+               "     calls     exits     redos     fails     tries   matches   time ms  relation\n");
+     for (i = 1; i <= n; i++) {
+          s = porder[i - 1];
+          PadInt(pcalls[s - 1], 10);
+          PadInt(pexits[s - 1], 10);
+          PadInt(predos[s - 1], 10);
+          PadInt(pfails[s - 1], 10);
+          PadInt(ptries[s - 1], 10);
+          PadInt(pmatches[s - 1], 10);
+          PadInt((ptime[s - 1] / 1000), 10);
+          fprintf(output, "  ");
+          WriteString(symtab[s - 1].name);
+          fprintf(output, "%c%d", '/', symtab[s - 1].arity);
+          putc('\n', output);
+     }
+     fprintf(output, "%c%d samples, %d paths]", '[', nsample, ncct);
+     if ((! openout(pfile, profname))) {
+          putc('\n', output);
+          fprintf(output, "Can\'t write ");
+          WriteTemp(profname);
+     }
+     else {
+          for (i = 1; i <= ncct; i++)
+               if ((cntime[i - 1] > 0)) {
+                    if (WritePath(i))
+                         fprintf(pfile, "%c%d\n", ' ', cntime[i - 1]);
+               }
+          closeout(pfile);
+     }
+}
+
+boolean ok;
+
+void PushFrame(nvars, retry)
+integer nvars;
+integer retry;
+{
+     integer f;
+     integer i;
+
+     f = LocAlloc((9 + (nvars * 3)));
+     mem[f - 1] = current;
+     mem[(f + 1) - 1] = goalframe;
+     mem[(f + 2) - 1] = retry;
+     mem[(f + 8) - 1] = 0;
+     mem[(f + 3) - 1] = choice;
+     mem[(f + 4) - 1] = gsp;
+     mem[(f + 5) - 1] = trhead;
+     mem[(f + 6) - 1] = nvars;
+     if (pflag) {
+          if ((goalframe == 0))
+               mem[(f + 7) - 1] = 0;
+          else
+               mem[(f + 7) - 1] = (2 * ProfNode((mem[(goalframe + 7)
+                         - 1] / 2), FrameRel(f)));
+          if (((current == pgoal) && (goalframe == pgframe)))
+               mem[(f + 7) - 1] = (mem[(f + 7) - 1] + 1);
+     }
+     for (i = 1; i <= nvars; i++) {
+          mem[((f + 9) + ((i - 1) * 3)) - 1] = ((256 * 4) + 3);
+          mem[(((f + 9) + ((i - 1) * 3)) + 2) - 1] = 0;
+     }
+     goalframe = f;
+     if ((retry != 0))
+          choice = goalframe;
+}
+
+void TroStep()
+{
+     integer temp;
+     integer oldsize, newsize, i;
+
+     if (dflag)
+          fprintf(output, "(TRO)\n");
+     oldsize = (9 + (mem[(goalframe + 6) - 1] * 3));
+     newsize = (9 + (mem[proc - 1] * 3));
+     temp = LocAlloc(newsize);
+     temp = (goalframe + newsize);
+     for (i = (oldsize - 1); i >= 0; i--)
+          mem[(temp + i) - 1] = mem[(goalframe + i) - 1];
+     for (i = 1; i <= mem[(goalframe + 6) - 1]; i++) {
+          if ((((((mem[((temp + 9) + ((i - 1) * 3)) - 1] / 256) == 4)
+                    && (mem[(((temp + 9) + ((i - 1) * 3)) + 2) - 1]
+                    != 0)) && (goalframe <= mem[(((temp + 9) + ((i -
+                    1) * 3)) + 2) - 1])) && (mem[(((temp + 9) + ((i -
+                    1) * 3)) + 2) - 1] < (goalframe + oldsize))))
+               mem[(((temp + 9) + ((i - 1) * 3)) + 2) - 1] =
+                         (mem[(((temp + 9) + ((i - 1) * 3)) + 2) - 1]
+                         + newsize);
+     }
+     mem[(goalframe + 6) - 1] = mem[proc - 1];
+     for (i = 1; i <= mem[(goalframe + 6) - 1]; i++) {
+          mem[((goalframe + 9) + ((i - 1) * 3)) - 1] = ((256 * 4) +
+                    3);
+          mem[(((goalframe + 9) + ((i - 1) * 3)) + 2) - 1] = 0;
+     }
+     ok = Match(call, temp, proc, goalframe);
+     current = (proc + 6);
+     lsp = (temp - 1);
+}
+
+void Resolve()
+{
+     integer retry, retry2;
+
+     if ((proc == 0))
+          ok = FALSE;
+     else {
+          if (((callkey == 0) || (symtab[mem[(call + 2) - 1] -
+                    1].index == 0))) {
+               retry = Search(callkey, mem[(proc + 2) - 1]);
+               retry2 = 0;
+          }
+          else
+               Order(mem[(proc + 5) - 1], alt, &retry, &retry2);
+          if ((((((mem[(current + 1) - 1] == 0) && (choice <
+                    goalframe)) && (retry == 0)) && (goalframe !=
+                    base)) && (! pflag)))
+               TroStep();
+          else {
+               PushFrame(mem[proc - 1], retry);
+               mem[(goalframe + 8) - 1] = retry2;
+               ok = Match(call, mem[(goalframe + 1) - 1], proc,
+                         goalframe);
+               current = (proc + 6);
+               if (pflag) {
+                    ptries[mem[(call + 2) - 1] - 1] =
+                              (ptries[mem[(call + 2) - 1] - 1] + 1);
+                    if (ok)
+                         pmatches[mem[(call + 2) - 1] - 1] =
+                                   (pmatches[mem[(call + 2) - 1] - 1]
+                                   + 1);
+               }
+          }
+     }
+     if ((pflag && (! ok)))
+          pfails[mem[(call + 2) - 1] - 1] = (pfails[mem[(call + 2) -
+                    1] - 1] + 1);
+}
+
+void Step()
+{
+     symbol s;
+     integer f;
+
+     s = mem[(call + 2) - 1];
+     if ((symtab[s - 1].action == 0))
+          Resolve();
+     else {
+          f = goalframe;
+          ok = DoBuiltin(symtab[s - 1].action);
+          if (pflag) {
+               if ((! ok))
+                    pfails[s - 1] = (pfails[s - 1] + 1);
+               else if ((goalframe == f))
+                    pexits[s - 1] = (pexits[s - 1] + 1);
+          }
+     }
+}
+
+void Unwind()
+{
+     while (((mem[current - 1] == 0) && (goalframe != base))) {
+          if (dflag) {
+               fprintf(output, "Exit: ");
+               PrintTerm(mem[mem[goalframe - 1] - 1], mem[(goalframe
+                         + 1) - 1], 2);
+               putc('\n', output);
+          }
+          if ((pflag && ((mem[(goalframe + 7) - 1] % 2) == 1))) {
+               pexits[FrameRel(goalframe) - 1] =
+                         (pexits[FrameRel(goalframe) - 1] + 1);
+               mem[(goalframe + 7) - 1] = (mem[(goalframe + 7) - 1] -
+                         1);
+          }
+          current = (mem[goalframe - 1] + 1);
+          if ((goalframe > choice))
+               lsp = (goalframe - 1);
+          goalframe = mem[(goalframe + 1) - 1];
+     }
+}
+
+void Backtrack()
+{
+     Restore();
+     current = mem[choice - 1];
+     goalframe = mem[(choice + 1) - 1];
+     call = Deref(mem[current - 1], goalframe);
+     callkey = Key(call, goalframe);
+     proc = mem[(choice + 2) - 1];
+     alt = mem[(choice + 8) - 1];
+     gsp = mem[(choice + 4) - 1];
+     if ((gcmark < gsp))
+          gcmark = gsp;
+     lsp = (choice - 1);
+     choice = mem[(choice + 3) - 1];
+     if (dflag) {
+          fprintf(output, "Redo: ");
+          PrintTerm(call, goalframe, 2);
+          putc('\n', output);
+     }
+     if (pflag) {
+          predos[mem[(call + 2) - 1] - 1] = (predos[mem[(call + 2) -
+                    1] - 1] + 1);
+          pgoal = current;
+          pgframe = goalframe;
+     }
+}
+
+void Resume()
+{
      while (run) {
           if (ok) {
                if ((mem[current - 1] == 0))
@@ -1530,29 +2448,37 @@ void Resume()
                     WriteString(symtab[mem[(call + 2) - 1] - 1].name);
                     goto L2;
                }
-               proc = Search(call, goalframe, symtab[mem[(call + 2) -
-                         1] - 1].proc);
+               callkey = Key(call, goalframe);
+               FirstClause(call, callkey);
+               if (pflag)
+                    ProfCall();
+               Step();
           }
           else {
                if ((choice <= base))
                     goto L2;
                Backtrack();
+               Resolve();
           }
-          Step();
           if (ok)
                Unwind();
-          if (((gsp - lsp) <= 10000))
+          if ((((lsp + ((134217728 + 1) - gsp)) + 10000) >= memlimit))
                Collect();
      }
 L2:
      /* skip */;
 }
 
+integer nminor, nmajor;
+integer reclaimed;
+integer gctime, gcmax;
+
 void Execute(g)
 integer g;
 {
      lsp = hp;
-     gsp = (1000000 + 1);
+     gsp = (134217728 + 1);
+     gcmark = gsp;
      current = 0;
      goalframe = 0;
      choice = 0;
@@ -1560,10 +2486,18 @@ integer g;
      PushFrame(mem[g - 1], 0);
      choice = goalframe;
      base = goalframe;
-     current = (g + 4);
+     current = (g + 6);
      mem[(base + 3) - 1] = base;
      run = TRUE;
      ok = TRUE;
+     nminor = 0;
+     nmajor = 0;
+     reclaimed = 0;
+     gctime = 0;
+     gcmax = 0;
+     ResetTables();
+     if (pflag)
+          ResetProfile();
      do {
           Resume();
           if ((! run))
@@ -1578,7 +2512,9 @@ integer g;
      putc('\n', output);
      fprintf(output, "yes");
 L2:
-     /* skip */;
+     GCReport();
+     if (pflag)
+          ProfReport();
 }
 
 argbuf av;
@@ -1610,7 +2546,7 @@ boolean DoCut()
      boolean __R__;
 
      choice = mem[(goalframe + 3) - 1];
-     lsp = ((goalframe + (7 + (mem[(goalframe + 6) - 1] * 3))) - 1);
+     lsp = ((goalframe + (9 + (mem[(goalframe + 6) - 1] * 3))) - 1);
      Commit();
      current = (current + 1);
      __R__ = TRUE;
@@ -1632,7 +2568,7 @@ boolean DoCall()
      }
      else {
           PushFrame(1, 0);
-          mem[(((goalframe + 7) + ((1 - 1) * 3)) + 2) - 1] =
+          mem[(((goalframe + 9) + ((1 - 1) * 3)) + 2) - 1] =
                     GloCopy(av[1 - 1], mem[(goalframe + 1) - 1]);
           current = callbody;
           __R__ = TRUE;
@@ -1660,7 +2596,7 @@ boolean DoNot()
           savebase = base;
           base = goalframe;
           choice = goalframe;
-          mem[(((goalframe + 7) + ((1 - 1) * 3)) + 2) - 1] =
+          mem[(((goalframe + 9) + ((1 - 1) * 3)) + 2) - 1] =
                     GloCopy(av[1 - 1], mem[(goalframe + 1) - 1]);
           current = callbody;
           ok = TRUE;
@@ -1713,98 +2649,563 @@ boolean DoPlus()
                     "Error: plus/3 needs at least two integers");
           run = FALSE;
      }
-     current = (current + 1);
-     __R__ = result;
-     return __R__;
+     current = (current + 1);
+     __R__ = result;
+     return __R__;
+}
+
+boolean DoTimes()
+{
+     boolean result;
+
+     boolean __R__;
+
+     GetArgs();
+     result = FALSE;
+     if ((((mem[av[1 - 1] - 1] / 256) == 2) && ((mem[av[2 - 1] - 1] /
+               256) == 2)))
+          result = Unify(av[3 - 1], goalframe, NewInt((mem[(av[1 - 1]
+                    + 2) - 1] * mem[(av[2 - 1] + 2) - 1])), 0);
+     else if ((((mem[av[1 - 1] - 1] / 256) == 2) && ((mem[av[3 - 1] -
+               1] / 256) == 2))) {
+          if ((mem[(av[1 - 1] + 2) - 1] != 0))
+               if (((mem[(av[3 - 1] + 2) - 1] % mem[(av[1 - 1] + 2) -
+                         1]) == 0))
+                    result = Unify(av[2 - 1], goalframe,
+                              NewInt((mem[(av[3 - 1] + 2) - 1] /
+                              mem[(av[1 - 1] + 2) - 1])), 0);
+     }
+     else if ((((mem[av[2 - 1] - 1] / 256) == 2) && ((mem[av[3 - 1] -
+               1] / 256) == 2))) {
+          if ((mem[(av[2 - 1] + 2) - 1] != 0))
+               if (((mem[(av[3 - 1] + 2) - 1] % mem[(av[2 - 1] + 2) -
+                         1]) == 0))
+                    result = Unify(av[1 - 1], goalframe,
+                              NewInt((mem[(av[3 - 1] + 2) - 1] /
+                              mem[(av[2 - 1] + 2) - 1])), 0);
+     }
+     else {
+          putc('\n', output);
+          fprintf(output,
+                    "Error: times/3 needs at least two integers");
+          run = FALSE;
+     }
+     current = (current + 1);
+     __R__ = result;
+     return __R__;
+}
+
+boolean DoEqual()
+{
+     boolean __R__;
+
+     GetArgs();
+     current = (current + 1);
+     __R__ = Unify(av[1 - 1], goalframe, av[2 - 1], goalframe);
+     return __R__;
+}
+
+boolean DoInteger()
+{
+     boolean __R__;
+
+     GetArgs();
+     current = (current + 1);
+     __R__ = ((mem[av[1 - 1] - 1] / 256) == 2);
+     return __R__;
+}
+
+boolean DoChar()
+{
+     boolean __R__;
+
+     GetArgs();
+     current = (current + 1);
+     __R__ = ((mem[av[1 - 1] - 1] / 256) == 3);
+     return __R__;
+}
+
+boolean DoPrint()
+{
+     boolean __R__;
+
+     GetArgs();
+     PrintTerm(av[1 - 1], goalframe, 2);
+     current = (current + 1);
+     __R__ = TRUE;
+     return __R__;
+}
+
+boolean DoNl()
+{
+     boolean __R__;
+
+     putc('\n', output);
+     current = (current + 1);
+     __R__ = TRUE;
+     return __R__;
+}
+
+integer tmem[16777216];
+integer tbtop;
+integer triehash[4194301];
+integer nnodes;
+integer tvar[65536];
+integer ntvar;
+integer tokbuf[65536];
+integer ntok;
+boolean fresh;
+integer tbstack;
+integer evaltbl;
+integer curround;
+integer ntables, nanswers, ndfn;
+integer tblbody;
+
+integer TabAlloc(size)
+integer size;
+{
+     integer __R__;
+
+     if (((tbtop + size) > 16777216)) {
+          putc('\n', output);
+          fprintf(output, "Panic: out of table space\n");
+          halt();
+     }
+     __R__ = (tbtop + 1);
+     tbtop = (tbtop + size);
+     return __R__;
+}
+
+integer NewRoot()
+{
+     integer p;
+
+     integer __R__;
+
+     p = TabAlloc(4);
+     tmem[p - 1] = 0;
+     tmem[(p + 1) - 1] = 0;
+     tmem[(p + 2) - 1] = 0;
+     tmem[(p + 3) - 1] = 0;
+     __R__ = p;
+     return __R__;
+}
+
+integer TrieStep(p, kind, val)
+integer p;
+integer kind;
+integer val;
+{
+     integer h;
+     integer q;
+
+     integer __R__;
+
+     h = (((p % 4194301) * 499) % 4194301);
+     h = (((h + kind) * 499) % 4194301);
+     h = ((((((h + (val % 4194301)) + 4194301) % 4194301) * 499) %
+               4194301) + 1);
+     q = triehash[h - 1];
+     while (((q != 0) && (((tmem[(q + 2) - 1] != p) || (tmem[q - 1]
+               != kind)) || (tmem[(q + 1) - 1] != val)))) {
+          h = (h - 1);
+          if ((h == 0))
+               h = 4194301;
+          q = triehash[h - 1];
+     }
+     if ((q == 0)) {
+          if ((nnodes >= ((4194301 / 10) * 9))) {
+               putc('\n', output);
+               fprintf(output, "Panic: out of table space\n");
+               halt();
+          }
+          q = TabAlloc(4);
+          tmem[q - 1] = kind;
+          tmem[(q + 1) - 1] = val;
+          tmem[(q + 2) - 1] = p;
+          tmem[(q + 3) - 1] = 0;
+          triehash[h - 1] = q;
+          nnodes = (nnodes + 1);
+          fresh = TRUE;
+     }
+     __R__ = q;
+     return __R__;
+}
+
+integer TrieTerm(p, t, e)
+integer p;
+integer t;
+integer e;
+{
+     integer i;
+
+     integer __R__;
+
+     ntok = (ntok + 1);
+     if ((ntok > 65536)) {
+          putc('\n', output);
+          fprintf(output, "Panic: term too big to table\n");
+          halt();
+     }
+     t = Deref(t, e);
+     switch ((mem[t - 1] / 256)) {
+     case 1:
+          {
+               p = TrieStep(p, 1, mem[(t + 2) - 1]);
+               for (i = 1; i <= symtab[mem[(t + 2) - 1] - 1].arity;
+                         i++)
+                    p = TrieTerm(p, mem[((t + i) + 2) - 1], e);
+          }
+          break;
+     case 2:
+          p = TrieStep(p, 2, mem[(t + 2) - 1]);
+          break;
+     case 3:
+          p = TrieStep(p, 3, mem[(t + 2) - 1]);
+          break;
+     case 4:
+          {
+               i = 1;
+               while (((i <= ntvar) && (tvar[i - 1] != t)))
+                    i = (i + 1);
+               if ((i > ntvar)) {
+                    ntvar = i;
+                    tvar[i - 1] = t;
+               }
+               p = TrieStep(p, 4, i);
+          }
+          break;
+     default:
+          {
+               putc('\n', output);
+               fprintf(output, "Panic: bad tag %d in TrieTerm\n",
+                         (mem[t - 1] / 256));
+               halt();
+          }
+     }
+     __R__ = p;
+     return __R__;
+}
+
+integer TriePath(root, t, e)
+integer root;
+integer t;
+integer e;
+{
+     integer __R__;
+
+     ntvar = 0;
+     ntok = 0;
+     fresh = FALSE;
+     __R__ = TrieTerm(root, t, e);
+     return __R__;
+}
+
+integer Rebuild()
+{
+     integer t;
+     integer p;
+     integer i, n;
+
+     integer __R__;
+
+     p = tokbuf[ntok - 1];
+     ntok = (ntok - 1);
+     switch (tmem[p - 1]) {
+     case 1:
+          {
+               n = symtab[tmem[(p + 1) - 1] - 1].arity;
+               t = GloAlloc(1, (3 + n));
+               mem[(t + 2) - 1] = tmem[(p + 1) - 1];
+               for (i = 1; i <= n; i++)
+                    mem[((t + i) + 2) - 1] = Rebuild();
+          }
+          break;
+     case 2:
+          t = NewInt(tmem[(p + 1) - 1]);
+          break;
+     case 3:
+          {
+               t = GloAlloc(3, 3);
+               mem[(t + 2) - 1] = tmem[(p + 1) - 1];
+          }
+          break;
+     case 4:
+          if ((tmem[(p + 1) - 1] <= ntvar))
+               t = tvar[tmem[(p + 1) - 1] - 1];
+          else {
+               t = GloAlloc(4, 3);
+               mem[(t + 2) - 1] = 0;
+               ntvar = tmem[(p + 1) - 1];
+               tvar[ntvar - 1] = t;
+          }
+          break;
+     default:
+          {
+               putc('\n', output);
+               fprintf(output, "Panic: bad tag %d in Rebuild\n",
+                         tmem[p - 1]);
+               halt();
+          }
+     }
+     __R__ = t;
+     return __R__;
+}
+
+integer TrieValue(p)
+integer p;
+{
+     integer __R__;
+
+     ntok = 0;
+     while ((tmem[p - 1] != 0)) {
+          ntok = (ntok + 1);
+          tokbuf[ntok - 1] = p;
+          p = tmem[(p + 2) - 1];
+     }
+     ntvar = 0;
+     __R__ = Rebuild();
+     return __R__;
+}
+
+integer FindTable(t, e)
+integer t;
+integer e;
+{
+     symbol s;
+     integer p, tb;
+
+     integer __R__;
+
+     s = mem[(t + 2) - 1];
+     if ((symtab[s - 1].table == 0))
+          symtab[s - 1].table = NewRoot();
+     p = TriePath(symtab[s - 1].table, t, e);
+     if ((tmem[(p + 3) - 1] == 0)) {
+          tb = TabAlloc(9);
+          tmem[tb - 1] = 1;
+          tmem[(tb + 1) - 1] = 0;
+          tmem[(tb + 2) - 1] = 0;
+          tmem[(tb + 3) - 1] = NewRoot();
+          tmem[(tb + 4) - 1] = 0;
+          tmem[(tb + 5) - 1] = 0;
+          tmem[(tb + 6) - 1] = 0;
+          tmem[(tb + 7) - 1] = 0;
+          tmem[(tb + 8) - 1] = 0;
+          tmem[(p + 3) - 1] = tb;
+          ntables = (ntables + 1);
+     }
+     __R__ = tmem[(p + 3) - 1];
+     return __R__;
+}
+
+void AddAnswer(tb, t)
+integer tb;
+integer t;
+{
+     integer p;
+
+     p = TriePath(tmem[(tb + 3) - 1], t, 0);
+     if (fresh) {
+          if ((tmem[(tb + 5) - 1] == 0))
+               tmem[(tb + 4) - 1] = p;
+          else
+               tmem[(tmem[(tb + 5) - 1] + 3) - 1] = p;
+          tmem[(tb + 5) - 1] = p;
+          tmem[(tb + 6) - 1] = (tmem[(tb + 6) - 1] + 1);
+          nanswers = (nanswers + 1);
+     }
+}
+
+void RunClauses(tb)
+integer tb;
+{
+     integer savebase;
+     integer savegoal;
+     integer savegframe;
+
+     savegoal = pgoal;
+     savegframe = pgframe;
+     PushFrame(1, 0);
+     savebase = base;
+     base = goalframe;
+     choice = goalframe;
+     mem[(((goalframe + 9) + ((1 - 1) * 3)) + 2) - 1] = GloCopy(call,
+               mem[(goalframe + 1) - 1]);
+     current = callbody;
+     call = Deref(mem[current - 1], goalframe);
+     callkey = Key(call, goalframe);
+     FirstClause(call, callkey);
+     Resolve();
+     if (ok)
+          Unwind();
+     Resume();
+     while ((ok && run)) {
+          AddAnswer(tb, Deref(((base + 9) + ((1 - 1) * 3)), 0));
+          ok = FALSE;
+          Resume();
+     }
+     choice = base;
+     Restore();
+     gsp = mem[(base + 4) - 1];
+     if ((gcmark < gsp))
+          gcmark = gsp;
+     choice = mem[(base + 3) - 1];
+     goalframe = mem[(base + 1) - 1];
+     current = mem[base - 1];
+     lsp = (base - 1);
+     base = savebase;
+     call = Deref(mem[current - 1], goalframe);
+     pgoal = savegoal;
+     pgframe = savegframe;
 }
 
-boolean DoTimes()
+void Complete(tb, last)
+integer tb;
+integer last;
 {
-     boolean result;
+     boolean popped;
+     integer x;
+
+     popped = FALSE;
+     while ((! popped)) {
+          x = tbstack;
+          tbstack = tmem[(x + 7) - 1];
+          tmem[(x + 7) - 1] = 0;
+          tmem[(x + 8) - 1] = 0;
+          if (((x == tb) || (tmem[(x + 1) - 1] > last)))
+               tmem[x - 1] = 3;
+          else {
+               tmem[x - 1] = 1;
+               tmem[(x + 1) - 1] = 0;
+          }
+          popped = (x == tb);
+     }
+}
+
+void Evaluate(tb)
+integer tb;
+{
+     integer outer;
+     integer before, last, outround;
+
+     outer = evaltbl;
+     evaltbl = tb;
+     outround = curround;
+     if ((tmem[(tb + 8) - 1] == 0)) {
+          tmem[(tb + 7) - 1] = tbstack;
+          tbstack = tb;
+          tmem[(tb + 8) - 1] = 1;
+     }
+     ndfn = (ndfn + 1);
+     tmem[(tb + 1) - 1] = ndfn;
+     tmem[(tb + 2) - 1] = ndfn;
+     tmem[tb - 1] = 2;
+     do {
+          before = nanswers;
+          last = ndfn;
+          curround = last;
+          RunClauses(tb);
+     } while (! ((((nanswers == before) || (tmem[(tb + 2) - 1] <
+               tmem[(tb + 1) - 1])) || (! run))));
+     tmem[tb - 1] = 1;
+     if ((run && (tmem[(tb + 2) - 1] == tmem[(tb + 1) - 1])))
+          Complete(tb, last);
+     evaltbl = outer;
+     curround = outround;
+     if ((outer != 0))
+          if ((tmem[(tb + 2) - 1] < tmem[(outer + 2) - 1]))
+               tmem[(outer + 2) - 1] = tmem[(tb + 2) - 1];
+}
+
+boolean DoTable()
+{
+     integer tb;
 
      boolean __R__;
 
-     GetArgs();
-     result = FALSE;
-     if ((((mem[av[1 - 1] - 1] / 256) == 2) && ((mem[av[2 - 1] - 1] /
-               256) == 2)))
-          result = Unify(av[3 - 1], goalframe, NewInt((mem[(av[1 - 1]
-                    + 2) - 1] * mem[(av[2 - 1] + 2) - 1])), 0);
-     else if ((((mem[av[1 - 1] - 1] / 256) == 2) && ((mem[av[3 - 1] -
-               1] / 256) == 2))) {
-          if ((mem[(av[1 - 1] + 2) - 1] != 0))
-               if (((mem[(av[3 - 1] + 2) - 1] % mem[(av[1 - 1] + 2) -
-                         1]) == 0))
-                    result = Unify(av[2 - 1], goalframe,
-                              NewInt((mem[(av[3 - 1] + 2) - 1] /
-                              mem[(av[1 - 1] + 2) - 1])), 0);
+     tb = FindTable(call, goalframe);
+     if ((tmem[tb - 1] == 2)) {
+          if ((tmem[(tb + 1) - 1] < tmem[(evaltbl + 2) - 1]))
+               tmem[(evaltbl + 2) - 1] = tmem[(tb + 1) - 1];
      }
-     else if ((((mem[av[2 - 1] - 1] / 256) == 2) && ((mem[av[3 - 1] -
-               1] / 256) == 2))) {
-          if ((mem[(av[2 - 1] + 2) - 1] != 0))
-               if (((mem[(av[3 - 1] + 2) - 1] % mem[(av[2 - 1] + 2) -
-                         1]) == 0))
-                    result = Unify(av[1 - 1], goalframe,
-                              NewInt((mem[(av[3 - 1] + 2) - 1] /
-                              mem[(av[2 - 1] + 2) - 1])), 0);
+     else if ((tmem[tb - 1] == 1)) {
+          if (((evaltbl == 0) || (tmem[(tb + 1) - 1] <= curround)))
+               Evaluate(tb);
+          else if ((tmem[(tb + 2) - 1] < tmem[(evaltbl + 2) - 1]))
+               tmem[(evaltbl + 2) - 1] = tmem[(tb + 2) - 1];
      }
+     if (((! run) || (tmem[(tb + 4) - 1] == 0)))
+          __R__ = FALSE;
      else {
-          putc('\n', output);
-          fprintf(output,
-                    "Error: times/3 needs at least two integers");
-          run = FALSE;
+          PushFrame(2, 0);
+          mem[(((goalframe + 9) + ((1 - 1) * 3)) + 2) - 1] =
+                    GloCopy(call, mem[(goalframe + 1) - 1]);
+          mem[(((goalframe + 9) + ((2 - 1) * 3)) + 2) - 1] =
+                    NewInt(tmem[(tb + 4) - 1]);
+          current = tblbody;
+          __R__ = TRUE;
      }
-     current = (current + 1);
-     __R__ = result;
      return __R__;
 }
 
-boolean DoEqual()
+boolean DoTblGet()
 {
      boolean __R__;
 
      GetArgs();
      current = (current + 1);
-     __R__ = Unify(av[1 - 1], goalframe, av[2 - 1], goalframe);
+     __R__ = Unify(av[2 - 1], goalframe, TrieValue(mem[(av[1 - 1] +
+               2) - 1]), 0);
      return __R__;
 }
 
-boolean DoInteger()
+boolean DoTblNext()
 {
-     boolean __R__;
-
-     GetArgs();
-     current = (current + 1);
-     __R__ = ((mem[av[1 - 1] - 1] / 256) == 2);
-     return __R__;
-}
+     integer p;
 
-boolean DoChar()
-{
      boolean __R__;
 
      GetArgs();
      current = (current + 1);
-     __R__ = ((mem[av[1 - 1] - 1] / 256) == 3);
+     p = tmem[(mem[(av[1 - 1] + 2) - 1] + 3) - 1];
+     if ((p == 0))
+          __R__ = FALSE;
+     else
+          __R__ = Unify(av[2 - 1], goalframe, NewInt(p), 0);
      return __R__;
 }
 
-boolean DoPrint()
+void ResetTables()
 {
-     boolean __R__;
+     integer tb;
 
-     GetArgs();
-     PrintTerm(av[1 - 1], goalframe, 2);
-     current = (current + 1);
-     __R__ = TRUE;
-     return __R__;
+     while ((tbstack != 0)) {
+          tb = tbstack;
+          tbstack = tmem[(tb + 7) - 1];
+          tmem[tb - 1] = 1;
+          tmem[(tb + 1) - 1] = 0;
+          tmem[(tb + 7) - 1] = 0;
+          tmem[(tb + 8) - 1] = 0;
+     }
+     evaltbl = 0;
+     curround = ndfn;
 }
 
-boolean DoNl()
+boolean DoStats()
 {
      boolean __R__;
 
      putc('\n', output);
+     fprintf(output,
+               "heap %d, local %d, global %d, limit %d words (raised %d times)\n",
+               hp, (lsp - hp), ((134217728 + 1) - gsp), memlimit,
+               nexpand);
+     fprintf(output, "strings %d chars, %d symbols, hash table %d\n",
+               charptr, nsymbols, hashsize);
+     fprintf(output,
+               "tables %d, answers %d, trie nodes %d, table space %d words",
+               ntables, nanswers, nnodes, tbtop);
      current = (current + 1);
      __R__ = TRUE;
      return __R__;
@@ -1849,6 +3250,18 @@ integer action;
      case 11:
           __R__ = DoNl();
           break;
+     case 12:
+          __R__ = DoStats();
+          break;
+     case 13:
+          __R__ = DoTable();
+          break;
+     case 14:
+          __R__ = DoTblGet();
+          break;
+     case 15:
+          __R__ = DoTblNext();
+          break;
      default:
           {
                putc('\n', output);
@@ -1861,6 +3274,7 @@ integer action;
 }
 
 integer shift;
+integer gctop;
 
 void Visit(t)
 integer t;
@@ -1868,7 +3282,8 @@ integer t;
      integer i, n;
 
      while ((t != 0)) {
-          if (((! (t >= gsp)) || ((mem[t - 1] % 256) >= 128)))
+          if (((! ((t >= gsp) && (t < gctop))) || ((mem[t - 1] % 256)
+                    >= 128)))
                goto L2;
           mem[t - 1] = (mem[t - 1] + 128);
           switch ((mem[t - 1] / 256)) {
@@ -1910,19 +3325,32 @@ void MarkStack()
      f = (hp + 1);
      while ((f <= lsp)) {
           for (i = 1; i <= mem[(f + 6) - 1]; i++)
-               if (((mem[((f + 7) + ((i - 1) * 3)) - 1] / 256) == 4))
-                    Visit(mem[(((f + 7) + ((i - 1) * 3)) + 2) - 1]);
-          f = (f + (7 + (mem[(f + 6) - 1] * 3)));
+               if (((mem[((f + 9) + ((i - 1) * 3)) - 1] / 256) == 4))
+                    Visit(mem[(((f + 9) + ((i - 1) * 3)) + 2) - 1]);
+          f = (f + (9 + (mem[(f + 6) - 1] * 3)));
+     }
+}
+
+void MarkOld()
+{
+     integer p;
+
+     p = trhead;
+     while (((p != 0) && (p < gctop))) {
+          if ((mem[(p + 2) - 1] >= gctop))
+               Visit(mem[(mem[(p + 2) - 1] + 2) - 1]);
+          p = mem[(p + 3) - 1];
      }
 }
 
 void CullTrail(p)
 integer (*p);
 {
-     while ((*p != 0)) {
+     while (((*p != 0) && (*p < gctop))) {
           if ((mem[(*p + 2) - 1] != 0))
-               if (((! (mem[(*p + 2) - 1] >= gsp)) || ((mem[mem[(*p +
-                         2) - 1] - 1] % 256) >= 128)))
+               if (((! ((mem[(*p + 2) - 1] >= gsp) && (mem[(*p + 2) -
+                         1] < gctop))) || ((mem[mem[(*p + 2) - 1] -
+                         1] % 256) >= 128)))
                     goto L2;
           *p = mem[(*p + 3) - 1];
      }
@@ -1936,33 +3364,55 @@ void MarkTrail()
 
      CullTrail(&trhead);
      p = trhead;
-     while ((p != 0)) {
+     while (((p != 0) && (p < gctop))) {
           mem[p - 1] = (mem[p - 1] + 128);
           CullTrail(&mem[(p + 3) - 1]);
           p = mem[(p + 3) - 1];
      }
 }
 
+void Forward(q, p)
+integer q;
+integer p;
+{
+     integer r;
+
+     while ((q != 0)) {
+          r = mem[(q + 1) - 1];
+          mem[(q + 1) - 1] = p;
+          q = r;
+     }
+}
+
 void Relocate()
 {
-     integer p;
+     integer p, q;
      integer step;
 
      shift = 0;
      p = gsp;
-     while ((p <= 1000000)) {
+     q = 0;
+     while ((p < gctop)) {
           step = (mem[p - 1] % 128);
-          mem[(p + 1) - 1] = shift;
-          if ((! ((mem[p - 1] % 256) >= 128)))
+          if (((mem[p - 1] % 256) >= 128)) {
+               mem[(p + 1) - 1] = shift;
+               Forward(q, p);
+               q = 0;
+          }
+          else {
                shift = (shift + step);
+               mem[(p + 1) - 1] = q;
+               q = p;
+          }
           p = (p + step);
      }
+     Forward(q, gctop);
 }
 
 void AdjustPointer(p)
 integer (*p);
 {
-     if (((*p != 0) && (*p >= gsp))) {
+     if (((*p != 0) && ((*p >= gsp) && (*p < gctop)))) {
           if ((! ((mem[*p - 1] % 256) >= 128))) {
                putc('\n', output);
                fprintf(output,
@@ -1977,44 +3427,54 @@ void AdjustStack()
 {
      integer f;
      integer i;
-     integer q;
+     integer q, r, r2;
 
      f = (hp + 1);
      while ((f <= lsp)) {
           q = mem[(f + 4) - 1];
-          while ((q <= 1000000)) {
-               if (((mem[q - 1] % 256) >= 128))
-                    goto L1;
-               q = (q + (mem[q - 1] % 128));
-          }
-     L1:
-          if ((q <= 1000000))
-               AdjustPointer(&q);
+          if (((q < gctop) && (! ((mem[q - 1] % 256) >= 128))))
+               q = mem[(q + 1) - 1];
+          AdjustPointer(&q);
           mem[(f + 4) - 1] = q;
           q = mem[(f + 5) - 1];
-          while ((q != 0)) {
-               if (((mem[q - 1] % 256) >= 128))
-                    goto L4;
+          while ((((q != 0) && (q < gctop)) && (! ((mem[q - 1] % 256)
+                    >= 128))))
                q = mem[(q + 3) - 1];
+          r = mem[(f + 5) - 1];
+          while ((r != q)) {
+               r2 = mem[(r + 3) - 1];
+               mem[(r + 3) - 1] = q;
+               r = r2;
           }
-     L4:
           AdjustPointer(&q);
           mem[(f + 5) - 1] = q;
           for (i = 1; i <= mem[(f + 6) - 1]; i++)
-               if (((mem[((f + 7) + ((i - 1) * 3)) - 1] / 256) == 4))
-                    AdjustPointer(&mem[(((f + 7) + ((i - 1) * 3)) +
+               if (((mem[((f + 9) + ((i - 1) * 3)) - 1] / 256) == 4))
+                    AdjustPointer(&mem[(((f + 9) + ((i - 1) * 3)) +
                               2) - 1]);
-          f = (f + (7 + (mem[(f + 6) - 1] * 3)));
+          f = (f + (9 + (mem[(f + 6) - 1] * 3)));
           /* skip */;
      }
 }
 
+void AdjustOld()
+{
+     integer p;
+
+     p = trhead;
+     while (((p != 0) && (p < gctop))) {
+          if ((mem[(p + 2) - 1] >= gctop))
+               AdjustPointer(&mem[(mem[(p + 2) - 1] + 2) - 1]);
+          p = mem[(p + 3) - 1];
+     }
+}
+
 void AdjustInternal()
 {
      integer p, i;
 
      p = gsp;
-     while ((p <= 1000000)) {
+     while ((p < gctop)) {
           if (((mem[p - 1] % 256) >= 128)) {
                switch ((mem[p - 1] / 256)) {
                case 1:
@@ -2055,7 +3515,7 @@ void Compact()
 
      p = gsp;
      q = gsp;
-     while ((p <= 1000000)) {
+     while ((p < gctop)) {
           step = (mem[p - 1] % 128);
           if (((mem[p - 1] % 256) >= 128)) {
                mem[p - 1] = (mem[p - 1] - 128);
@@ -2066,42 +3526,186 @@ void Compact()
           p = (p + step);
      }
      gsp = (gsp + shift);
-     for (i = 1000000; i >= gsp; i--)
+     for (i = (gctop - 1); i >= gsp; i--)
           mem[i - 1] = mem[(i - shift) - 1];
      /* skip */;
 }
 
-void Collect()
+void Sweep(top)
+integer top;
 {
-     fprintf(output, "[gc");
-     flush();
+     gctop = top;
      Visit(call);
      MarkStack();
+     MarkOld();
      MarkTrail();
      Relocate();
+     AdjustOld();
      AdjustPointer(&call);
      AdjustPointer(&trhead);
      AdjustStack();
      AdjustInternal();
      Compact();
+}
+
+void Collect()
+{
+     integer start, before;
+
+     fprintf(output, "[gc");
+     flush();
+     start = cputime();
+     before = gsp;
+     if ((gcmark <= 134217728)) {
+          Sweep(gcmark);
+          nminor = (nminor + 1);
+     }
+     if (((gcmark > 134217728) || (((lsp + ((134217728 + 1) - gsp)) +
+               50000) > memlimit))) {
+          Sweep((134217728 + 1));
+          nmajor = (nmajor + 1);
+     }
+     gcmark = gsp;
+     reclaimed = ((reclaimed + gsp) - before);
+     start = Elapsed(start);
+     if ((gctime > (2147483647 - start)))
+          gctime = 2147483647;
+     else
+          gctime = (gctime + start);
+     if ((start > gcmax))
+          gcmax = start;
      putc(']', output);
      flush();
-     if (((gsp - lsp) <= 50000)) {
+     Expand(((lsp + ((134217728 + 1) - gsp)) + 50000));
+     if ((((lsp + ((134217728 + 1) - gsp)) + 50000) > memlimit)) {
           putc('\n', output);
           fprintf(output, "Error: out of memory space");
           run = FALSE;
      }
 }
 
+void GCReport()
+{
+     if (((nminor + nmajor) > 0)) {
+          putc('\n', output);
+          fprintf(output,
+                    "[gc: %d minor, %d major, %d words reclaimed, %d us, longest %d us]",
+                    nminor, nmajor, reclaimed, gctime, gcmax);
+     }
+}
+
+integer inithp, initsyms;
+integer imghead[10];
+text imgfile;
+tempstring loadname, savename;
+boolean loading, saving;
+
+void SaveImage()
+{
+     boolean good;
+
+     imghead[1 - 1] = 1886940209;
+     imghead[2 - 1] = inithp;
+     imghead[3 - 1] = initsyms;
+     imghead[4 - 1] = 134217728;
+     imghead[5 - 1] = 9;
+     imghead[6 - 1] = hp;
+     imghead[7 - 1] = charptr;
+     imghead[8 - 1] = nsymbols;
+     imghead[9 - 1] = hashsize;
+     imghead[10 - 1] = memlimit;
+     good = openout(imgfile, savename);
+     if (good) {
+          good = ((((putblock(imgfile, imghead, 10) &&
+                    putblock(imgfile, mem, hp)) && putblock(imgfile,
+                    charbuf, charptr)) && putblock(imgfile, symtab,
+                    nsymbols)) && putblock(imgfile, hashtab,
+                    hashsize));
+          closeout(imgfile);
+     }
+     if ((! good)) {
+          fprintf(output, "Can\'t write ");
+          WriteTemp(savename);
+          putc('\n', output);
+          halt();
+     }
+     fprintf(output, "Saved ");
+     WriteTemp(savename);
+     putc('\n', output);
+}
+
+void DropCode()
+{
+     integer i;
+     integer c;
+
+     for (i = 1; i <= nsymbols; i++) {
+          c = symtab[i - 1].proc;
+          while ((c != 0)) {
+               mem[(c + 4) - 1] = 0;
+               c = mem[(c + 2) - 1];
+          }
+     }
+}
+
+void LoadImage()
+{
+     boolean good;
+
+     good = openin(imgfile, loadname);
+     if (good) {
+          good = getblock(imgfile, imghead, 10);
+          if (good)
+               good = (((((((((imghead[1 - 1] == 1886940209) &&
+                         (imghead[2 - 1] == inithp)) && (imghead[3 -
+                         1] == initsyms)) && (imghead[4 - 1] ==
+                         134217728)) && (imghead[5 - 1] == 9)) &&
+                         (imghead[6 - 1] < (134217728 / 2))) &&
+                         (imghead[7 - 1] <= 16777216)) && (imghead[8
+                         - 1] <= 1048576)) && (imghead[9 - 1] <=
+                         2097152));
+          if (good) {
+               hp = imghead[6 - 1];
+               charptr = imghead[7 - 1];
+               nsymbols = imghead[8 - 1];
+               hashsize = imghead[9 - 1];
+               if ((memlimit < imghead[10 - 1]))
+                    memlimit = imghead[10 - 1];
+               good = (((getblock(imgfile, mem, hp) &&
+                         getblock(imgfile, charbuf, charptr)) &&
+                         getblock(imgfile, symtab, nsymbols)) &&
+                         getblock(imgfile, hashtab, hashsize));
+          }
+          closein(imgfile);
+     }
+     if ((! good)) {
+          fprintf(output, "Can\'t load ");
+          WriteTemp(loadname);
+          putc('\n', output);
+          halt();
+     }
+     if ((! cflag))
+          DropCode();
+     fprintf(output, "Loaded ");
+     WriteTemp(loadname);
+     putc('\n', output);
+}
+
 void Initialize()
 {
      integer i;
      integer p;
+     argbuf body;
 
      dflag = FALSE;
+     cflag = TRUE;
+     pflag = FALSE;
      errcount = 0;
+     batching = FALSE;
      pbchar = chr(127);
      charptr = 0;
+     memlimit = 1000000;
+     nexpand = 0;
      hp = 0;
      InitSymbols();
      for (i = 1; i <= 63; i++) {
@@ -2113,6 +3717,28 @@ void Initialize()
      callbody = HeapAlloc(2);
      mem[callbody - 1] = MakeRef(1);
      mem[(callbody + 1) - 1] = 0;
+     tbtop = 0;
+     nnodes = 0;
+     tbstack = 0;
+     evaltbl = 0;
+     ntables = 0;
+     nanswers = 0;
+     ndfn = 0;
+     curround = 0;
+     for (i = 1; i <= 4194301; i++)
+          triehash[i - 1] = 0;
+     body[1 - 1] = MakeNode(tblget, MakeRef(2), MakeRef(1));
+     AddClause(MakeClause(2, MakeNode(tblsym, MakeRef(1),
+               MakeRef(2)), body, 1));
+     body[1 - 1] = MakeNode(tblnext, MakeRef(2), MakeRef(3));
+     body[2 - 1] = MakeNode(tblsym, MakeRef(1), MakeRef(3));
+     AddClause(MakeClause(3, MakeNode(tblsym, MakeRef(1),
+               MakeRef(2)), body, 2));
+     tblbody = HeapAlloc(2);
+     mem[tblbody - 1] = MakeNode(tblsym, MakeRef(1), MakeRef(2));
+     mem[(tblbody + 1) - 1] = 0;
+     inithp = hp;
+     initsyms = nsymbols;
 }
 
 void ReadFile()
@@ -2141,20 +3767,268 @@ void ReadFile()
      } while (! ((c == 0)));
 }
 
+boolean batch;
+tempstring batchfile;
+integer njobs;
+tempstring jobbase;
+integer qstart;
+
+void EchoQuery(c)
+integer c;
+{
+     integer f;
+     integer p;
+     integer i;
+
+     f = HeapAlloc((9 + (nvars * 3)));
+     for (i = 1; i <= nvars; i++) {
+          p = HeapAlloc(3);
+          mem[p - 1] = ((256 * 1) + 3);
+          mem[(p + 2) - 1] = vartable[i - 1];
+          mem[((f + 9) + ((i - 1) * 3)) - 1] = ((256 * 4) + 3);
+          mem[(((f + 9) + ((i - 1) * 3)) + 2) - 1] = p;
+     }
+     fprintf(output, "# :- ");
+     i = 1;
+     while ((mem[(((c + 6) + i) - 1) - 1] != 0)) {
+          if ((i > 1))
+               fprintf(output, ", ");
+          PrintTerm(mem[(((c + 6) + i) - 1) - 1], f, 2);
+          i = (i + 1);
+     }
+     fprintf(output, "%c\n", '.');
+}
+
+void Answer(c)
+integer c;
+{
+     EchoQuery(c);
+     Execute(c);
+     putc('\n', output);
+     putc('\n', output);
+}
+
+void OpenBatch()
+{
+     if ((! openin(infile, batchfile))) {
+          fprintf(output, "Can\'t read ");
+          WriteString(filename);
+          putc('\n', output);
+          halt();
+     }
+     lineno = 1;
+     pbchar = chr(127);
+     batching = TRUE;
+}
+
+integer ScanBatch(solve)
+boolean solve;
+{
+     integer c;
+     integer n, pos, line;
+     integer p;
+
+     integer __R__;
+
+     OpenBatch();
+     qstart = (hp + 1);
+     n = 0;
+     do {
+          pos = inpos(infile);
+          line = lineno;
+          hmark = hp;
+          c = ReadClause();
+          if ((c != 0)) {
+               if (solve)
+                    Answer(c);
+               hp = hmark;
+               p = HeapAlloc(2);
+               mem[p - 1] = pos;
+               mem[(p + 1) - 1] = line;
+               n = (n + 1);
+          }
+     } while (! ((c == 0)));
+     closein(infile);
+     batching = FALSE;
+     __R__ = n;
+     return __R__;
+}
+
+void JobName(n, name)
+integer n;
+tempstring name;
+{
+     integer i, j;
+
+     i = 1;
+     while ((jobbase[i - 1] != chr(0))) {
+          name[i - 1] = jobbase[i - 1];
+          i = (i + 1);
+     }
+     name[i - 1] = '.';
+     j = 1;
+     while ((j <= (n / 10)))
+          j = (10 * j);
+     do {
+          i = (i + 1);
+          name[i - 1] = chr((ord('0') + ((n / j) % 10)));
+          j = (j / 10);
+     } while (! ((j == 0)));
+     name[(i + 1) - 1] = chr(0);
+}
+
+void Worker(nquery)
+integer nquery;
+{
+     integer n;
+     integer c;
+     tempstring name;
+
+     OpenBatch();
+     n = nextjob();
+     while ((n < nquery)) {
+          JobName(n, name);
+          if (openout(output, name)) {
+               seekin(infile, mem[(qstart + (2 * n)) - 1]);
+               lineno = mem[((qstart + (2 * n)) + 1) - 1];
+               pbchar = chr(127);
+               hmark = hp;
+               c = ReadClause();
+               if ((c != 0))
+                    Answer(c);
+               hp = hmark;
+          }
+          n = nextjob();
+     }
+     closein(infile);
+     batching = FALSE;
+}
+
+void CopyFile(name)
+tempstring name;
+{
+     char ch;
+
+     if (openin(infile, name)) {
+          ch = FGetChar(infile);
+          while ((ch != chr(127))) {
+               if ((ch == chr(10)))
+                    putc('\n', output);
+               else
+                    putc(ch, output);
+               ch = FGetChar(infile);
+          }
+          closein(infile);
+     }
+}
+
+void RunBatch()
+{
+     integer nquery, i, k, n, pid;
+     boolean shared, parent;
+     tempstring name;
+
+     filename = SaveString(batchfile);
+     nquery = ScanBatch(FALSE);
+     if ((errcount > 0))
+          halt();
+     if ((njobs > nquery))
+          njobs = nquery;
+     i = 0;
+     k = 0;
+     parent = TRUE;
+     shared = newjobs();
+     if (shared) {
+          tempname(jobbase);
+          while ((parent && (i < njobs))) {
+               i = (i + 1);
+               pid = spawn();
+               if ((pid > 0))
+                    k = (k + 1);
+               parent = (pid != 0);
+          }
+     }
+     if ((! parent))
+          Worker(nquery);
+     else {
+          if ((k == 0))
+               nquery = ScanBatch(TRUE);
+          else {
+               waitall();
+               for (n = 0; n <= (nquery - 1); n++) {
+                    JobName(n, name);
+                    CopyFile(name);
+                    removefile(name);
+               }
+          }
+          if (shared)
+               removefile(jobbase);
+     }
+}
+
 void ReadProgram()
 {
      integer i0, i;
      tempstring arg;
+     boolean more;
 
+     batch = FALSE;
+     njobs = 4;
+     loading = FALSE;
+     saving = FALSE;
      i0 = 1;
-     if ((argc() > 1)) {
-          argv(1, arg);
-          if ((((arg[1 - 1] == '-') && (arg[2 - 1] == 'd')) && (arg[3
-                    - 1] == chr(0)))) {
+     more = TRUE;
+     while ((more && (i0 < argc()))) {
+          argv(i0, arg);
+          if ((((arg[1 - 1] != '-') || (arg[2 - 1] == chr(0))) ||
+                    (arg[3 - 1] != chr(0))))
+               more = FALSE;
+          else if ((arg[2 - 1] == 'd'))
                dflag = TRUE;
+          else if ((arg[2 - 1] == 'i'))
+               cflag = FALSE;
+          else if (((arg[2 - 1] == 'l') && ((i0 + 1) < argc()))) {
+               i0 = (i0 + 1);
+               argv(i0, loadname);
+               loading = TRUE;
+          }
+          else if (((arg[2 - 1] == 's') && ((i0 + 1) < argc()))) {
+               i0 = (i0 + 1);
+               argv(i0, savename);
+               saving = TRUE;
+          }
+          else if (((arg[2 - 1] == 'p') && ((i0 + 1) < argc()))) {
+               i0 = (i0 + 1);
+               argv(i0, profname);
+               pflag = TRUE;
+          }
+          else if (((arg[2 - 1] == 'b') && ((i0 + 1) < argc()))) {
+               i0 = (i0 + 1);
+               argv(i0, batchfile);
+               batch = TRUE;
+          }
+          else if (((arg[2 - 1] == 'j') && ((i0 + 1) < argc()))) {
                i0 = (i0 + 1);
+               argv(i0, arg);
+               njobs = 0;
+               i = 1;
+               while (((arg[i - 1] >= '0') && (arg[i - 1] <= '9'))) {
+                    njobs = ((10 * njobs) + (ord(arg[i - 1]) -
+                              ord('0')));
+                    i = (i + 1);
+               }
+               if ((njobs < 1))
+                    njobs = 1;
+               if ((njobs > 64))
+                    njobs = 64;
           }
+          else
+               more = FALSE;
+          if (more)
+               i0 = (i0 + 1);
      }
+     if (loading)
+          LoadImage();
      for (i = i0; i <= (argc() - 1); i++) {
           argv(i, arg);
           filename = SaveString(arg);
@@ -2180,10 +4054,16 @@ void p_main()
      Initialize();
      interacting = FALSE;
      ReadProgram();
-     interacting = TRUE;
-     lineno = 1;
-     ReadFile();
-     putc('\n', output);
+     if (saving)
+          SaveImage();
+     else if (batch)
+          RunBatch();
+     else {
+          interacting = TRUE;
+          lineno = 1;
+          ReadFile();
+          putc('\n', output);
+     }
 L999:
      /* skip */;
 }
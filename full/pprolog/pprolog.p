@@ -15,15 +15,39 @@
 program picoProlog(input, output);
 
 { tunable parameters }
+
+{ The big arrays |mem|, |charbuf| and |symtab| are sized generously,
+  because their sizes are only a reservation of address space: the
+  operating system commits pages to them as they are first touched.
+  What is actually used is governed by the smaller starting sizes
+  below, which grow as the program needs them. }
 const
-  MAXSYMBOLS = 511;  { max no. of symbols }
+  MAXSYMBOLS = 1048576;  { max no. of symbols }
+  MAXHASH = 2097152;  { max size of symbol hash table }
+  HASHINIT = 512;  { initial size of symbol hash table }
   HASHFACTOR = 90;  { percent loading factor for hash table }
-  MAXCHARS = 2048;  { max chars in symbols }
+  MAXCHARS = 16777216;  { max chars in symbols }
   MAXSTRING = 128;  { max string length }
   MAXARITY = 63;  { max arity of function, vars in clause }
-  MEMSIZE = 1000000;  { size of |mem| array }
+  MEMSIZE = 134217728;  { size of |mem| array }
+  MEMINIT = 1000000;  { initial limit on use of |mem| }
   GCLOW = 10000;  { call GC when this much space left }
   GCHIGH = 50000;  { GC must find this much space }
+  INDEXMIN = 8;  { index relations with this many clauses }
+  INDEXSLOTS = 16;  { initial size of an index }
+  TABSIZE = 16777216;  { size of |tmem| array for tables }
+  TRIEHASH = 4194301;  { size of hash table for trie edges (prime) }
+  TOKMAX = 65536;  { max size of a tabled term }
+  VMSTACK = 256;  { stack for matching compiled heads }
+  MAXJOBS = 64;  { max worker processes in batch mode }
+  JOBS = 4;  { default number of workers }
+  PROFTICK = 64;  { calls between profile samples }
+  PROFNODES = 65536;  { max nodes in calling context tree }
+  PROFHASH = 131071;  { size of hash table for the tree (prime) }
+  PROFDEPTH = 1024;  { max depth of a path in the tree }
+  IMGMAGIC = 1886940209;  { identifies an image file }
+  IMGHEAD = 10;  { size of image header }
+  CLOCKMAX = 2147483647;  { |cputime| counts modulo |CLOCKMAX|+1 }
 
 { special character values }
   { end of string }
@@ -98,6 +122,7 @@ label 999;
 
 var run: boolean;  { whether execution should continue }
   dflag: boolean;  { switch for debugging code }
+  cflag: boolean;  { whether to compile clause heads }
 
 
 
@@ -110,7 +135,8 @@ var run: boolean;  { whether execution should continue }
   represented elsewhere by an index |k| into this array, and the
   characters of the string are |charbuf[k]|,
   |charbuf[k+1]|,~\dots, terminated by the character |ENDSTR|.
-  |charptr| is the last occupied location in |charbuf|.
+  |charptr| is the last occupied location in |charbuf|.  The array
+  is never searched, so pages beyond |charptr| are never touched.
 
   In addition to these `permanent' strings, there are `temporary'
   strings put together for some short-term purpose.  These are
@@ -164,6 +190,15 @@ begin
     begin write(charbuf[i]); i := i+1 end
 end;
 
+{ |WriteTemp| -- print a tempstring }
+procedure WriteTemp(var s: tempstring);
+  var i: 0..MAXSTRING;
+begin
+  i := 1;
+  while s[i] <> chr(0) do
+    begin write(s[i]); i := i+1 end
+end;
+
 {S Representation of terms }
 
 { It is now time to give the details of how terms are
@@ -242,11 +277,33 @@ type term = pointer;
   execution of goals, and the global stack other longer-lived data
   structures.  Both stacks expand and contract during execution of
   goals.  Also, there is a garbage collector that can reclaim
-  inaccessible portions of the global stack. }
+  inaccessible portions of the global stack.
+
+  The space between the local and global stacks is mostly untouched
+  address space, so the amount of |mem| in use is limited instead by
+  |memlimit|.  The garbage collector runs when the words in use
+  come within |GCLOW| of the limit, and the limit is doubled by
+  |Expand| whenever the heap or a collection leaves less than
+  |GCHIGH| words to spare. }
 
 var
   lsp, gsp, hp, hmark: pointer;
   mem: array [1..MEMSIZE] of integer;
+  memlimit: integer;  { soft limit on words in use }
+  nexpand: integer;  { times the limit has been raised }
+
+{ |mem_used| -- words used by heap and stacks }
+
+
+{ |Expand| -- raise |memlimit| to at least |n| if possible }
+procedure Expand(n: integer);
+begin
+  while (memlimit < n) and (memlimit < MEMSIZE) do begin
+    if memlimit > MEMSIZE div 2 then memlimit := MEMSIZE
+    else memlimit := 2 * memlimit;
+    nexpand := nexpand+1
+  end
+end;
 
 { |LocAlloc| -- allocate space on local stack }
 function LocAlloc(size: integer): pointer;
@@ -270,6 +327,7 @@ end;
 function HeapAlloc(size: integer): pointer;
 begin
   if hp + size > MEMSIZE then begin writeln; writeln('Panic: ', 'out of heap space'); halt end;
+  if hp + size + GCHIGH > memlimit then Expand(hp + size + GCHIGH);
   HeapAlloc := hp + 1; hp := hp + size
 end;
 
@@ -289,6 +347,7 @@ end;
 
 var
   interacting: boolean;  { whether input is from terminal }
+  batching: boolean;  { whether reading queries from a batch file }
   pbchar: char;  { pushed-back char, else |ENDFILE| }
   infile: text;  { the current input file }
   lineno: integer;  { line number in current file }
@@ -345,13 +404,17 @@ end;
 
   The number of clauses tried against a goal literal is reduced by
   using associating each literal with a `key', calculated so that
-  unifiable literals have matching keys. }
+  unifiable literals have matching keys.  Program clauses also have
+  a pointer to code for matching the head, described later, and a
+  link used by the index for their relation. }
 
 type clause = pointer;
   { no. of variables }
   { unification key }
   { next clause for same relation }
   { clause head }
+  { compiled head or NULL }
+  { next clause with same key in index }
   { clause body (ends with NULL) }
 
   { ... plus size of body + 1 }
@@ -382,6 +445,9 @@ type frame = pointer;
   { global stack at creation }
   { trail state at creation }
   { no. of local variables }
+  { for profiling: 2 * node, + 1 if exit due }
+  { node in the profile }
+  { other chain of untried clauses }
 
   { \dots plus space for local variables }
 
@@ -391,10 +457,12 @@ type frame = pointer;
 var
   current: pointer;  { current goal }
   call: term;  { |Deref|'ed first literal of goal }
+  callkey: integer;  { |Key| of |call| }
   goalframe: frame;  { current stack frame }
   choice: frame;  { last choice point }
   base: frame;  { frame for original goal }
   proc: clause;  { clauses left to try on current goal }
+  alt: clause;  { ... and another chain of them, from an index }
 
 { |Deref| is a function that resolves the indirection in the
   representation of terms.  It looks up references in the frame, and
@@ -408,7 +476,7 @@ function Deref(t: term; e: frame): term;
 begin
   if t = 0 then begin writeln; writeln('Panic: ', 'Deref'); halt end;
   if (mem[t] div 256 = 5) and (e <> 0) then
-    t := (e+7+(mem[t+2]-1)*3);
+    t := (e+9+(mem[t+2]-1)*3);
   while (mem[t] div 256 = 4) and (mem[t+2] <> 0) do
     t := mem[t+2];
   Deref := t
@@ -420,7 +488,10 @@ procedure PrintTerm(t: term; e: frame; prio: integer); forward;
 function ParseTerm: term; forward;
 function DoBuiltin(action: integer): boolean; forward;
 procedure Collect; forward;
+procedure GCReport; forward;
+procedure ResetTables; forward;
 function Key(t: term; e: frame): integer; forward;
+function CompileHead(c: pointer): pointer; forward;
 
 { In the actual definition of a procedure or function that
   has been declared forward, we repeat the parameter list
@@ -435,27 +506,38 @@ function Key(t: term; e: frame): integer; forward;
 { The names of relations, functions, constants and variables are
   held in a hash table.  It is organized as a `closed' hash table
   with sequential search: this is simple but leaves much room for
-  improvement. The symbol table is not allowed to become more full
+  improvement. The hash table is not allowed to become more full
   than |HASHFACTOR| per cent, since nearly full hash tables of this kind
-  perform rather badly.
+  perform rather badly; instead it is rebuilt at twice the size.  The
+  hash table |hashtab| holds symbol numbers, and the symbols
+  themselves are numbered in order of creation in |symtab|, so a
+  symbol keeps its number when the table is rebuilt.
 
   Each symbol has an |s_action| code that has a different non-zero
   value for each built-in relation, and is zero for everything
   else. User-defined relations have a chain of clauses that starts
   at the |s_proc| field and is linked together by the |c_next| fields
-  of the clauses. }
+  of the clauses.  Tabled relations have an action code too, and keep
+  the root of their table in |s_table|. }
 
 type symbol = 1..MAXSYMBOLS;  { index in |symtab| }
 
 var
   nsymbols: 0..MAXSYMBOLS;  { number of symbols }
+  hashsize: integer;  { size of the hash table in use }
+  hashtab: array [1..MAXHASH] of integer;  { symbols or 0 }
   symtab: array [1..MAXSYMBOLS] of record
       name: integer;  { print name: index in |charbuf| }
       arity: integer;  { number of arguments or -1 }
       action: integer;  { code if built-in, 0 otherwise }
-      proc: clause  { clause chain }
+      proc: clause;  { clause chain }
+      last: clause;  { last clause in the chain }
+      nclauses: integer;  { length of the chain }
+      index: pointer;  { first-argument index or |NULL| }
+      table: pointer  { call trie for tabled relation or |NULL| }
     end;
   cons, eqsym, cutsym, nilsym, notsym: symbol;
+  tablesym, tblsym, tblget, tblnext: symbol;
 
 { We define selector macros for symbols, just as for terms }
 
@@ -463,35 +545,67 @@ var
 
 
 
+
+
+
+
+{ |HashName| -- hash function for a permstring }
+function HashName(s: permstring): integer;
+  var h: integer;
+begin
+  h := 0;
+  while charbuf[s] <> chr(0) do
+    begin h := (5 * h + ord(charbuf[s])) mod hashsize; s := s+1 end;
+  HashName := h
+end;
+
+{ |Rehash| -- rebuild the hash table at twice the size }
+procedure Rehash;
+  var i, p: integer;
+begin
+  hashsize := 2 * hashsize;
+  for i := 1 to hashsize do hashtab[i] := 0;
+  for i := 1 to nsymbols do begin
+    p := HashName(symtab[i].name) + 1;
+    while hashtab[p] <> 0 do
+      begin p := p-1; if p = 0 then p := hashsize end;
+    hashtab[p] := i
+  end
+end;
+
 { |Lookup| -- convert string to internal symbol }
 function Lookup(var name: tempstring): symbol;
   label 1;
-  var h, i: integer; p: symbol;
+  var h, i: integer; p: integer; s: symbol;
 begin
   { Compute the hash function in |h| }
   h := 0; i := 1;
   while name[i] <> chr(0) do
-    begin h := (5 * h + ord(name[i])) mod MAXSYMBOLS; i := i+1 end;
+    begin h := (5 * h + ord(name[i])) mod hashsize; i := i+1 end;
 
   { Search the hash table }
   p := h+1;
-  while symtab[p].name <> -1 do begin
-    if StringEqual(name, symtab[p].name) then goto 1;
+  while hashtab[p] <> 0 do begin
+    s := hashtab[p];
+    if StringEqual(name, symtab[s].name) then goto 1;
     p := p-1;
-    if p = 0 then p := MAXSYMBOLS
+    if p = 0 then p := hashsize
   end;
 
   { Not found: enter a new symbol }
-  { Be careful to avoid overflow on 16 bit machines: }
-  if nsymbols >= (MAXSYMBOLS div 10) * (HASHFACTOR div 10) then
+  if nsymbols >= MAXSYMBOLS then
     begin writeln; writeln('Panic: ', 'out of symbol space'); halt end;
-  nsymbols := nsymbols+1;
-  symtab[p].name := SaveString(name);
-  symtab[p].arity := -1;
-  symtab[p].action := 0; symtab[p].proc := 0;
+  nsymbols := nsymbols+1; s := nsymbols; hashtab[p] := s;
+  symtab[s].name := SaveString(name);
+  symtab[s].arity := -1;
+  symtab[s].action := 0; symtab[s].proc := 0; symtab[s].last := 0;
+  symtab[s].nclauses := 0; symtab[s].index := 0; symtab[s].table := 0;
+  { Be careful to avoid overflow on 16 bit machines: }
+  if nsymbols >= (hashsize div 10) * (HASHFACTOR div 10) then
+    Rehash;
 
 1:
-  Lookup := p
+  Lookup := s
 end;
 
 type keyword = array [1..8] of char;
@@ -520,13 +634,17 @@ end;
   { |false/0| }
   { |print/1| }
   { |nl/0| }
+  { |stats/0| }
+  { any tabled relation }
+  { |$get/2| }
+  { |$next/2| }
 
 { |InitSymbols| -- initialize and define standard symbols }
 procedure InitSymbols;
   var i: integer; dummy: symbol;
 begin
-  nsymbols := 0;
-  for i := 1 to MAXSYMBOLS do symtab[i].name := -1;
+  nsymbols := 0; hashsize := HASHINIT;
+  for i := 1 to hashsize do hashtab[i] := 0;
   cons   := Enter(':       ', 2, 0);
   cutsym := Enter('!       ', 0, 1);
   eqsym  := Enter('=       ', 2, 8);
@@ -539,24 +657,150 @@ begin
   dummy  := Enter('char    ', 1, 6);
   dummy  := Enter('false   ', 0, 9);
   dummy  := Enter('print   ', 1, 10);
-  dummy  := Enter('nl      ', 0, 11)
+  dummy  := Enter('nl      ', 0, 11);
+  dummy  := Enter('stats   ', 0, 12);
+  tablesym := Enter('table   ', -1, 0);
+  tblsym := Enter('$tbl    ', 2, 0);
+  tblget := Enter('$get    ', 2, 14);
+  tblnext := Enter('$next   ', 2, 15)
+end;
+
+{S Clause indexing }
+
+{ The |Key| of a goal literal rules out clauses whose first argument
+  cannot match, but |Search| must still skip over them one at a time,
+  so a query against a big table of facts takes time proportional to
+  the size of the table.  Once a relation has |INDEXMIN| clauses, we
+  give it an index: a hash table in the heap that maps each non-zero
+  key to a chain of the clauses that have that key, linked in the
+  original order through their |c_knext| fields.  The clauses with
+  key zero could match a goal with any key, but they are not copied
+  onto every chain: they have a single chain of their own.
+
+  A goal with a non-zero key must try the clauses on its own chain
+  and those on the chain for key zero, in the order they appear in
+  the program.  Clauses are put on the heap in the order they are
+  read, so the two chains are merged as the goal runs by comparing
+  the addresses of the clauses at their heads, much as a
+  `switch_on_term' instruction in Warren's abstract machine falls
+  through to the code for clauses with a variable first argument.
+  The interpreter keeps its place in both chains, in |proc| and
+  |alt| while it runs and in the |f_retry| and |f_alt| fields of a
+  choice-point, and no choice-point is left behind when a goal
+  matches the last clause that remains on either chain.  A goal with
+  key zero tries every clause, and ignores the index.
+
+  The table uses open addressing with linear probing, and is replaced
+  by one twice the size when it becomes two-thirds full; the old table
+  is simply abandoned in the heap. }
+
+  { number of slots }
+  { slots in use }
+  { chain for key zero }
+  { key for slot $2 (from 0) }
+  { its chain }
+  { \dots\ plus 3 words per slot }
+
+{ A chain is a pair of words holding its first and last clause; an
+  empty slot has an empty chain. }
+
+
+
+{ |Append| -- add a clause to the end of a chain }
+procedure Append(c: clause; ch: pointer);
+begin
+  mem[c+5] := 0;
+  if mem[ch] = 0 then mem[ch] := c
+  else mem[mem[ch+1]+5] := c;
+  mem[ch+1] := c
+end;
+
+{ |NewIndex| -- allocate an empty index with |n| slots }
+function NewIndex(n: integer): pointer;
+  var x: pointer; j: integer;
+begin
+  x := HeapAlloc(4 + 3*n);
+  mem[x] := n; mem[x+1] := 0;
+  mem[(x+2)] := 0; mem[(x+2)+1] := 0;
+  for j := 0 to n-1 do mem[(x+3*j+5)] := 0;
+  NewIndex := x
+end;
+
+{ |FindSlot| -- find the slot for key |k|, or an empty one }
+function FindSlot(x: pointer; k: integer): integer;
+  var j: integer;
+begin
+  j := k mod mem[x];
+  if j < 0 then j := j + mem[x];
+  while (mem[(x+3*j+5)] <> 0) and (mem[x+3*j+4] <> k) do
+    j := (j+1) mod mem[x];
+  FindSlot := j
+end;
+
+{ |GrowIndex| -- move the chains of an index to a bigger table }
+function GrowIndex(x: pointer): pointer;
+  var y: pointer; i, j: integer;
+begin
+  y := NewIndex(2 * mem[x]);
+  mem[y+1] := mem[x+1];
+  mem[(y+2)] := mem[(x+2)];
+  mem[(y+2)+1] := mem[(x+2)+1];
+  for i := 0 to mem[x]-1 do
+    if mem[(x+3*i+5)] <> 0 then begin
+      j := FindSlot(y, mem[x+3*i+4]);
+      mem[y+3*j+4] := mem[x+3*i+4];
+      mem[(y+3*j+5)] := mem[(x+3*i+5)];
+      mem[(y+3*j+5)+1] := mem[(x+3*i+5)+1]
+    end;
+  GrowIndex := y
+end;
+
+{ |IndexClause| -- enter a clause in the index for its relation }
+procedure IndexClause(s: symbol; c: clause);
+  var x: pointer; j: integer;
+begin
+  if mem[c+1] = 0 then
+    Append(c, (symtab[s].index+2))
+  else begin
+    if 3 * (mem[symtab[s].index+1] + 1) > 2 * mem[symtab[s].index] then
+      symtab[s].index := GrowIndex(symtab[s].index);
+    x := symtab[s].index; j := FindSlot(x, mem[c+1]);
+    if mem[(x+3*j+5)] = 0 then
+      begin mem[x+3*j+4] := mem[c+1]; mem[x+1] := mem[x+1]+1 end;
+    Append(c, (x+3*j+5))
+  end
+end;
+
+{ |MakeIndex| -- build the index for a relation }
+procedure MakeIndex(s: symbol);
+  var p: clause;
+begin
+  symtab[s].index := NewIndex(INDEXSLOTS);
+  p := symtab[s].proc;
+  while p <> 0 do
+    begin IndexClause(s, p); p := mem[p+2] end
 end;
 
 { |AddClause| -- insert a clause at the end of its chain }
 procedure AddClause(c: clause);
-  var s: symbol; p: clause;
+  var s: symbol;
 begin
   s := mem[mem[c+3]+2];
-  if symtab[s].action <> 0 then begin
+  if (symtab[s].action <> 0) and (symtab[s].action <> 13) then begin
     begin writeln; write('Error: ', 'can''t add clauses to built-in relation '); run := false end;
     WriteString(symtab[s].name)
   end
-  else if symtab[s].proc = 0 then
-    symtab[s].proc := c
   else begin
-    p := symtab[s].proc;
-    while mem[p+2] <> 0 do p := mem[p+2];
-    mem[p+2] := c
+    if symtab[s].proc = 0 then
+      symtab[s].proc := c
+    else
+      mem[symtab[s].last+2] := c;
+    symtab[s].last := c;
+    symtab[s].nclauses := symtab[s].nclauses+1;
+    if symtab[s].index <> 0 then
+      IndexClause(s, c)
+    else if symtab[s].nclauses = INDEXMIN then
+      MakeIndex(s)
   end
 end;
 
@@ -634,12 +878,15 @@ function MakeClause(nvars: integer; head: term;
 		    var body: argbuf; nbody: integer): clause;
   var p: clause; i: integer;
 begin
-  p := HeapAlloc(4 + nbody + 1);
+  p := HeapAlloc(6 + nbody + 1);
   mem[p] := nvars; mem[p+2] := 0; mem[p+3] := head;
-  for i := 1 to nbody do mem[(p+4)+i-1] := body[i];
-  mem[(p+4)+nbody+1-1] := 0;
+  for i := 1 to nbody do mem[(p+6)+i-1] := body[i];
+  mem[(p+6)+nbody+1-1] := 0; mem[p+4] := 0;
   if head = 0 then mem[p+1] := 0
-  else mem[p+1] := Key(head, 0);
+  else begin
+    mem[p+1] := Key(head, 0);
+    if cflag then mem[p+4] := CompileHead(p)
+  end;
   MakeClause := p
 end;
 
@@ -773,12 +1020,12 @@ begin
       write(' ')
     end;
     write(':- ');
-    if mem[(c+4)+1-1] <> 0 then begin
-      PrintTerm(mem[(c+4)+1-1], 0, 2);
+    if mem[(c+6)+1-1] <> 0 then begin
+      PrintTerm(mem[(c+6)+1-1], 0, 2);
       i := 2;
-      while mem[(c+4)+i-1] <> 0 do begin
+      while mem[(c+6)+i-1] <> 0 do begin
 	write(', ');
-	PrintTerm(mem[(c+4)+i-1], 0, 2);
+	PrintTerm(mem[(c+6)+i-1], 0, 2);
 	i := i+1
       end
     end;
@@ -1012,7 +1259,7 @@ begin
     for i := 1 to nvars do begin
       writeln;
       WriteString(symtab[vartable[i]].name); write(' = ');
-      PrintTerm((bindings+7+(i-1)*3), 0, 2-1)
+      PrintTerm((bindings+9+(i-1)*3), 0, 2-1)
     end;
     if not interacting then
       begin writeln; ShowAnswer := false end
@@ -1164,18 +1411,54 @@ begin
   else ParseClause := MakeClause(nvars, head, body, n)
 end;
 
+{ A program file may also contain directives of the form
+  `|:- table p(X, Y), q(Z).|', naming the relations that are to be
+  tabled.  The arguments in each literal serve only to fix the arity
+  of the relation. }
+
+{ |ParseDirective| -- parse and obey a directive }
+procedure ParseDirective;
+  label 3;
+  var t: term; s: symbol;
+begin
+  Eat(6);
+  if (token <> 1) or (tokval <> tablesym) then
+    begin if not errflag then
+    begin ShowError; writeln('unknown directive'); Recover end end
+  else begin
+    Eat(1);
+    while true do begin
+      t := ParseTerm; CheckAtom(t);
+      if not errflag then begin
+        s := mem[t+2];
+        if symtab[s].action = 0 then
+          symtab[s].action := 13
+        else if symtab[s].action <> 13 then
+          begin if not errflag then
+    begin ShowError; writeln('can''t table a built-in relation'); Recover end end
+      end;
+      if token <> 9 then goto 3;
+      Eat(9)
+    end
+  end;
+3:
+  Eat(10)
+end;
+
 { |ReadClause| -- read a clause from |infile| }
 function ReadClause: clause;
-  var c: clause;
+  var c: clause; directive: boolean;
 begin
   repeat
     hp := hmark; nvars := 0; errflag := false;
     if interacting then
       begin writeln; write('# :- '); flush end;
-    Scan;
+    Scan; directive := false;
     if token = 14 then c := 0
-    else c := ParseClause(interacting)
-  until (not errflag) or (token = 14);
+    else if (token = 6) and not interacting and not batching then
+      begin ParseDirective; directive := true; c := 0 end
+    else c := ParseClause(interacting or batching)
+  until ((not errflag) and (not directive)) or (token = 14);
   ReadClause := c
 end;
 
@@ -1185,7 +1468,14 @@ end;
   they can be undone on backtracking.  It is a linked list of nodes
   with a |t_kind| of |UNDO| allocated from the global stack.  The
   variables for which bindings are actually kept in the trail are the
-  `critical' ones that will not be destroyed on backtracking. }
+  `critical' ones that will not be destroyed on backtracking.
+
+  The trail also serves the garbage collector as a record of the
+  places where an old term might point to a younger one.  Cells on
+  the global stack above |gcmark| survived the last collection; since
+  a binding is the only way an old term can come to point at a new
+  one, bindings of these cells are always trailed, even when the
+  cell is not critical. }
 
 type trail = pointer;
 { Nodes on the trail share the |t_tag| and |t_shift| fields of
@@ -1195,15 +1485,19 @@ type trail = pointer;
 
 
 var trhead: trail;  { start of the trail }
+  gcmark: pointer;  { global stack at the end of the last GC }
 
 { |critical| -- test if a variable will survive backtracking }
 
 
-{ |Save| -- add a variable to the trail if it is critical }
+{ |remember| -- test if a binding must be trailed }
+
+
+{ |Save| -- add a variable to the trail if needed }
 procedure Save(v: term);
   var p: trail;
 begin
-  if ((v < choice) or (v >= mem[choice+4])) then begin
+  if (((v < choice) or (v >= mem[choice+4])) or (v >= gcmark)) then begin
     p := GloAlloc(6, 4);
     mem[p+2] := v; mem[p+3] := trhead; trhead := p
   end
@@ -1227,7 +1521,7 @@ begin
   p := trhead;
   if choice = 0 then begin writeln; write('Error: ', 'Commit'); run := false end;
   while (p <> 0) and (p < mem[choice+4]) do begin
-    if (mem[p+2] <> 0) and not ((mem[p+2] < choice) or (mem[p+2] >= mem[choice+4])) then
+    if (mem[p+2] <> 0) and not (((mem[p+2] < choice) or (mem[p+2] >= mem[choice+4])) or (mem[p+2] >= gcmark)) then
       mem[p+2] := 0;
     p := mem[p+3]
   end
@@ -1376,17 +1670,486 @@ begin
   end
 end;
 
-{ |Search| -- find the first clause that might match }
-function Search(t: term; e: frame; p: clause): clause;
-  var k: integer;
+{ |Search| -- find the first clause that might match key |k| }
+function Search(k: integer; p: clause): clause;
 begin
-  k := Key(t, e);
   if k <> 0 then
     while (p <> 0) and (mem[p+1] <> 0) and (mem[p+1] <> k) do
       p := mem[p+2];
   Search := p
 end;
 
+{ |Order| -- put two chains in the order of their first clauses }
+procedure Order(p, q: clause; var first, second: clause);
+begin
+  if (p = 0) or ((q <> 0) and (q < p)) then
+    begin first := q; second := p end
+  else
+    begin first := p; second := q end
+end;
+
+{ |FirstClause| -- set |proc| and |alt| for a goal with key |k| }
+procedure FirstClause(t: term; k: integer);
+  var s: symbol; x: pointer;
+begin
+  s := mem[t+2]; x := symtab[s].index;
+  if (x = 0) or (k = 0) then
+    begin proc := Search(k, symtab[s].proc); alt := 0 end
+  else
+    Order(mem[(x+3*FindSlot(x, k)+5)],
+      mem[(x+2)], proc, alt)
+end;
+
+{S Compiling clause heads }
+
+{ Matching a goal literal against the head of a clause is the
+  commonest job the interpreter does, and |Unify| does it the slow
+  way, following |REF| nodes through the frame and taking both terms
+  apart at every level.  So each program clause is also given a
+  short sequence of instructions in the style of the `get' and
+  `unify' instructions of Warren's abstract machine, kept on the
+  heap after the clause.  The instructions work on a stack of goal
+  subterms that are waiting to be matched: to start with, the
+  arguments of the goal literal, and later the arguments of each
+  compound term that is taken apart.  Each instruction pops a term
+  from the stack and matches it against one part of the head.
+
+  The first occurrence of a variable simply binds the cell in the
+  new frame, a variable that occurs only once in the clause matches
+  anything, and only later occurrences need the full |Unify|.  If a
+  goal subterm is an unbound variable where the head has a compound
+  term, that part of the head is copied with |GloCopy| just as
+  |Unify| would do, and the instructions for its arguments are
+  skipped.  A head that would need more than |VMSTACK| stack entries
+  is not compiled, and |Unify| is used for it instead; the same
+  happens for every clause if picoProlog is started with `-i'.
+
+  Only heads are compiled.  Body literals stay as terms that share
+  structure with the clause and are run by |Step|, and clauses are
+  still chosen through the index of chains above rather than by
+  `try' and `switch' instructions.  Because of structure sharing, a
+  body literal together with its frame already serves as the
+  argument registers of the call it makes, so `put' instructions
+  would only copy it; compiling bodies would pay only once terms are
+  built on the global stack by copying, as in the WAM, and that
+  means a new collector and a new layout for frames. }
+
+{ instruction codes }
+  { atom |arg| }
+  { integer |arg| }
+  { character |arg| }
+  { compound term |arg|, ending at |skip| }
+  { first occurrence of variable |arg| }
+  { later occurrence of variable |arg| }
+  { variable that occurs only once }
+  { end of the head }
+
+
+
+
+
+var
+  occurs: array [1..MAXARITY] of integer;  { occurrences of each var }
+  seen: array [1..MAXARITY] of boolean;  { whether var is bound yet }
+  depth, maxdepth: integer;  { stack depth during compilation }
+  vmterm: array [1..VMSTACK] of term;  { terms waiting to be matched }
+  vmenv: array [1..VMSTACK] of frame;  { ... and their frames }
+
+{ |CountVars| -- count occurrences of variables in a clause term }
+procedure CountVars(t: term);
+  var i: integer;
+begin
+  case mem[t] div 256 of
+  1:
+    for i := 1 to symtab[mem[t+2]].arity do CountVars(mem[t+i+2]);
+  5:
+    occurs[mem[t+2]] := occurs[mem[t+2]]+1;
+  2, 3:
+    { skip }
+  else
+    begin writeln; writeln('Panic: ', 'bad tag ', mem[t] div 256:1, ' in ', 'CountVars'); halt end
+  end
+end;
+
+{ |Emit| -- add a word of code on the heap }
+procedure Emit(w: integer);
+  var p: pointer;
+begin
+  p := HeapAlloc(1); mem[p] := w
+end;
+
+{ |CompileArg| -- compile code to match one subterm of a head }
+procedure CompileArg(t: term);
+  var i, n: integer; p: pointer;
+begin
+  depth := depth-1;
+  case mem[t] div 256 of
+  1:
+    begin
+      n := symtab[mem[t+2]].arity;
+      if n = 0 then
+        begin Emit(1); Emit(t) end
+      else begin
+        p := hp+1; Emit(4); Emit(t); Emit(0);
+        depth := depth + n;
+        if depth > maxdepth then maxdepth := depth;
+        for i := 1 to n do CompileArg(mem[t+i+2]);
+        mem[p+2] := hp+1
+      end
+    end;
+  2:
+    begin Emit(2); Emit(t) end;
+  3:
+    begin Emit(3); Emit(t) end;
+  5:
+    if occurs[mem[t+2]] = 1 then
+      Emit(7)
+    else if not seen[mem[t+2]] then begin
+      Emit(5); Emit(mem[t+2]);
+      seen[mem[t+2]] := true
+    end
+    else
+      begin Emit(6); Emit(mem[t+2]) end
+  else
+    begin writeln; writeln('Panic: ', 'bad tag ', mem[t] div 256:1, ' in ', 'CompileArg'); halt end
+  end
+end;
+
+{ |CompileHead| -- compile the head of a clause, or return |NULL| }
+function CompileHead ;
+  var i, n: integer; code: pointer;
+begin
+  for i := 1 to mem[c] do
+    begin occurs[i] := 0; seen[i] := false end;
+  CountVars(mem[c+3]); i := 1;
+  while mem[(c+6)+i-1] <> 0 do
+    begin CountVars(mem[(c+6)+i-1]); i := i+1 end;
+
+  n := symtab[mem[mem[c+3]+2]].arity;
+  code := hp+1; depth := n; maxdepth := n;
+  for i := 1 to n do CompileArg(mem[mem[c+3]+i+2]);
+  Emit(8);
+
+  if maxdepth > VMSTACK then
+    begin hp := code-1; code := 0 end;
+  CompileHead := code
+end;
+
+{ |Match| -- unify goal |t| with head of |c| in new frame |e2| }
+function Match(t: term; e1: frame; c: clause; e2: frame): boolean;
+  label 2;
+  var pc: pointer; sp, i: integer; e: frame; v: term;
+begin
+  Match := false;
+  if mem[c+4] = 0 then
+    begin Match := Unify(t, e1, mem[c+3], e2); goto 2 end;
+
+  sp := 0;
+  for i := symtab[mem[t+2]].arity downto 1 do
+    begin sp := sp+1; vmterm[sp] := mem[t+i+2]; vmenv[sp] := e1 end;
+
+  pc := mem[c+4];
+  while mem[pc] <> 8 do begin
+    if mem[pc] = 7 then
+      begin sp := sp-1; pc := pc+1 end
+    else begin
+      e := vmenv[sp]; t := Deref(vmterm[sp], e); sp := sp-1;
+      case mem[pc] of
+      1:
+	begin
+	  if mem[t] div 256 = 4 then
+	    begin Save(t); mem[t+2] := mem[pc+1] end
+	  else if mem[t] div 256 <> 1 then goto 2
+	  else if mem[t+2] <> mem[mem[pc+1]+2] then goto 2;
+	  pc := pc+2
+	end;
+      2:
+	begin
+	  if mem[t] div 256 = 4 then
+	    begin Save(t); mem[t+2] := mem[pc+1] end
+	  else if mem[t] div 256 <> 2 then goto 2
+	  else if mem[t+2] <> mem[mem[pc+1]+2] then goto 2;
+	  pc := pc+2
+	end;
+      3:
+	begin
+	  if mem[t] div 256 = 4 then
+	    begin Save(t); mem[t+2] := mem[pc+1] end
+	  else if mem[t] div 256 <> 3 then goto 2
+	  else if mem[t+2] <> mem[mem[pc+1]+2] then goto 2;
+	  pc := pc+2
+	end;
+      4:
+	if mem[t] div 256 = 4 then begin
+	  Save(t); mem[t+2] := GloCopy(mem[pc+1], e2);
+	  pc := mem[pc+2]
+	end
+	else if mem[t] div 256 <> 1 then goto 2
+	else if mem[t+2] <> mem[mem[pc+1]+2] then goto 2
+	else begin
+	  for i := symtab[mem[t+2]].arity downto 1 do begin
+	    sp := sp+1; vmterm[sp] := mem[t+i+2]; vmenv[sp] := e
+	  end;
+	  pc := pc+3
+	end;
+      5:
+	begin
+	  v := (e2+9+(mem[pc+1]-1)*3);
+	  if mem[t] div 256 = 4 then
+	    Share(t, v)
+	  else
+	    begin Save(v); mem[v+2] := GloCopy(t, e) end;
+	  pc := pc+2
+	end;
+      6:
+	begin
+	  if not Unify(t, e, (e2+9+(mem[pc+1]-1)*3), e2) then goto 2;
+	  pc := pc+2
+	end
+      else
+	begin writeln; writeln('Panic: ', 'bad tag ', mem[pc]:1, ' in ', 'Match'); halt end
+      end
+    end
+  end;
+  Match := true;
+2:
+end;
+
+{S Profiling }
+
+{ With the option `|-p file|', picoProlog profiles each query.  For
+  each relation, it counts the events that appear in the trace
+  printed with |-d|: calls, exits, and redos on backtracking.  It also
+  counts fails, meaning built-in calls that fail and resolution steps
+  that find no matching clause, and it counts the attempts to match
+  a clause head and how many succeed.  While profiling, tail
+  recursion is turned off so that each call keeps its frame until it
+  exits.
+
+  Time is measured by sampling, over a calling context tree that has
+  a node for each distinct path of calls from the goal.  Each frame
+  records its node, found from the node of its parent when the frame
+  is pushed.  A directly recursive call shares its caller's node,
+  and paths deeper than |PROFDEPTH| share the node at that depth, so
+  the tree stays small.  After every |PROFTICK| calls, the CPU time
+  since the last sample is added to the node for the current call.
+  When the query is finished, each relation is charged the time of
+  every node that has the relation on its path, counting each node
+  only once.  This gives an inclusive time.  A table of relations
+  sorted by time is then printed, and the tree is written to the
+  file as folded stacks.  Each line `|p/1;q/2 120|' gives a path and
+  its time in microseconds, which is the form that flame graph tools
+  expect.  The file is rewritten after each query.  Hidden relations,
+  whose names begin with |$|, are left out of both.
+
+  A frame can exit more than once if a choice made below it is
+  retried, and the frames that tabling uses to run clauses and
+  return answers are not made by counted calls at all.  So that
+  exits do not outnumber calls and redos, a frame owes an exit only
+  if it was pushed for the goal whose call or redo was last counted,
+  and the exit is counted only the first time the frame exits. }
+
+var
+  pflag: boolean;  { whether to profile }
+  profname: tempstring;  { file for folded stacks }
+  pfile: text;  { the same, when open }
+  pcalls, pexits, predos, pfails: array [1..MAXSYMBOLS] of integer;
+  ptries, pmatches: array [1..MAXSYMBOLS] of integer;  { head matching }
+  ptime: array [1..MAXSYMBOLS] of integer;  { inclusive time }
+  pstamp: array [1..MAXSYMBOLS] of integer;  { last node charged }
+  porder: array [1..MAXSYMBOLS] of symbol;  { relations for the table }
+  pgoal: pointer;  { goal of the last call or redo counted }
+  pgframe: frame;  { and its frame }
+  nsample: integer;  { number of samples }
+  ptick: integer;  { calls until the next sample }
+  plast: integer;  { time of the last sample }
+  ncct: integer;  { nodes in the calling context tree }
+  cnparent, cndepth: array [1..PROFNODES] of integer;
+  cnsym: array [1..PROFNODES] of symbol;  { relation for each node }
+  cntime: array [1..PROFNODES] of integer;  { time in each node }
+  cnhash: array [1..PROFHASH] of integer;  { hash table for nodes }
+
+{ |Elapsed| -- CPU time since |start|, allowing for |cputime| to wrap }
+function Elapsed(start: integer): integer;
+  var t: integer;
+begin
+  t := cputime - start;
+  if t < 0 then t := (t + CLOCKMAX) + 1;
+  Elapsed := t
+end;
+
+{ |ResetProfile| -- clear the profile before a query }
+procedure ResetProfile;
+  var i: integer;
+begin
+  for i := 1 to nsymbols do begin
+    pcalls[i] := 0; pexits[i] := 0; predos[i] := 0; pfails[i] := 0;
+    ptries[i] := 0; pmatches[i] := 0; ptime[i] := 0; pstamp[i] := 0
+  end;
+  for i := 1 to PROFHASH do cnhash[i] := 0;
+  ncct := 0; nsample := 0; ptick := PROFTICK; plast := cputime;
+  pgoal := 0; pgframe := 0
+end;
+
+{ |Hidden| -- whether relation |s| is an internal one }
+function Hidden(s: symbol): boolean;
+begin
+  Hidden := (charbuf[symtab[s].name] = '$')
+end;
+
+{ |FrameRel| -- relation for the call that created frame |f| }
+function FrameRel(f: frame): symbol;
+begin
+  FrameRel := mem[Deref(mem[mem[f]], mem[f+1])+2]
+end;
+
+{ |ProfNode| -- find or make the child of node |p| for relation |s| }
+function ProfNode(p: integer; s: symbol): integer;
+  label 2;
+  var h, q: integer;
+begin
+  if p > 0 then begin
+    if (cnsym[p] = s) or (cndepth[p] >= PROFDEPTH) then
+      begin ProfNode := p; goto 2 end
+  end;
+  h := (p * 499 + s) mod PROFHASH + 1;
+  while cnhash[h] <> 0 do begin
+    q := cnhash[h];
+    if (cnparent[q] = p) and (cnsym[q] = s) then
+      begin ProfNode := q; goto 2 end;
+    h := h mod PROFHASH + 1
+  end;
+  if ncct >= PROFNODES then
+    ProfNode := p  { the tree is full: use the parent }
+  else begin
+    ncct := ncct+1; cnparent[ncct] := p; cnsym[ncct] := s;
+    if p = 0 then cndepth[ncct] := 1
+    else cndepth[ncct] := cndepth[p] + 1;
+    cntime[ncct] := 0; cnhash[h] := ncct; ProfNode := ncct
+  end;
+2:
+end;
+
+{ |ProfSample| -- charge the time since the last sample }
+procedure ProfSample;
+  var node, dt: integer;
+begin
+  dt := Elapsed(plast); plast := cputime;
+  nsample := nsample+1;
+  node := ProfNode((mem[goalframe+7] div 2), mem[call+2]);
+  if node > 0 then cntime[node] := cntime[node] + dt
+end;
+
+{ |ProfCall| -- count a call and take a sample if one is due }
+procedure ProfCall;
+begin
+  pcalls[mem[call+2]] := pcalls[mem[call+2]]+1;
+  pgoal := current; pgframe := goalframe;
+  ptick := ptick-1;
+  if ptick = 0 then
+    begin ProfSample; ptick := PROFTICK end
+end;
+
+{ |PadInt| -- print |n| right-justified in |w| columns }
+procedure PadInt(n, w: integer);
+  var k, m: integer;
+begin
+  k := 1; m := n;
+  while m >= 10 do begin m := m div 10; k := k+1 end;
+  while k < w do begin write(' '); k := k+1 end;
+  write(n:1)
+end;
+
+{ |ProfBefore| -- whether relation |a| comes before |b| in the table }
+function ProfBefore(a, b: symbol): boolean;
+begin
+  if ptime[a] <> ptime[b] then
+    ProfBefore := (ptime[a] > ptime[b])
+  else
+    ProfBefore := (pcalls[a] > pcalls[b])
+end;
+
+{ |WritePath| -- write the path for node |p| to the stacks file,
+  returning false if it is empty }
+function WritePath(p: integer): boolean;
+  var i: integer; any: boolean;
+begin
+  any := false;
+  if cnparent[p] <> 0 then any := WritePath(cnparent[p]);
+  if not Hidden(cnsym[p]) then begin
+    if any then write(pfile, ';');
+    i := symtab[cnsym[p]].name;
+    while charbuf[i] <> chr(0) do
+      begin write(pfile, charbuf[i]); i := i+1 end;
+    write(pfile, '/', symtab[cnsym[p]].arity:1);
+    any := true
+  end;
+  WritePath := any
+end;
+
+{ |ProfReport| -- print the profile and write the stacks file }
+procedure ProfReport;
+  var i, j, n, h: integer; s: symbol; more: boolean;
+begin
+  { Charge the time of each node to the relations on its path }
+  for i := 1 to ncct do begin
+    if cntime[i] > 0 then j := i else j := 0;
+    while j <> 0 do begin
+      s := cnsym[j];
+      if pstamp[s] <> i then
+        begin pstamp[s] := i; ptime[s] := ptime[s] + cntime[i] end;
+      j := cnparent[j]
+    end
+  end;
+
+  { Sort the relations that were used with Shell's method }
+  n := 0;
+  for i := 1 to nsymbols do
+    if (pcalls[i] + predos[i] > 0) and not Hidden(i) then
+      begin n := n+1; porder[n] := i end;
+  h := 1;
+  while h < n div 3 do h := 3*h + 1;
+  while h >= 1 do begin
+    for i := h+1 to n do begin
+      s := porder[i]; j := i; more := true;
+      while more do begin
+        if j <= h then
+          more := false
+        else if not ProfBefore(s, porder[j-h]) then
+          more := false
+        else
+          begin porder[j] := porder[j-h]; j := j-h end
+      end;
+      porder[j] := s
+    end;
+    h := h div 3
+  end;
+
+  writeln; writeln;
+  writeln('     calls     exits     redos     fails     tries',
+    '   matches   time ms  relation');
+  for i := 1 to n do begin
+    s := porder[i];
+    PadInt(pcalls[s], 10); PadInt(pexits[s], 10);
+    PadInt(predos[s], 10); PadInt(pfails[s], 10);
+    PadInt(ptries[s], 10); PadInt(pmatches[s], 10);
+    PadInt(ptime[s] div 1000, 10); write('  ');
+    WriteString(symtab[s].name); write('/', symtab[s].arity:1); writeln
+  end;
+  write('[', nsample:1, ' samples, ', ncct:1, ' paths]');
+
+  if not openout(pfile, profname) then begin
+    writeln; write('Can''t write '); WriteTemp(profname)
+  end
+  else begin
+    for i := 1 to ncct do
+      if cntime[i] > 0 then begin
+        if WritePath(i) then writeln(pfile, ' ', cntime[i]:1)
+      end;
+    closeout(pfile)
+  end
+end;
+
 {S Interpreter }
 
 { The main control of the interpreter uses a depth-first search
@@ -1402,14 +2165,20 @@ var ok: boolean;  { whether execution succeeded }
 procedure PushFrame(nvars: integer; retry: clause);
   var f: frame; i: integer;
 begin
-  f := LocAlloc((7 + (nvars)*3));
+  f := LocAlloc((9 + (nvars)*3));
   mem[f] := current; mem[f+1] := goalframe;
-  mem[f+2] := retry; mem[f+3] := choice;
+  mem[f+2] := retry; mem[f+8] := 0; mem[f+3] := choice;
   mem[f+4] := gsp; mem[f+5] := trhead;
   mem[f+6] := nvars;
+  if pflag then begin
+    if goalframe = 0 then mem[f+7] := 0
+    else mem[f+7] := 2 * ProfNode((mem[goalframe+7] div 2), FrameRel(f));
+    if (current = pgoal) and (goalframe = pgframe) then
+      mem[f+7] := mem[f+7] + 1
+  end;
   for i := 1 to nvars do begin
-    mem[(f+7+(i-1)*3)] := 256 * 4 + 3;
-    mem[(f+7+(i-1)*3)+2] := 0
+    mem[(f+9+(i-1)*3)] := 256 * 4 + 3;
+    mem[(f+9+(i-1)*3)+2] := 0
   end;
   goalframe := f;
   if retry <> 0 then choice := goalframe
@@ -1444,8 +2213,8 @@ procedure TroStep;
 begin
   if dflag then writeln('(TRO)');
 
-  oldsize := (7 + (mem[goalframe+6])*3); { size of old frame }
-  newsize := (7 + (mem[proc])*3); { size of new frame }
+  oldsize := (9 + (mem[goalframe+6])*3); { size of old frame }
+  newsize := (9 + (mem[proc])*3); { size of new frame }
   temp := LocAlloc(newsize);
   temp := goalframe + newsize; { copy old frame here }
 
@@ -1454,52 +2223,80 @@ begin
 
   { Adjust internal pointers in the copy }
   for i := 1 to mem[goalframe+6] do begin
-    if (mem[(temp+7+(i-1)*3)] div 256 = 4)
-        and (mem[(temp+7+(i-1)*3)+2] <> 0)
-        and (goalframe <= mem[(temp+7+(i-1)*3)+2])
-        and (mem[(temp+7+(i-1)*3)+2] < goalframe + oldsize) then
-      mem[(temp+7+(i-1)*3)+2] := mem[(temp+7+(i-1)*3)+2] + newsize
+    if (mem[(temp+9+(i-1)*3)] div 256 = 4)
+        and (mem[(temp+9+(i-1)*3)+2] <> 0)
+        and (goalframe <= mem[(temp+9+(i-1)*3)+2])
+        and (mem[(temp+9+(i-1)*3)+2] < goalframe + oldsize) then
+      mem[(temp+9+(i-1)*3)+2] := mem[(temp+9+(i-1)*3)+2] + newsize
   end;
 
   { Overwrite the old frame with the new one }
   mem[goalframe+6] := mem[proc];
   for i := 1 to mem[goalframe+6] do begin
-    mem[(goalframe+7+(i-1)*3)] := 256 * 4 + 3;
-    mem[(goalframe+7+(i-1)*3)+2] := 0
+    mem[(goalframe+9+(i-1)*3)] := 256 * 4 + 3;
+    mem[(goalframe+9+(i-1)*3)+2] := 0
   end;
 
   { Perform the resolution step }
-  ok := Unify(call, temp, mem[proc+3], goalframe);
-  current := (proc+4);
+  ok := Match(call, temp, proc, goalframe);
+  current := (proc+6);
   lsp := temp-1
 end;
 
 { The |Step| procedure carries out a single resolution step.
-  Built-in relations are treated as a special case; so are
-  resolution steps that can use the tail-recursion optimization.
-  Otherwise, we allocate a frame for the first clause for the
-  current goal literal, unify the clause head with the literal, and adopt
-  the clause body as the new goal.  The step can fail (and |Step|
-  returns |false|) if there are no clauses to try, or if the first
-  clause fails to match. }
-
-{ |Step| -- perform a resolution step }
-procedure Step;
-  var retry: clause;
-begin
-  if symtab[mem[call+2]].action <> 0 then
-    ok := DoBuiltin(symtab[mem[call+2]].action)
-  else if proc = 0 then
+  Built-in relations are treated as a special case; the rest of the
+  work is done by |Resolve|, which tries the clauses in |proc|.
+  Resolution steps that can use the tail-recursion optimization are
+  another special case.  Otherwise, we allocate a frame for the first
+  clause for the current goal literal, unify the clause head with the
+  literal, and adopt the clause body as the new goal.  The step can
+  fail (and sets |ok| to |false|) if there are no clauses to try, or
+  if the first clause fails to match.  On backtracking, |Resolve| is
+  called directly to try the remaining clauses; that matters for
+  tabled relations, which have an action code but also clauses. }
+
+{ |Resolve| -- perform a resolution step with clauses |proc| }
+procedure Resolve;
+  var retry, retry2: clause;
+begin
+  if proc = 0 then
     ok := false
   else begin
-    retry := Search(call, goalframe, mem[proc+2]);
+    if (callkey = 0) or (symtab[mem[call+2]].index = 0) then
+      begin retry := Search(callkey, mem[proc+2]); retry2 := 0 end
+    else
+      Order(mem[proc+5], alt, retry, retry2);
     if (mem[(current)+1] = 0) and (choice < goalframe)
-    and (retry = 0) and (goalframe <> base) then
+    and (retry = 0) and (goalframe <> base) and not pflag then
       TroStep
     else begin
       PushFrame(mem[proc], retry);
-      ok := Unify(call, mem[goalframe+1], mem[proc+3], goalframe);
-      current := (proc+4);
+      mem[goalframe+8] := retry2;
+      ok := Match(call, mem[goalframe+1], proc, goalframe);
+      current := (proc+6);
+      if pflag then begin
+        ptries[mem[call+2]] := ptries[mem[call+2]]+1;
+        if ok then pmatches[mem[call+2]] := pmatches[mem[call+2]]+1
+      end
+    end
+  end;
+  if pflag and not ok then pfails[mem[call+2]] := pfails[mem[call+2]]+1
+end;
+
+{ |Step| -- perform a resolution step }
+procedure Step;
+  var s: symbol; f: frame;
+begin
+  s := mem[call+2];
+  if symtab[s].action = 0 then
+    Resolve
+  else begin
+    f := goalframe;
+    ok := DoBuiltin(symtab[s].action);
+    if pflag then begin
+      { Built-ins that push a frame exit in |Unwind| }
+      if not ok then pfails[s] := pfails[s]+1
+      else if goalframe = f then pexits[s] := pexits[s]+1
     end
   end
 end;
@@ -1515,6 +2312,10 @@ begin
   while (mem[current] = 0) and (goalframe <> base) do begin
     if dflag then begin write('Exit', ': ');
     PrintTerm(mem[mem[goalframe]], mem[goalframe+1], 2); writeln end;
+    if pflag and (mem[goalframe+7] mod 2 = 1) then begin
+      pexits[FrameRel(goalframe)] := pexits[FrameRel(goalframe)]+1;
+      mem[goalframe+7] := mem[goalframe+7] - 1
+    end;
     current := (mem[goalframe])+1;
     if goalframe > choice then lsp := goalframe-1;
     goalframe := mem[goalframe+1]
@@ -1535,10 +2336,17 @@ begin
   Restore;
   current := mem[choice]; goalframe := mem[choice+1];
   call := Deref(mem[current], goalframe);
-  proc := mem[choice+2]; gsp := mem[choice+4];
+  callkey := Key(call, goalframe);
+  proc := mem[choice+2]; alt := mem[choice+8];
+  gsp := mem[choice+4];
+  if gcmark < gsp then gcmark := gsp;
   lsp := choice-1; choice := mem[choice+3];
   if dflag then begin write('Redo', ': ');
     PrintTerm(call, goalframe, 2); writeln end;
+  if pflag then begin
+    predos[mem[call+2]] := predos[mem[call+2]]+1;
+    pgoal := current; pgframe := goalframe
+  end
 end;
 
 { |Resume| is called with |ok = true| when the interpreter starts to
@@ -1564,29 +2372,42 @@ begin
 	WriteString(symtab[mem[call+2]].name);
 	goto 2
       end;
-      proc := Search(call, goalframe, symtab[mem[call+2]].proc)
+      callkey := Key(call, goalframe);
+      FirstClause(call, callkey);
+      if pflag then ProfCall;
+      Step
     end
     else begin
       if choice <= base then goto 2;
-      Backtrack
+      Backtrack; Resolve
     end;
-    Step;
     if ok then Unwind;
-    if gsp - lsp <= GCLOW then Collect
+    if (lsp + (MEMSIZE + 1 - gsp)) + GCLOW >= memlimit then Collect
   end;
 2:
 end;
 
+{ Statistics for the collections made while solving a goal are
+  printed by |GCReport| when the goal is finished.  The times are CPU
+  time in microseconds. }
+var
+  nminor, nmajor: integer;  { collections of each kind }
+  reclaimed: integer;  { words freed }
+  gctime, gcmax: integer;  { total and longest pause }
+
 { |Execute| -- solve a goal by SLD-resolution }
 procedure Execute(g: clause);
   label 2;
 begin
-  lsp := hp; gsp := MEMSIZE+1;
+  lsp := hp; gsp := MEMSIZE+1; gcmark := gsp;
   current := 0; goalframe := 0; choice := 0; trhead := 0;
   PushFrame(mem[g], 0);
-  choice := goalframe; base := goalframe; current := (g+4);
+  choice := goalframe; base := goalframe; current := (g+6);
   mem[base+3] := base;
   run := true; ok := true;
+  nminor := 0; nmajor := 0; reclaimed := 0; gctime := 0; gcmax := 0;
+  ResetTables;
+  if pflag then ResetProfile;
   repeat
     Resume;
     if not run then goto 2;
@@ -1596,6 +2417,8 @@ begin
   until ok;
   writeln; write('yes');
 2:
+  GCReport;
+  if pflag then ProfReport
 end;
 
 {S Built-in relations }
@@ -1638,7 +2461,7 @@ end;
 function DoCut: boolean;
 begin
   choice := mem[goalframe+3];
-  lsp := goalframe + (7 + (mem[goalframe+6])*3) - 1;
+  lsp := goalframe + (9 + (mem[goalframe+6])*3) - 1;
   Commit;
   current := (current)+1;
   DoCut := true
@@ -1654,7 +2477,7 @@ begin
   end
   else begin
     PushFrame(1, 0);
-    mem[(goalframe+7+(1-1)*3)+2] :=
+    mem[(goalframe+9+(1-1)*3)+2] :=
       GloCopy(av[1], mem[goalframe+1]);
     current := callbody;
     DoCall := true
@@ -1673,7 +2496,7 @@ begin
   else begin
     PushFrame(1, 0);
     savebase := base; base := goalframe; choice := goalframe;
-    mem[(goalframe+7+(1-1)*3)+2] :=
+    mem[(goalframe+9+(1-1)*3)+2] :=
       GloCopy(av[1], mem[goalframe+1]);
     current := callbody; ok := true;
     Resume;
@@ -1788,6 +2611,392 @@ begin
   DoNl := true
 end;  
 
+{S Tabling }
+
+{ A tabled relation remembers the answers to each call it receives,
+  so that a repeated call is answered from the table and a recursive
+  call of the same form (a `variant' of the call, the same up to
+  renaming of variables) cannot loop.  The method is linear tabling:
+  when a call is made for which there is no finished table, the
+  clauses for the relation are run to find all answers, each answer
+  is added to the table, and the whole process is repeated until it
+  produces no new answers.  A variant call made during the evaluation
+  gets the answers found so far and no more.  If it was an older call
+  that was still being evaluated, the table for the newer call cannot
+  be finished on its own: it is evaluated only once and left
+  incomplete, and it will be evaluated again if it is called in a
+  later round, but not if it is called again in the same round.  The
+  oldest call it depends on, the `leader', goes on repeating its
+  evaluation until a whole round adds no answer to any table.  Then
+  the leader's table is complete, and so is every table whose
+  evaluation began during the last round; the tables that were
+  evaluated in this way are found on a stack, |tbstack|.  The |dfn|
+  numbers that record the order in which evaluations start tell
+  which tables are old and which are new.
+
+  Tables live in their own array |tmem|, since the heap and stacks
+  are reset after each goal, and they are kept between goals.  Both
+  the variants of calls to a relation and the answers to each call
+  are held in tries, where each term is stored as the sequence of
+  tokens met in a left-to-right walk over it, and variables are
+  numbered in order of first occurrence.  Each trie node has a link
+  to its parent, so that a term can be rebuilt from the node at the
+  end of its path, and the edges from a node to its children are
+  found with a single hash table |triehash|.  The node at the end of
+  a call's path holds the table for that call, and the answers are
+  chained through the nodes at the end of their paths.
+
+  The answers in a table are chained in the order they were found,
+  and they are returned by a hidden relation that walks along the
+  chain, unifying each answer with the call:
+  |$tbl(X, P) :- $get(P, X).| and
+  |$tbl(X, P) :- $next(P, Q), $tbl(X, Q).|  Here |P| and |Q| are
+  integers that point to answers in |tmem|, and |$get/2| and
+  |$next/2| are built in.  Since the end of the chain is only found
+  when |$next| fails, a call of a table that is still being
+  evaluated also sees any answers that are added while it is being
+  answered. }
+
+  { |FUNC|, |INT|, |CHRCTR|, |CELL| or 0 for root }
+  { symbol, value or variable number }
+
+  { table, or next answer }
+
+
+  { state of evaluation }
+  { order of starting evaluation }
+  { oldest table this one depends on }
+  { root of answer trie }
+  { first answer }
+  { last answer }
+  { number of answers }
+  { next on |tbstack| or |NULL| }
+  { 1 if on |tbstack|, 0 if not }
+
+
+{ table states }
+
+
+
+
+var
+  tmem: array [1..TABSIZE] of integer;  { space for tables }
+  tbtop: integer;  { top of |tmem| }
+  triehash: array [1..TRIEHASH] of integer;  { trie edges }
+  nnodes: integer;  { nodes in the hash table }
+  tvar: array [1..TOKMAX] of term;  { variables in a tabled term }
+  ntvar: integer;  { no. of variables so far }
+  tokbuf: array [1..TOKMAX] of pointer;  { path to rebuild a term }
+  ntok: integer;  { no. of tokens in |tokbuf| }
+  fresh: boolean;  { whether |TriePath| made a new path }
+  tbstack: pointer;  { tables that may need completing }
+  evaltbl: pointer;  { table being evaluated or |NULL| }
+  curround: integer;  { value of |ndfn| when the current round began }
+  ntables, nanswers, ndfn: integer;
+  tblbody: pointer;  { dummy clause body for returning answers }
+
+{ |TabAlloc| -- allocate space in |tmem| }
+function TabAlloc(size: integer): pointer;
+begin
+  if tbtop + size > TABSIZE then begin writeln; writeln('Panic: ', 'out of table space'); halt end;
+  TabAlloc := tbtop+1; tbtop := tbtop + size
+end;
+
+{ |NewRoot| -- create the root of a trie }
+function NewRoot: pointer;
+  var p: pointer;
+begin
+  p := TabAlloc(4);
+  tmem[p] := 0; tmem[p+1] := 0;
+  tmem[p+2] := 0; tmem[p+3] := 0;
+  NewRoot := p
+end;
+
+{ |TrieStep| -- find or make the child of |p| for a token }
+function TrieStep(p: pointer; kind, val: integer): pointer;
+  var h: integer; q: pointer;
+begin
+  { Mix the parent, kind and value so that neighbouring edges
+    spread out over the table }
+  h := (p mod TRIEHASH) * 499 mod TRIEHASH;
+  h := (h + kind) * 499 mod TRIEHASH;
+  h := (h + val mod TRIEHASH + TRIEHASH) mod TRIEHASH * 499
+	mod TRIEHASH + 1;
+  q := triehash[h];
+  while (q <> 0) and ((tmem[q+2] <> p) or (tmem[q] <> kind)
+			 or (tmem[q+1] <> val)) do begin
+    h := h-1; if h = 0 then h := TRIEHASH;
+    q := triehash[h]
+  end;
+  if q = 0 then begin
+    if nnodes >= (TRIEHASH div 10) * 9 then
+      begin writeln; writeln('Panic: ', 'out of table space'); halt end;
+    q := TabAlloc(4);
+    tmem[q] := kind; tmem[q+1] := val;
+    tmem[q+2] := p; tmem[q+3] := 0;
+    triehash[h] := q; nnodes := nnodes+1; fresh := true
+  end;
+  TrieStep := q
+end;
+
+{ |TrieTerm| -- follow or make the path in a trie for a term }
+function TrieTerm(p: pointer; t: term; e: frame): pointer;
+  var i: integer;
+begin
+  ntok := ntok+1;
+  if ntok > TOKMAX then begin writeln; writeln('Panic: ', 'term too big to table'); halt end;
+  t := Deref(t, e);
+  case mem[t] div 256 of
+  1:
+    begin
+      p := TrieStep(p, 1, mem[t+2]);
+      for i := 1 to symtab[mem[t+2]].arity do
+	p := TrieTerm(p, mem[t+i+2], e)
+    end;
+  2:
+    p := TrieStep(p, 2, mem[t+2]);
+  3:
+    p := TrieStep(p, 3, mem[t+2]);
+  4:
+    begin
+      i := 1;
+      while (i <= ntvar) and (tvar[i] <> t) do i := i+1;
+      if i > ntvar then begin ntvar := i; tvar[i] := t end;
+      p := TrieStep(p, 4, i)
+    end
+  else
+    begin writeln; writeln('Panic: ', 'bad tag ', mem[t] div 256:1, ' in ', 'TrieTerm'); halt end
+  end;
+  TrieTerm := p
+end;
+
+{ |TriePath| -- find the path in a trie for a whole term }
+function TriePath(root: pointer; t: term; e: frame): pointer;
+begin
+  ntvar := 0; ntok := 0; fresh := false;
+  TriePath := TrieTerm(root, t, e)
+end;
+
+{ |Rebuild| -- build the term for the tokens in |tokbuf| }
+function Rebuild: term;
+  var t: term; p: pointer; i, n: integer;
+begin
+  p := tokbuf[ntok]; ntok := ntok-1;
+  case tmem[p] of
+  1:
+    begin
+      n := symtab[tmem[p+1]].arity;
+      t := GloAlloc(1, 3+n);
+      mem[t+2] := tmem[p+1];
+      for i := 1 to n do mem[t+i+2] := Rebuild
+    end;
+  2:
+    t := NewInt(tmem[p+1]);
+  3:
+    begin
+      t := GloAlloc(3, 3);
+      mem[t+2] := tmem[p+1]
+    end;
+  4:
+    if tmem[p+1] <= ntvar then
+      t := tvar[tmem[p+1]]
+    else begin
+      t := GloAlloc(4, 3);
+      mem[t+2] := 0;
+      ntvar := tmem[p+1]; tvar[ntvar] := t
+    end
+  else
+    begin writeln; writeln('Panic: ', 'bad tag ', tmem[p]:1, ' in ', 'Rebuild'); halt end
+  end;
+  Rebuild := t
+end;
+
+{ |TrieValue| -- rebuild the term whose path ends at |p| }
+function TrieValue(p: pointer): term;
+begin
+  ntok := 0;
+  while tmem[p] <> 0 do
+    begin ntok := ntok+1; tokbuf[ntok] := p; p := tmem[p+2] end;
+  ntvar := 0;
+  TrieValue := Rebuild
+end;
+
+{ |FindTable| -- find or make the table for a call }
+function FindTable(t: term; e: frame): pointer;
+  var s: symbol; p, tb: pointer;
+begin
+  s := mem[t+2];
+  if symtab[s].table = 0 then symtab[s].table := NewRoot;
+  p := TriePath(symtab[s].table, t, e);
+  if tmem[p+3] = 0 then begin
+    tb := TabAlloc(9);
+    tmem[tb] := 1; tmem[tb+1] := 0; tmem[tb+2] := 0;
+    tmem[tb+3] := NewRoot;
+    tmem[tb+4] := 0; tmem[tb+5] := 0;
+    tmem[tb+6] := 0; tmem[tb+7] := 0; tmem[tb+8] := 0;
+    tmem[p+3] := tb; ntables := ntables+1
+  end;
+  FindTable := tmem[p+3]
+end;
+
+{ |AddAnswer| -- add an answer to a table if it is new }
+procedure AddAnswer(tb: pointer; t: term);
+  var p: pointer;
+begin
+  p := TriePath(tmem[tb+3], t, 0);
+  if fresh then begin
+    if tmem[tb+5] = 0 then
+      tmem[tb+4] := p
+    else
+      tmem[tmem[tb+5]+3] := p;
+    tmem[tb+5] := p;
+    tmem[tb+6] := tmem[tb+6]+1; nanswers := nanswers+1
+  end
+end;
+
+{ |RunClauses| -- find all answers from the clauses for |call| }
+procedure RunClauses(tb: pointer);
+  var savebase: frame; savegoal: pointer; savegframe: frame;
+begin
+  savegoal := pgoal; savegframe := pgframe;
+  PushFrame(1, 0);
+  savebase := base; base := goalframe; choice := goalframe;
+  mem[(goalframe+9+(1-1)*3)+2] :=
+    GloCopy(call, mem[goalframe+1]);
+  current := callbody;
+  call := Deref(mem[current], goalframe);
+  callkey := Key(call, goalframe);
+  FirstClause(call, callkey);
+  Resolve;
+  if ok then Unwind;
+  Resume;
+  while ok and run do begin
+    AddAnswer(tb, Deref((base+9+(1-1)*3), 0));
+    ok := false; Resume
+  end;
+
+  { Undo everything, as if the goal had failed }
+  choice := base; Restore;
+  gsp := mem[base+4];
+  if gcmark < gsp then gcmark := gsp;
+  choice := mem[base+3]; goalframe := mem[base+1];
+  current := mem[base]; lsp := base-1; base := savebase;
+  call := Deref(mem[current], goalframe);
+  pgoal := savegoal; pgframe := savegframe
+end;
+
+{ |Complete| -- pop tables down to leader |tb| evaluated from |last| }
+procedure Complete(tb: pointer; last: integer);
+  var popped: boolean; x: pointer;
+begin
+  popped := false;
+  while not popped do begin
+    x := tbstack; tbstack := tmem[x+7];
+    tmem[x+7] := 0; tmem[x+8] := 0;
+    if (x = tb) or (tmem[x+1] > last) then
+      tmem[x] := 3
+    else
+      begin tmem[x] := 1; tmem[x+1] := 0 end;
+    popped := (x = tb)
+  end
+end;
+
+{ |Evaluate| -- evaluate a tabled call until no more answers appear }
+procedure Evaluate(tb: pointer);
+  var outer: pointer; before, last, outround: integer;
+begin
+  outer := evaltbl; evaltbl := tb; outround := curround;
+  if tmem[tb+8] = 0 then begin
+    tmem[tb+7] := tbstack; tbstack := tb; tmem[tb+8] := 1
+  end;
+  ndfn := ndfn+1; tmem[tb+1] := ndfn; tmem[tb+2] := ndfn;
+  tmem[tb] := 2;
+  repeat
+    before := nanswers; last := ndfn; curround := last;
+    RunClauses(tb)
+  until (nanswers = before) or (tmem[tb+2] < tmem[tb+1]) or not run;
+  tmem[tb] := 1;
+  if run and (tmem[tb+2] = tmem[tb+1]) then Complete(tb, last);
+  evaltbl := outer; curround := outround;
+  if outer <> 0 then
+    if tmem[tb+2] < tmem[outer+2] then tmem[outer+2] := tmem[tb+2]
+end;
+
+{ |DoTable| -- call a tabled relation }
+function DoTable: boolean;
+  var tb: pointer;
+begin
+  tb := FindTable(call, goalframe);
+  if tmem[tb] = 2 then begin
+    if tmem[tb+1] < tmem[evaltbl+2] then tmem[evaltbl+2] := tmem[tb+1]
+  end
+  else if tmem[tb] = 1 then begin
+    if (evaltbl = 0) or (tmem[tb+1] <= curround) then
+      Evaluate(tb)
+    else if tmem[tb+2] < tmem[evaltbl+2] then
+      tmem[evaltbl+2] := tmem[tb+2]
+  end;
+
+  if (not run) or (tmem[tb+4] = 0) then
+    DoTable := false
+  else begin
+    PushFrame(2, 0);
+    mem[(goalframe+9+(1-1)*3)+2] :=
+      GloCopy(call, mem[goalframe+1]);
+    mem[(goalframe+9+(2-1)*3)+2] := NewInt(tmem[tb+4]);
+    current := tblbody;
+    DoTable := true
+  end
+end;
+
+{ |DoTblGet| -- hidden relation |$get/2| }
+function DoTblGet: boolean;
+begin
+  GetArgs;
+  current := (current)+1;
+  DoTblGet := Unify(av[2], goalframe, TrieValue(mem[av[1]+2]), 0)
+end;
+
+{ |DoTblNext| -- hidden relation |$next/2| }
+function DoTblNext: boolean;
+  var p: pointer;
+begin
+  GetArgs;
+  current := (current)+1;
+  p := tmem[mem[av[1]+2]+3];
+  if p = 0 then
+    DoTblNext := false
+  else
+    DoTblNext := Unify(av[2], goalframe, NewInt(p), 0)
+end;
+
+{ |ResetTables| -- abandon evaluations cut short by an error }
+procedure ResetTables;
+  var tb: pointer;
+begin
+  while tbstack <> 0 do begin
+    tb := tbstack; tbstack := tmem[tb+7];
+    tmem[tb] := 1; tmem[tb+1] := 0;
+    tmem[tb+7] := 0; tmem[tb+8] := 0
+  end;
+  evaltbl := 0; curround := ndfn
+end;
+
+{ |DoStats| -- built-in relation |stats/0| }
+function DoStats: boolean;
+begin
+  writeln;
+  writeln('heap ', hp:1, ', local ', lsp-hp:1, ', global ',
+    MEMSIZE+1-gsp:1, ', limit ', memlimit:1, ' words (raised ',
+    nexpand:1, ' times)');
+  writeln('strings ', charptr:1, ' chars, ', nsymbols:1,
+    ' symbols, hash table ', hashsize:1);
+  write('tables ', ntables:1, ', answers ', nanswers:1, ', trie nodes ',
+    nnodes:1, ', table space ', tbtop:1, ' words');
+  current := (current)+1;
+  DoStats := true
+end;
+
 { |DoBuiltin| -- switch for built-in relations }
 function DoBuiltin ;
 begin
@@ -1802,7 +3011,11 @@ begin
   8: DoBuiltin := DoEqual;
   9:	    DoBuiltin := false;
   10:    DoBuiltin := DoPrint;
-  11:	    DoBuiltin := DoNl
+  11:	    DoBuiltin := DoNl;
+  12:    DoBuiltin := DoStats;
+  13:   DoBuiltin := DoTable;
+  14:   DoBuiltin := DoTblGet;
+  15:  DoBuiltin := DoTblNext
   else
     begin writeln; writeln('Panic: ', 'bad tag ', action:1, ' in ', 'DoBuiltin'); halt end
   end
@@ -1837,9 +3050,25 @@ end;
   execution is abandoned without much grace.  This plan works
   because the amount of space consumed in a resolution step is
   bounded by the maximum size of a program clause; this size is not
-  checked, though. }
+  checked, though.
+
+  Most terms die young, so most collections are `minor' ones that
+  deal only with the part of the global stack below |gcmark|, which
+  holds the terms made since the last collection.  Everything above
+  |gcmark| is taken to be alive and is left where it is; the only
+  pointers from there into the young part are bindings of old cells,
+  and these are found from the newer part of the trail.  If a minor
+  collection does not free enough space, it is followed by a `major'
+  one over the whole global stack.  Either way, the survivors become
+  old.  The variable |gctop| marks the top of the part being
+  collected, so that all the phases below serve for both kinds. }
+
+var
+  shift: integer;  { amount global stack will shift }
+  gctop: pointer;  { top of the region being collected }
+
+{ |in_gc| -- test if a pointer is in the region being collected }
 
-var shift: integer;  { amount global stack will shift }
 
 { |Visit| -- recursively mark a term and all its sub-terms }
 procedure Visit(t: term);
@@ -1850,7 +3079,7 @@ begin
     treating the last argument of a function iteratively, making
     recursive calls only for the other arguments. }
   while t <> 0 do begin
-    if not (t >= gsp) or (mem[t] mod 256 >= 128) then goto 2;
+    if not ((t >= gsp) and (t < gctop)) or (mem[t] mod 256 >= 128) then goto 2;
     mem[t] := mem[t] + 128;
     case mem[t] div 256 of
     1:
@@ -1878,9 +3107,20 @@ begin
   f := hp+1;
   while f <= lsp do begin
     for i := 1 to mem[f+6] do
-      if mem[(f+7+(i-1)*3)] div 256 = 4 then
-	Visit(mem[(f+7+(i-1)*3)+2]);
-    f := f + (7 + (mem[f+6])*3)
+      if mem[(f+9+(i-1)*3)] div 256 = 4 then
+	Visit(mem[(f+9+(i-1)*3)+2]);
+    f := f + (9 + (mem[f+6])*3)
+  end
+end;
+
+{ |MarkOld| -- mark the values of old cells bound since the last GC }
+procedure MarkOld;
+  var p: trail;
+begin
+  p := trhead;
+  while (p <> 0) and (p < gctop) do begin
+    if mem[p+2] >= gctop then Visit(mem[mem[p+2]+2]);
+    p := mem[p+3]
   end
 end;
 
@@ -1888,9 +3128,9 @@ end;
 procedure CullTrail(var p: trail);
   label 2;
 begin
-  while p <> 0 do begin
+  while (p <> 0) and (p < gctop) do begin
     if mem[p+2] <> 0 then
-      if not (mem[p+2] >= gsp) or (mem[mem[p+2]] mod 256 >= 128) then
+      if not ((mem[p+2] >= gsp) and (mem[p+2] < gctop)) or (mem[mem[p+2]] mod 256 >= 128) then
 	goto 2;
     p := mem[p+3]
   end;
@@ -1902,27 +3142,47 @@ procedure MarkTrail;
   var p: trail;
 begin
   CullTrail(trhead); p := trhead;
-  while p <> 0 do
+  while (p <> 0) and (p < gctop) do
     begin mem[p] := mem[p] + 128; CullTrail(mem[p+3]); p := mem[p+3] end
 end;
 
+{ The shift is recorded only in marked blocks.  In each unmarked
+  block, |Relocate| leaves instead the address of the next marked
+  block above it, so that |AdjustStack| can find the new value of
+  each |f_glotop| field without searching.  The unmarked blocks that
+  are waiting for the next marked block are chained together through
+  the same field. }
+
+{ |Forward| -- point a chain of unmarked blocks at |p| }
+procedure Forward(q, p: pointer);
+  var r: pointer;
+begin
+  while q <> 0 do
+    begin r := mem[q+1]; mem[q+1] := p; q := r end
+end;
+
 { |Relocate| -- compute shifts }
 procedure Relocate;
-  var p: pointer; step: integer;
+  var p, q: pointer; step: integer;
 begin
-  shift := 0; p := gsp;
-  while p <= MEMSIZE do begin
-    step := mem[p] mod 128; mem[p+1] := shift;
-    if not (mem[p] mod 256 >= 128) then
+  shift := 0; p := gsp; q := 0;
+  while p < gctop do begin
+    step := mem[p] mod 128;
+    if (mem[p] mod 256 >= 128) then
+      begin mem[p+1] := shift; Forward(q, p); q := 0 end
+    else begin
       shift := shift + step;
+      mem[p+1] := q; q := p
+    end;
     p := p + step
-  end
+  end;
+  Forward(q, gctop)
 end;
 
 { |AdjustPointer| -- update a pointer}
 procedure AdjustPointer(var p: term);
 begin
-  if (p <> 0) and (p >= gsp) then begin
+  if (p <> 0) and ((p >= gsp) and (p < gctop)) then begin
     if not (mem[p] mod 256 >= 128) then
       begin writeln; writeln('Panic: ', 'adjusting pointer to unmarked block'); halt end;
     p := p + shift - mem[p+1]
@@ -1931,33 +3191,43 @@ end;
 
 { |AdjustStack| -- adjust pointers in local stack }
 procedure AdjustStack;
-  var f: frame; i: integer; q: pointer;
-  label 1, 4;
+  var f: frame; i: integer; q, r, r2: pointer;
 begin
   f := hp+1;
   while f <= lsp do begin
     q := mem[f+4];
-    while q <= MEMSIZE do begin
-      if (mem[q] mod 256 >= 128) then goto 1;
-      q := q + mem[q] mod 128
-    end;
-  1:
-    if q <= MEMSIZE then AdjustPointer(q);
+    if (q < gctop) and not (mem[q] mod 256 >= 128) then q := mem[q+1];
+    AdjustPointer(q);
     mem[f+4] := q;
 
+    { Find the first live trail entry, then make the dead ones that
+      were passed over point straight to it, so that frames further
+      up need not follow the same path. }
     q := mem[f+5];
-    while q <> 0 do begin
-      if (mem[q] mod 256 >= 128) then goto 4;
-      q := mem[q+3]
-    end;
-  4:
+    while (q <> 0) and (q < gctop) and not (mem[q] mod 256 >= 128) do
+      q := mem[q+3];
+    r := mem[f+5];
+    while r <> q do
+      begin r2 := mem[r+3]; mem[r+3] := q; r := r2 end;
     AdjustPointer(q);
     mem[f+5] := q;
 
     for i := 1 to mem[f+6] do
-      if mem[(f+7+(i-1)*3)] div 256 = 4 then
-	AdjustPointer(mem[(f+7+(i-1)*3)+2]);
-    f := f + (7 + (mem[f+6])*3);
+      if mem[(f+9+(i-1)*3)] div 256 = 4 then
+	AdjustPointer(mem[(f+9+(i-1)*3)+2]);
+    f := f + (9 + (mem[f+6])*3);
+  end
+end;
+
+{ |AdjustOld| -- update pointers from old cells }
+procedure AdjustOld;
+  var p: trail;
+begin
+  { This must come first, while the trail links are unchanged }
+  p := trhead;
+  while (p <> 0) and (p < gctop) do begin
+    if mem[p+2] >= gctop then AdjustPointer(mem[mem[p+2]+2]);
+    p := mem[p+3]
   end
 end;
 
@@ -1966,7 +3236,7 @@ procedure AdjustInternal;
   var p, i: integer;
 begin
   p := gsp;
-  while p <= MEMSIZE do begin
+  while p < gctop do begin
     if (mem[p] mod 256 >= 128) then begin
       case mem[p] div 256 of
       1:
@@ -1994,7 +3264,7 @@ procedure Compact;
   var p, q, step, i: integer;
 begin
   p := gsp; q := gsp;
-  while p <= MEMSIZE do begin
+  while p < gctop do begin
     step := mem[p] mod 128;
     if (mem[p] mod 256 >= 128) then begin mem[p] := mem[p] - 128;
       for i := 0 to step-1 do mem[q+i] := mem[p+i];
@@ -2003,39 +3273,170 @@ begin
     p := p + step
   end;
   gsp := gsp+shift;
-  for i := MEMSIZE downto gsp do mem[i] := mem[i-shift];
+  for i := gctop-1 downto gsp do mem[i] := mem[i-shift];
 end;
 
-{ |Collect| -- collect garbage }
-procedure Collect;
+{ |Sweep| -- collect garbage below |top| }
+procedure Sweep(top: pointer);
 begin
-  write('[gc'); flush;
+  gctop := top;
 
   { Phase 1: marking }
-  Visit(call); MarkStack; MarkTrail;
+  Visit(call); MarkStack; MarkOld; MarkTrail;
 
   { Phase 2: compute new locations }
   Relocate;
 
   { Phase 3: adjust pointers }
-  AdjustPointer(call); AdjustPointer(trhead);
+  AdjustOld; AdjustPointer(call); AdjustPointer(trhead);
   AdjustStack; AdjustInternal;
 
   { Phase 4: compact }
-  Compact;
+  Compact
+end;
+
+{ |Collect| -- collect garbage }
+procedure Collect;
+  var start, before: integer;
+begin
+  write('[gc'); flush;
+  start := cputime; before := gsp;
+
+  if gcmark <= MEMSIZE then
+    begin Sweep(gcmark); nminor := nminor+1 end;
+  if (gcmark > MEMSIZE) or ((lsp + (MEMSIZE + 1 - gsp)) + GCHIGH > memlimit) then
+    begin Sweep(MEMSIZE+1); nmajor := nmajor+1 end;
+  gcmark := gsp;
+
+  reclaimed := reclaimed + gsp - before;
+  start := Elapsed(start);
+  if gctime > CLOCKMAX - start then gctime := CLOCKMAX  { clamp }
+  else gctime := gctime + start;
+  if start > gcmax then gcmax := start;
 
   write(']'); flush;
-  if gsp - lsp <= GCHIGH then begin writeln; write('Error: ', 'out of memory space'); run := false end
+  Expand((lsp + (MEMSIZE + 1 - gsp)) + GCHIGH);
+  if (lsp + (MEMSIZE + 1 - gsp)) + GCHIGH > memlimit then begin writeln; write('Error: ', 'out of memory space'); run := false end
+end;
+
+{ |GCReport| -- print statistics for collections during a goal }
+procedure GCReport;
+begin
+  if nminor + nmajor > 0 then begin
+    writeln;
+    write('[gc: ', nminor:1, ' minor, ', nmajor:1, ' major, ',
+      reclaimed:1, ' words reclaimed, ', gctime:1, ' us, longest ',
+      gcmax:1, ' us]')
+  end
+end;
+
+{S Program images }
+
+{ The state of picoProlog after it has read a program can be saved
+  in an image file with the option `|-s file|', and loaded again with
+  `|-l file|', much faster than the program could be read.  The state
+  is made up of the heap, which holds the clauses with their indexes
+  and compiled heads, together with the string buffer and the symbol
+  table; the stacks are empty between goals.  Tables are kept from
+  one goal to the next, but an image is saved after the program has
+  been read and before any goal has run, so there are none yet:
+  |tmem| is left out of the image on purpose, every |s_table| in it
+  is |NULL|, and a program loaded from an image starts with no tables,
+  just as one that is read.  Each part is written as a single block of
+  words.  |Initialize| makes the same built-in symbols and heap nodes
+  every time, so the global variables that point to them are still
+  right after an image is loaded, and the header of the image
+  records how far it went, so that an image made by a different
+  version of picoProlog is refused.  The compiled heads are part of
+  the heap too, so if the image is loaded with `-i' they are thrown
+  away by |DropCode|, and every clause is matched with |Unify| just
+  as if the program had been read with `-i'. }
+
+var
+  inithp, initsyms: integer;  { state after |Initialize| }
+  imghead: array [1..IMGHEAD] of integer;  { header for an image }
+  imgfile: text;  { the image file }
+  loadname, savename: tempstring;  { names from the command line }
+  loading, saving: boolean;  { whether they were given }
+
+{ |SaveImage| -- save the program in an image file }
+procedure SaveImage;
+  var good: boolean;
+begin
+  imghead[1] := IMGMAGIC; imghead[2] := inithp;
+  imghead[3] := initsyms; imghead[4] := MEMSIZE;
+  imghead[5] := 9; imghead[6] := hp;
+  imghead[7] := charptr; imghead[8] := nsymbols;
+  imghead[9] := hashsize; imghead[10] := memlimit;
+  good := openout(imgfile, savename);
+  if good then begin
+    good := putblock(imgfile, imghead, IMGHEAD)
+      and putblock(imgfile, mem, hp)
+      and putblock(imgfile, charbuf, charptr)
+      and putblock(imgfile, symtab, nsymbols)
+      and putblock(imgfile, hashtab, hashsize);
+    closeout(imgfile)
+  end;
+  if not good then begin
+    write('Can''t write '); WriteTemp(savename); writeln;
+    halt
+  end;
+  write('Saved '); WriteTemp(savename); writeln
+end;
+
+{ |DropCode| -- forget the compiled heads of every clause }
+procedure DropCode;
+  var i: integer; c: clause;
+begin
+  for i := 1 to nsymbols do begin
+    c := symtab[i].proc;
+    while c <> 0 do
+      begin mem[c+4] := 0; c := mem[c+2] end
+  end
+end;
+
+{ |LoadImage| -- load a program from an image file }
+procedure LoadImage;
+  var good: boolean;
+begin
+  good := openin(imgfile, loadname);
+  if good then begin
+    good := getblock(imgfile, imghead, IMGHEAD);
+    if good then
+      good := (imghead[1] = IMGMAGIC) and (imghead[2] = inithp)
+        and (imghead[3] = initsyms) and (imghead[4] = MEMSIZE)
+        and (imghead[5] = 9) and (imghead[6] < MEMSIZE div 2)
+        and (imghead[7] <= MAXCHARS) and (imghead[8] <= MAXSYMBOLS)
+        and (imghead[9] <= MAXHASH);
+    if good then begin
+      hp := imghead[6]; charptr := imghead[7];
+      nsymbols := imghead[8]; hashsize := imghead[9];
+      if memlimit < imghead[10] then memlimit := imghead[10];
+      good := getblock(imgfile, mem, hp)
+        and getblock(imgfile, charbuf, charptr)
+        and getblock(imgfile, symtab, nsymbols)
+        and getblock(imgfile, hashtab, hashsize)
+    end;
+    closein(imgfile)
+  end;
+  if not good then begin
+    write('Can''t load '); WriteTemp(loadname); writeln;
+    halt
+  end;
+  if not cflag then DropCode;
+  write('Loaded '); WriteTemp(loadname); writeln
 end;
 
 {S Main program }
 
 { |Initialize| -- initialize everything }
 procedure Initialize;
-  var i: integer; p: term;
+  var i: integer; p: term; body: argbuf;
 begin
-  dflag := false; errcount := 0;
+  dflag := false; cflag := true; pflag := false; errcount := 0;
+  batching := false;
   pbchar := chr(127); charptr := 0;
+  memlimit := MEMINIT; nexpand := 0;
   hp := 0; InitSymbols;
 
   { Set up the |refnode| array }
@@ -2048,7 +3449,23 @@ begin
   { The dummy clause $\it call(\sci p) \IF p$ is used by |call/1|. }
   callbody := HeapAlloc(2);
   mem[callbody] := MakeRef(1);
-  mem[(callbody)+1] := 0
+  mem[(callbody)+1] := 0;
+
+  { Tables start empty, and answers are returned by |$tbl/2| }
+  tbtop := 0; nnodes := 0; tbstack := 0; evaltbl := 0;
+  ntables := 0; nanswers := 0; ndfn := 0; curround := 0;
+  for i := 1 to TRIEHASH do triehash[i] := 0;
+  body[1] := MakeNode(tblget, MakeRef(2), MakeRef(1));
+  AddClause(MakeClause(2, MakeNode(tblsym, MakeRef(1), MakeRef(2)),
+    body, 1));
+  body[1] := MakeNode(tblnext, MakeRef(2), MakeRef(3));
+  body[2] := MakeNode(tblsym, MakeRef(1), MakeRef(3));
+  AddClause(MakeClause(3, MakeNode(tblsym, MakeRef(1), MakeRef(2)),
+    body, 2));
+  tblbody := HeapAlloc(2);
+  mem[tblbody] := MakeNode(tblsym, MakeRef(1), MakeRef(2));
+  mem[(tblbody)+1] := 0;
+  inithp := hp; initsyms := nsymbols
 end;
 
 { |ReadFile| -- read and process clauses from an open file }
@@ -2074,20 +3491,226 @@ begin
   until c = 0
 end;
 
+{ In batch mode, selected by the option `|-b file|', the queries
+  are read from a file instead of the terminal, one per clause in the
+  same form as they would be typed at the prompt, and all answers to
+  each are shown.  The queries are independent, so they can be
+  answered in parallel: after the program has been read, the batch
+  file is read once to check it and to note where each query starts,
+  and then the interpreter forks |njobs| worker processes (set with
+  `|-j n|').  The workers share the program database copy-on-write
+  and each has its own stacks, so nothing is copied in advance.
+
+  The queries are handed out one at a time from a counter that the
+  workers share, so a worker that has finished a quick query goes on
+  to the next one while another is still busy with a slow one, and
+  each worker reads only the queries it takes, going straight to each
+  of them with |seekin|.  The answers to each query go to a temporary
+  file of its own; when all the workers are finished, the files are
+  copied to the output in order, so the result is the same as
+  answering the queries one by one.  If the counter can't be shared
+  or no worker can be started, the queries are answered in the parent
+  instead.  Each query is echoed before its answers with the variable
+  names from the file, so that the output can be matched up with the
+  input. }
+
+var
+  batch: boolean;  { whether in batch mode }
+  batchfile: tempstring;  { name of the batch file }
+  njobs: integer;  { number of worker processes }
+  jobbase: tempstring;  { prefix for the output files }
+  qstart: pointer;  { where each query starts: position and line }
+
+{ |EchoQuery| -- print goal |c| with the names from |vartable| }
+procedure EchoQuery(c: clause);
+  var f: frame; p: term; i: integer;
+begin
+  { Bind each variable to an atom that is its name }
+  f := HeapAlloc((9 + (nvars)*3));
+  for i := 1 to nvars do begin
+    p := HeapAlloc(3);
+    mem[p] := 256 * 1 + 3;
+    mem[p+2] := vartable[i];
+    mem[(f+9+(i-1)*3)] := 256 * 4 + 3;
+    mem[(f+9+(i-1)*3)+2] := p
+  end;
+
+  write('# :- ');
+  i := 1;
+  while mem[(c+6)+i-1] <> 0 do begin
+    if i > 1 then write(', ');
+    PrintTerm(mem[(c+6)+i-1], f, 2);
+    i := i+1
+  end;
+  writeln('.')
+end;
+
+{ |Answer| -- echo a query and show all its answers }
+procedure Answer(c: clause);
+begin
+  EchoQuery(c);
+  Execute(c);
+  writeln; writeln
+end;
+
+{ |OpenBatch| -- open the batch file for reading queries }
+procedure OpenBatch;
+begin
+  if not openin(infile, batchfile) then begin
+    write('Can''t read '); WriteString(filename); writeln;
+    halt
+  end;
+  lineno := 1; pbchar := chr(127); batching := true
+end;
+
+{ |ScanBatch| -- read the batch file, noting where each query
+  starts, and return the number of queries; if |solve| is true, also
+  answer them }
+function ScanBatch(solve: boolean): integer;
+  var c: clause; n, pos, line: integer; p: pointer;
+begin
+  OpenBatch; qstart := hp+1; n := 0;
+  repeat
+    pos := inpos(infile); line := lineno;
+    hmark := hp;
+    c := ReadClause;
+    if c <> 0 then begin
+      if solve then Answer(c);
+      hp := hmark; p := HeapAlloc(2);
+      mem[p] := pos; mem[p+1] := line; n := n+1
+    end
+  until c = 0;
+  closein(infile); batching := false;
+  ScanBatch := n
+end;
+
+{ |JobName| -- name of the output file for query |n| }
+procedure JobName(n: integer; var name: tempstring);
+  var i, j: integer;
+begin
+  i := 1;
+  while jobbase[i] <> chr(0) do
+    begin name[i] := jobbase[i]; i := i+1 end;
+  name[i] := '.';
+  j := 1;
+  while j <= n div 10 do j := 10 * j;
+  repeat
+    i := i+1; name[i] := chr(ord('0') + n div j mod 10);
+    j := j div 10
+  until j = 0;
+  name[i+1] := chr(0)
+end;
+
+{ |Worker| -- answer queries from the shared counter until there
+  are none left }
+procedure Worker(nquery: integer);
+  var n: integer; c: clause; name: tempstring;
+begin
+  OpenBatch; n := nextjob;
+  while n < nquery do begin
+    JobName(n, name);
+    if openout(output, name) then begin
+      seekin(infile, mem[qstart+2*n]); lineno := mem[qstart+2*n+1];
+      pbchar := chr(127); hmark := hp;
+      c := ReadClause;
+      if c <> 0 then Answer(c);
+      hp := hmark
+    end;
+    n := nextjob
+  end;
+  closein(infile); batching := false
+end;
+
+{ |CopyFile| -- copy a file to the output }
+procedure CopyFile(var name: tempstring);
+  var ch: char;
+begin
+  if openin(infile, name) then begin
+    ch := FGetChar(infile);
+    while ch <> chr(127) do begin
+      if ch = chr(10) then writeln else write(ch);
+      ch := FGetChar(infile)
+    end;
+    closein(infile)
+  end
+end;
+
+{ |RunBatch| -- answer the queries in the batch file }
+procedure RunBatch;
+  var nquery, i, k, n, pid: integer; shared, parent: boolean;
+    name: tempstring;
+begin
+  filename := SaveString(batchfile);
+  nquery := ScanBatch(false);
+  if errcount > 0 then halt;
+  if njobs > nquery then njobs := nquery;
+
+  i := 0; k := 0; parent := true;
+  shared := newjobs;
+  if shared then begin
+    tempname(jobbase);
+    while parent and (i < njobs) do begin
+      i := i+1; pid := spawn;
+      if pid > 0 then k := k+1;
+      parent := (pid <> 0)
+    end
+  end;
+
+  if not parent then
+    { A worker answers queries until there are none left, and stops }
+    Worker(nquery)
+  else begin
+    if k = 0 then
+      nquery := ScanBatch(true)
+    else begin
+      waitall;
+      for n := 0 to nquery-1 do begin
+        JobName(n, name);
+        CopyFile(name); removefile(name)
+      end
+    end;
+    if shared then removefile(jobbase)
+  end
+end;
+
 { |ReadProgram| -- read files listed on command line }
 procedure ReadProgram;
   var i0, i: integer;
     arg: tempstring;
-begin
-  i0 := 1;
-  if argc > 1 then begin
-    argv(1, arg);
-    if (arg[1] = '-') and (arg[2] = 'd')
-	and (arg[3] = chr(0)) then begin
-      dflag := true;
-      i0 := i0+1
+    more: boolean;
+begin
+  batch := false; njobs := JOBS; loading := false; saving := false;
+  i0 := 1; more := true;
+  while more and (i0 < argc) do begin
+    argv(i0, arg);
+    if (arg[1] <> '-') or (arg[2] = chr(0)) or (arg[3] <> chr(0)) then
+      more := false
+    else if arg[2] = 'd' then
+      dflag := true
+    else if arg[2] = 'i' then
+      cflag := false
+    else if (arg[2] = 'l') and (i0+1 < argc) then
+      begin i0 := i0+1; argv(i0, loadname); loading := true end
+    else if (arg[2] = 's') and (i0+1 < argc) then
+      begin i0 := i0+1; argv(i0, savename); saving := true end
+    else if (arg[2] = 'p') and (i0+1 < argc) then
+      begin i0 := i0+1; argv(i0, profname); pflag := true end
+    else if (arg[2] = 'b') and (i0+1 < argc) then
+      begin i0 := i0+1; argv(i0, batchfile); batch := true end
+    else if (arg[2] = 'j') and (i0+1 < argc) then begin
+      i0 := i0+1; argv(i0, arg);
+      njobs := 0; i := 1;
+      while ((arg[i] >= '0') and (arg[i] <= '9')) do begin
+        njobs := 10 * njobs + (ord(arg[i]) - ord('0')); i := i+1
+      end;
+      if njobs < 1 then njobs := 1;
+      if njobs > MAXJOBS then njobs := MAXJOBS
     end
+    else
+      more := false;
+    if more then i0 := i0+1
   end;
+  if loading then LoadImage;
   for i := i0 to argc-1 do begin
     argv(i, arg);
     filename := SaveString(arg);
@@ -2106,7 +3729,13 @@ begin  { main program }
   writeln('Welcome to picoProlog');
   Initialize;
   interacting := false; ReadProgram;
-  interacting := true; lineno := 1; ReadFile;
-  writeln;
+  if saving then
+    SaveImage
+  else if batch then
+    RunBatch
+  else begin
+    interacting := true; lineno := 1; ReadFile;
+    writeln
+  end;
 999:
 end.
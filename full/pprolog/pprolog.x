@@ -14,15 +14,39 @@
 program &picoProlog(input, output);
 
 { tunable parameters }
+
+{ The big arrays |mem|, |charbuf| and |symtab| are sized generously,
+  because their sizes are only a reservation of address space: the
+  operating system commits pages to them as they are first touched.
+  What is actually used is governed by the smaller starting sizes
+  below, which grow as the program needs them. }
 const
-  &MAXSYMBOLS = 511;  { max no. of symbols }
+  &MAXSYMBOLS = 1048576;  { max no. of symbols }
+  &MAXHASH = 2097152;  { max size of symbol hash table }
+  &HASHINIT = 512;  { initial size of symbol hash table }
   &HASHFACTOR = 90;  { percent loading factor for hash table }
-  &MAXCHARS = 2048;  { max chars in symbols }
+  &MAXCHARS = 16777216;  { max chars in symbols }
   &MAXSTRING = 128;  { max string length }
   &MAXARITY = 63;  { max arity of function, vars in clause }
-  &MEMSIZE = 1000000;  { size of |mem| array }
+  &MEMSIZE = 134217728;  { size of |mem| array }
+  &MEMINIT = 1000000;  { initial limit on use of |mem| }
   &GCLOW = 10000;  { call GC when this much space left }
   &GCHIGH = 50000;  { GC must find this much space }
+  &INDEXMIN = 8;  { index relations with this many clauses }
+  &INDEXSLOTS = 16;  { initial size of an index }
+  &TABSIZE = 16777216;  { size of |tmem| array for tables }
+  &TRIEHASH = 4194301;  { size of hash table for trie edges (prime) }
+  &TOKMAX = 65536;  { max size of a tabled term }
+  &VMSTACK = 256;  { stack for matching compiled heads }
+  &MAXJOBS = 64;  { max worker processes in batch mode }
+  &JOBS = 4;  { default number of workers }
+  &PROFTICK = 64;  { calls between profile samples }
+  &PROFNODES = 65536;  { max nodes in calling context tree }
+  &PROFHASH = 131071;  { size of hash table for the tree (prime) }
+  &PROFDEPTH = 1024;  { max depth of a path in the tree }
+  &IMGMAGIC = 1886940209;  { identifies an image file }
+  &IMGHEAD = 10;  { size of image header }
+  &CLOCKMAX = 2147483647;  { |cputime| counts modulo |CLOCKMAX|+1 }
 
 { special character values }
 define(&ENDSTR, chr(0))  { end of string }
@@ -97,6 +121,7 @@ define(&skip)  { empty statement }
 
 var &run: boolean;  { whether execution should continue }
   &dflag: boolean;  { switch for debugging code }
+  &cflag: boolean;  { whether to compile clause heads }
 
 define(&exec_error,
   begin writeln; write('Error: ', $0); run := false end)
@@ -110,7 +135,8 @@ define(&bad_tag, panic('bad tag ', $2:1, ' in ', $1))
   represented elsewhere by an index |k| into this array, and the
   characters of the string are |charbuf[k]|,
   |charbuf[k+1]|,~\dots, terminated by the character |ENDSTR|.
-  |charptr| is the last occupied location in |charbuf|.
+  |charptr| is the last occupied location in |charbuf|.  The array
+  is never searched, so pages beyond |charptr| are never touched.
 
   In addition to these `permanent' strings, there are `temporary'
   strings put together for some short-term purpose.  These are
@@ -164,6 +190,15 @@ begin
     begin write(charbuf[i]); incr(i) end
 end;
 
+{ |WriteTemp| -- print a tempstring }
+procedure &WriteTemp(var s: tempstring);
+  var i: 0..MAXSTRING;
+begin
+  i := 1;
+  while s[i] <> ENDSTR do
+    begin write(s[i]); incr(i) end
+end;
+
 {S Representation of terms }
 
 { It is now time to give the details of how terms are
@@ -242,11 +277,33 @@ define(&TERM_SIZE, 3)  { \dots\ plus no. of args }
   execution of goals, and the global stack other longer-lived data
   structures.  Both stacks expand and contract during execution of
   goals.  Also, there is a garbage collector that can reclaim
-  inaccessible portions of the global stack. }
+  inaccessible portions of the global stack.
+
+  The space between the local and global stacks is mostly untouched
+  address space, so the amount of |mem| in use is limited instead by
+  |memlimit|.  The garbage collector runs when the words in use
+  come within |GCLOW| of the limit, and the limit is doubled by
+  |Expand| whenever the heap or a collection leaves less than
+  |GCHIGH| words to spare. }
 
 var
   &lsp, &gsp, &hp, &hmark: pointer;
   &mem: array [1..MEMSIZE] of integer;
+  &memlimit: integer;  { soft limit on words in use }
+  &nexpand: integer;  { times the limit has been raised }
+
+{ |mem_used| -- words used by heap and stacks }
+define(&mem_used, (lsp + (MEMSIZE + 1 - gsp)))
+
+{ |Expand| -- raise |memlimit| to at least |n| if possible }
+procedure &Expand(n: integer);
+begin
+  while (memlimit < n) and (memlimit < MEMSIZE) do begin
+    if memlimit > MEMSIZE div 2 then memlimit := MEMSIZE
+    else memlimit := 2 * memlimit;
+    incr(nexpand)
+  end
+end;
 
 { |LocAlloc| -- allocate space on local stack }
 function &LocAlloc(&size: integer): pointer;
@@ -270,6 +327,7 @@ end;
 function &HeapAlloc(&size: integer): pointer;
 begin
   if hp + size > MEMSIZE then panic('out of heap space');
+  if hp + size + GCHIGH > memlimit then Expand(hp + size + GCHIGH);
   HeapAlloc := hp + 1; hp := hp + size
 end;
 
@@ -289,6 +347,7 @@ define(&is_glob, ($1 >= gsp))  { test if it is in the global stack }
 
 var
   &interacting: boolean;  { whether input is from terminal }
+  &batching: boolean;  { whether reading queries from a batch file }
   &pbchar: char;  { pushed-back char, else |ENDFILE| }
   &infile: text;  { the current input file }
   &lineno: integer;  { line number in current file }
@@ -345,16 +404,20 @@ end;
 
   The number of clauses tried against a goal literal is reduced by
   using associating each literal with a `key', calculated so that
-  unifiable literals have matching keys. }
+  unifiable literals have matching keys.  Program clauses also have
+  a pointer to code for matching the head, described later, and a
+  link used by the index for their relation. }
 
 type &clause = pointer;
 define(&c_nvars, mem[$1])  { no. of variables }
 define(&c_key, mem[$1+1])  { unification key }
 define(&c_next, mem[$1+2])  { next clause for same relation }
 define(&c_head, mem[$1+3])  { clause head }
-define(&c_rhs, ($1+4))  { clause body (ends with NULL) }
+define(&c_code, mem[$1+4])  { compiled head or NULL }
+define(&c_knext, mem[$1+5])  { next clause with same key in index }
+define(&c_rhs, ($1+6))  { clause body (ends with NULL) }
 define(&c_body, mem[c_rhs($1)+$2-1])
-define(&CLAUSE_SIZE, 4)  { ... plus size of body + 1 }
+define(&CLAUSE_SIZE, 6)  { ... plus size of body + 1 }
 
 define(&g_first, mem[$1])  { first of a list of literals }
 define(&g_rest, ($1)+1)  { rest of the list }
@@ -382,8 +445,11 @@ define(&f_choice, mem[$1+3])  { previous choice-point }
 define(&f_glotop, mem[$1+4])  { global stack at creation }
 define(&f_trail, mem[$1+5])  { trail state at creation }
 define(&f_nvars, mem[$1+6])  { no. of local variables }
-define(&f_local, ($1+7+($2-1)*TERM_SIZE))
-define(&FRAME_SIZE, 7)  { \dots plus space for local variables }
+define(&f_prof, mem[$1+7])  { for profiling: 2 * node, + 1 if exit due }
+define(&f_node, (f_prof($1) div 2))  { node in the profile }
+define(&f_alt, mem[$1+8])  { other chain of untried clauses }
+define(&f_local, ($1+9+($2-1)*TERM_SIZE))
+define(&FRAME_SIZE, 9)  { \dots plus space for local variables }
 
 { |frame_size| -- compute size of a frame with |n| variables }
 define(&frame_size, (FRAME_SIZE + ($1)*TERM_SIZE))
@@ -391,10 +457,12 @@ define(&frame_size, (FRAME_SIZE + ($1)*TERM_SIZE))
 var
   &current: pointer;  { current goal }
   &call: term;  { |Deref|'ed first literal of goal }
+  &callkey: integer;  { |Key| of |call| }
   &goalframe: frame;  { current stack frame }
   &choice: frame;  { last choice point }
   &base: frame;  { frame for original goal }
   &proc: clause;  { clauses left to try on current goal }
+  &alt: clause;  { ... and another chain of them, from an index }
 
 { |Deref| is a function that resolves the indirection in the
   representation of terms.  It looks up references in the frame, and
@@ -420,7 +488,10 @@ procedure PrintTerm(t: term; e: frame; prio: integer); forward;
 function ParseTerm: term; forward;
 function DoBuiltin(action: integer): boolean; forward;
 procedure Collect; forward;
+procedure GCReport; forward;
+procedure ResetTables; forward;
 function Key(t: term; e: frame): integer; forward;
+function CompileHead(c: pointer): pointer; forward;
 
 { In the actual definition of a procedure or function that
   has been declared forward, we repeat the parameter list
@@ -435,63 +506,106 @@ define(&fwd)
 { The names of relations, functions, constants and variables are
   held in a hash table.  It is organized as a `closed' hash table
   with sequential search: this is simple but leaves much room for
-  improvement. The symbol table is not allowed to become more full
+  improvement. The hash table is not allowed to become more full
   than |HASHFACTOR| per cent, since nearly full hash tables of this kind
-  perform rather badly.
+  perform rather badly; instead it is rebuilt at twice the size.  The
+  hash table |hashtab| holds symbol numbers, and the symbols
+  themselves are numbered in order of creation in |symtab|, so a
+  symbol keeps its number when the table is rebuilt.
 
   Each symbol has an |s_action| code that has a different non-zero
   value for each built-in relation, and is zero for everything
   else. User-defined relations have a chain of clauses that starts
   at the |s_proc| field and is linked together by the |c_next| fields
-  of the clauses. }
+  of the clauses.  Tabled relations have an action code too, and keep
+  the root of their table in |s_table|. }
 
 type &symbol = 1..MAXSYMBOLS;  { index in |symtab| }
 
 var
   &nsymbols: 0..MAXSYMBOLS;  { number of symbols }
+  &hashsize: integer;  { size of the hash table in use }
+  &hashtab: array [1..MAXHASH] of integer;  { symbols or 0 }
   &symtab: array [1..MAXSYMBOLS] of record
       &name: integer;  { print name: index in |charbuf| }
       &arity: integer;  { number of arguments or -1 }
       &action: integer;  { code if built-in, 0 otherwise }
-      &proc: clause  { clause chain }
+      &proc: clause;  { clause chain }
+      &last: clause;  { last clause in the chain }
+      &nclauses: integer;  { length of the chain }
+      &index: pointer;  { first-argument index or |NULL| }
+      &table: pointer  { call trie for tabled relation or |NULL| }
     end;
   &cons, &eqsym, &cutsym, &nilsym, &notsym: symbol;
+  &tablesym, &tblsym, &tblget, &tblnext: symbol;
 
 { We define selector macros for symbols, just as for terms }
 define(&s_name, symtab[$1].name)
 define(&s_arity, symtab[$1].arity)
 define(&s_action, symtab[$1].action)
 define(&s_proc, symtab[$1].proc)
+define(&s_last, symtab[$1].last)
+define(&s_nclauses, symtab[$1].nclauses)
+define(&s_index, symtab[$1].index)
+define(&s_table, symtab[$1].table)
+
+{ |HashName| -- hash function for a permstring }
+function &HashName(s: permstring): integer;
+  var h: integer;
+begin
+  h := 0;
+  while charbuf[s] <> ENDSTR do
+    begin h := (5 * h + ord(charbuf[s])) mod hashsize; incr(s) end;
+  HashName := h
+end;
+
+{ |Rehash| -- rebuild the hash table at twice the size }
+procedure &Rehash;
+  var i, p: integer;
+begin
+  hashsize := 2 * hashsize;
+  for i := 1 to hashsize do hashtab[i] := 0;
+  for i := 1 to nsymbols do begin
+    p := HashName(s_name(i)) + 1;
+    while hashtab[p] <> 0 do
+      begin decr(p); if p = 0 then p := hashsize end;
+    hashtab[p] := i
+  end
+end;
 
 { |Lookup| -- convert string to internal symbol }
 function &Lookup(var &name: tempstring): symbol;
   label &found;
-  var h, i: integer; p: symbol;
+  var h, i: integer; p: integer; s: symbol;
 begin
   { Compute the hash function in |h| }
   h := 0; i := 1;
   while name[i] <> ENDSTR do
-    begin h := (5 * h + ord(name[i])) mod MAXSYMBOLS; incr(i) end;
+    begin h := (5 * h + ord(name[i])) mod hashsize; incr(i) end;
 
   { Search the hash table }
   p := h+1;
-  while s_name(p) <> -1 do begin
-    if StringEqual(name, s_name(p)) then goto found;
+  while hashtab[p] <> 0 do begin
+    s := hashtab[p];
+    if StringEqual(name, s_name(s)) then goto found;
     decr(p);
-    if p = 0 then p := MAXSYMBOLS
+    if p = 0 then p := hashsize
   end;
 
   { Not found: enter a new symbol }
-  { Be careful to avoid overflow on 16 bit machines: }
-  if nsymbols >= (MAXSYMBOLS div 10) * (HASHFACTOR div 10) then
+  if nsymbols >= MAXSYMBOLS then
     panic('out of symbol space');
-  incr(nsymbols);
-  s_name(p) := SaveString(name);
-  s_arity(p) := -1;
-  s_action(p) := 0; s_proc(p) := NULL;
+  incr(nsymbols); s := nsymbols; hashtab[p] := s;
+  s_name(s) := SaveString(name);
+  s_arity(s) := -1;
+  s_action(s) := 0; s_proc(s) := NULL; s_last(s) := NULL;
+  s_nclauses(s) := 0; s_index(s) := NULL; s_table(s) := NULL;
+  { Be careful to avoid overflow on 16 bit machines: }
+  if nsymbols >= (hashsize div 10) * (HASHFACTOR div 10) then
+    Rehash;
 
 found:
-  Lookup := p
+  Lookup := s
 end;
 
 type &keyword = array [1..8] of char;
@@ -520,13 +634,17 @@ define(&EQUALITY, 8)  { |=/2| }
 define(&FAIL, 9)  { |false/0| }
 define(&PRINT, 10)  { |print/1| }
 define(&NL, 11)  { |nl/0| }
+define(&STATS, 12)  { |stats/0| }
+define(&TABLED, 13)  { any tabled relation }
+define(&TBLGET, 14)  { |$get/2| }
+define(&TBLNEXT, 15)  { |$next/2| }
 
 { |InitSymbols| -- initialize and define standard symbols }
 procedure &InitSymbols;
   var i: integer; &dummy: symbol;
 begin
-  nsymbols := 0;
-  for i := 1 to MAXSYMBOLS do s_name(i) := -1;
+  nsymbols := 0; hashsize := HASHINIT;
+  for i := 1 to hashsize do hashtab[i] := 0;
   cons   := Enter(':       ', 2, 0);
   cutsym := Enter('!       ', 0, CUT);
   eqsym  := Enter('=       ', 2, EQUALITY);
@@ -539,24 +657,150 @@ begin
   dummy  := Enter('char    ', 1, ISCHAR);
   dummy  := Enter('false   ', 0, FAIL);
   dummy  := Enter('print   ', 1, PRINT);
-  dummy  := Enter('nl      ', 0, NL)
+  dummy  := Enter('nl      ', 0, NL);
+  dummy  := Enter('stats   ', 0, STATS);
+  tablesym := Enter('table   ', -1, 0);
+  tblsym := Enter('$tbl    ', 2, 0);
+  tblget := Enter('$get    ', 2, TBLGET);
+  tblnext := Enter('$next   ', 2, TBLNEXT)
+end;
+
+{S Clause indexing }
+
+{ The |Key| of a goal literal rules out clauses whose first argument
+  cannot match, but |Search| must still skip over them one at a time,
+  so a query against a big table of facts takes time proportional to
+  the size of the table.  Once a relation has |INDEXMIN| clauses, we
+  give it an index: a hash table in the heap that maps each non-zero
+  key to a chain of the clauses that have that key, linked in the
+  original order through their |c_knext| fields.  The clauses with
+  key zero could match a goal with any key, but they are not copied
+  onto every chain: they have a single chain of their own.
+
+  A goal with a non-zero key must try the clauses on its own chain
+  and those on the chain for key zero, in the order they appear in
+  the program.  Clauses are put on the heap in the order they are
+  read, so the two chains are merged as the goal runs by comparing
+  the addresses of the clauses at their heads, much as a
+  `switch_on_term' instruction in Warren's abstract machine falls
+  through to the code for clauses with a variable first argument.
+  The interpreter keeps its place in both chains, in |proc| and
+  |alt| while it runs and in the |f_retry| and |f_alt| fields of a
+  choice-point, and no choice-point is left behind when a goal
+  matches the last clause that remains on either chain.  A goal with
+  key zero tries every clause, and ignores the index.
+
+  The table uses open addressing with linear probing, and is replaced
+  by one twice the size when it becomes two-thirds full; the old table
+  is simply abandoned in the heap. }
+
+define(&i_size, mem[$1])  { number of slots }
+define(&i_count, mem[$1+1])  { slots in use }
+define(&i_vars, ($1+2))  { chain for key zero }
+define(&i_key, mem[$1+3*$2+4])  { key for slot $2 (from 0) }
+define(&i_chain, ($1+3*$2+5))  { its chain }
+define(&INDEX_SIZE, 4)  { \dots\ plus 3 words per slot }
+
+{ A chain is a pair of words holding its first and last clause; an
+  empty slot has an empty chain. }
+define(&ch_first, mem[$1])
+define(&ch_last, mem[$1+1])
+
+{ |Append| -- add a clause to the end of a chain }
+procedure &Append(c: clause; &ch: pointer);
+begin
+  c_knext(c) := NULL;
+  if ch_first(ch) = NULL then ch_first(ch) := c
+  else c_knext(ch_last(ch)) := c;
+  ch_last(ch) := c
+end;
+
+{ |NewIndex| -- allocate an empty index with |n| slots }
+function &NewIndex(n: integer): pointer;
+  var x: pointer; j: integer;
+begin
+  x := HeapAlloc(INDEX_SIZE + 3*n);
+  i_size(x) := n; i_count(x) := 0;
+  ch_first(i_vars(x)) := NULL; ch_last(i_vars(x)) := NULL;
+  for j := 0 to n-1 do ch_first(i_chain(x, j)) := NULL;
+  NewIndex := x
+end;
+
+{ |FindSlot| -- find the slot for key |k|, or an empty one }
+function &FindSlot(x: pointer; k: integer): integer;
+  var j: integer;
+begin
+  j := k mod i_size(x);
+  if j < 0 then j := j + i_size(x);
+  while (ch_first(i_chain(x, j)) <> NULL) and (i_key(x, j) <> k) do
+    j := (j+1) mod i_size(x);
+  FindSlot := j
+end;
+
+{ |GrowIndex| -- move the chains of an index to a bigger table }
+function &GrowIndex(x: pointer): pointer;
+  var y: pointer; i, j: integer;
+begin
+  y := NewIndex(2 * i_size(x));
+  i_count(y) := i_count(x);
+  ch_first(i_vars(y)) := ch_first(i_vars(x));
+  ch_last(i_vars(y)) := ch_last(i_vars(x));
+  for i := 0 to i_size(x)-1 do
+    if ch_first(i_chain(x, i)) <> NULL then begin
+      j := FindSlot(y, i_key(x, i));
+      i_key(y, j) := i_key(x, i);
+      ch_first(i_chain(y, j)) := ch_first(i_chain(x, i));
+      ch_last(i_chain(y, j)) := ch_last(i_chain(x, i))
+    end;
+  GrowIndex := y
+end;
+
+{ |IndexClause| -- enter a clause in the index for its relation }
+procedure &IndexClause(s: symbol; c: clause);
+  var x: pointer; j: integer;
+begin
+  if c_key(c) = 0 then
+    Append(c, i_vars(s_index(s)))
+  else begin
+    if 3 * (i_count(s_index(s)) + 1) > 2 * i_size(s_index(s)) then
+      s_index(s) := GrowIndex(s_index(s));
+    x := s_index(s); j := FindSlot(x, c_key(c));
+    if ch_first(i_chain(x, j)) = NULL then
+      begin i_key(x, j) := c_key(c); incr(i_count(x)) end;
+    Append(c, i_chain(x, j))
+  end
+end;
+
+{ |MakeIndex| -- build the index for a relation }
+procedure &MakeIndex(s: symbol);
+  var p: clause;
+begin
+  s_index(s) := NewIndex(INDEXSLOTS);
+  p := s_proc(s);
+  while p <> NULL do
+    begin IndexClause(s, p); p := c_next(p) end
 end;
 
 { |AddClause| -- insert a clause at the end of its chain }
 procedure &AddClause(c: clause);
-  var s: symbol; p: clause;
+  var s: symbol;
 begin
   s := t_func(c_head(c));
-  if s_action(s) <> 0 then begin
+  if (s_action(s) <> 0) and (s_action(s) <> TABLED) then begin
     exec_error('can''t add clauses to built-in relation ');
     WriteString(s_name(s))
   end
-  else if s_proc(s) = NULL then
-    s_proc(s) := c
   else begin
-    p := s_proc(s);
-    while c_next(p) <> NULL do p := c_next(p);
-    c_next(p) := c
+    if s_proc(s) = NULL then
+      s_proc(s) := c
+    else
+      c_next(s_last(s)) := c;
+    s_last(s) := c;
+    incr(s_nclauses(s));
+    if s_index(s) <> NULL then
+      IndexClause(s, c)
+    else if s_nclauses(s) = INDEXMIN then
+      MakeIndex(s)
   end
 end;
 
@@ -637,9 +881,12 @@ begin
   p := HeapAlloc(CLAUSE_SIZE + nbody + 1);
   c_nvars(p) := nvars; c_next(p) := NULL; c_head(p) := head;
   for i := 1 to nbody do c_body(p, i) := body[i];
-  c_body(p, nbody+1) := NULL;
+  c_body(p, nbody+1) := NULL; c_code(p) := NULL;
   if head = NULL then c_key(p) := 0
-  else c_key(p) := Key(head, NULL);
+  else begin
+    c_key(p) := Key(head, NULL);
+    if cflag then c_code(p) := CompileHead(p)
+  end;
   MakeClause := p
 end;
 
@@ -1157,18 +1404,52 @@ done:
   else ParseClause := MakeClause(nvars, head, body, n)
 end;
 
+{ A program file may also contain directives of the form
+  `|:- table p(X, Y), q(Z).|', naming the relations that are to be
+  tabled.  The arguments in each literal serve only to fix the arity
+  of the relation. }
+
+{ |ParseDirective| -- parse and obey a directive }
+procedure &ParseDirective;
+  label &done;
+  var t: term; s: symbol;
+begin
+  Eat(ARROW);
+  if (token <> IDENT) or (tokval <> tablesym) then
+    syntax_error('unknown directive')
+  else begin
+    Eat(IDENT);
+    while true do begin
+      t := ParseTerm; CheckAtom(t);
+      if not errflag then begin
+        s := t_func(t);
+        if s_action(s) = 0 then
+          s_action(s) := TABLED
+        else if s_action(s) <> TABLED then
+          syntax_error('can''t table a built-in relation')
+      end;
+      if token <> COMMA then goto done;
+      Eat(COMMA)
+    end
+  end;
+done:
+  Eat(DOT)
+end;
+
 { |ReadClause| -- read a clause from |infile| }
 function &ReadClause: clause;
-  var c: clause;
+  var c: clause; &directive: boolean;
 begin
   repeat
     hp := hmark; nvars := 0; errflag := false;
     if interacting then
       begin writeln; write('# :- '); flush_out end;
-    Scan;
+    Scan; directive := false;
     if token = EOFTOK then c := NULL
-    else c := ParseClause(interacting)
-  until (not errflag) or (token = EOFTOK);
+    else if (token = ARROW) and not interacting and not batching then
+      begin ParseDirective; directive := true; c := NULL end
+    else c := ParseClause(interacting or batching)
+  until ((not errflag) and (not directive)) or (token = EOFTOK);
   ReadClause := c
 end;
 
@@ -1178,7 +1459,14 @@ end;
   they can be undone on backtracking.  It is a linked list of nodes
   with a |t_kind| of |UNDO| allocated from the global stack.  The
   variables for which bindings are actually kept in the trail are the
-  `critical' ones that will not be destroyed on backtracking. }
+  `critical' ones that will not be destroyed on backtracking.
+
+  The trail also serves the garbage collector as a record of the
+  places where an old term might point to a younger one.  Cells on
+  the global stack above |gcmark| survived the last collection; since
+  a binding is the only way an old term can come to point at a new
+  one, bindings of these cells are always trailed, even when the
+  cell is not critical. }
 
 type &trail = pointer;
 { Nodes on the trail share the |t_tag| and |t_shift| fields of
@@ -1188,15 +1476,19 @@ define(&x_next, mem[$1+3])  { next trail entry }
 define(&TRAIL_SIZE, 4)
 
 var &trhead: trail;  { start of the trail }
+  &gcmark: pointer;  { global stack at the end of the last GC }
 
 { |critical| -- test if a variable will survive backtracking }
 define(&critical, (($1 < choice) or ($1 >= f_glotop(choice))))
 
-{ |Save| -- add a variable to the trail if it is critical }
+{ |remember| -- test if a binding must be trailed }
+define(&remember, (critical($1) or ($1 >= gcmark)))
+
+{ |Save| -- add a variable to the trail if needed }
 procedure &Save(v: term);
   var p: trail;
 begin
-  if critical(v) then begin
+  if remember(v) then begin
     p := GloAlloc(UNDO, TRAIL_SIZE);
     x_reset(p) := v; x_next(p) := trhead; trhead := p
   end
@@ -1220,7 +1512,7 @@ begin
   p := trhead;
   if choice = NULL then exec_error('Commit');
   while (p <> NULL) and (p < f_glotop(choice)) do begin
-    if (x_reset(p) <> NULL) and not critical(x_reset(p)) then
+    if (x_reset(p) <> NULL) and not remember(x_reset(p)) then
       x_reset(p) := NULL;
     p := x_next(p)
   end
@@ -1369,17 +1661,486 @@ begin
   end
 end;
 
-{ |Search| -- find the first clause that might match }
-function &Search(t: term; e: frame; p: clause): clause;
-  var k: integer;
+{ |Search| -- find the first clause that might match key |k| }
+function &Search(k: integer; p: clause): clause;
 begin
-  k := Key(t, e);
   if k <> 0 then
     while (p <> NULL) and (c_key(p) <> 0) and (c_key(p) <> k) do
       p := c_next(p);
   Search := p
 end;
 
+{ |Order| -- put two chains in the order of their first clauses }
+procedure &Order(p, q: clause; var &first, &second: clause);
+begin
+  if (p = NULL) or ((q <> NULL) and (q < p)) then
+    begin first := q; second := p end
+  else
+    begin first := p; second := q end
+end;
+
+{ |FirstClause| -- set |proc| and |alt| for a goal with key |k| }
+procedure &FirstClause(t: term; k: integer);
+  var s: symbol; x: pointer;
+begin
+  s := t_func(t); x := s_index(s);
+  if (x = NULL) or (k = 0) then
+    begin proc := Search(k, s_proc(s)); alt := NULL end
+  else
+    Order(ch_first(i_chain(x, FindSlot(x, k))),
+      ch_first(i_vars(x)), proc, alt)
+end;
+
+{S Compiling clause heads }
+
+{ Matching a goal literal against the head of a clause is the
+  commonest job the interpreter does, and |Unify| does it the slow
+  way, following |REF| nodes through the frame and taking both terms
+  apart at every level.  So each program clause is also given a
+  short sequence of instructions in the style of the `get' and
+  `unify' instructions of Warren's abstract machine, kept on the
+  heap after the clause.  The instructions work on a stack of goal
+  subterms that are waiting to be matched: to start with, the
+  arguments of the goal literal, and later the arguments of each
+  compound term that is taken apart.  Each instruction pops a term
+  from the stack and matches it against one part of the head.
+
+  The first occurrence of a variable simply binds the cell in the
+  new frame, a variable that occurs only once in the clause matches
+  anything, and only later occurrences need the full |Unify|.  If a
+  goal subterm is an unbound variable where the head has a compound
+  term, that part of the head is copied with |GloCopy| just as
+  |Unify| would do, and the instructions for its arguments are
+  skipped.  A head that would need more than |VMSTACK| stack entries
+  is not compiled, and |Unify| is used for it instead; the same
+  happens for every clause if picoProlog is started with `-i'.
+
+  Only heads are compiled.  Body literals stay as terms that share
+  structure with the clause and are run by |Step|, and clauses are
+  still chosen through the index of chains above rather than by
+  `try' and `switch' instructions.  Because of structure sharing, a
+  body literal together with its frame already serves as the
+  argument registers of the call it makes, so `put' instructions
+  would only copy it; compiling bodies would pay only once terms are
+  built on the global stack by copying, as in the WAM, and that
+  means a new collector and a new layout for frames. }
+
+{ instruction codes }
+define(&HATOM, 1)  { atom |arg| }
+define(&HINT, 2)  { integer |arg| }
+define(&HCHAR, 3)  { character |arg| }
+define(&HFUNC, 4)  { compound term |arg|, ending at |skip| }
+define(&HFIRST, 5)  { first occurrence of variable |arg| }
+define(&HVAR, 6)  { later occurrence of variable |arg| }
+define(&HVOID, 7)  { variable that occurs only once }
+define(&HEND, 8)  { end of the head }
+
+define(&i_op, mem[$1])
+define(&i_arg, mem[$1+1])
+define(&i_skip, mem[$1+2])
+
+var
+  &occurs: array [1..MAXARITY] of integer;  { occurrences of each var }
+  &seen: array [1..MAXARITY] of boolean;  { whether var is bound yet }
+  &depth, &maxdepth: integer;  { stack depth during compilation }
+  &vmterm: array [1..VMSTACK] of term;  { terms waiting to be matched }
+  &vmenv: array [1..VMSTACK] of frame;  { ... and their frames }
+
+{ |CountVars| -- count occurrences of variables in a clause term }
+procedure &CountVars(t: term);
+  var i: integer;
+begin
+  case t_kind(t) of
+  FUNC:
+    for i := 1 to s_arity(t_func(t)) do CountVars(t_arg(t, i));
+  REF:
+    incr(occurs[t_index(t)]);
+  INT, CHRCTR:
+    { skip }
+  default
+    bad_tag('CountVars', t_kind(t))
+  end
+end;
+
+{ |Emit| -- add a word of code on the heap }
+procedure &Emit(w: integer);
+  var p: pointer;
+begin
+  p := HeapAlloc(1); mem[p] := w
+end;
+
+{ |CompileArg| -- compile code to match one subterm of a head }
+procedure &CompileArg(t: term);
+  var i, n: integer; p: pointer;
+begin
+  decr(depth);
+  case t_kind(t) of
+  FUNC:
+    begin
+      n := s_arity(t_func(t));
+      if n = 0 then
+        begin Emit(HATOM); Emit(t) end
+      else begin
+        p := hp+1; Emit(HFUNC); Emit(t); Emit(NULL);
+        depth := depth + n;
+        if depth > maxdepth then maxdepth := depth;
+        for i := 1 to n do CompileArg(t_arg(t, i));
+        i_skip(p) := hp+1
+      end
+    end;
+  INT:
+    begin Emit(HINT); Emit(t) end;
+  CHRCTR:
+    begin Emit(HCHAR); Emit(t) end;
+  REF:
+    if occurs[t_index(t)] = 1 then
+      Emit(HVOID)
+    else if not seen[t_index(t)] then begin
+      Emit(HFIRST); Emit(t_index(t));
+      seen[t_index(t)] := true
+    end
+    else
+      begin Emit(HVAR); Emit(t_index(t)) end
+  default
+    bad_tag('CompileArg', t_kind(t))
+  end
+end;
+
+{ |CompileHead| -- compile the head of a clause, or return |NULL| }
+function &CompileHead fwd((c: clause): pointer);
+  var i, n: integer; &code: pointer;
+begin
+  for i := 1 to c_nvars(c) do
+    begin occurs[i] := 0; seen[i] := false end;
+  CountVars(c_head(c)); i := 1;
+  while c_body(c, i) <> NULL do
+    begin CountVars(c_body(c, i)); incr(i) end;
+
+  n := s_arity(t_func(c_head(c)));
+  code := hp+1; depth := n; maxdepth := n;
+  for i := 1 to n do CompileArg(t_arg(c_head(c), i));
+  Emit(HEND);
+
+  if maxdepth > VMSTACK then
+    begin hp := code-1; code := NULL end;
+  CompileHead := code
+end;
+
+{ |Match| -- unify goal |t| with head of |c| in new frame |e2| }
+function &Match(t: term; &e1: frame; c: clause; &e2: frame): boolean;
+  label &exit;
+  var &pc: pointer; &sp, i: integer; e: frame; v: term;
+begin
+  Match := false;
+  if c_code(c) = NULL then
+    begin Match := Unify(t, e1, c_head(c), e2); return end;
+
+  sp := 0;
+  for i := s_arity(t_func(t)) downto 1 do
+    begin incr(sp); vmterm[sp] := t_arg(t, i); vmenv[sp] := e1 end;
+
+  pc := c_code(c);
+  while i_op(pc) <> HEND do begin
+    if i_op(pc) = HVOID then
+      begin decr(sp); pc := pc+1 end
+    else begin
+      e := vmenv[sp]; t := Deref(vmterm[sp], e); decr(sp);
+      case i_op(pc) of
+      HATOM:
+	begin
+	  if t_kind(t) = CELL then
+	    begin Save(t); t_val(t) := i_arg(pc) end
+	  else if t_kind(t) <> FUNC then return
+	  else if t_func(t) <> t_func(i_arg(pc)) then return;
+	  pc := pc+2
+	end;
+      HINT:
+	begin
+	  if t_kind(t) = CELL then
+	    begin Save(t); t_val(t) := i_arg(pc) end
+	  else if t_kind(t) <> INT then return
+	  else if t_ival(t) <> t_ival(i_arg(pc)) then return;
+	  pc := pc+2
+	end;
+      HCHAR:
+	begin
+	  if t_kind(t) = CELL then
+	    begin Save(t); t_val(t) := i_arg(pc) end
+	  else if t_kind(t) <> CHRCTR then return
+	  else if t_cval(t) <> t_cval(i_arg(pc)) then return;
+	  pc := pc+2
+	end;
+      HFUNC:
+	if t_kind(t) = CELL then begin
+	  Save(t); t_val(t) := GloCopy(i_arg(pc), e2);
+	  pc := i_skip(pc)
+	end
+	else if t_kind(t) <> FUNC then return
+	else if t_func(t) <> t_func(i_arg(pc)) then return
+	else begin
+	  for i := s_arity(t_func(t)) downto 1 do begin
+	    incr(sp); vmterm[sp] := t_arg(t, i); vmenv[sp] := e
+	  end;
+	  pc := pc+3
+	end;
+      HFIRST:
+	begin
+	  v := f_local(e2, i_arg(pc));
+	  if t_kind(t) = CELL then
+	    Share(t, v)
+	  else
+	    begin Save(v); t_val(v) := GloCopy(t, e) end;
+	  pc := pc+2
+	end;
+      HVAR:
+	begin
+	  if not Unify(t, e, f_local(e2, i_arg(pc)), e2) then return;
+	  pc := pc+2
+	end
+      default
+	bad_tag('Match', i_op(pc))
+      end
+    end
+  end;
+  Match := true;
+exit:
+end;
+
+{S Profiling }
+
+{ With the option `|-p file|', picoProlog profiles each query.  For
+  each relation, it counts the events that appear in the trace
+  printed with |-d|: calls, exits, and redos on backtracking.  It also
+  counts fails, meaning built-in calls that fail and resolution steps
+  that find no matching clause, and it counts the attempts to match
+  a clause head and how many succeed.  While profiling, tail
+  recursion is turned off so that each call keeps its frame until it
+  exits.
+
+  Time is measured by sampling, over a calling context tree that has
+  a node for each distinct path of calls from the goal.  Each frame
+  records its node, found from the node of its parent when the frame
+  is pushed.  A directly recursive call shares its caller's node,
+  and paths deeper than |PROFDEPTH| share the node at that depth, so
+  the tree stays small.  After every |PROFTICK| calls, the CPU time
+  since the last sample is added to the node for the current call.
+  When the query is finished, each relation is charged the time of
+  every node that has the relation on its path, counting each node
+  only once.  This gives an inclusive time.  A table of relations
+  sorted by time is then printed, and the tree is written to the
+  file as folded stacks.  Each line `|p/1;q/2 120|' gives a path and
+  its time in microseconds, which is the form that flame graph tools
+  expect.  The file is rewritten after each query.  Hidden relations,
+  whose names begin with |$|, are left out of both.
+
+  A frame can exit more than once if a choice made below it is
+  retried, and the frames that tabling uses to run clauses and
+  return answers are not made by counted calls at all.  So that
+  exits do not outnumber calls and redos, a frame owes an exit only
+  if it was pushed for the goal whose call or redo was last counted,
+  and the exit is counted only the first time the frame exits. }
+
+var
+  &pflag: boolean;  { whether to profile }
+  &profname: tempstring;  { file for folded stacks }
+  &pfile: text;  { the same, when open }
+  &pcalls, &pexits, &predos, &pfails: array [1..MAXSYMBOLS] of integer;
+  &ptries, &pmatches: array [1..MAXSYMBOLS] of integer;  { head matching }
+  &ptime: array [1..MAXSYMBOLS] of integer;  { inclusive time }
+  &pstamp: array [1..MAXSYMBOLS] of integer;  { last node charged }
+  &porder: array [1..MAXSYMBOLS] of symbol;  { relations for the table }
+  &pgoal: pointer;  { goal of the last call or redo counted }
+  &pgframe: frame;  { and its frame }
+  &nsample: integer;  { number of samples }
+  &ptick: integer;  { calls until the next sample }
+  &plast: integer;  { time of the last sample }
+  &ncct: integer;  { nodes in the calling context tree }
+  &cnparent, &cndepth: array [1..PROFNODES] of integer;
+  &cnsym: array [1..PROFNODES] of symbol;  { relation for each node }
+  &cntime: array [1..PROFNODES] of integer;  { time in each node }
+  &cnhash: array [1..PROFHASH] of integer;  { hash table for nodes }
+
+{ |Elapsed| -- CPU time since |start|, allowing for |cputime| to wrap }
+function &Elapsed(&start: integer): integer;
+  var t: integer;
+begin
+  t := cputime - start;
+  if t < 0 then t := (t + CLOCKMAX) + 1;
+  Elapsed := t
+end;
+
+{ |ResetProfile| -- clear the profile before a query }
+procedure &ResetProfile;
+  var i: integer;
+begin
+  for i := 1 to nsymbols do begin
+    pcalls[i] := 0; pexits[i] := 0; predos[i] := 0; pfails[i] := 0;
+    ptries[i] := 0; pmatches[i] := 0; ptime[i] := 0; pstamp[i] := 0
+  end;
+  for i := 1 to PROFHASH do cnhash[i] := 0;
+  ncct := 0; nsample := 0; ptick := PROFTICK; plast := cputime;
+  pgoal := NULL; pgframe := NULL
+end;
+
+{ |Hidden| -- whether relation |s| is an internal one }
+function &Hidden(s: symbol): boolean;
+begin
+  Hidden := (charbuf[s_name(s)] = '$')
+end;
+
+{ |FrameRel| -- relation for the call that created frame |f| }
+function &FrameRel(f: frame): symbol;
+begin
+  FrameRel := t_func(Deref(g_first(f_goal(f)), f_parent(f)))
+end;
+
+{ |ProfNode| -- find or make the child of node |p| for relation |s| }
+function &ProfNode(p: integer; s: symbol): integer;
+  label &exit;
+  var h, q: integer;
+begin
+  if p > 0 then begin
+    if (cnsym[p] = s) or (cndepth[p] >= PROFDEPTH) then
+      begin ProfNode := p; return end
+  end;
+  h := (p * 499 + s) mod PROFHASH + 1;
+  while cnhash[h] <> 0 do begin
+    q := cnhash[h];
+    if (cnparent[q] = p) and (cnsym[q] = s) then
+      begin ProfNode := q; return end;
+    h := h mod PROFHASH + 1
+  end;
+  if ncct >= PROFNODES then
+    ProfNode := p  { the tree is full: use the parent }
+  else begin
+    incr(ncct); cnparent[ncct] := p; cnsym[ncct] := s;
+    if p = 0 then cndepth[ncct] := 1
+    else cndepth[ncct] := cndepth[p] + 1;
+    cntime[ncct] := 0; cnhash[h] := ncct; ProfNode := ncct
+  end;
+exit:
+end;
+
+{ |ProfSample| -- charge the time since the last sample }
+procedure &ProfSample;
+  var &node, &dt: integer;
+begin
+  dt := Elapsed(plast); plast := cputime;
+  incr(nsample);
+  node := ProfNode(f_node(goalframe), t_func(call));
+  if node > 0 then cntime[node] := cntime[node] + dt
+end;
+
+{ |ProfCall| -- count a call and take a sample if one is due }
+procedure &ProfCall;
+begin
+  incr(pcalls[t_func(call)]);
+  pgoal := current; pgframe := goalframe;
+  decr(ptick);
+  if ptick = 0 then
+    begin ProfSample; ptick := PROFTICK end
+end;
+
+{ |PadInt| -- print |n| right-justified in |w| columns }
+procedure &PadInt(n, w: integer);
+  var k, m: integer;
+begin
+  k := 1; m := n;
+  while m >= 10 do begin m := m div 10; incr(k) end;
+  while k < w do begin write(' '); incr(k) end;
+  write(n:1)
+end;
+
+{ |ProfBefore| -- whether relation |a| comes before |b| in the table }
+function &ProfBefore(a, b: symbol): boolean;
+begin
+  if ptime[a] <> ptime[b] then
+    ProfBefore := (ptime[a] > ptime[b])
+  else
+    ProfBefore := (pcalls[a] > pcalls[b])
+end;
+
+{ |WritePath| -- write the path for node |p| to the stacks file,
+  returning false if it is empty }
+function &WritePath(p: integer): boolean;
+  var i: integer; &any: boolean;
+begin
+  any := false;
+  if cnparent[p] <> 0 then any := WritePath(cnparent[p]);
+  if not Hidden(cnsym[p]) then begin
+    if any then write(pfile, ';');
+    i := s_name(cnsym[p]);
+    while charbuf[i] <> ENDSTR do
+      begin write(pfile, charbuf[i]); incr(i) end;
+    write(pfile, '/', s_arity(cnsym[p]):1);
+    any := true
+  end;
+  WritePath := any
+end;
+
+{ |ProfReport| -- print the profile and write the stacks file }
+procedure &ProfReport;
+  var i, j, n, h: integer; s: symbol; &more: boolean;
+begin
+  { Charge the time of each node to the relations on its path }
+  for i := 1 to ncct do begin
+    if cntime[i] > 0 then j := i else j := 0;
+    while j <> 0 do begin
+      s := cnsym[j];
+      if pstamp[s] <> i then
+        begin pstamp[s] := i; ptime[s] := ptime[s] + cntime[i] end;
+      j := cnparent[j]
+    end
+  end;
+
+  { Sort the relations that were used with Shell's method }
+  n := 0;
+  for i := 1 to nsymbols do
+    if (pcalls[i] + predos[i] > 0) and not Hidden(i) then
+      begin incr(n); porder[n] := i end;
+  h := 1;
+  while h < n div 3 do h := 3*h + 1;
+  while h >= 1 do begin
+    for i := h+1 to n do begin
+      s := porder[i]; j := i; more := true;
+      while more do begin
+        if j <= h then
+          more := false
+        else if not ProfBefore(s, porder[j-h]) then
+          more := false
+        else
+          begin porder[j] := porder[j-h]; j := j-h end
+      end;
+      porder[j] := s
+    end;
+    h := h div 3
+  end;
+
+  writeln; writeln;
+  writeln('     calls     exits     redos     fails     tries',
+    '   matches   time ms  relation');
+  for i := 1 to n do begin
+    s := porder[i];
+    PadInt(pcalls[s], 10); PadInt(pexits[s], 10);
+    PadInt(predos[s], 10); PadInt(pfails[s], 10);
+    PadInt(ptries[s], 10); PadInt(pmatches[s], 10);
+    PadInt(ptime[s] div 1000, 10); write('  ');
+    WriteString(s_name(s)); write('/', s_arity(s):1); writeln
+  end;
+  write('[', nsample:1, ' samples, ', ncct:1, ' paths]');
+
+  if not openout(pfile, profname) then begin
+    writeln; write('Can''t write '); WriteTemp(profname)
+  end
+  else begin
+    for i := 1 to ncct do
+      if cntime[i] > 0 then begin
+        if WritePath(i) then writeln(pfile, ' ', cntime[i]:1)
+      end;
+    closeout(pfile)
+  end
+end;
+
 {S Interpreter }
 
 { The main control of the interpreter uses a depth-first search
@@ -1398,9 +2159,15 @@ procedure &PushFrame(&nvars: integer; &retry: clause);
 begin
   f := LocAlloc(frame_size(nvars));
   f_goal(f) := current; f_parent(f) := goalframe;
-  f_retry(f) := retry; f_choice(f) := choice;
+  f_retry(f) := retry; f_alt(f) := NULL; f_choice(f) := choice;
   f_glotop(f) := gsp; f_trail(f) := trhead;
   f_nvars(f) := nvars;
+  if pflag then begin
+    if goalframe = NULL then f_prof(f) := 0
+    else f_prof(f) := 2 * ProfNode(f_node(goalframe), FrameRel(f));
+    if (current = pgoal) and (goalframe = pgframe) then
+      f_prof(f) := f_prof(f) + 1
+  end;
   for i := 1 to nvars do begin
     t_tag(f_local(f, i)) := make_tag(CELL, TERM_SIZE);
     t_val(f_local(f, i)) := NULL
@@ -1419,7 +2186,7 @@ end;
 
 { |tro_test| -- test if a resolution step can use TRO }
 define(&tro_test, (g_first(g_rest(current)) = NULL) and (choice < goalframe)
-    and ($1 = NULL) and (goalframe <> base))
+    and ($1 = NULL) and (goalframe <> base) and not pflag)
 
 { If the |tro_test| macro returns true, then it is safe to discard
   the calling frame in a resolution step before solving the subgoals
@@ -1464,36 +2231,64 @@ begin
   end;
 
   { Perform the resolution step }
-  ok := Unify(call, temp, c_head(proc), goalframe);
+  ok := Match(call, temp, proc, goalframe);
   current := c_rhs(proc);
   lsp := temp-1
 end;
 
 { The |Step| procedure carries out a single resolution step.
-  Built-in relations are treated as a special case; so are
-  resolution steps that can use the tail-recursion optimization.
-  Otherwise, we allocate a frame for the first clause for the
-  current goal literal, unify the clause head with the literal, and adopt
-  the clause body as the new goal.  The step can fail (and |Step|
-  returns |false|) if there are no clauses to try, or if the first
-  clause fails to match. }
-
-{ |Step| -- perform a resolution step }
-procedure &Step;
-  var &retry: clause;
-begin
-  if s_action(t_func(call)) <> 0 then
-    ok := DoBuiltin(s_action(t_func(call)))
-  else if proc = NULL then
+  Built-in relations are treated as a special case; the rest of the
+  work is done by |Resolve|, which tries the clauses in |proc|.
+  Resolution steps that can use the tail-recursion optimization are
+  another special case.  Otherwise, we allocate a frame for the first
+  clause for the current goal literal, unify the clause head with the
+  literal, and adopt the clause body as the new goal.  The step can
+  fail (and sets |ok| to |false|) if there are no clauses to try, or
+  if the first clause fails to match.  On backtracking, |Resolve| is
+  called directly to try the remaining clauses; that matters for
+  tabled relations, which have an action code but also clauses. }
+
+{ |Resolve| -- perform a resolution step with clauses |proc| }
+procedure &Resolve;
+  var &retry, &retry2: clause;
+begin
+  if proc = NULL then
     ok := false
   else begin
-    retry := Search(call, goalframe, c_next(proc));
+    if (callkey = 0) or (s_index(t_func(call)) = NULL) then
+      begin retry := Search(callkey, c_next(proc)); retry2 := NULL end
+    else
+      Order(c_knext(proc), alt, retry, retry2);
     if tro_test(retry) then
       TroStep
     else begin
       PushFrame(c_nvars(proc), retry);
-      ok := Unify(call, f_parent(goalframe), c_head(proc), goalframe);
+      f_alt(goalframe) := retry2;
+      ok := Match(call, f_parent(goalframe), proc, goalframe);
       current := c_rhs(proc);
+      if pflag then begin
+        incr(ptries[t_func(call)]);
+        if ok then incr(pmatches[t_func(call)])
+      end
+    end
+  end;
+  if pflag and not ok then incr(pfails[t_func(call)])
+end;
+
+{ |Step| -- perform a resolution step }
+procedure &Step;
+  var s: symbol; f: frame;
+begin
+  s := t_func(call);
+  if s_action(s) = 0 then
+    Resolve
+  else begin
+    f := goalframe;
+    ok := DoBuiltin(s_action(s));
+    if pflag then begin
+      { Built-ins that push a frame exit in |Unwind| }
+      if not ok then incr(pfails[s])
+      else if goalframe = f then incr(pexits[s])
     end
   end
 end;
@@ -1508,6 +2303,10 @@ procedure &Unwind;
 begin
   while (g_first(current) = NULL) and (goalframe <> base) do begin
     debug_point('Exit', g_first(f_goal(goalframe)), f_parent(goalframe));
+    if pflag and (f_prof(goalframe) mod 2 = 1) then begin
+      incr(pexits[FrameRel(goalframe)]);
+      f_prof(goalframe) := f_prof(goalframe) - 1
+    end;
     current := g_rest(f_goal(goalframe));
     if goalframe > choice then lsp := goalframe-1;
     goalframe := f_parent(goalframe)
@@ -1528,9 +2327,16 @@ begin
   Restore;
   current := f_goal(choice); goalframe := f_parent(choice);
   call := Deref(g_first(current), goalframe);
-  proc := f_retry(choice); gsp := f_glotop(choice);
+  callkey := Key(call, goalframe);
+  proc := f_retry(choice); alt := f_alt(choice);
+  gsp := f_glotop(choice);
+  if gcmark < gsp then gcmark := gsp;
   lsp := choice-1; choice := f_choice(choice);
   debug_point('Redo', call, goalframe);
+  if pflag then begin
+    incr(predos[t_func(call)]);
+    pgoal := current; pgframe := goalframe
+  end
 end;
 
 { |Resume| is called with |ok = true| when the interpreter starts to
@@ -1555,29 +2361,42 @@ begin
 	WriteString(s_name(t_func(call)));
 	return
       end;
-      proc := Search(call, goalframe, s_proc(t_func(call)))
+      callkey := Key(call, goalframe);
+      FirstClause(call, callkey);
+      if pflag then ProfCall;
+      Step
     end
     else begin
       if choice <= base then return;
-      Backtrack
+      Backtrack; Resolve
     end;
-    Step;
     if ok then Unwind;
-    if gsp - lsp <= GCLOW then Collect
+    if mem_used + GCLOW >= memlimit then Collect
   end;
 exit:
 end;
 
+{ Statistics for the collections made while solving a goal are
+  printed by |GCReport| when the goal is finished.  The times are CPU
+  time in microseconds. }
+var
+  &nminor, &nmajor: integer;  { collections of each kind }
+  &reclaimed: integer;  { words freed }
+  &gctime, &gcmax: integer;  { total and longest pause }
+
 { |Execute| -- solve a goal by SLD-resolution }
 procedure &Execute(g: clause);
   label &exit;
 begin
-  lsp := hp; gsp := MEMSIZE+1;
+  lsp := hp; gsp := MEMSIZE+1; gcmark := gsp;
   current := NULL; goalframe := NULL; choice := NULL; trhead := NULL;
   PushFrame(c_nvars(g), NULL);
   choice := goalframe; base := goalframe; current := c_rhs(g);
   f_choice(base) := base;
   run := true; ok := true;
+  nminor := 0; nmajor := 0; reclaimed := 0; gctime := 0; gcmax := 0;
+  ResetTables;
+  if pflag then ResetProfile;
   repeat
     Resume;
     if not run then return;
@@ -1587,6 +2406,8 @@ begin
   until ok;
   writeln; write('yes');
 exit:
+  GCReport;
+  if pflag then ProfReport
 end;
 
 {S Built-in relations }
@@ -1779,6 +2600,392 @@ begin
   DoNl := true
 end;  
 
+{S Tabling }
+
+{ A tabled relation remembers the answers to each call it receives,
+  so that a repeated call is answered from the table and a recursive
+  call of the same form (a `variant' of the call, the same up to
+  renaming of variables) cannot loop.  The method is linear tabling:
+  when a call is made for which there is no finished table, the
+  clauses for the relation are run to find all answers, each answer
+  is added to the table, and the whole process is repeated until it
+  produces no new answers.  A variant call made during the evaluation
+  gets the answers found so far and no more.  If it was an older call
+  that was still being evaluated, the table for the newer call cannot
+  be finished on its own: it is evaluated only once and left
+  incomplete, and it will be evaluated again if it is called in a
+  later round, but not if it is called again in the same round.  The
+  oldest call it depends on, the `leader', goes on repeating its
+  evaluation until a whole round adds no answer to any table.  Then
+  the leader's table is complete, and so is every table whose
+  evaluation began during the last round; the tables that were
+  evaluated in this way are found on a stack, |tbstack|.  The |dfn|
+  numbers that record the order in which evaluations start tell
+  which tables are old and which are new.
+
+  Tables live in their own array |tmem|, since the heap and stacks
+  are reset after each goal, and they are kept between goals.  Both
+  the variants of calls to a relation and the answers to each call
+  are held in tries, where each term is stored as the sequence of
+  tokens met in a left-to-right walk over it, and variables are
+  numbered in order of first occurrence.  Each trie node has a link
+  to its parent, so that a term can be rebuilt from the node at the
+  end of its path, and the edges from a node to its children are
+  found with a single hash table |triehash|.  The node at the end of
+  a call's path holds the table for that call, and the answers are
+  chained through the nodes at the end of their paths.
+
+  The answers in a table are chained in the order they were found,
+  and they are returned by a hidden relation that walks along the
+  chain, unifying each answer with the call:
+  |$tbl(X, P) :- $get(P, X).| and
+  |$tbl(X, P) :- $next(P, Q), $tbl(X, Q).|  Here |P| and |Q| are
+  integers that point to answers in |tmem|, and |$get/2| and
+  |$next/2| are built in.  Since the end of the chain is only found
+  when |$next| fails, a call of a table that is still being
+  evaluated also sees any answers that are added while it is being
+  answered. }
+
+define(&n_kind, tmem[$1])  { |FUNC|, |INT|, |CHRCTR|, |CELL| or 0 for root }
+define(&n_val, tmem[$1+1])  { symbol, value or variable number }
+define(&n_parent, tmem[$1+2])
+define(&n_data, tmem[$1+3])  { table, or next answer }
+define(&NODE_SIZE, 4)
+
+define(&tb_state, tmem[$1])  { state of evaluation }
+define(&tb_dfn, tmem[$1+1])  { order of starting evaluation }
+define(&tb_low, tmem[$1+2])  { oldest table this one depends on }
+define(&tb_answers, tmem[$1+3])  { root of answer trie }
+define(&tb_first, tmem[$1+4])  { first answer }
+define(&tb_last, tmem[$1+5])  { last answer }
+define(&tb_count, tmem[$1+6])  { number of answers }
+define(&tb_stack, tmem[$1+7])  { next on |tbstack| or |NULL| }
+define(&tb_onstack, tmem[$1+8])  { 1 if on |tbstack|, 0 if not }
+define(&TABLE_SIZE, 9)
+
+{ table states }
+define(&INCOMPLETE, 1)
+define(&EVALUATING, 2)
+define(&COMPLETE, 3)
+
+var
+  &tmem: array [1..TABSIZE] of integer;  { space for tables }
+  &tbtop: integer;  { top of |tmem| }
+  &triehash: array [1..TRIEHASH] of integer;  { trie edges }
+  &nnodes: integer;  { nodes in the hash table }
+  &tvar: array [1..TOKMAX] of term;  { variables in a tabled term }
+  &ntvar: integer;  { no. of variables so far }
+  &tokbuf: array [1..TOKMAX] of pointer;  { path to rebuild a term }
+  &ntok: integer;  { no. of tokens in |tokbuf| }
+  &fresh: boolean;  { whether |TriePath| made a new path }
+  &tbstack: pointer;  { tables that may need completing }
+  &evaltbl: pointer;  { table being evaluated or |NULL| }
+  &curround: integer;  { value of |ndfn| when the current round began }
+  &ntables, &nanswers, &ndfn: integer;
+  &tblbody: pointer;  { dummy clause body for returning answers }
+
+{ |TabAlloc| -- allocate space in |tmem| }
+function &TabAlloc(&size: integer): pointer;
+begin
+  if tbtop + size > TABSIZE then panic('out of table space');
+  TabAlloc := tbtop+1; tbtop := tbtop + size
+end;
+
+{ |NewRoot| -- create the root of a trie }
+function &NewRoot: pointer;
+  var p: pointer;
+begin
+  p := TabAlloc(NODE_SIZE);
+  n_kind(p) := 0; n_val(p) := 0;
+  n_parent(p) := NULL; n_data(p) := NULL;
+  NewRoot := p
+end;
+
+{ |TrieStep| -- find or make the child of |p| for a token }
+function &TrieStep(p: pointer; &kind, &val: integer): pointer;
+  var h: integer; q: pointer;
+begin
+  { Mix the parent, kind and value so that neighbouring edges
+    spread out over the table }
+  h := (p mod TRIEHASH) * 499 mod TRIEHASH;
+  h := (h + kind) * 499 mod TRIEHASH;
+  h := (h + val mod TRIEHASH + TRIEHASH) mod TRIEHASH * 499
+	mod TRIEHASH + 1;
+  q := triehash[h];
+  while (q <> NULL) and ((n_parent(q) <> p) or (n_kind(q) <> kind)
+			 or (n_val(q) <> val)) do begin
+    decr(h); if h = 0 then h := TRIEHASH;
+    q := triehash[h]
+  end;
+  if q = NULL then begin
+    if nnodes >= (TRIEHASH div 10) * 9 then
+      panic('out of table space');
+    q := TabAlloc(NODE_SIZE);
+    n_kind(q) := kind; n_val(q) := val;
+    n_parent(q) := p; n_data(q) := NULL;
+    triehash[h] := q; incr(nnodes); fresh := true
+  end;
+  TrieStep := q
+end;
+
+{ |TrieTerm| -- follow or make the path in a trie for a term }
+function &TrieTerm(p: pointer; t: term; e: frame): pointer;
+  var i: integer;
+begin
+  incr(ntok);
+  if ntok > TOKMAX then panic('term too big to table');
+  t := Deref(t, e);
+  case t_kind(t) of
+  FUNC:
+    begin
+      p := TrieStep(p, FUNC, t_func(t));
+      for i := 1 to s_arity(t_func(t)) do
+	p := TrieTerm(p, t_arg(t, i), e)
+    end;
+  INT:
+    p := TrieStep(p, INT, t_ival(t));
+  CHRCTR:
+    p := TrieStep(p, CHRCTR, t_cval(t));
+  CELL:
+    begin
+      i := 1;
+      while (i <= ntvar) and (tvar[i] <> t) do incr(i);
+      if i > ntvar then begin ntvar := i; tvar[i] := t end;
+      p := TrieStep(p, CELL, i)
+    end
+  default
+    bad_tag('TrieTerm', t_kind(t))
+  end;
+  TrieTerm := p
+end;
+
+{ |TriePath| -- find the path in a trie for a whole term }
+function &TriePath(root: pointer; t: term; e: frame): pointer;
+begin
+  ntvar := 0; ntok := 0; fresh := false;
+  TriePath := TrieTerm(root, t, e)
+end;
+
+{ |Rebuild| -- build the term for the tokens in |tokbuf| }
+function &Rebuild: term;
+  var t: term; p: pointer; i, n: integer;
+begin
+  p := tokbuf[ntok]; decr(ntok);
+  case n_kind(p) of
+  FUNC:
+    begin
+      n := s_arity(n_val(p));
+      t := GloAlloc(FUNC, TERM_SIZE+n);
+      t_func(t) := n_val(p);
+      for i := 1 to n do t_arg(t, i) := Rebuild
+    end;
+  INT:
+    t := NewInt(n_val(p));
+  CHRCTR:
+    begin
+      t := GloAlloc(CHRCTR, TERM_SIZE);
+      t_cval(t) := n_val(p)
+    end;
+  CELL:
+    if n_val(p) <= ntvar then
+      t := tvar[n_val(p)]
+    else begin
+      t := GloAlloc(CELL, TERM_SIZE);
+      t_val(t) := NULL;
+      ntvar := n_val(p); tvar[ntvar] := t
+    end
+  default
+    bad_tag('Rebuild', n_kind(p))
+  end;
+  Rebuild := t
+end;
+
+{ |TrieValue| -- rebuild the term whose path ends at |p| }
+function &TrieValue(p: pointer): term;
+begin
+  ntok := 0;
+  while n_kind(p) <> 0 do
+    begin incr(ntok); tokbuf[ntok] := p; p := n_parent(p) end;
+  ntvar := 0;
+  TrieValue := Rebuild
+end;
+
+{ |FindTable| -- find or make the table for a call }
+function &FindTable(t: term; e: frame): pointer;
+  var s: symbol; p, tb: pointer;
+begin
+  s := t_func(t);
+  if s_table(s) = NULL then s_table(s) := NewRoot;
+  p := TriePath(s_table(s), t, e);
+  if n_data(p) = NULL then begin
+    tb := TabAlloc(TABLE_SIZE);
+    tb_state(tb) := INCOMPLETE; tb_dfn(tb) := 0; tb_low(tb) := 0;
+    tb_answers(tb) := NewRoot;
+    tb_first(tb) := NULL; tb_last(tb) := NULL;
+    tb_count(tb) := 0; tb_stack(tb) := NULL; tb_onstack(tb) := 0;
+    n_data(p) := tb; incr(ntables)
+  end;
+  FindTable := n_data(p)
+end;
+
+{ |AddAnswer| -- add an answer to a table if it is new }
+procedure &AddAnswer(tb: pointer; t: term);
+  var p: pointer;
+begin
+  p := TriePath(tb_answers(tb), t, NULL);
+  if fresh then begin
+    if tb_last(tb) = NULL then
+      tb_first(tb) := p
+    else
+      n_data(tb_last(tb)) := p;
+    tb_last(tb) := p;
+    incr(tb_count(tb)); incr(nanswers)
+  end
+end;
+
+{ |RunClauses| -- find all answers from the clauses for |call| }
+procedure &RunClauses(tb: pointer);
+  var &savebase: frame; &savegoal: pointer; &savegframe: frame;
+begin
+  savegoal := pgoal; savegframe := pgframe;
+  PushFrame(1, NULL);
+  savebase := base; base := goalframe; choice := goalframe;
+  t_val(f_local(goalframe, 1)) :=
+    GloCopy(call, f_parent(goalframe));
+  current := callbody;
+  call := Deref(g_first(current), goalframe);
+  callkey := Key(call, goalframe);
+  FirstClause(call, callkey);
+  Resolve;
+  if ok then Unwind;
+  Resume;
+  while ok and run do begin
+    AddAnswer(tb, Deref(f_local(base, 1), NULL));
+    ok := false; Resume
+  end;
+
+  { Undo everything, as if the goal had failed }
+  choice := base; Restore;
+  gsp := f_glotop(base);
+  if gcmark < gsp then gcmark := gsp;
+  choice := f_choice(base); goalframe := f_parent(base);
+  current := f_goal(base); lsp := base-1; base := savebase;
+  call := Deref(g_first(current), goalframe);
+  pgoal := savegoal; pgframe := savegframe
+end;
+
+{ |Complete| -- pop tables down to leader |tb| evaluated from |last| }
+procedure &Complete(tb: pointer; &last: integer);
+  var &popped: boolean; x: pointer;
+begin
+  popped := false;
+  while not popped do begin
+    x := tbstack; tbstack := tb_stack(x);
+    tb_stack(x) := NULL; tb_onstack(x) := 0;
+    if (x = tb) or (tb_dfn(x) > last) then
+      tb_state(x) := COMPLETE
+    else
+      begin tb_state(x) := INCOMPLETE; tb_dfn(x) := 0 end;
+    popped := (x = tb)
+  end
+end;
+
+{ |Evaluate| -- evaluate a tabled call until no more answers appear }
+procedure &Evaluate(tb: pointer);
+  var &outer: pointer; &before, &last, &outround: integer;
+begin
+  outer := evaltbl; evaltbl := tb; outround := curround;
+  if tb_onstack(tb) = 0 then begin
+    tb_stack(tb) := tbstack; tbstack := tb; tb_onstack(tb) := 1
+  end;
+  incr(ndfn); tb_dfn(tb) := ndfn; tb_low(tb) := ndfn;
+  tb_state(tb) := EVALUATING;
+  repeat
+    before := nanswers; last := ndfn; curround := last;
+    RunClauses(tb)
+  until (nanswers = before) or (tb_low(tb) < tb_dfn(tb)) or not run;
+  tb_state(tb) := INCOMPLETE;
+  if run and (tb_low(tb) = tb_dfn(tb)) then Complete(tb, last);
+  evaltbl := outer; curround := outround;
+  if outer <> NULL then
+    if tb_low(tb) < tb_low(outer) then tb_low(outer) := tb_low(tb)
+end;
+
+{ |DoTable| -- call a tabled relation }
+function &DoTable: boolean;
+  var tb: pointer;
+begin
+  tb := FindTable(call, goalframe);
+  if tb_state(tb) = EVALUATING then begin
+    if tb_dfn(tb) < tb_low(evaltbl) then tb_low(evaltbl) := tb_dfn(tb)
+  end
+  else if tb_state(tb) = INCOMPLETE then begin
+    if (evaltbl = NULL) or (tb_dfn(tb) <= curround) then
+      Evaluate(tb)
+    else if tb_low(tb) < tb_low(evaltbl) then
+      tb_low(evaltbl) := tb_low(tb)
+  end;
+
+  if (not run) or (tb_first(tb) = NULL) then
+    DoTable := false
+  else begin
+    PushFrame(2, NULL);
+    t_val(f_local(goalframe, 1)) :=
+      GloCopy(call, f_parent(goalframe));
+    t_val(f_local(goalframe, 2)) := NewInt(tb_first(tb));
+    current := tblbody;
+    DoTable := true
+  end
+end;
+
+{ |DoTblGet| -- hidden relation |$get/2| }
+function &DoTblGet: boolean;
+begin
+  GetArgs;
+  current := g_rest(current);
+  DoTblGet := Unify(av[2], goalframe, TrieValue(a_ival(1)), NULL)
+end;
+
+{ |DoTblNext| -- hidden relation |$next/2| }
+function &DoTblNext: boolean;
+  var p: pointer;
+begin
+  GetArgs;
+  current := g_rest(current);
+  p := n_data(a_ival(1));
+  if p = NULL then
+    DoTblNext := false
+  else
+    DoTblNext := Unify(av[2], goalframe, NewInt(p), NULL)
+end;
+
+{ |ResetTables| -- abandon evaluations cut short by an error }
+procedure &ResetTables;
+  var tb: pointer;
+begin
+  while tbstack <> NULL do begin
+    tb := tbstack; tbstack := tb_stack(tb);
+    tb_state(tb) := INCOMPLETE; tb_dfn(tb) := 0;
+    tb_stack(tb) := NULL; tb_onstack(tb) := 0
+  end;
+  evaltbl := NULL; curround := ndfn
+end;
+
+{ |DoStats| -- built-in relation |stats/0| }
+function &DoStats: boolean;
+begin
+  writeln;
+  writeln('heap ', hp:1, ', local ', lsp-hp:1, ', global ',
+    MEMSIZE+1-gsp:1, ', limit ', memlimit:1, ' words (raised ',
+    nexpand:1, ' times)');
+  writeln('strings ', charptr:1, ' chars, ', nsymbols:1,
+    ' symbols, hash table ', hashsize:1);
+  write('tables ', ntables:1, ', answers ', nanswers:1, ', trie nodes ',
+    nnodes:1, ', table space ', tbtop:1, ' words');
+  current := g_rest(current);
+  DoStats := true
+end;
+
 { |DoBuiltin| -- switch for built-in relations }
 function &DoBuiltin fwd((&action: integer): boolean);
 begin
@@ -1793,7 +3000,11 @@ begin
   EQUALITY: DoBuiltin := DoEqual;
   FAIL:	    DoBuiltin := false;
   PRINT:    DoBuiltin := DoPrint;
-  NL:	    DoBuiltin := DoNl
+  NL:	    DoBuiltin := DoNl;
+  STATS:    DoBuiltin := DoStats;
+  TABLED:   DoBuiltin := DoTable;
+  TBLGET:   DoBuiltin := DoTblGet;
+  TBLNEXT:  DoBuiltin := DoTblNext
   default
     bad_tag('DoBuiltin', action)
   end
@@ -1828,9 +3039,25 @@ end;
   execution is abandoned without much grace.  This plan works
   because the amount of space consumed in a resolution step is
   bounded by the maximum size of a program clause; this size is not
-  checked, though. }
+  checked, though.
+
+  Most terms die young, so most collections are `minor' ones that
+  deal only with the part of the global stack below |gcmark|, which
+  holds the terms made since the last collection.  Everything above
+  |gcmark| is taken to be alive and is left where it is; the only
+  pointers from there into the young part are bindings of old cells,
+  and these are found from the newer part of the trail.  If a minor
+  collection does not free enough space, it is followed by a `major'
+  one over the whole global stack.  Either way, the survivors become
+  old.  The variable |gctop| marks the top of the part being
+  collected, so that all the phases below serve for both kinds. }
+
+var
+  &shift: integer;  { amount global stack will shift }
+  &gctop: pointer;  { top of the region being collected }
 
-var &shift: integer;  { amount global stack will shift }
+{ |in_gc| -- test if a pointer is in the region being collected }
+define(&in_gc, (is_glob($1) and ($1 < gctop)))
 
 { |Visit| -- recursively mark a term and all its sub-terms }
 procedure &Visit(t: term);
@@ -1841,7 +3068,7 @@ begin
     treating the last argument of a function iteratively, making
     recursive calls only for the other arguments. }
   while t <> NULL do begin
-    if not is_glob(t) or marked(t) then return;
+    if not in_gc(t) or marked(t) then return;
     add_mark(t);
     case t_kind(t) of
     FUNC:
@@ -1875,13 +3102,24 @@ begin
   end
 end;
 
+{ |MarkOld| -- mark the values of old cells bound since the last GC }
+procedure &MarkOld;
+  var p: trail;
+begin
+  p := trhead;
+  while (p <> NULL) and (p < gctop) do begin
+    if x_reset(p) >= gctop then Visit(t_val(x_reset(p)));
+    p := x_next(p)
+  end
+end;
+
 { |CullTrail| -- delete an initial segment of unwanted trail }
 procedure &CullTrail(var p: trail);
   label &exit;
 begin
-  while p <> NULL do begin
+  while (p <> NULL) and (p < gctop) do begin
     if x_reset(p) <> NULL then
-      if not is_glob(x_reset(p)) or marked(x_reset(p)) then
+      if not in_gc(x_reset(p)) or marked(x_reset(p)) then
 	return;
     p := x_next(p)
   end;
@@ -1893,27 +3131,47 @@ procedure &MarkTrail;
   var p: trail;
 begin
   CullTrail(trhead); p := trhead;
-  while p <> NULL do
+  while (p <> NULL) and (p < gctop) do
     begin add_mark(p); CullTrail(x_next(p)); p := x_next(p) end
 end;
 
+{ The shift is recorded only in marked blocks.  In each unmarked
+  block, |Relocate| leaves instead the address of the next marked
+  block above it, so that |AdjustStack| can find the new value of
+  each |f_glotop| field without searching.  The unmarked blocks that
+  are waiting for the next marked block are chained together through
+  the same field. }
+
+{ |Forward| -- point a chain of unmarked blocks at |p| }
+procedure &Forward(q, p: pointer);
+  var r: pointer;
+begin
+  while q <> NULL do
+    begin r := t_shift(q); t_shift(q) := p; q := r end
+end;
+
 { |Relocate| -- compute shifts }
 procedure &Relocate;
-  var p: pointer; &step: integer;
+  var p, q: pointer; &step: integer;
 begin
-  shift := 0; p := gsp;
-  while p <= MEMSIZE do begin
-    step := t_size(p); t_shift(p) := shift;
-    if not marked(p) then
+  shift := 0; p := gsp; q := NULL;
+  while p < gctop do begin
+    step := t_size(p);
+    if marked(p) then
+      begin t_shift(p) := shift; Forward(q, p); q := NULL end
+    else begin
       shift := shift + step;
+      t_shift(p) := q; q := p
+    end;
     p := p + step
-  end
+  end;
+  Forward(q, gctop)
 end;
 
 { |AdjustPointer| -- update a pointer}
 procedure &AdjustPointer(var p: term);
 begin
-  if (p <> NULL) and is_glob(p) then begin
+  if (p <> NULL) and in_gc(p) then begin
     if not marked(p) then
       panic('adjusting pointer to unmarked block');
     p := p + shift - t_shift(p)
@@ -1922,26 +3180,24 @@ end;
 
 { |AdjustStack| -- adjust pointers in local stack }
 procedure &AdjustStack;
-  var f: frame; i: integer; q: pointer;
-  label &found, &found2;
+  var f: frame; i: integer; q, r, &r2: pointer;
 begin
   f := hp+1;
   while f <= lsp do begin
     q := f_glotop(f);
-    while q <= MEMSIZE do begin
-      if marked(q) then goto found;
-      q := q + t_size(q)
-    end;
-  found:
-    if q <= MEMSIZE then AdjustPointer(q);
+    if (q < gctop) and not marked(q) then q := t_shift(q);
+    AdjustPointer(q);
     f_glotop(f) := q;
 
+    { Find the first live trail entry, then make the dead ones that
+      were passed over point straight to it, so that frames further
+      up need not follow the same path. }
     q := f_trail(f);
-    while q <> NULL do begin
-      if marked(q) then goto found2;
-      q := x_next(q)
-    end;
-  found2:
+    while (q <> NULL) and (q < gctop) and not marked(q) do
+      q := x_next(q);
+    r := f_trail(f);
+    while r <> q do
+      begin r2 := x_next(r); x_next(r) := q; r := r2 end;
     AdjustPointer(q);
     f_trail(f) := q;
 
@@ -1952,12 +3208,24 @@ begin
   end
 end;
 
+{ |AdjustOld| -- update pointers from old cells }
+procedure &AdjustOld;
+  var p: trail;
+begin
+  { This must come first, while the trail links are unchanged }
+  p := trhead;
+  while (p <> NULL) and (p < gctop) do begin
+    if x_reset(p) >= gctop then AdjustPointer(t_val(x_reset(p)));
+    p := x_next(p)
+  end
+end;
+
 { |AdjustInternal| -- update internal pointers }
 procedure &AdjustInternal;
   var p, i: integer;
 begin
   p := gsp;
-  while p <= MEMSIZE do begin
+  while p < gctop do begin
     if marked(p) then begin
       case t_kind(p) of
       FUNC:
@@ -1985,7 +3253,7 @@ procedure &Compact;
   var p, q, &step, i: integer;
 begin
   p := gsp; q := gsp;
-  while p <= MEMSIZE do begin
+  while p < gctop do begin
     step := t_size(p);
     if marked(p) then begin rem_mark(p);
       for i := 0 to step-1 do mem[q+i] := mem[p+i];
@@ -1994,39 +3262,170 @@ begin
     p := p + step
   end;
   gsp := gsp+shift;
-  for i := MEMSIZE downto gsp do mem[i] := mem[i-shift];
+  for i := gctop-1 downto gsp do mem[i] := mem[i-shift];
 end;
 
-{ |Collect| -- collect garbage }
-procedure &Collect;
+{ |Sweep| -- collect garbage below |top| }
+procedure &Sweep(top: pointer);
 begin
-  write('[gc'); flush_out;
+  gctop := top;
 
   { Phase 1: marking }
-  Visit(call); MarkStack; MarkTrail;
+  Visit(call); MarkStack; MarkOld; MarkTrail;
 
   { Phase 2: compute new locations }
   Relocate;
 
   { Phase 3: adjust pointers }
-  AdjustPointer(call); AdjustPointer(trhead);
+  AdjustOld; AdjustPointer(call); AdjustPointer(trhead);
   AdjustStack; AdjustInternal;
 
   { Phase 4: compact }
-  Compact;
+  Compact
+end;
+
+{ |Collect| -- collect garbage }
+procedure &Collect;
+  var &start, &before: integer;
+begin
+  write('[gc'); flush_out;
+  start := cputime; before := gsp;
+
+  if gcmark <= MEMSIZE then
+    begin Sweep(gcmark); incr(nminor) end;
+  if (gcmark > MEMSIZE) or (mem_used + GCHIGH > memlimit) then
+    begin Sweep(MEMSIZE+1); incr(nmajor) end;
+  gcmark := gsp;
+
+  reclaimed := reclaimed + gsp - before;
+  start := Elapsed(start);
+  if gctime > CLOCKMAX - start then gctime := CLOCKMAX  { clamp }
+  else gctime := gctime + start;
+  if start > gcmax then gcmax := start;
 
   write(']'); flush_out;
-  if gsp - lsp <= GCHIGH then exec_error('out of memory space')
+  Expand(mem_used + GCHIGH);
+  if mem_used + GCHIGH > memlimit then exec_error('out of memory space')
+end;
+
+{ |GCReport| -- print statistics for collections during a goal }
+procedure &GCReport;
+begin
+  if nminor + nmajor > 0 then begin
+    writeln;
+    write('[gc: ', nminor:1, ' minor, ', nmajor:1, ' major, ',
+      reclaimed:1, ' words reclaimed, ', gctime:1, ' us, longest ',
+      gcmax:1, ' us]')
+  end
+end;
+
+{S Program images }
+
+{ The state of picoProlog after it has read a program can be saved
+  in an image file with the option `|-s file|', and loaded again with
+  `|-l file|', much faster than the program could be read.  The state
+  is made up of the heap, which holds the clauses with their indexes
+  and compiled heads, together with the string buffer and the symbol
+  table; the stacks are empty between goals.  Tables are kept from
+  one goal to the next, but an image is saved after the program has
+  been read and before any goal has run, so there are none yet:
+  |tmem| is left out of the image on purpose, every |s_table| in it
+  is |NULL|, and a program loaded from an image starts with no tables,
+  just as one that is read.  Each part is written as a single block of
+  words.  |Initialize| makes the same built-in symbols and heap nodes
+  every time, so the global variables that point to them are still
+  right after an image is loaded, and the header of the image
+  records how far it went, so that an image made by a different
+  version of picoProlog is refused.  The compiled heads are part of
+  the heap too, so if the image is loaded with `-i' they are thrown
+  away by |DropCode|, and every clause is matched with |Unify| just
+  as if the program had been read with `-i'. }
+
+var
+  &inithp, &initsyms: integer;  { state after |Initialize| }
+  &imghead: array [1..IMGHEAD] of integer;  { header for an image }
+  &imgfile: text;  { the image file }
+  &loadname, &savename: tempstring;  { names from the command line }
+  &loading, &saving: boolean;  { whether they were given }
+
+{ |SaveImage| -- save the program in an image file }
+procedure &SaveImage;
+  var &good: boolean;
+begin
+  imghead[1] := IMGMAGIC; imghead[2] := inithp;
+  imghead[3] := initsyms; imghead[4] := MEMSIZE;
+  imghead[5] := FRAME_SIZE; imghead[6] := hp;
+  imghead[7] := charptr; imghead[8] := nsymbols;
+  imghead[9] := hashsize; imghead[10] := memlimit;
+  good := openout(imgfile, savename);
+  if good then begin
+    good := putblock(imgfile, imghead, IMGHEAD)
+      and putblock(imgfile, mem, hp)
+      and putblock(imgfile, charbuf, charptr)
+      and putblock(imgfile, symtab, nsymbols)
+      and putblock(imgfile, hashtab, hashsize);
+    closeout(imgfile)
+  end;
+  if not good then begin
+    write('Can''t write '); WriteTemp(savename); writeln;
+    abort
+  end;
+  write('Saved '); WriteTemp(savename); writeln
+end;
+
+{ |DropCode| -- forget the compiled heads of every clause }
+procedure &DropCode;
+  var i: integer; c: clause;
+begin
+  for i := 1 to nsymbols do begin
+    c := s_proc(i);
+    while c <> NULL do
+      begin c_code(c) := NULL; c := c_next(c) end
+  end
+end;
+
+{ |LoadImage| -- load a program from an image file }
+procedure &LoadImage;
+  var &good: boolean;
+begin
+  good := openin(imgfile, loadname);
+  if good then begin
+    good := getblock(imgfile, imghead, IMGHEAD);
+    if good then
+      good := (imghead[1] = IMGMAGIC) and (imghead[2] = inithp)
+        and (imghead[3] = initsyms) and (imghead[4] = MEMSIZE)
+        and (imghead[5] = FRAME_SIZE) and (imghead[6] < MEMSIZE div 2)
+        and (imghead[7] <= MAXCHARS) and (imghead[8] <= MAXSYMBOLS)
+        and (imghead[9] <= MAXHASH);
+    if good then begin
+      hp := imghead[6]; charptr := imghead[7];
+      nsymbols := imghead[8]; hashsize := imghead[9];
+      if memlimit < imghead[10] then memlimit := imghead[10];
+      good := getblock(imgfile, mem, hp)
+        and getblock(imgfile, charbuf, charptr)
+        and getblock(imgfile, symtab, nsymbols)
+        and getblock(imgfile, hashtab, hashsize)
+    end;
+    closein(imgfile)
+  end;
+  if not good then begin
+    write('Can''t load '); WriteTemp(loadname); writeln;
+    abort
+  end;
+  if not cflag then DropCode;
+  write('Loaded '); WriteTemp(loadname); writeln
 end;
 
 {S Main program }
 
 { |Initialize| -- initialize everything }
 procedure &Initialize;
-  var i: integer; p: term;
+  var i: integer; p: term; &body: argbuf;
 begin
-  dflag := false; errcount := 0;
+  dflag := false; cflag := true; pflag := false; errcount := 0;
+  batching := false;
   pbchar := ENDFILE; charptr := 0;
+  memlimit := MEMINIT; nexpand := 0;
   hp := 0; InitSymbols;
 
   { Set up the |refnode| array }
@@ -2039,7 +3438,23 @@ begin
   { The dummy clause $\it call(\sci p) \IF p$ is used by |call/1|. }
   callbody := HeapAlloc(2);
   g_first(callbody) := MakeRef(1);
-  g_first(g_rest(callbody)) := NULL
+  g_first(g_rest(callbody)) := NULL;
+
+  { Tables start empty, and answers are returned by |$tbl/2| }
+  tbtop := 0; nnodes := 0; tbstack := NULL; evaltbl := NULL;
+  ntables := 0; nanswers := 0; ndfn := 0; curround := 0;
+  for i := 1 to TRIEHASH do triehash[i] := NULL;
+  body[1] := MakeNode(tblget, MakeRef(2), MakeRef(1));
+  AddClause(MakeClause(2, MakeNode(tblsym, MakeRef(1), MakeRef(2)),
+    body, 1));
+  body[1] := MakeNode(tblnext, MakeRef(2), MakeRef(3));
+  body[2] := MakeNode(tblsym, MakeRef(1), MakeRef(3));
+  AddClause(MakeClause(3, MakeNode(tblsym, MakeRef(1), MakeRef(2)),
+    body, 2));
+  tblbody := HeapAlloc(2);
+  g_first(tblbody) := MakeNode(tblsym, MakeRef(1), MakeRef(2));
+  g_first(g_rest(tblbody)) := NULL;
+  inithp := hp; initsyms := nsymbols
 end;
 
 { |ReadFile| -- read and process clauses from an open file }
@@ -2065,20 +3480,226 @@ begin
   until c = NULL
 end;
 
+{ In batch mode, selected by the option `|-b file|', the queries
+  are read from a file instead of the terminal, one per clause in the
+  same form as they would be typed at the prompt, and all answers to
+  each are shown.  The queries are independent, so they can be
+  answered in parallel: after the program has been read, the batch
+  file is read once to check it and to note where each query starts,
+  and then the interpreter forks |njobs| worker processes (set with
+  `|-j n|').  The workers share the program database copy-on-write
+  and each has its own stacks, so nothing is copied in advance.
+
+  The queries are handed out one at a time from a counter that the
+  workers share, so a worker that has finished a quick query goes on
+  to the next one while another is still busy with a slow one, and
+  each worker reads only the queries it takes, going straight to each
+  of them with |seekin|.  The answers to each query go to a temporary
+  file of its own; when all the workers are finished, the files are
+  copied to the output in order, so the result is the same as
+  answering the queries one by one.  If the counter can't be shared
+  or no worker can be started, the queries are answered in the parent
+  instead.  Each query is echoed before its answers with the variable
+  names from the file, so that the output can be matched up with the
+  input. }
+
+var
+  &batch: boolean;  { whether in batch mode }
+  &batchfile: tempstring;  { name of the batch file }
+  &njobs: integer;  { number of worker processes }
+  &jobbase: tempstring;  { prefix for the output files }
+  &qstart: pointer;  { where each query starts: position and line }
+
+{ |EchoQuery| -- print goal |c| with the names from |vartable| }
+procedure &EchoQuery(c: clause);
+  var f: frame; p: term; i: integer;
+begin
+  { Bind each variable to an atom that is its name }
+  f := HeapAlloc(frame_size(nvars));
+  for i := 1 to nvars do begin
+    p := HeapAlloc(TERM_SIZE);
+    t_tag(p) := make_tag(FUNC, TERM_SIZE);
+    t_func(p) := vartable[i];
+    t_tag(f_local(f, i)) := make_tag(CELL, TERM_SIZE);
+    t_val(f_local(f, i)) := p
+  end;
+
+  write('# :- ');
+  i := 1;
+  while c_body(c, i) <> NULL do begin
+    if i > 1 then write(', ');
+    PrintTerm(c_body(c, i), f, MAXPRIO);
+    incr(i)
+  end;
+  writeln('.')
+end;
+
+{ |Answer| -- echo a query and show all its answers }
+procedure &Answer(c: clause);
+begin
+  EchoQuery(c);
+  Execute(c);
+  writeln; writeln
+end;
+
+{ |OpenBatch| -- open the batch file for reading queries }
+procedure &OpenBatch;
+begin
+  if not openin(infile, batchfile) then begin
+    write('Can''t read '); WriteString(filename); writeln;
+    abort
+  end;
+  lineno := 1; pbchar := ENDFILE; batching := true
+end;
+
+{ |ScanBatch| -- read the batch file, noting where each query
+  starts, and return the number of queries; if |solve| is true, also
+  answer them }
+function &ScanBatch(&solve: boolean): integer;
+  var c: clause; n, &pos, &line: integer; p: pointer;
+begin
+  OpenBatch; qstart := hp+1; n := 0;
+  repeat
+    pos := inpos(infile); line := lineno;
+    hmark := hp;
+    c := ReadClause;
+    if c <> NULL then begin
+      if solve then Answer(c);
+      hp := hmark; p := HeapAlloc(2);
+      mem[p] := pos; mem[p+1] := line; incr(n)
+    end
+  until c = NULL;
+  closein(infile); batching := false;
+  ScanBatch := n
+end;
+
+{ |JobName| -- name of the output file for query |n| }
+procedure &JobName(n: integer; var &name: tempstring);
+  var i, j: integer;
+begin
+  i := 1;
+  while jobbase[i] <> ENDSTR do
+    begin name[i] := jobbase[i]; incr(i) end;
+  name[i] := '.';
+  j := 1;
+  while j <= n div 10 do j := 10 * j;
+  repeat
+    incr(i); name[i] := chr(ord('0') + n div j mod 10);
+    j := j div 10
+  until j = 0;
+  name[i+1] := ENDSTR
+end;
+
+{ |Worker| -- answer queries from the shared counter until there
+  are none left }
+procedure &Worker(&nquery: integer);
+  var n: integer; c: clause; &name: tempstring;
+begin
+  OpenBatch; n := nextjob;
+  while n < nquery do begin
+    JobName(n, name);
+    if openout(output, name) then begin
+      seekin(infile, mem[qstart+2*n]); lineno := mem[qstart+2*n+1];
+      pbchar := ENDFILE; hmark := hp;
+      c := ReadClause;
+      if c <> NULL then Answer(c);
+      hp := hmark
+    end;
+    n := nextjob
+  end;
+  closein(infile); batching := false
+end;
+
+{ |CopyFile| -- copy a file to the output }
+procedure &CopyFile(var name: tempstring);
+  var &ch: char;
+begin
+  if openin(infile, name) then begin
+    ch := FGetChar(infile);
+    while ch <> ENDFILE do begin
+      if ch = ENDLINE then writeln else write(ch);
+      ch := FGetChar(infile)
+    end;
+    closein(infile)
+  end
+end;
+
+{ |RunBatch| -- answer the queries in the batch file }
+procedure &RunBatch;
+  var &nquery, i, k, n, &pid: integer; &shared, &parent: boolean;
+    &name: tempstring;
+begin
+  filename := SaveString(batchfile);
+  nquery := ScanBatch(false);
+  if errcount > 0 then abort;
+  if njobs > nquery then njobs := nquery;
+
+  i := 0; k := 0; parent := true;
+  shared := newjobs;
+  if shared then begin
+    tempname(jobbase);
+    while parent and (i < njobs) do begin
+      incr(i); pid := spawn;
+      if pid > 0 then incr(k);
+      parent := (pid <> 0)
+    end
+  end;
+
+  if not parent then
+    { A worker answers queries until there are none left, and stops }
+    Worker(nquery)
+  else begin
+    if k = 0 then
+      nquery := ScanBatch(true)
+    else begin
+      waitall;
+      for n := 0 to nquery-1 do begin
+        JobName(n, name);
+        CopyFile(name); removefile(name)
+      end
+    end;
+    if shared then removefile(jobbase)
+  end
+end;
+
 { |ReadProgram| -- read files listed on command line }
 procedure &ReadProgram;
   var &i0, i: integer;
     &arg: tempstring;
-begin
-  i0 := 1;
-  if argc > 1 then begin
-    argv(1, arg);
-    if (arg[1] = '-') and (arg[2] = 'd')
-	and (arg[3] = ENDSTR) then begin
-      dflag := true;
-      incr(i0)
+    &more: boolean;
+begin
+  batch := false; njobs := JOBS; loading := false; saving := false;
+  i0 := 1; more := true;
+  while more and (i0 < argc) do begin
+    argv(i0, arg);
+    if (arg[1] <> '-') or (arg[2] = ENDSTR) or (arg[3] <> ENDSTR) then
+      more := false
+    else if arg[2] = 'd' then
+      dflag := true
+    else if arg[2] = 'i' then
+      cflag := false
+    else if (arg[2] = 'l') and (i0+1 < argc) then
+      begin incr(i0); argv(i0, loadname); loading := true end
+    else if (arg[2] = 's') and (i0+1 < argc) then
+      begin incr(i0); argv(i0, savename); saving := true end
+    else if (arg[2] = 'p') and (i0+1 < argc) then
+      begin incr(i0); argv(i0, profname); pflag := true end
+    else if (arg[2] = 'b') and (i0+1 < argc) then
+      begin incr(i0); argv(i0, batchfile); batch := true end
+    else if (arg[2] = 'j') and (i0+1 < argc) then begin
+      incr(i0); argv(i0, arg);
+      njobs := 0; i := 1;
+      while is_digit(arg[i]) do begin
+        njobs := 10 * njobs + (ord(arg[i]) - ord('0')); incr(i)
+      end;
+      if njobs < 1 then njobs := 1;
+      if njobs > MAXJOBS then njobs := MAXJOBS
     end
+    else
+      more := false;
+    if more then incr(i0)
   end;
+  if loading then LoadImage;
   for i := i0 to argc-1 do begin
     argv(i, arg);
     filename := SaveString(arg);
@@ -2097,7 +3718,13 @@ begin  { main program }
   writeln('Welcome to picoProlog');
   Initialize;
   interacting := false; ReadProgram;
-  interacting := true; lineno := 1; ReadFile;
-  writeln;
+  if saving then
+    SaveImage
+  else if batch then
+    RunBatch
+  else begin
+    interacting := true; lineno := 1; ReadFile;
+    writeln
+  end;
 end_of_pp:
 end.
@@ -0,0 +1,34 @@
+/* tabling.pp */
+
+/* The flights of flights.pp, with a tabled relation for routes.  The
+   left-recursive definition would loop forever without the table, and
+   so would route(X, rome) with any definition, because of the cycle
+   from london to paris to berlin and back. */
+
+:- table route(A, B).
+
+flight(london, paris) :- .
+flight(london, dublin) :- .
+flight(paris, berlin) :- .
+flight(paris, rome) :- .
+flight(berlin, london) :- .
+
+route(A, C) :- route(A, B), flight(B, C).
+route(A, B) :- flight(A, B).
+
+/* Same generation: two people are of the same generation if they are
+   the same, or if their parents are of the same generation. */
+
+:- table samegen(X, Y).
+
+parent(ann, carol) :- .
+parent(bob, carol) :- .
+parent(dan, ann) :- .
+parent(eve, bob) :- .
+parent(carol, fred) :- .
+
+person(X) :- parent(X, Y).
+person(Y) :- parent(X, Y).
+
+samegen(X, X) :- person(X).
+samegen(X, Y) :- parent(X, P), samegen(P, Q), parent(Y, Q).
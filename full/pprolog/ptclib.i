@@ -36,7 +36,7 @@ void allocate(integer huge **mem, long size)
 
 void flush()
 {
-	fflush(stdout);
+	fflush(output);
 }
 
 boolean eof(f)
@@ -75,10 +75,34 @@ char *name;
 }
 
 
-void closein(f)
-text f;
+#define closein(f) _closein(&f)
+
+void _closein(f)
+text *f;
+{
+     fclose(*f);
+     *f = NULL;
+}
+
+#define openout(f, name) _openout(&f, name)
+
+int _openout(f, name)
+text *f;
+char *name;
+{
+     if (*f != NULL && *f != stdout) fclose(*f);
+
+     if ((*f = fopen(name, "w")) == NULL) return FALSE;
+     return TRUE;
+}
+
+#define closeout(f) _closeout(&f)
+
+void _closeout(f)
+text *f;
 {
-     fclose(f);
+     fclose(*f);
+     *f = NULL;
 }
 
 int save_argc;
@@ -96,6 +120,81 @@ char *buf;
      strcpy(buf, save_argv[i]);
 }
 
+#include <time.h>
+
+/* CPU time in microseconds, modulo 2**31 */
+integer cputime()
+{
+     return (integer) ((unsigned long) clock()
+                       * (1000000 / CLOCKS_PER_SEC) & 0x7fffffff);
+}
+
+/* Read or write the first n elements of an array as a block */
+#define getblock(f, a, n) \
+     (fread((char *) (a), sizeof((a)[0]), (n), (f)) == (n))
+#define putblock(f, a, n) \
+     (fwrite((char *) (a), sizeof((a)[0]), (n), (f)) == (n))
+
+#include <unistd.h>
+#include <sys/wait.h>
+
+/* Start a worker process: 0 in the worker, its id in the parent,
+   or -1 if it can't be started */
+integer spawn()
+{
+     fflush(stdout);
+     return (integer) fork();
+}
+
+/* Wait for all worker processes to finish */
+void waitall()
+{
+     while (wait(NULL) > 0) ;
+}
+
+/* Create an empty temporary file and return its name */
+void tempname(buf)
+char *buf;
+{
+     int fd;
+
+     strcpy(buf, "/tmp/ppXXXXXX");
+     fd = mkstemp(buf);
+     if (fd >= 0) close(fd);
+}
+
+void removefile(name)
+char *name;
+{
+     remove(name);
+}
+
+#include <sys/mman.h>
+
+static integer *jobcount;
+
+/* Make a counter that worker processes share, starting from 0;
+   return FALSE if it can't be shared */
+boolean newjobs()
+{
+     jobcount = (integer *) mmap(NULL, sizeof(integer),
+				 PROT_READ | PROT_WRITE,
+				 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+     if (jobcount == (integer *) MAP_FAILED) return FALSE;
+     *jobcount = 0;
+     return TRUE;
+}
+
+/* Take the next number from the shared counter */
+integer nextjob()
+{
+     return (integer) __sync_fetch_and_add(jobcount, 1);
+}
+
+/* Find the position in an input file, or go back to it */
+#define inpos(f) ((integer) ftell(f))
+#define seekin(f, n) fseek(f, (long) (n), SEEK_SET)
+
 static char obuf[BUFSIZ];
 
 int main(ac, av)
@@ -1,10 +1,30 @@
+#define _POSIX_C_SOURCE 200809L
 #include<limits.h>
 #include<stdarg.h>
+#include<stdio.h>
+#include<string.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
 
 #include"bloom.h"
 
-#define SETBIT(a, n) (a[n/CHAR_BIT] |= (1<<(n%CHAR_BIT)))
-#define GETBIT(a, n) (a[n/CHAR_BIT] & (1<<(n%CHAR_BIT)))
+/* Bits are only ever set, so relaxed atomics are enough to let threads
+ * add to and check a filter at the same time without locking: a check
+ * racing with an add of the same key may miss it, nothing worse. */
+#ifdef __GNUC__
+#define ATOMIC_OR(p, v) __atomic_fetch_or((p), (v), __ATOMIC_RELAXED)
+#define ATOMIC_AND(p, v) __atomic_fetch_and((p), (v), __ATOMIC_RELAXED)
+#define ATOMIC_LOAD(p) __atomic_load_n((p), __ATOMIC_RELAXED)
+#else
+#define ATOMIC_OR(p, v) (*(p) |= (v))
+#define ATOMIC_AND(p, v) (*(p) &= (v))
+#define ATOMIC_LOAD(p) (*(p))
+#endif
+
+#define SETBIT(a, n) ATOMIC_OR(&a[n/CHAR_BIT], (unsigned char)(1<<(n%CHAR_BIT)))
+#define GETBIT(a, n) (ATOMIC_LOAD(&a[n/CHAR_BIT]) & (1<<(n%CHAR_BIT)))
 
 BLOOM *bloom_create(size_t size, size_t nfuncs, ...)
 {
@@ -65,3 +85,456 @@ int bloom_check(BLOOM *bloom, const char *s)
 
 	return 1;
 }
+
+/* MurmurHash64A, by Austin Appleby (public domain). */
+uint64_t bloom_hash(const void *key, size_t len, uint64_t seed)
+{
+	const uint64_t m=0xc6a4a7935bd1e995ULL;
+	const int r=47;
+	const unsigned char *p=key, *end=p+(len&~(size_t)7);
+	uint64_t h=seed^(len*m), k;
+
+	for(; p!=end; p+=8) {
+		memcpy(&k, p, 8);
+		k*=m;
+		k^=k>>r;
+		k*=m;
+		h^=k;
+		h*=m;
+	}
+	switch(len&7) {
+	case 7: h^=(uint64_t)p[6]<<48; /* fall through */
+	case 6: h^=(uint64_t)p[5]<<40; /* fall through */
+	case 5: h^=(uint64_t)p[4]<<32; /* fall through */
+	case 4: h^=(uint64_t)p[3]<<24; /* fall through */
+	case 3: h^=(uint64_t)p[2]<<16; /* fall through */
+	case 2: h^=(uint64_t)p[1]<<8; /* fall through */
+	case 1: h^=(uint64_t)p[0];
+		h*=m;
+	}
+	h^=h>>r;
+	h*=m;
+	h^=h>>r;
+
+	return h;
+}
+
+#define BBLOOM_WORDS (BBLOOM_BLOCK/sizeof(uint64_t))
+#define BBLOOM_BITS (BBLOOM_BLOCK*CHAR_BIT)
+
+#ifdef __GNUC__
+#define PREFETCH(p) __builtin_prefetch(p)
+#else
+#define PREFETCH(p) ((void)(p))
+#endif
+
+/* The high half of the hash picks the block (by multiply and shift,
+ * cheaper than a division). Bit i is the top 9 bits of the hash times
+ * the i+1th power of an odd constant. Kirsch-Mitzenmacher double
+ * hashing modulo the bits in a block was used before, but h1 and h2
+ * modulo 512 give at most 2^17 different masks per block, so the false
+ * positive rate stopped falling at about 1 in 1000 however many bits
+ * per key were given. The slices of a scalable filter ask for far lower
+ * rates than that. */
+#define BBLOOM_SHIFT (64-9)
+static uint64_t *bbloom_block(BBLOOM *bloom, uint64_t h)
+{
+	return bloom->blocks+((h>>32)*bloom->nblocks>>32)*BBLOOM_WORDS;
+}
+
+static void bbloom_mask(BBLOOM *bloom, uint64_t h, uint64_t *mask)
+{
+	uint64_t x=h;
+	size_t i, bit;
+
+	memset(mask, 0, BBLOOM_BLOCK);
+	for(i=0; i<bloom->k; ++i) {
+		x*=0x9e3779b97f4a7c15ULL;
+		bit=(size_t)(x>>BBLOOM_SHIFT);
+		mask[bit/64]|=(uint64_t)1<<(bit%64);
+	}
+}
+
+BBLOOM *bbloom_create(size_t size, size_t k)
+{
+	BBLOOM *bloom;
+
+	if(!(bloom=malloc(sizeof(BBLOOM)))) return NULL;
+	bloom->nblocks=(size+BBLOOM_BITS-1)/BBLOOM_BITS;
+	if(bloom->nblocks==0) bloom->nblocks=1;
+	if(bloom->nblocks>UINT32_MAX || k==0) {
+		free(bloom);
+		return NULL;
+	}
+	if(!(bloom->mem=calloc(bloom->nblocks+1, BBLOOM_BLOCK))) {
+		free(bloom);
+		return NULL;
+	}
+	bloom->blocks=(uint64_t*)(((uintptr_t)bloom->mem+BBLOOM_BLOCK-1)&~(uintptr_t)(BBLOOM_BLOCK-1));
+	bloom->k=k;
+	bloom->map=NULL;
+	bloom->maplen=0;
+	bloom->readonly=0;
+
+	return bloom;
+}
+
+int bbloom_destroy(BBLOOM *bloom)
+{
+	if(bloom->map) munmap(bloom->map, bloom->maplen);
+	free(bloom->mem);
+	free(bloom);
+
+	return 0;
+}
+
+int bbloom_add(BBLOOM *bloom, const void *key, size_t len)
+{
+	uint64_t h=bloom_hash(key, len, 0), mask[BBLOOM_WORDS], *b=bbloom_block(bloom, h);
+	size_t i;
+
+	if(bloom->readonly) return -1;
+	bbloom_mask(bloom, h, mask);
+	for(i=0; i<BBLOOM_WORDS; ++i) {
+		if(mask[i]) ATOMIC_OR(&b[i], mask[i]);
+	}
+
+	return 0;
+}
+
+static int bbloom_test(BBLOOM *bloom, uint64_t h)
+{
+	uint64_t mask[BBLOOM_WORDS], *b=bbloom_block(bloom, h);
+	size_t i;
+
+	bbloom_mask(bloom, h, mask);
+	for(i=0; i<BBLOOM_WORDS; ++i) {
+		if(mask[i] && (ATOMIC_LOAD(&b[i])&mask[i])!=mask[i]) return 0;
+	}
+
+	return 1;
+}
+
+int bbloom_check(BBLOOM *bloom, const void *key, size_t len)
+{
+	return bbloom_test(bloom, bloom_hash(key, len, 0));
+}
+
+/* Check n keys, setting found[i] for each, and return how many were
+ * found. The keys are hashed a batch at a time and all the blocks of
+ * a batch prefetched before any are tested, so the cache misses for
+ * the batch overlap rather than being taken one after another. */
+#define BBLOOM_BATCH 16
+
+size_t bbloom_check_many(BBLOOM *bloom, size_t n, const void *const *keys,
+		const size_t *lens, unsigned char *found)
+{
+	uint64_t h[BBLOOM_BATCH];
+	size_t i, j, m, nfound=0;
+
+	for(i=0; i<n; i+=m) {
+		m=n-i<BBLOOM_BATCH ? n-i : BBLOOM_BATCH;
+		for(j=0; j<m; ++j) {
+			h[j]=bloom_hash(keys[i+j], lens[i+j], 0);
+			PREFETCH(bbloom_block(bloom, h[j]));
+		}
+		for(j=0; j<m; ++j) {
+			found[i+j]=bbloom_test(bloom, h[j]);
+			nfound+=found[i+j];
+		}
+	}
+
+	return nfound;
+}
+
+/* Merge src into dst, which must have the same number of blocks and
+ * bits per key. The union holds every key in either; the intersection
+ * holds every key in both, with a false positive rate no better than
+ * that of the fuller filter. */
+static int bbloom_merge(BBLOOM *dst, BBLOOM *src, int and)
+{
+	size_t i, n=dst->nblocks*BBLOOM_WORDS;
+
+	if(dst->readonly || dst->nblocks!=src->nblocks || dst->k!=src->k) return -1;
+	for(i=0; i<n; ++i) {
+		if(and) ATOMIC_AND(&dst->blocks[i], ATOMIC_LOAD(&src->blocks[i]));
+		else ATOMIC_OR(&dst->blocks[i], ATOMIC_LOAD(&src->blocks[i]));
+	}
+
+	return 0;
+}
+
+int bbloom_union(BBLOOM *dst, BBLOOM *src)
+{
+	return bbloom_merge(dst, src, 0);
+}
+
+int bbloom_intersect(BBLOOM *dst, BBLOOM *src)
+{
+	return bbloom_merge(dst, src, 1);
+}
+
+/* File format: a header of one block followed by the blocks, in host
+ * byte order (the order field catches a file from a machine with the
+ * other one). Keeping the header a block long leaves the blocks block
+ * aligned when the file is mapped. */
+#define BBLOOM_MAGIC "BBLOOM\0\0"
+#define BBLOOM_ORDER 0x0102030405060708ULL
+#define BBLOOM_VERSION 2 /* 1 picked bits by double hashing */
+
+typedef struct {
+	char magic[8];
+	uint64_t order;
+	uint64_t version;
+	uint64_t nblocks;
+	uint64_t k;
+	uint64_t seed;
+	uint64_t reserved[2];
+} bbloom_header;
+
+int bbloom_save(BBLOOM *bloom, const char *file)
+{
+	bbloom_header hdr;
+	FILE *fp;
+	int r=0;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, BBLOOM_MAGIC, sizeof(hdr.magic));
+	hdr.order=BBLOOM_ORDER;
+	hdr.version=BBLOOM_VERSION;
+	hdr.nblocks=bloom->nblocks;
+	hdr.k=bloom->k;
+	hdr.seed=0;
+
+	if(!(fp=fopen(file, "wb"))) return -1;
+	if(fwrite(&hdr, sizeof(hdr), 1, fp)!=1) r=-1;
+	if(!r && fwrite(bloom->blocks, BBLOOM_BLOCK, bloom->nblocks, fp)!=bloom->nblocks) r=-1;
+	if(fclose(fp)) r=-1;
+
+	return r;
+}
+
+/* Map a filter saved by bbloom_save. Nothing is read until it is used,
+ * so even a very large filter opens at once. If writable, adds go to
+ * the file, and other processes mapping it see them. */
+BBLOOM *bbloom_open(const char *file, int writable)
+{
+	BBLOOM *bloom;
+	bbloom_header *hdr;
+	struct stat st;
+	void *map;
+	int fd;
+
+	if((fd=open(file, writable ? O_RDWR : O_RDONLY))<0) return NULL;
+	if(fstat(fd, &st)<0 || (size_t)st.st_size<sizeof(bbloom_header)) {
+		close(fd);
+		return NULL;
+	}
+	map=mmap(NULL, st.st_size, PROT_READ|(writable ? PROT_WRITE : 0), MAP_SHARED, fd, 0);
+	close(fd);
+	if(map==MAP_FAILED) return NULL;
+
+	hdr=map;
+	if(memcmp(hdr->magic, BBLOOM_MAGIC, sizeof(hdr->magic)) || hdr->order!=BBLOOM_ORDER
+			|| hdr->version!=BBLOOM_VERSION || hdr->seed!=0 || hdr->k==0
+			|| hdr->nblocks==0 || hdr->nblocks>UINT32_MAX
+			|| (uint64_t)st.st_size!=(hdr->nblocks+1)*BBLOOM_BLOCK
+			|| !(bloom=malloc(sizeof(BBLOOM)))) {
+		munmap(map, st.st_size);
+		return NULL;
+	}
+	bloom->nblocks=hdr->nblocks;
+	bloom->k=hdr->k;
+	bloom->blocks=(uint64_t*)((char*)map+BBLOOM_BLOCK);
+	bloom->mem=NULL;
+	bloom->map=map;
+	bloom->maplen=st.st_size;
+	bloom->readonly=!writable;
+
+	return bloom;
+}
+
+/* Counter i of a counting filter is the low nibble of byte i/2 if i is
+ * even, the high one if odd. The k counters of a key are picked by
+ * Kirsch-Mitzenmacher double hashing over the whole array; there is
+ * no block to keep them in, so the small second hashes that made
+ * bbloom_mask give it up cost little here. */
+#define GETCOUNT(a, i) ((a[(i)/2]>>((i)%2*4))&0xf)
+#define INCCOUNT(a, i) (a[(i)/2]+=(unsigned char)(1<<((i)%2*4)))
+#define DECCOUNT(a, i) (a[(i)/2]-=(unsigned char)(1<<((i)%2*4)))
+
+static size_t cbloom_index(CBLOOM *bloom, uint64_t h, size_t i)
+{
+	uint64_t h1=h, h2=(h*0x9e3779b97f4a7c15ULL)|1;
+
+	return (size_t)((h1+i*h2)%bloom->size);
+}
+
+CBLOOM *cbloom_create(size_t size, size_t k)
+{
+	CBLOOM *bloom;
+
+	if(size==0 || k==0) return NULL;
+	if(!(bloom=malloc(sizeof(CBLOOM)))) return NULL;
+	if(!(bloom->a=calloc((size+1)/2, 1))) {
+		free(bloom);
+		return NULL;
+	}
+	bloom->size=size;
+	bloom->k=k;
+
+	return bloom;
+}
+
+int cbloom_destroy(CBLOOM *bloom)
+{
+	free(bloom->a);
+	free(bloom);
+
+	return 0;
+}
+
+int cbloom_add(CBLOOM *bloom, const void *key, size_t len)
+{
+	uint64_t h=bloom_hash(key, len, 0);
+	size_t i, n;
+
+	for(i=0; i<bloom->k; ++i) {
+		n=cbloom_index(bloom, h, i);
+		if(GETCOUNT(bloom->a, n)<15) INCCOUNT(bloom->a, n);
+	}
+
+	return 0;
+}
+
+int cbloom_check(CBLOOM *bloom, const void *key, size_t len)
+{
+	uint64_t h=bloom_hash(key, len, 0);
+	size_t i;
+
+	for(i=0; i<bloom->k; ++i) {
+		if(!GETCOUNT(bloom->a, cbloom_index(bloom, h, i))) return 0;
+	}
+
+	return 1;
+}
+
+/* Remove a key that was added; removing one that was not can remove
+ * others too. Returns -1, changing nothing, if the key is not there. */
+int cbloom_remove(CBLOOM *bloom, const void *key, size_t len)
+{
+	uint64_t h=bloom_hash(key, len, 0);
+	size_t i, n;
+
+	if(!cbloom_check(bloom, key, len)) return -1;
+	for(i=0; i<bloom->k; ++i) {
+		n=cbloom_index(bloom, h, i);
+		if(GETCOUNT(bloom->a, n)<15) DECCOUNT(bloom->a, n);
+	}
+
+	return 0;
+}
+
+size_t cbloom_memory(CBLOOM *bloom)
+{
+	return sizeof(CBLOOM)+(bloom->size+1)/2;
+}
+
+/* Each slice holds twice the keys of the one before at half the false
+ * positive rate, so the rates sum to at most twice the first one's;
+ * the first gets half the target. A slice with rate fp wants
+ * k=log2(1/fp) bits set per key and k/ln(2) bits per key in all, but
+ * keys do not spread evenly over the blocks of a blocked filter and
+ * the crowded blocks push the rate up, so it is sized for half. */
+#define SBLOOM_GROWTH 2
+#define SBLOOM_TIGHTEN 0.5
+
+static BBLOOM *sbloom_slice(size_t capacity, double fp)
+{
+	size_t k=1;
+	double p=0.5;
+
+	for(; p>fp/2 && k<BBLOOM_BITS/2; p/=2) k++;
+
+	return bbloom_create((size_t)(capacity*k/0.6931471805599453)+1, k);
+}
+
+SBLOOM *sbloom_create(size_t capacity, double fp)
+{
+	SBLOOM *bloom;
+
+	if(capacity==0 || fp<=0 || fp>=1) return NULL;
+	if(!(bloom=malloc(sizeof(SBLOOM)))) return NULL;
+	bloom->nslices=0;
+	bloom->capacity=capacity;
+	bloom->count=0;
+	bloom->fp=fp*(1-SBLOOM_TIGHTEN);
+	bloom->keys=0;
+	if(!(bloom->slices=malloc(sizeof(BBLOOM*)))
+			|| !(bloom->slices[0]=sbloom_slice(capacity, bloom->fp))) {
+		free(bloom->slices);
+		free(bloom);
+		return NULL;
+	}
+	bloom->nslices=1;
+
+	return bloom;
+}
+
+int sbloom_destroy(SBLOOM *bloom)
+{
+	size_t i;
+
+	for(i=0; i<bloom->nslices; ++i) bbloom_destroy(bloom->slices[i]);
+	free(bloom->slices);
+	free(bloom);
+
+	return 0;
+}
+
+int sbloom_check(SBLOOM *bloom, const void *key, size_t len)
+{
+	uint64_t h=bloom_hash(key, len, 0);
+	size_t i;
+
+	for(i=bloom->nslices; i-->0; ) {
+		if(bbloom_test(bloom->slices[i], h)) return 1;
+	}
+
+	return 0;
+}
+
+/* Add a key to the newest slice, first adding a slice if that one is
+ * full. Keys already present are not added again, so they do not use
+ * up capacity. */
+int sbloom_add(SBLOOM *bloom, const void *key, size_t len)
+{
+	BBLOOM **slices, *slice;
+
+	if(sbloom_check(bloom, key, len)) return 0;
+	if(bloom->count>=bloom->capacity) {
+		if(!(slices=realloc(bloom->slices, (bloom->nslices+1)*sizeof(BBLOOM*)))) return -1;
+		bloom->slices=slices;
+		if(!(slice=sbloom_slice(bloom->capacity*SBLOOM_GROWTH, bloom->fp*SBLOOM_TIGHTEN))) return -1;
+		bloom->slices[bloom->nslices++]=slice;
+		bloom->capacity*=SBLOOM_GROWTH;
+		bloom->fp*=SBLOOM_TIGHTEN;
+		bloom->count=0;
+	}
+	bbloom_add(bloom->slices[bloom->nslices-1], key, len);
+	bloom->count++;
+	bloom->keys++;
+
+	return 0;
+}
+
+size_t sbloom_memory(SBLOOM *bloom)
+{
+	size_t i, n=sizeof(SBLOOM)+bloom->nslices*sizeof(BBLOOM*);
+
+	for(i=0; i<bloom->nslices; ++i) {
+		n+=sizeof(BBLOOM)+(bloom->slices[i]->nblocks+1)*BBLOOM_BLOCK;
+	}
+
+	return n;
+}
@@ -2,6 +2,7 @@
 #define __BLOOM_H__
 
 #include<stdlib.h>
+#include<stdint.h>
 
 typedef unsigned int (*hashfunc_t)(const char *);
 typedef struct {
@@ -16,4 +17,70 @@ int bloom_destroy(BLOOM *bloom);
 int bloom_add(BLOOM *bloom, const char *s);
 int bloom_check(BLOOM *bloom, const char *s);
 
+/* Blocked bloom filter: all the bits for a key are in one 64 byte
+ * block (a cache line), picked by one 64 bit hash of the key, which
+ * also gives the k bit positions in the block by repeated
+ * multiplication.
+ * Adds and checks are safe from any number of threads at once, and a
+ * filter can be saved to a file and mapped back in with bbloom_open. */
+#define BBLOOM_BLOCK 64
+
+typedef struct {
+	size_t nblocks;
+	uint64_t *blocks;	/* BBLOOM_BLOCK aligned */
+	void *mem;
+	size_t k;
+	void *map;	/* set if opened from a file */
+	size_t maplen;
+	int readonly;
+} BBLOOM;
+
+uint64_t bloom_hash(const void *key, size_t len, uint64_t seed);
+
+BBLOOM *bbloom_create(size_t size, size_t k);
+int bbloom_destroy(BBLOOM *bloom);
+int bbloom_add(BBLOOM *bloom, const void *key, size_t len);
+int bbloom_check(BBLOOM *bloom, const void *key, size_t len);
+size_t bbloom_check_many(BBLOOM *bloom, size_t n, const void *const *keys,
+		const size_t *lens, unsigned char *found);
+int bbloom_union(BBLOOM *dst, BBLOOM *src);
+int bbloom_intersect(BBLOOM *dst, BBLOOM *src);
+int bbloom_save(BBLOOM *bloom, const char *file);
+BBLOOM *bbloom_open(const char *file, int writable);
+
+/* Counting bloom filter: 4 bit counters instead of bits, two to a byte,
+ * so keys can be removed again. A counter that reaches 15 stays there.
+ * Not safe to share between threads. */
+typedef struct {
+	size_t size;	/* counters */
+	unsigned char *a;
+	size_t k;
+} CBLOOM;
+
+CBLOOM *cbloom_create(size_t size, size_t k);
+int cbloom_destroy(CBLOOM *bloom);
+int cbloom_add(CBLOOM *bloom, const void *key, size_t len);
+int cbloom_remove(CBLOOM *bloom, const void *key, size_t len);
+int cbloom_check(CBLOOM *bloom, const void *key, size_t len);
+size_t cbloom_memory(CBLOOM *bloom);
+
+/* Scalable bloom filter: a chain of blocked filters, each twice the
+ * size of the one before and with a tighter false positive rate, added
+ * as each one fills, so the whole keeps about the target rate however
+ * many keys are added. Adds are not safe to share between threads. */
+typedef struct {
+	BBLOOM **slices;
+	size_t nslices;
+	size_t capacity;	/* keys the newest slice was sized for */
+	size_t count;	/* keys added to the newest slice */
+	double fp;	/* false positive rate of the newest slice */
+	size_t keys;
+} SBLOOM;
+
+SBLOOM *sbloom_create(size_t capacity, double fp);
+int sbloom_destroy(SBLOOM *bloom);
+int sbloom_add(SBLOOM *bloom, const void *key, size_t len);
+int sbloom_check(SBLOOM *bloom, const void *key, size_t len);
+size_t sbloom_memory(SBLOOM *bloom);
+
 #endif
@@ -19,19 +19,126 @@ unsigned int sdbm_hash(const char *key)
 	return h;
 }
 
+/* check the words of a line in one batch against the blocked filter */
+static void check_line(BBLOOM *bbloom, char *line)
+{
+	const void *keys[512];
+	size_t lens[512];
+	unsigned char found[512];
+	size_t n=0, i;
+	char *p;
+
+	p=strtok(line, " \t,.;:\r\n?!-/()");
+	while(p && n<512) {
+		keys[n]=p;
+		lens[n++]=strlen(p);
+		p=strtok(NULL, " \t,.;:\r\n?!-/()");
+	}
+	bbloom_check_many(bbloom, n, keys, lens, found);
+	for(i=0; i<n; ++i) {
+		if(!found[i]) printf("No match for word \"%s\"\n", (const char*)keys[i]);
+	}
+}
+
+/* add the words of fp to a counting filter, take out every other one,
+ * then the rest; the words left in must still be found, and the filter
+ * must be empty at the end. A counter that reaches 15 sticks there, so
+ * the words should be distinct. */
+static int check_counting(FILE *fp)
+{
+	CBLOOM *cbloom;
+	char line[1024];
+	char *p;
+	size_t pass, n, lost=0, left=0;
+
+	if(!(cbloom=cbloom_create(2500000, 7))) {
+		fprintf(stderr, "ERROR: Could not create bloom filter\n");
+		return EXIT_FAILURE;
+	}
+	for(pass=0; pass<4; ++pass) {
+		rewind(fp);
+		for(n=0; fgets(line, 1024, fp); ++n) {
+			if((p=strchr(line, '\r'))) *p='\0';
+			if((p=strchr(line, '\n'))) *p='\0';
+
+			if(pass==0) cbloom_add(cbloom, line, strlen(line));
+			else if(pass==1 && n%2==0) {
+				if(cbloom_remove(cbloom, line, strlen(line))) ++lost;
+			} else if(pass==2 && n%2==1) {
+				if(!cbloom_check(cbloom, line, strlen(line))) ++lost;
+				else if(cbloom_remove(cbloom, line, strlen(line))) ++lost;
+			} else if(pass==3 && cbloom_check(cbloom, line, strlen(line))) ++left;
+		}
+	}
+	fprintf(stderr, "%lu words, %lu bytes: %lu not found, %lu left after removal\n",
+			(unsigned long)n, (unsigned long)cbloom_memory(cbloom),
+			(unsigned long)lost, (unsigned long)left);
+	cbloom_destroy(cbloom);
+
+	return lost || left ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
 int main(int argc, char *argv[])
 {
 	FILE *fp;
 	char line[1024];
 	char *p;
-	BLOOM *bloom;
-	
-	if(argc<2) {
+	BLOOM *bloom=NULL;
+	BBLOOM *bbloom=NULL;
+	SBLOOM *sbloom=NULL;
+	int blocked=0, scalable=0, counting=0;
+	const char *save=NULL;
+
+	for(; argc>1 && argv[1][0]=='-'; argc--, argv++) {
+		if(!strcmp(argv[1], "-b")) {
+			blocked=1;
+		} else if(!strcmp(argv[1], "-s")) {
+			scalable=1;
+		} else if(!strcmp(argv[1], "-c")) {
+			counting=1;
+		} else if(!strcmp(argv[1], "-o") && argc>2) {
+			blocked=1;
+			save=argv[2];
+			argc--, argv++;
+		} else if(!strcmp(argv[1], "-m") && argc>2) {
+			if(!(bbloom=bbloom_open(argv[2], 0))) {
+				fprintf(stderr, "ERROR: Could not open bloom filter %s\n", argv[2]);
+				return EXIT_FAILURE;
+			}
+			blocked=1;
+			argc--, argv++;
+		} else {
+			break;
+		}
+	}
+	if(argc<2 && !bbloom) {
 		fprintf(stderr, "ERROR: No word file specified\n");
 		return EXIT_FAILURE;
 	}
 
-	if(!(bloom=bloom_create(2500000, 2, sax_hash, sdbm_hash))) {
+	if(bbloom) {
+		goto check;
+	} else if(counting) {
+		int rc;
+
+		if(!(fp=fopen(argv[1], "r"))) {
+			fprintf(stderr, "ERROR: Could not open file %s\n", argv[1]);
+			return EXIT_FAILURE;
+		}
+		rc=check_counting(fp);
+		fclose(fp);
+		return rc;
+	} else if(scalable) {
+		if(!(sbloom=sbloom_create(10000, 0.01))) {
+			fprintf(stderr, "ERROR: Could not create bloom filter\n");
+			return EXIT_FAILURE;
+		}
+	} else if(blocked) {
+		if(!(bbloom=bbloom_create(2500000, 7))) {
+			fprintf(stderr, "ERROR: Could not create bloom filter\n");
+			return EXIT_FAILURE;
+		}
+	} else if(!(bloom=bloom_create(2500000, 2, sax_hash, sdbm_hash))) {
 		fprintf(stderr, "ERROR: Could not create bloom filter\n");
 		return EXIT_FAILURE;
 	}
@@ -45,26 +152,42 @@ int main(int argc, char *argv[])
 		if((p=strchr(line, '\r'))) *p='\0';
 		if((p=strchr(line, '\n'))) *p='\0';
 
-		bloom_add(bloom, line);
+		if(scalable) sbloom_add(sbloom, line, strlen(line));
+		else if(blocked) bbloom_add(bbloom, line, strlen(line));
+		else bloom_add(bloom, line);
 	}
 
 	fclose(fp);
+	if(scalable) fprintf(stderr, "%lu keys in %lu slices, %lu bytes\n",
+			(unsigned long)sbloom->keys, (unsigned long)sbloom->nslices,
+			(unsigned long)sbloom_memory(sbloom));
 
+	if(save && bbloom_save(bbloom, save)) {
+		fprintf(stderr, "ERROR: Could not save bloom filter to %s\n", save);
+		return EXIT_FAILURE;
+	}
+
+check:
 	while(fgets(line, 1024, stdin)) {
 		if((p=strchr(line, '\r'))) *p='\0';
 		if((p=strchr(line, '\n'))) *p='\0';
 
+		if(blocked) {
+			check_line(bbloom, line);
+			continue;
+		}
 		p=strtok(line, " \t,.;:\r\n?!-/()");
 		while(p) {
-			if(!bloom_check(bloom, p)) {
+			if(scalable ? !sbloom_check(sbloom, p, strlen(p)) : !bloom_check(bloom, p)) {
 				printf("No match for word \"%s\"\n", p);
 			}
 			p=strtok(NULL, " \t,.;:\r\n?!-/()");
 		}
 	}
 
-	bloom_destroy(bloom);
+	if(scalable) sbloom_destroy(sbloom);
+	else if(blocked) bbloom_destroy(bbloom);
+	else bloom_destroy(bloom);
 
 	return EXIT_SUCCESS;
 }
-
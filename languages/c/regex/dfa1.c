@@ -1,54 +1,107 @@
 /*
  * Regular expression implementation.
- * Supports only ( | ) * + ?.  No escapes.
+ * Supports only ( | ) * + ? and . for any byte.
+ * A backslash escapes the next character.
  * Compiles to NFA and then simulates NFA
  * using Thompson's algorithm.
- * Caches steps of Thompson's algorithm to 
+ * Caches steps of Thompson's algorithm to
  * build DFA on the fly, as in Aho's egrep.
  *
+ * The compiled NFA is never written to once built;
+ * everything the simulation marks or caches lives in
+ * a Cache, so one Regexp can be matched from several
+ * threads that each own a Cache.  The cache is bounded
+ * by a memory budget and is thrown away when full.  If
+ * it keeps filling up without getting much use out of
+ * the states in it, the match finishes by simulating
+ * the NFA directly, which is slower but still linear.
+ *
+ * recompileset builds one NFA for a whole set of
+ * patterns, each with its own matching state, and
+ * rematchset reports which of them match in one pass
+ * sharing one cache.
+ *
+ * For small patterns refull can instead build the
+ * whole DFA up front and minimize it, after which
+ * matching is one table lookup per byte.
+ *
+ * If every match must contain some literal string,
+ * text is first searched for it with memfind, and
+ * text without it never reaches the automaton.
+ *
  * See also http://swtch.com/~rsc/regexp/ and
  * Thompson, Ken.  Regular Expression Search Algorithm,
  * Communications of the ACM 11(6) (June 1968), pp. 419-422.
- * 
+ *
  * Copyright (c) 2007 Russ Cox.
  * Can be distributed under the MIT license, see bottom of file.
  */
-#include <stdio.h>
+#include <limits.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
+#include "dfa1.h"
+#include "memfind.h"
+
+typedef unsigned char uchar;
+
+/*
+ * NFA state kinds and postfix operators.
+ * Anything below 256 is a literal byte.
+ */
+enum
+{
+	Match = 256,
+	Split,
+	Any,
+	Cat,
+	Alt,
+	Quest,
+	Star,
+	Plus
+};
+
+enum
+{
+	DefaultBudget = 1<<20,
+	MinStates = 8,		/* smallest useful cache, in states */
+	MinBytes = 10,		/* bytes scanned per state built before giving up on the DFA */
+	MaxLit = 32		/* longest literal kept for the prefilter */
+};
 
 /*
  * Convert infix regexp re to postfix notation.
- * Insert . as explicit concatenation operator.
- * Cheesy parser, return static buffer.
+ * Insert Cat as explicit concatenation operator.
+ * Cheesy parser, returns an allocated array of
+ * *np tokens or NULL on a syntax error.
  */
-char*
-re2post(char *re)
+static int*
+re2post(char *re, int *np)
 {
-	int nalt, natom;
-	static char buf[8000];
-	char *dst;
-	struct {
+	int nalt, natom, c;
+	int *buf, *dst;
+	struct Paren {
 		int nalt;
 		int natom;
-	} paren[100], *p;
-	
+	} *paren, *p;
+	size_t len;
+
+	len = strlen(re);
+	buf = malloc((3*len+1)*sizeof buf[0]);
+	paren = malloc((len+1)*sizeof paren[0]);
+	if(buf == NULL || paren == NULL)
+		goto bad;
 	p = paren;
 	dst = buf;
 	nalt = 0;
 	natom = 0;
-	if(strlen(re) >= sizeof buf/2)
-		return NULL;
 	for(; *re; re++){
 		switch(*re){
 		case '(':
 			if(natom > 1){
 				--natom;
-				*dst++ = '.';
+				*dst++ = Cat;
 			}
-			if(p >= paren+100)
-				return NULL;
 			p->nalt = nalt;
 			p->natom = natom;
 			p++;
@@ -57,20 +110,20 @@ re2post(char *re)
 			break;
 		case '|':
 			if(natom == 0)
-				return NULL;
+				goto bad;
 			while(--natom > 0)
-				*dst++ = '.';
+				*dst++ = Cat;
 			nalt++;
 			break;
 		case ')':
 			if(p == paren)
-				return NULL;
+				goto bad;
 			if(natom == 0)
-				return NULL;
+				goto bad;
 			while(--natom > 0)
-				*dst++ = '.';
+				*dst++ = Cat;
 			for(; nalt > 0; nalt--)
-				*dst++ = '|';
+				*dst++ = Alt;
 			--p;
 			nalt = p->nalt;
 			natom = p->natom;
@@ -80,63 +133,106 @@ re2post(char *re)
 		case '+':
 		case '?':
 			if(natom == 0)
-				return NULL;
-			*dst++ = *re;
+				goto bad;
+			*dst++ = *re == '*' ? Star : *re == '+' ? Plus : Quest;
 			break;
+		case '.':
+			c = Any;
+			goto atom;
+		case '\\':
+			if(*++re == 0)
+				goto bad;
+			/* fall through */
 		default:
+			c = *re & 0xFF;
+		atom:
 			if(natom > 1){
 				--natom;
-				*dst++ = '.';
+				*dst++ = Cat;
 			}
-			*dst++ = *re;
+			*dst++ = c;
 			natom++;
 			break;
 		}
 	}
 	if(p != paren)
-		return NULL;
+		goto bad;
 	while(--natom > 0)
-		*dst++ = '.';
+		*dst++ = Cat;
 	for(; nalt > 0; nalt--)
-		*dst++ = '|';
-	*dst = 0;
+		*dst++ = Alt;
+	free(paren);
+	*np = dst - buf;
 	return buf;
+
+bad:
+	free(buf);
+	free(paren);
+	return NULL;
 }
 
 /*
  * Represents an NFA state plus zero or one or two arrows exiting.
  * if c == Match, no arrows out; matching state.
  * If c == Split, unlabeled arrows to out and out1 (if != NULL).
+ * If c == Any, arrow labeled with every byte to out.
  * If c < 256, labeled arrow with character c to out.
  */
-enum
-{
-	Match = 256,
-	Split = 257
-};
 typedef struct State State;
 struct State
 {
 	int c;
 	State *out;
 	State *out1;
-	int lastlist;
+	int id;		/* index in Regexp.states */
+	int pat;	/* for Match, which pattern of a set */
+};
+
+/*
+ * A complete, minimized DFA built ahead of time by refull.
+ * Bytes the NFA cannot tell apart share a class, and the
+ * transitions are a dense table indexed by state*nclass+class.
+ */
+typedef struct Full Full;
+struct Full
+{
+	uchar class[256];
+	int nclass;
+	int nstates;
+	int scaled;	/* trans holds state*nclass, saving a multiply */
+	unsigned start;
+	unsigned stop;	/* states from here on are DState.stop */
+	uint16_t *trans;
+	uchar *accept;
 };
-State matchstate = { Match };	/* matching state */
-int nstate;
+
+struct Regexp
+{
+	State *states;
+	int nstate;
+	State *start;
+	int npat;	/* patterns in the set, each with a Match state */
+	int flags;
+	Full *full;	/* or NULL to build states lazily */
+	uchar lit[MaxLit];	/* every match contains this */
+	int nlit;
+	int litprefix;	/* every match starts with it */
+};
+
+static void freefull(Full*);
 
 /* Allocate and initialize State */
-State*
-state(int c, State *out, State *out1)
+static State*
+state(Regexp *re, int c, State *out, State *out1)
 {
 	State *s;
-	
-	nstate++;
-	s = malloc(sizeof *s);
-	s->lastlist = 0;
+
+	s = &re->states[re->nstate];
+	s->id = re->nstate++;
 	s->c = c;
 	s->out = out;
 	s->out1 = out1;
+	s->pat = 0;
 	return s;
 }
 
@@ -155,7 +251,7 @@ struct Frag
 };
 
 /* Initialize Frag struct. */
-Frag
+static Frag
 frag(State *start, Ptrlist *out)
 {
 	Frag n = { start, out };
@@ -163,7 +259,7 @@ frag(State *start, Ptrlist *out)
 }
 
 /*
- * Since the out pointers in the list are always 
+ * Since the out pointers in the list are always
  * uninitialized, we use the pointers themselves
  * as storage for the Ptrlists.
  */
@@ -174,22 +270,22 @@ union Ptrlist
 };
 
 /* Create singleton list containing just outp. */
-Ptrlist*
+static Ptrlist*
 list1(State **outp)
 {
 	Ptrlist *l;
-	
+
 	l = (Ptrlist*)outp;
 	l->next = NULL;
 	return l;
 }
 
 /* Patch the list of states at out to point to start. */
-void
+static void
 patch(Ptrlist *l, State *s)
 {
 	Ptrlist *next;
-	
+
 	for(; l; l=next){
 		next = l->next;
 		l->s = s;
@@ -197,11 +293,11 @@ patch(Ptrlist *l, State *s)
 }
 
 /* Join the two lists l1 and l2, returning the combination. */
-Ptrlist*
+static Ptrlist*
 append(Ptrlist *l1, Ptrlist *l2)
 {
 	Ptrlist *oldl1;
-	
+
 	oldl1 = l1;
 	while(l1->next)
 		l1 = l1->next;
@@ -210,57 +306,58 @@ append(Ptrlist *l1, Ptrlist *l2)
 }
 
 /*
- * Convert postfix regular expression to NFA.
+ * Convert postfix regular expression to NFA
+ * ending in the matching state match.
  * Return start state.
  */
-State*
-post2nfa(char *postfix)
+static State*
+post2nfa(Regexp *re, int *postfix, int n, State *match)
 {
-	char *p;
-	Frag stack[1000], *stackp, e1, e2, e;
+	int *p;
+	Frag *stack, *stackp, e1, e2, e;
 	State *s;
-	
-	// fprintf(stderr, "postfix: %s\n", postfix);
 
-	if(postfix == NULL)
+	if(n == 0)
+		return match;
+	if((stack = malloc(n*sizeof stack[0])) == NULL)
 		return NULL;
 
 	#define push(s) *stackp++ = s
 	#define pop() *--stackp
 
 	stackp = stack;
-	for(p=postfix; *p; p++){
+	for(p=postfix; p<postfix+n; p++){
 		switch(*p){
 		default:
-			s = state(*p, NULL, NULL);
+			s = state(re, *p, NULL, NULL);
 			push(frag(s, list1(&s->out)));
 			break;
-		case '.':	/* catenate */
+		case Cat:	/* catenate */
 			e2 = pop();
 			e1 = pop();
 			patch(e1.out, e2.start);
 			push(frag(e1.start, e2.out));
 			break;
-		case '|':	/* alternate */
+		case Alt:	/* alternate */
 			e2 = pop();
 			e1 = pop();
-			s = state(Split, e1.start, e2.start);
+			s = state(re, Split, e1.start, e2.start);
 			push(frag(s, append(e1.out, e2.out)));
 			break;
-		case '?':	/* zero or one */
+		case Quest:	/* zero or one */
 			e = pop();
-			s = state(Split, e.start, NULL);
+			s = state(re, Split, e.start, NULL);
 			push(frag(s, append(e.out, list1(&s->out1))));
 			break;
-		case '*':	/* zero or more */
+		case Star:	/* zero or more */
 			e = pop();
-			s = state(Split, e.start, NULL);
+			s = state(re, Split, e.start, NULL);
 			patch(e.out, s);
 			push(frag(s, list1(&s->out1)));
 			break;
-		case '+':	/* one or more */
+		case Plus:	/* one or more */
 			e = pop();
-			s = state(Split, e.start, NULL);
+			s = state(re, Split, e.start, NULL);
 			patch(e.out, s);
 			push(frag(e.start, list1(&s->out1)));
 			break;
@@ -268,277 +365,1073 @@ post2nfa(char *postfix)
 	}
 
 	e = pop();
-	if(stackp != stack)
+	n = stackp != stack;
+	free(stack);
+	if(n)
 		return NULL;
 
-	patch(e.out, &matchstate);
+	patch(e.out, match);
 	return e.start;
 #undef pop
 #undef push
 }
 
+/*
+ * What is known about the strings a fragment matches:
+ * every match starts with pre, ends with suf and
+ * contains req.  If exact, pre is the only match.
+ * Longer literals are cut short, which keeps
+ * them true but means they are no longer exact.
+ */
+typedef struct Lit Lit;
+struct Lit
+{
+	uchar pre[MaxLit];
+	uchar suf[MaxLit];
+	uchar req[MaxLit];
+	int npre;
+	int nsuf;
+	int nreq;
+	int exact;
+};
+
+/* Keep the longer of req and the n bytes at s. */
+static void
+litreq(Lit *l, uchar *s, int n)
+{
+	if(n > MaxLit)
+		n = MaxLit;
+	if(n > l->nreq){
+		memmove(l->req, s, n);
+		l->nreq = n;
+	}
+}
+
+static void
+litcat(Lit *l, Lit *l1, Lit *l2)
+{
+	uchar buf[2*MaxLit];
+	int n;
+
+	memset(l, 0, sizeof *l);
+	if(l1->exact){
+		n = l1->npre + l2->npre;
+		memmove(buf, l1->pre, l1->npre);
+		memmove(buf+l1->npre, l2->pre, l2->npre);
+		l->npre = n < MaxLit ? n : MaxLit;
+		memmove(l->pre, buf, l->npre);
+		l->exact = l2->exact && n <= MaxLit;
+	}else{
+		l->npre = l1->npre;
+		memmove(l->pre, l1->pre, l1->npre);
+	}
+	if(l2->exact){
+		n = l1->nsuf + l2->nsuf;
+		memmove(buf, l1->suf, l1->nsuf);
+		memmove(buf+l1->nsuf, l2->suf, l2->nsuf);
+		l->nsuf = n < MaxLit ? n : MaxLit;
+		memmove(l->suf, buf+n-l->nsuf, l->nsuf);
+	}else{
+		l->nsuf = l2->nsuf;
+		memmove(l->suf, l2->suf, l2->nsuf);
+	}
+	litreq(l, l1->req, l1->nreq);
+	litreq(l, l2->req, l2->nreq);
+	memmove(buf, l1->suf, l1->nsuf);
+	memmove(buf+l1->nsuf, l2->pre, l2->npre);
+	litreq(l, buf, l1->nsuf + l2->npre);
+	litreq(l, l->pre, l->npre);
+	litreq(l, l->suf, l->nsuf);
+}
+
+static void
+litalt(Lit *l, Lit *l1, Lit *l2)
+{
+	int n;
+
+	memset(l, 0, sizeof *l);
+	for(n=0; n<l1->npre && n<l2->npre && l1->pre[n] == l2->pre[n]; n++)
+		;
+	l->npre = n;
+	memmove(l->pre, l1->pre, n);
+	for(n=0; n<l1->nsuf && n<l2->nsuf
+	&& l1->suf[l1->nsuf-1-n] == l2->suf[l2->nsuf-1-n]; n++)
+		;
+	l->nsuf = n;
+	memmove(l->suf, l1->suf+l1->nsuf-n, n);
+	l->exact = l1->exact && l2->exact && l1->npre == l2->npre
+		&& memcmp(l1->pre, l2->pre, l1->npre) == 0;
+	litreq(l, l->pre, l->npre);
+	litreq(l, l->suf, l->nsuf);
+}
+
+/*
+ * Find a literal that every match of the postfix
+ * regexp must contain, preferring one every match
+ * starts with if the match can start anywhere,
+ * and store it in re.
+ */
+static void
+findlit(Regexp *re, int *postfix, int n)
+{
+	Lit *stack, *stackp, e1, e2, e;
+	int *p;
+
+	re->nlit = 0;
+	re->litprefix = 0;
+	if(n == 0 || (stack = malloc(n*sizeof stack[0])) == NULL)
+		return;
+
+	#define push(s) *stackp++ = s
+	#define pop() *--stackp
+
+	stackp = stack;
+	for(p=postfix; p<postfix+n; p++){
+		memset(&e, 0, sizeof e);
+		switch(*p){
+		default:
+			e.pre[0] = e.suf[0] = e.req[0] = *p;
+			e.npre = e.nsuf = e.nreq = 1;
+			e.exact = 1;
+			break;
+		case Any:
+		case Quest:
+		case Star:
+			if(*p != Any)
+				stackp--;
+			break;
+		case Cat:
+			e2 = pop();
+			e1 = pop();
+			litcat(&e, &e1, &e2);
+			break;
+		case Alt:
+			e2 = pop();
+			e1 = pop();
+			litalt(&e, &e1, &e2);
+			break;
+		case Plus:
+			e = pop();
+			e.exact = 0;
+			break;
+		}
+		push(e);
+	}
+	e = pop();
+	free(stack);
+#undef pop
+#undef push
+
+	if(e.npre > 0 && e.npre >= e.nreq && !(re->flags & Anchored)){
+		re->nlit = e.npre;
+		memmove(re->lit, e.pre, e.npre);
+		re->litprefix = 1;
+	}else{
+		re->nlit = e.nreq;
+		memmove(re->lit, e.req, e.nreq);
+	}
+}
+
+/*
+ * Compile re.  Unless flags has Anchored the
+ * NFA starts with an implicit .* loop and stops
+ * as soon as it matches, so it finds substrings.
+ */
+Regexp*
+recompile(char *re, int flags)
+{
+	return recompileset(&re, 1, flags);
+}
+
+/*
+ * Compile the n patterns in re into one NFA, the
+ * alternation of them all but with a Match state
+ * for each, so a single pass over the text tells
+ * which of them match.
+ */
+Regexp*
+recompileset(char **re, int n, int flags)
+{
+	int **post, *npost, *all, i, nall, empty;
+	Regexp *r;
+	State *s, *any, *match;
+
+	if(n <= 0)
+		return NULL;
+	r = calloc(1, sizeof *r);
+	post = calloc(n, sizeof post[0]);
+	npost = calloc(n, sizeof npost[0]);
+	all = NULL;
+	if(r == NULL || post == NULL || npost == NULL)
+		goto bad;
+	nall = 0;
+	empty = 0;
+	for(i=0; i<n; i++){
+		if((post[i] = re2post(re[i], &npost[i])) == NULL)
+			goto bad;
+		nall += npost[i];
+		empty |= npost[i] == 0;
+	}
+
+	/*
+	 * one state per token, a match state and a Split
+	 * joining it to the others per pattern, and the .* loop
+	 */
+	r->states = malloc((nall+2*n+2)*sizeof r->states[0]);
+	r->npat = n;
+	r->flags = flags;
+	if(r->states == NULL)
+		goto bad;
+	for(i=n-1; i>=0; i--){
+		match = state(r, Match, NULL, NULL);
+		match->pat = i;
+		if((s = post2nfa(r, post[i], npost[i], match)) == NULL)
+			goto bad;
+		r->start = r->start == NULL ? s : state(r, Split, s, r->start);
+	}
+
+	/* the literal comes from the patterns' alternation */
+	if((all = malloc((nall+n)*sizeof all[0])) == NULL)
+		goto bad;
+	if(empty)
+		nall = 0;	/* something matches everywhere */
+	else
+	for(nall=0, i=0; i<n; i++){
+		memmove(all+nall, post[i], npost[i]*sizeof all[0]);
+		nall += npost[i];
+		if(i > 0)
+			all[nall++] = Alt;
+	}
+	findlit(r, all, nall);
+
+	if(!(flags & Anchored)){
+		any = state(r, Any, NULL, NULL);
+		s = state(r, Split, r->start, any);
+		any->out = s;
+		r->start = s;
+	}
+	for(i=0; i<n; i++)
+		free(post[i]);
+	free(post);
+	free(npost);
+	free(all);
+	return r;
+
+bad:
+	if(post != NULL)
+		for(i=0; i<n; i++)
+			free(post[i]);
+	free(post);
+	free(npost);
+	free(all);
+	refree(r);
+	return NULL;
+}
+
+void
+refree(Regexp *re)
+{
+	if(re == NULL)
+		return;
+	freefull(re->full);
+	free(re->states);
+	free(re);
+}
+
+/*
+ * Set *lit to the literal every match of re contains
+ * and return its length, or 0 if there is none.
+ */
+int
+reliteral(Regexp *re, char **lit)
+{
+	*lit = (char*)re->lit;
+	return re->nlit;
+}
+
 typedef struct List List;
 struct List
 {
 	State **s;
 	int n;
 };
-List l1, l2;
-static int listid;
 
-void addstate(List*, State*);
-void step(List*, int, List*);
+/*
+ * Represents a DFA state: a cached NFA state list.
+ */
+typedef struct DState DState;
+struct DState
+{
+	List l;
+	unsigned hash;
+	int nmatch;	/* Match states in l */
+	int stop;	/* nothing more to learn by reading input */
+	int id;		/* order of creation since the last flush */
+	DState *next[256];
+	DState *hnext;	/* hash chain */
+	DState *link;	/* all cached states, or the free list */
+};
+
+struct Cache
+{
+	Regexp *re;
+	int *lastlist;	/* listid each NFA state was last added with */
+	int listid;
+	State **stack;	/* for addstate */
+	List l1, l2;
+	DState **table;
+	int tabsize;	/* power of two */
+	DState *all;
+	DState *freelist;
+	DState *start;
+	size_t dsize;	/* bytes in one DState */
+	size_t budget;
+	size_t nbytes;	/* input seen by the DFA so far */
+	size_t pos;	/* input offset of the current miss */
+	size_t flushpos;	/* input offset of the last flush */
+	CacheStats stats;
+};
 
-/* Compute initial state list */
-List*
-startlist(State *start, List *l)
+/*
+ * Make a cache for matching re holding at most
+ * about budget bytes of DFA states; 0 means a default.
+ */
+Cache*
+cachenew(Regexp *re, size_t budget)
 {
-	l->n = 0;
-	listid++;
-	addstate(l, start);
-	return l;
+	Cache *c;
+	size_t max;
+
+	if((c = calloc(1, sizeof *c)) == NULL)
+		return NULL;
+	c->re = re;
+	c->dsize = sizeof(DState) + re->nstate*sizeof(State*);
+	if(budget == 0)
+		budget = DefaultBudget;
+	if(budget < MinStates*c->dsize)
+		budget = MinStates*c->dsize;
+	c->budget = budget;
+	max = budget/c->dsize;
+	for(c->tabsize = 1; (size_t)c->tabsize < max; c->tabsize <<= 1)
+		;
+	c->table = calloc(c->tabsize, sizeof c->table[0]);
+	c->lastlist = calloc(re->nstate, sizeof c->lastlist[0]);
+	c->stack = malloc((2*re->nstate+1)*sizeof c->stack[0]);
+	c->l1.s = malloc(re->nstate*sizeof c->l1.s[0]);
+	c->l2.s = malloc(re->nstate*sizeof c->l2.s[0]);
+	if(c->table == NULL || c->lastlist == NULL || c->stack == NULL
+	|| c->l1.s == NULL || c->l2.s == NULL){
+		cachefree(c);
+		return NULL;
+	}
+	return c;
 }
 
-/* Check whether state list contains a match. */
-int
-ismatch(List *l)
+/* Free a chain of states linked through link. */
+static void
+freestates(DState *d)
 {
-	int i;
+	DState *next;
 
-	for(i=0; i<l->n; i++)
-		if(l->s[i] == &matchstate)
-			return 1;
-	return 0;
+	for(; d; d=next){
+		next = d->link;
+		free(d);
+	}
 }
 
-/* Add s to l, following unlabeled arrows. */
 void
-addstate(List *l, State *s)
+cachefree(Cache *c)
 {
-	if(s == NULL || s->lastlist == listid)
-		return;
-	s->lastlist = listid;
-	if(s->c == Split){
-		/* follow unlabeled arrows */
-		addstate(l, s->out);
-		addstate(l, s->out1);
+	if(c == NULL)
 		return;
+	freestates(c->all);
+	freestates(c->freelist);
+	free(c->table);
+	free(c->lastlist);
+	free(c->stack);
+	free(c->l1.s);
+	free(c->l2.s);
+	free(c);
+}
+
+void
+cachestats(Cache *c, CacheStats *st)
+{
+	*st = c->stats;
+}
+
+/* Start a new list generation, for marking states in addstate. */
+static void
+newlist(Cache *c, List *l)
+{
+	l->n = 0;
+	if(c->listid == INT_MAX){
+		memset(c->lastlist, 0, c->re->nstate*sizeof c->lastlist[0]);
+		c->listid = 0;
 	}
-	l->s[l->n++] = s;
+	c->listid++;
+}
+
+/*
+ * Add s to l, following unlabeled arrows.
+ * Uses an explicit stack so long chains of
+ * Splits cannot overflow the C stack.
+ */
+static void
+addstate(Cache *c, List *l, State *s)
+{
+	State **stack;
+	int n;
+
+	stack = c->stack;
+	n = 0;
+	stack[n++] = s;
+	while(n > 0){
+		s = stack[--n];
+		if(s == NULL || c->lastlist[s->id] == c->listid)
+			continue;
+		c->lastlist[s->id] = c->listid;
+		if(s->c == Split){
+			/* follow unlabeled arrows */
+			stack[n++] = s->out1;
+			stack[n++] = s->out;
+			continue;
+		}
+		l->s[l->n++] = s;
+	}
+}
+
+/* Compute initial state list */
+static List*
+startlist(Cache *c, List *l)
+{
+	newlist(c, l);
+	addstate(c, l, c->re->start);
+	return l;
 }
 
 /*
  * Step the NFA from the states in clist
  * past the character c,
  * to create next NFA state set nlist.
+ * When looking for substrings a Match state
+ * stays in the list once reached, so a DFA
+ * state remembers which patterns have matched.
  */
-void
-step(List *clist, int c, List *nlist)
+static void
+step(Cache *c, List *clist, int ch, List *nlist)
 {
 	int i;
 	State *s;
 
-	listid++;
-	nlist->n = 0;
+	newlist(c, nlist);
 	for(i=0; i<clist->n; i++){
 		s = clist->s[i];
-		if(s->c == c)
-			addstate(nlist, s->out);
+		if(s->c == ch || s->c == Any)
+			addstate(c, nlist, s->out);
+		else if(s->c == Match && !(c->re->flags & Anchored))
+			addstate(c, nlist, s);
 	}
 }
 
 /*
- * Represents a DFA state: a cached NFA state list.
+ * Count the Match states in l, the patterns that
+ * have matched, noting which in matched if not NULL.
  */
-typedef struct DState DState;
-struct DState
-{
-	List l;
-	DState *next[256];
-	DState *left;
-	DState *right;
-};
-
-/* Compare lists: first by length, then by members. */
 static int
-listcmp(List *l1, List *l2)
+nmatches(List *l, uchar *matched)
 {
-	int i;
+	int i, n;
 
-	if(l1->n < l2->n)
-		return -1;
-	if(l1->n > l2->n)
-		return 1;
-	for(i=0; i<l1->n; i++)
-		if(l1->s[i] < l2->s[i])
-			return -1;
-		else if(l1->s[i] > l2->s[i])
-			return 1;
-	return 0;
+	n = 0;
+	for(i=0; i<l->n; i++)
+		if(l->s[i]->c == Match){
+			if(matched != NULL)
+				matched[l->s[i]->pat] = 1;
+			n++;
+		}
+	return n;
 }
 
-/* Compare pointers by address. */
+/* Compare states by address, which is also by id. */
 static int
 ptrcmp(const void *a, const void *b)
 {
-	if(a < b)
+	State *sa, *sb;
+
+	sa = *(State**)a;
+	sb = *(State**)b;
+	if(sa < sb)
 		return -1;
-	if(a > b)
+	if(sa > sb)
 		return 1;
 	return 0;
 }
 
-DState *freelist;
+/* Hash a sorted state list (FNV-1a over the ids). */
+static unsigned
+listhash(List *l)
+{
+	unsigned h;
+	int i;
+
+	h = 2166136261u;
+	for(i=0; i<l->n; i++)
+		h = (h ^ (unsigned)l->s[i]->id) * 16777619u;
+	return h;
+}
+
+/* Throw away the cache and start over. */
+static void
+flushcache(Cache *c)
+{
+	DState *d, *next;
+
+	for(d=c->all; d; d=next){
+		next = d->link;
+		d->link = c->freelist;
+		c->freelist = d;
+	}
+	c->all = NULL;
+	c->start = NULL;
+	memset(c->table, 0, c->tabsize*sizeof c->table[0]);
+	c->stats.mem = 0;
+	c->stats.nstates = 0;
+	c->stats.nflush++;
+	c->flushpos = c->pos;
+}
 
 /* Allocate DStates from a cached list. */
-DState*
-allocdstate(void)
+static DState*
+allocdstate(Cache *c)
 {
 	DState *d;
-	
-	if((d = freelist) != NULL)
-		freelist = d->left;
+
+	if((d = c->freelist) != NULL)
+		c->freelist = d->link;
 	else{
-		d = malloc(sizeof *d + nstate*sizeof(State*));
+		if((d = malloc(c->dsize)) == NULL)
+			return NULL;
 		d->l.s = (State**)(d+1);
 	}
-	d->left = NULL;
-	d->right = NULL;
 	memset(d->next, 0, sizeof d->next);
 	return d;
 }
 
-/* Free the tree of states rooted at d. */
-void
-freestates(DState *d)
-{
-	if(d == NULL)
-		return;
-	freestates(d->left);
-	freestates(d->right);
-	d->left = freelist;
-	freelist = d;
-}
-
-static DState *alldstates;
-static int nstates;
-
-/* Throw away the cache and start over. */
-void
-freecache(void)
-{
-	freestates(alldstates);
-	alldstates = NULL;
-	nstates = 0;
-}
-
 /*
  * Return the cached DState for list l,
- * creating a new one if needed.
+ * creating a new one if needed.  Returns NULL
+ * if the cache is thrashing, in which case the
+ * caller should carry on by simulating the NFA.
  */
-int maxstates = 32;
-DState*
-dstate(List *l, DState **nextp)
+static DState*
+dstate(Cache *c, List *l, DState **nextp)
 {
-	int i;
-	DState **dp, *d;
+	DState *d, **dp;
+	unsigned h;
+	int thrash;
 
 	qsort(l->s, l->n, sizeof l->s[0], ptrcmp);
-	dp = &alldstates;
-	while((d = *dp) != NULL){
-		i = listcmp(l, &d->l);
-		if(i < 0)
-			dp = &d->left;
-		else if(i > 0)
-			dp = &d->right;
-		else
+	h = listhash(l);
+	dp = &c->table[h & (c->tabsize-1)];
+	for(d=*dp; d; d=d->hnext)
+		if(d->hash == h && d->l.n == l->n
+		&& memcmp(d->l.s, l->s, l->n*sizeof l->s[0]) == 0){
+			if(nextp != NULL)
+				*nextp = d;
 			return d;
-	}
+		}
 
-	if(nstates >= maxstates){
-		freecache();
-		dp = &alldstates;
+	if(c->stats.mem + c->dsize > c->budget){
+		thrash = c->pos - c->flushpos < (size_t)MinBytes*c->stats.nstates;
+		flushcache(c);
+		if(thrash){
+			c->stats.nfallback++;
+			return NULL;
+		}
 		nextp = NULL;
 	}
-	
-	d = allocdstate();
+
+	if((d = allocdstate(c)) == NULL){
+		c->stats.nfallback++;
+		return NULL;
+	}
 	memmove(d->l.s, l->s, l->n*sizeof l->s[0]);
 	d->l.n = l->n;
+	d->hash = h;
+	d->nmatch = nmatches(l, NULL);
+	d->stop = l->n == 0 || (d->nmatch == c->re->npat && !(c->re->flags & Anchored));
+	d->id = c->stats.nstates;
+	d->hnext = *dp;
 	*dp = d;
-	nstates++;
+	d->link = c->all;
+	c->all = d;
+	c->stats.mem += c->dsize;
+	c->stats.nstates++;
 	if(nextp != NULL)
 		*nextp = d;
 	return d;
 }
 
-void
-startnfa(State *start, List *l)
+static DState*
+nextstate(Cache *c, DState *d, int ch)
 {
-	l->n = 0;
-	listid++;
-	addstate(l, start);
+	c->stats.nmiss++;
+	step(c, &d->l, ch, &c->l1);
+	return dstate(c, &c->l1, &d->next[ch]);
 }
 
-DState*
-startdstate(State *start)
+/*
+ * Run the NFA over p..ep starting from the states in c->l1.
+ * Returns the number of patterns that matched, noting which
+ * in matched if not NULL.
+ */
+static int
+nfamatch(Cache *c, uchar *p, uchar *ep, uchar *matched)
 {
-	return dstate(startlist(start, &l1), NULL);
+	List *clist, *nlist, *t;
+	int anchored;
+
+	anchored = c->re->flags & Anchored;
+	clist = &c->l1;
+	nlist = &c->l2;
+	for(; p < ep; p++){
+		if(clist->n == 0 || (!anchored && nmatches(clist, NULL) == c->re->npat))
+			break;
+		step(c, clist, *p, nlist);
+		t = clist; clist = nlist; nlist = t;	/* swap clist, nlist */
+	}
+	return nmatches(clist, matched);
 }
 
-DState*
-nextstate(DState *d, int c)
+/*
+ * Split the bytes into classes: two bytes are in the
+ * same class if every literal state treats them alike.
+ * Returns the number of classes; rep gets one byte of each.
+ */
+static int
+byteclasses(Regexp *re, uchar *class, int *rep)
 {
-	step(&d->l, c, &l1);
-	return dstate(&l1, &d->next[c]);
+	uchar edge[257];
+	int i, n;
+
+	memset(edge, 0, sizeof edge);
+	for(i=0; i<re->nstate; i++)
+		if(re->states[i].c < 256){
+			edge[re->states[i].c] = 1;
+			edge[re->states[i].c+1] = 1;
+		}
+	n = 0;
+	for(i=0; i<256; i++){
+		if(i > 0 && edge[i])
+			n++;
+		if(i == 0 || edge[i])
+			rep[n] = i;
+		class[i] = n;
+	}
+	return n+1;
 }
 
-/* Run DFA to determine whether it matches s. */
-int
-match(DState *start, char *s)
+/*
+ * Hopcroft's algorithm: refine the partition of the n states
+ * into accepting and not until no block's members disagree
+ * on which block some class takes them to.  Fills in block[]
+ * and returns the number of blocks.
+ */
+static int
+minimize(int n, int nclass, int *trans, uchar *accept, int *block)
 {
-	DState *d, *next;
-	int c, i;
-	
-	d = start;
-	for(; *s; s++){
-		c = *s & 0xFF;
-		if((next = d->next[c]) == NULL)
-			next = nextstate(d, c);
-		d = next;
+	int *elems, *loc, *first, *end, *mark, *work, *touched, *split;
+	int *invstart, *inv;
+	uchar *inwork;
+	int a, b, i, j, k, s, t, y, z, nb, nwork, ntouched, nsplit;
+
+	elems = malloc(n*sizeof elems[0]);
+	loc = malloc(n*sizeof loc[0]);
+	first = malloc(n*sizeof first[0]);
+	end = malloc(n*sizeof end[0]);
+	mark = calloc(n, sizeof mark[0]);
+	work = malloc(n*sizeof work[0]);
+	touched = malloc(n*sizeof touched[0]);
+	split = malloc(n*sizeof split[0]);
+	inwork = calloc(n, sizeof inwork[0]);
+	invstart = calloc((size_t)nclass*n+1, sizeof invstart[0]);
+	inv = malloc((size_t)nclass*n*sizeof inv[0]);
+	nb = -1;
+	if(elems == NULL || loc == NULL || first == NULL || end == NULL
+	|| mark == NULL || work == NULL || touched == NULL || split == NULL
+	|| inwork == NULL || invstart == NULL || inv == NULL)
+		goto out;
+
+	/* inverse transitions: the states going to t on a */
+	for(s=0; s<n; s++)
+		for(a=0; a<nclass; a++)
+			invstart[a*n + trans[s*nclass+a] + 1]++;
+	for(i=0; i<nclass*n; i++)
+		invstart[i+1] += invstart[i];
+	for(s=0; s<n; s++)
+		for(a=0; a<nclass; a++){
+			i = a*n + trans[s*nclass+a];
+			inv[invstart[i]++] = s;
+		}
+	for(i=nclass*n; i>0; i--)
+		invstart[i] = invstart[i-1];
+	invstart[0] = 0;
+
+	nb = 0;
+	nwork = 0;
+	k = 0;
+	for(a=1; a>=0; a--){
+		j = k;
+		for(s=0; s<n; s++)
+			if(accept[s] == a){
+				elems[k] = s;
+				loc[s] = k++;
+				block[s] = nb;
+			}
+		if(k > j){
+			first[nb] = j;
+			end[nb] = k;
+			work[nwork++] = nb;
+			inwork[nb++] = 1;
+		}
+	}
+
+	while(nwork > 0){
+		b = work[--nwork];
+		inwork[b] = 0;
+		nsplit = 0;
+		for(i=first[b]; i<end[b]; i++)
+			split[nsplit++] = elems[i];
+		for(a=0; a<nclass; a++){
+			/* move the states going into b on a to the front of their blocks */
+			ntouched = 0;
+			for(i=0; i<nsplit; i++){
+				t = a*n + split[i];
+				for(j=invstart[t]; j<invstart[t+1]; j++){
+					s = inv[j];
+					y = block[s];
+					k = first[y] + mark[y];
+					if(loc[s] < k)
+						continue;
+					elems[loc[s]] = elems[k];
+					loc[elems[k]] = loc[s];
+					elems[k] = s;
+					loc[s] = k;
+					if(mark[y]++ == 0)
+						touched[ntouched++] = y;
+				}
+			}
+			for(i=0; i<ntouched; i++){
+				y = touched[i];
+				if(mark[y] == end[y] - first[y]){
+					mark[y] = 0;
+					continue;
+				}
+				z = nb++;
+				first[z] = first[y];
+				end[z] = first[y] + mark[y];
+				first[y] = end[z];
+				mark[y] = 0;
+				mark[z] = 0;
+				inwork[z] = 0;
+				for(j=first[z]; j<end[z]; j++)
+					block[elems[j]] = z;
+				if(inwork[y] || end[z]-first[z] <= end[y]-first[y])
+					y = z;
+				work[nwork++] = y;
+				inwork[y] = 1;
+			}
+		}
 	}
-	return ismatch(&d->l);
+
+out:
+	free(elems);
+	free(loc);
+	free(first);
+	free(end);
+	free(mark);
+	free(work);
+	free(touched);
+	free(split);
+	free(inwork);
+	free(invstart);
+	free(inv);
+	return nb;
 }
 
+static void
+freefull(Full *f)
+{
+	if(f == NULL)
+		return;
+	free(f->trans);
+	free(f->accept);
+	free(f);
+}
+
+/*
+ * Build the whole DFA for re now instead of while matching,
+ * minimize it and store it in re, where rematch will use it.
+ * Gives up, leaving re to the lazy DFA, if there would be
+ * more than maxstates states before minimization,
+ * or if re is a set of more than one pattern, since
+ * the table only records whether anything matched.
+ * Returns the number of states, or 0 if it gave up.
+ * Not safe while other threads are matching re.
+ */
 int
-main(int argc, char **argv)
+refull(Regexp *re, int maxstates)
 {
-	int i;
-	char *post;
-	State *start;
+	Cache *c;
+	DState **q, *d, *next;
+	Full *f;
+	int rep[256], *trans, *block, *order, *renum, *id;
+	int a, b, i, j, n, nb, nclass, ok;
 
-	if(argc < 3){
-		fprintf(stderr, "usage: nfa regexp string...\n");
-		return 1;
+	if(re->full != NULL)
+		return re->full->nstates;
+	if(re->npat > 1)
+		return 0;
+	if(maxstates <= 0 || maxstates > UINT16_MAX)
+		maxstates = UINT16_MAX;
+	f = calloc(1, sizeof *f);
+	c = cachenew(re, (size_t)(maxstates+1)*(sizeof(DState) + re->nstate*sizeof(State*)));
+	q = malloc(maxstates*sizeof q[0]);
+	trans = NULL;
+	block = NULL;
+	order = NULL;
+	renum = NULL;
+	id = NULL;
+	ok = 0;
+	if(f == NULL || c == NULL || q == NULL)
+		goto out;
+	nclass = byteclasses(re, f->class, rep);
+	trans = malloc((size_t)maxstates*nclass*sizeof trans[0]);
+	if(trans == NULL)
+		goto out;
+
+	/* subset construction, one byte from each class */
+	if((q[0] = dstate(c, startlist(c, &c->l1), NULL)) == NULL)
+		goto out;
+	n = 1;
+	for(i=0; i<n; i++){
+		d = q[i];
+		for(a=0; a<nclass; a++){
+			if(d->stop){
+				trans[i*nclass+a] = i;
+				continue;
+			}
+			if((next = nextstate(c, d, rep[a])) == NULL || c->stats.nflush > 0)
+				goto out;
+			if(next->id == n){
+				if(n == maxstates)
+					goto out;
+				q[n++] = next;
+			}
+			trans[i*nclass+a] = next->id;
+		}
 	}
-	
-	post = re2post(argv[1]);
-	if(post == NULL){
-		fprintf(stderr, "bad regexp %s\n", argv[1]);
-		return 1;
+
+	f->accept = malloc(n);
+	block = malloc(n*sizeof block[0]);
+	order = malloc(n*sizeof order[0]);
+	renum = malloc(n*sizeof renum[0]);
+	if(f->accept == NULL || block == NULL
+	|| order == NULL || renum == NULL)
+		goto out;
+	for(i=0; i<n; i++)
+		f->accept[i] = q[i]->nmatch > 0;
+	if((nb = minimize(n, nclass, trans, f->accept, block)) < 0)
+		goto out;
+
+	/* number the blocks breadth first from the start */
+	for(i=0; i<nb; i++)
+		renum[i] = -1;
+	renum[block[0]] = 0;
+	order[0] = 0;
+	j = 1;
+	for(i=0; i<j; i++)
+		for(a=0; a<nclass; a++){
+			b = block[trans[order[i]*nclass+a]];
+			if(renum[b] < 0){
+				renum[b] = j;
+				order[j++] = trans[order[i]*nclass+a];
+			}
+		}
+
+	/*
+	 * Then move the states that stop the scan to the end,
+	 * so testing for them is a comparison, and scale the
+	 * state numbers by nclass if the product fits.
+	 */
+	if((id = malloc(j*sizeof id[0])) == NULL)
+		goto out;
+	f->nclass = nclass;
+	f->nstates = j;
+	f->scaled = (long)j*nclass <= UINT16_MAX+1L;
+	f->stop = j;
+	n = 0;
+	for(i=0; i<j; i++){
+		f->accept[i] = q[order[i]]->nmatch > 0;
+		for(a=0; a<nclass && renum[block[trans[order[i]*nclass+a]]] == i; a++)
+			;
+		if(a == nclass || (f->accept[i] && !(re->flags & Anchored)))
+			id[i] = --f->stop;
+		else
+			id[i] = n++;
+	}
+	for(i=0; i<j; i++)
+		f->accept[id[i]] = q[order[i]]->nmatch > 0;
+	if((f->trans = malloc((size_t)j*nclass*sizeof f->trans[0])) == NULL)
+		goto out;
+	for(i=0; i<j; i++)
+		for(a=0; a<nclass; a++){
+			b = id[renum[block[trans[order[i]*nclass+a]]]];
+			f->trans[id[i]*nclass+a] = f->scaled ? b*nclass : b;
+		}
+	f->start = f->scaled ? id[0]*nclass : id[0];
+	if(f->scaled)
+		f->stop *= nclass;
+	re->full = f;
+	f = NULL;
+	ok = 1;
+
+out:
+	freefull(f);
+	cachefree(c);
+	free(q);
+	free(trans);
+	free(block);
+	free(order);
+	free(renum);
+	free(id);
+	return ok ? re->full->nstates : 0;
+}
+
+/*
+ * Skip p to the next place a match could start.
+ * Returns NULL, having skipped everything, if
+ * the required literal is not in p..ep.
+ */
+static uchar*
+skip(Cache *c, uchar *p, uchar *ep)
+{
+	uchar *q;
+
+	q = (uchar*)memfind((char*)p, ep-p, (char*)c->re->lit, c->re->nlit);
+	if(q == NULL){
+		c->stats.nskip += ep - p;
+		return NULL;
+	}
+	if(c->re->litprefix){
+		c->stats.nskip += q - p;
+		return q;
+	}
+	return p;
+}
+
+/*
+ * Run the full DFA over p..ep.  If every match starts
+ * with a literal, look for it whenever the DFA is back
+ * in its start state rather than stepping byte by byte.
+ */
+static int
+fullmatch(Cache *c, Full *f, uchar *p, uchar *ep)
+{
+	unsigned s;
+	int accel;
+
+	accel = c->re->litprefix;
+	s = f->start;
+	if(f->scaled){
+		for(; p < ep && s < f->stop; p++){
+			if(accel && s == f->start && (p = skip(c, p, ep)) == NULL)
+				return 0;
+			s = f->trans[s + f->class[*p]];
+		}
+		return f->accept[s/f->nclass];
 	}
+	for(; p < ep && s < f->stop; p++){
+		if(accel && s == f->start && (p = skip(c, p, ep)) == NULL)
+			return 0;
+		s = f->trans[s*f->nclass + f->class[*p]];
+	}
+	return f->accept[s];
+}
+
+/*
+ * Run DFA to find which patterns match the n bytes at s:
+ * the whole of it if the Regexp is Anchored, else any part.
+ * Text without the Regexp's required literal is rejected
+ * without running the DFA at all.  Returns the number of
+ * patterns that matched, noting which in matched if not NULL.
+ */
+static int
+run(Cache *c, char *s, size_t n, uchar *matched)
+{
+	DState *d, *next;
+	uchar *p, *ep;
+	int accel;
 
-	start = post2nfa(post);
-	if(start == NULL){
-		fprintf(stderr, "error in post2nfa %s\n", post);
+	p = (uchar*)s;
+	ep = p + n;
+	c->stats.nscan += n;
+	if(c->re->nlit > 0 && (p = skip(c, p, ep)) == NULL)
+		return 0;
+	if(c->re->full != NULL){
+		if(!fullmatch(c, c->re->full, p, ep))
+			return 0;
+		if(matched != NULL)
+			matched[0] = 1;
 		return 1;
 	}
-	
-	l1.s = malloc(nstate*sizeof l1.s[0]);
-	l2.s = malloc(nstate*sizeof l2.s[0]);
-	for(i=2; i<argc; i++)
-		if(match(startdstate(start), argv[i]))
-			printf("%s\n", argv[i]);
-	return 0;
+	if((d = c->start) == NULL){
+		c->pos = c->nbytes;
+		startlist(c, &c->l1);
+		if((d = dstate(c, &c->l1, NULL)) == NULL)
+			return nfamatch(c, p, ep, matched);
+		c->start = d;
+	}
+	accel = c->re->litprefix;
+	for(; p < ep && !d->stop; p++){
+		if(accel && d == c->start && (p = skip(c, p, ep)) == NULL){
+			c->nbytes += n;
+			return 0;
+		}
+		if((next = d->next[*p]) == NULL){
+			c->pos = c->nbytes + (p - (uchar*)s);
+			if((next = nextstate(c, d, *p)) == NULL){
+				c->nbytes += n;
+				return nfamatch(c, p+1, ep, matched);
+			}
+		}
+		d = next;
+	}
+	c->nbytes += p - (uchar*)s;
+	if(d->nmatch > 0)
+		nmatches(&d->l, matched);
+	return d->nmatch;
+}
+
+/* Report whether the Regexp (any of a set) matches the n bytes at s. */
+int
+rematch(Cache *c, char *s, size_t n)
+{
+	return run(c, s, n, NULL) > 0;
+}
+
+/*
+ * Match a set of patterns, setting matched[i] to 1 or 0
+ * as pattern i matches or not, and returning the number
+ * that did.  Every pattern is tracked at once, so the
+ * text is only read once however many there are.
+ */
+int
+rematchset(Cache *c, char *s, size_t n, unsigned char *matched)
+{
+	memset(matched, 0, c->re->npat);
+	return run(c, s, n, matched);
 }
 
 /*
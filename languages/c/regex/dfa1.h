@@ -0,0 +1,58 @@
+/*
+ * Lazy DFA regular expression matcher, see dfa1.c.
+ *
+ * A Regexp is compiled once and is read only afterwards,
+ * so it can be shared between threads.  All mutable
+ * matching state lives in a Cache, which must be used
+ * by one thread at a time; give each thread its own.
+ *
+ * Copyright (c) 2007 Russ Cox.
+ * Can be distributed under the MIT license, see dfa1.c.
+ */
+#ifndef DFA1_H
+#define DFA1_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct Regexp Regexp;
+typedef struct Cache Cache;
+typedef struct CacheStats CacheStats;
+
+enum
+{
+	Anchored = 1<<0	/* match the whole string, not a substring */
+};
+
+struct CacheStats
+{
+	size_t mem;	/* bytes held by cached DFA states */
+	long nstates;	/* DFA states currently cached */
+	long nmiss;	/* transitions computed from the NFA */
+	long nflush;	/* times the cache was thrown away */
+	long nfallback;	/* matches finished by NFA simulation */
+	size_t nscan;	/* bytes of text given to rematch */
+	size_t nskip;	/* of those, bytes passed over by the literal prefilter */
+};
+
+Regexp*	recompile(char *re, int flags);
+Regexp*	recompileset(char **re, int n, int flags);
+void	refree(Regexp *re);
+int	refull(Regexp *re, int maxstates);
+int	reliteral(Regexp *re, char **lit);
+
+Cache*	cachenew(Regexp *re, size_t budget);
+void	cachefree(Cache *c);
+void	cachestats(Cache *c, CacheStats *st);
+
+int	rematch(Cache *c, char *s, size_t n);
+int	rematchset(Cache *c, char *s, size_t n, unsigned char *matched);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
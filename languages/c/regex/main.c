@@ -0,0 +1,150 @@
+/*
+ * Command line driver for the lazy DFA in dfa1.c.
+ * Prints each string argument that regexp matches.
+ * With -s the regexp may match any substring,
+ * otherwise it must match the whole string.
+ * With -f the whole DFA is built up front.
+ *
+ * With one or more -e regexp the patterns are compiled
+ * as a set and matched together with rematchset; each
+ * string is printed with the numbers (from 0) of the
+ * patterns that matched it.  With -c as well every
+ * pattern is also compiled and matched on its own, and
+ * any string where the two disagree is reported and
+ * makes the exit status 1.
+ *
+ * Copyright (c) 2007 Russ Cox.
+ * Can be distributed under the MIT license, see dfa1.c.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dfa1.h"
+
+static int
+matchset(char **pat, int npat, int flags, int check, char **str, int nstr)
+{
+	int i, j, bad, n;
+	Regexp *re, **one;
+	Cache *c, **onec;
+	unsigned char *matched;
+
+	re = recompileset(pat, npat, flags);
+	if(re == NULL){
+		fprintf(stderr, "bad regexp set\n");
+		return 1;
+	}
+	c = cachenew(re, 0);
+	matched = malloc(npat);
+	one = calloc(npat, sizeof one[0]);
+	onec = calloc(npat, sizeof onec[0]);
+	if(c == NULL || matched == NULL || one == NULL || onec == NULL){
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	for(j=0; check && j<npat; j++){
+		if((one[j] = recompile(pat[j], flags)) == NULL
+		|| (onec[j] = cachenew(one[j], 0)) == NULL){
+			fprintf(stderr, "bad regexp %s\n", pat[j]);
+			return 1;
+		}
+	}
+
+	bad = 0;
+	for(i=0; i<nstr; i++){
+		n = rematchset(c, str[i], strlen(str[i]), matched);
+		if(n > 0){
+			printf("%s:", str[i]);
+			for(j=0; j<npat; j++)
+				if(matched[j])
+					printf(" %d", j);
+			printf("\n");
+		}
+		for(j=0; check && j<npat; j++){
+			if(rematch(onec[j], str[i], strlen(str[i])) != matched[j]){
+				fprintf(stderr, "%s: pattern %d %s alone but %s in the set\n",
+					str[i], j, matched[j] ? "fails" : "matches",
+					matched[j] ? "matches" : "fails");
+				bad = 1;
+			}
+			n -= matched[j];
+		}
+		if(check && n != 0){
+			fprintf(stderr, "%s: rematchset count is off by %d\n", str[i], n);
+			bad = 1;
+		}
+	}
+
+	for(j=0; j<npat; j++){
+		if(onec[j] != NULL)
+			cachefree(onec[j]);
+		if(one[j] != NULL)
+			refree(one[j]);
+	}
+	free(onec);
+	free(one);
+	free(matched);
+	cachefree(c);
+	refree(re);
+	return bad;
+}
+
+int
+main(int argc, char **argv)
+{
+	int i, flags, full, check, npat;
+	char **pat;
+	Regexp *re;
+	Cache *c;
+
+	flags = Anchored;
+	full = 0;
+	check = 0;
+	npat = 0;
+	pat = malloc(argc * sizeof pat[0]);
+	if(pat == NULL){
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	for(; argc > 1 && argv[1][0] == '-' && argv[1][1] != 0; argc--, argv++){
+		if(strcmp(argv[1], "-s") == 0)
+			flags = 0;
+		else if(strcmp(argv[1], "-f") == 0)
+			full = 1;
+		else if(strcmp(argv[1], "-c") == 0)
+			check = 1;
+		else if(strcmp(argv[1], "-e") == 0 && argc > 2){
+			pat[npat++] = argv[2];
+			argc--, argv++;
+		}else
+			break;
+	}
+	if(npat > 0)
+		return matchset(pat, npat, flags, check, argv+1, argc-1);
+	if(argc < 3){
+		fprintf(stderr, "usage: dfa1 [-s] [-f] regexp string...\n"
+			"       dfa1 [-s] [-c] -e regexp [-e regexp]... string...\n");
+		return 1;
+	}
+
+	re = recompile(argv[1], flags);
+	if(re == NULL){
+		fprintf(stderr, "bad regexp %s\n", argv[1]);
+		return 1;
+	}
+	if(full && refull(re, 0) == 0)
+		fprintf(stderr, "too many states, using the lazy DFA\n");
+	c = cachenew(re, 0);
+	if(c == NULL){
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	for(i=2; i<argc; i++)
+		if(rematch(c, argv[i], strlen(argv[i])))
+			printf("%s\n", argv[i]);
+	cachefree(c);
+	refree(re);
+	free(pat);
+	return 0;
+}
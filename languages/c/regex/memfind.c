@@ -0,0 +1,100 @@
+/*
+ * Find the k byte string n in the m bytes at h.
+ *
+ * On x86 the first and last bytes of n are compared
+ * against 16 (SSE2) or 32 (AVX2, if the CPU has it)
+ * positions of h at once, and memcmp is only called
+ * for the middle of the candidates where both agree.
+ * Picking the last byte as well as the first keeps
+ * the false candidates down for text like English
+ * where the first byte alone is common.  Elsewhere
+ * it is memchr for the first byte and memcmp.
+ */
+#include <string.h>
+#include "memfind.h"
+
+static char*
+memfind1(const char *h, size_t m, const char *n, size_t k)
+{
+	const char *p, *e;
+
+	if(k > m)
+		return NULL;
+	e = h + m - k + 1;
+	for(p=h; p<e; p++){
+		if((p = memchr(p, n[0], e-p)) == NULL)
+			return NULL;
+		if(memcmp(p+1, n+1, k-1) == 0)
+			return (char*)p;
+	}
+	return NULL;
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define MEMFIND_X86
+
+__attribute__((target("sse2")))
+static char*
+memfind16(const char *h, size_t m, const char *n, size_t k)
+{
+	__m128i first, last, a, b;
+	unsigned mask;
+	size_t i, j;
+
+	first = _mm_set1_epi8(n[0]);
+	last = _mm_set1_epi8(n[k-1]);
+	for(i=0; i+k-1+16 <= m; i+=16){
+		a = _mm_loadu_si128((const __m128i*)(h+i));
+		b = _mm_loadu_si128((const __m128i*)(h+i+k-1));
+		mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first),
+			_mm_cmpeq_epi8(b, last)));
+		for(; mask != 0; mask &= mask-1){
+			j = __builtin_ctz(mask);
+			if(k < 3 || memcmp(h+i+j+1, n+1, k-2) == 0)
+				return (char*)h+i+j;
+		}
+	}
+	return memfind1(h+i, m-i, n, k);
+}
+
+__attribute__((target("avx2")))
+static char*
+memfind32(const char *h, size_t m, const char *n, size_t k)
+{
+	__m256i first, last, a, b;
+	unsigned mask;
+	size_t i, j;
+
+	first = _mm256_set1_epi8(n[0]);
+	last = _mm256_set1_epi8(n[k-1]);
+	for(i=0; i+k-1+32 <= m; i+=32){
+		a = _mm256_loadu_si256((const __m256i*)(h+i));
+		b = _mm256_loadu_si256((const __m256i*)(h+i+k-1));
+		mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first),
+			_mm256_cmpeq_epi8(b, last)));
+		for(; mask != 0; mask &= mask-1){
+			j = __builtin_ctz(mask);
+			if(k < 3 || memcmp(h+i+j+1, n+1, k-2) == 0)
+				return (char*)h+i+j;
+		}
+	}
+	return memfind16(h+i, m-i, n, k);
+}
+#endif
+
+char*
+memfind(const char *h, size_t m, const char *n, size_t k)
+{
+	if(k == 0)
+		return (char*)h;
+	if(k > m)
+		return NULL;
+#ifdef MEMFIND_X86
+	if(__builtin_cpu_supports("avx2"))
+		return memfind32(h, m, n, k);
+	return memfind16(h, m, n, k);
+#else
+	return memfind1(h, m, n, k);
+#endif
+}
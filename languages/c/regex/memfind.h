@@ -0,0 +1,20 @@
+/*
+ * Fast substring search, used by the matchers to skip
+ * over text that cannot contain a match.
+ */
+#ifndef MEMFIND_H
+#define MEMFIND_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+char*	memfind(const char *h, size_t m, const char *n, size_t k);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,206 @@
+/*             main.c        */
+/* Example and test driver for rs.c.
+
+   With no arguments, runs Rockliff's original example, a (15,9) code over
+   GF(2**4) with one symbol corrupted, then checks random errors and erasures
+   on single codewords and on shards of a (255,223) and a (14,10) code.
+   With -b, times shard encoding and rebuilding for a 10+4 code.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "rs.h"
+
+#define SHARD  (1<<20)    /* bytes per shard for the tests and -b */
+
+
+static void example()
+ {
+   RS *rs ;
+   unsigned char data [9], bb [6], recd [15] ;
+   int i, n ;
+
+/* p(X) = 1+X+X**4 */
+   rs = rs_new(4, 0x13, 15, 9) ;
+
+/* for example, say we transmit the following message (nothing special!) */
+   data[0] = 8 ;
+   data[1] = 6 ;
+   data[2] = 8 ;
+   data[3] = 1 ;
+   data[4] = 2 ;
+   data[5] = 4 ;
+   data[6] = 15 ;
+   data[7] = 9 ;
+   data[8] = 9 ;
+
+/* encode data[] to produce parity in bb[] */
+   rs_encode(rs, data, bb) ;
+
+/* put the transmitted codeword, made up of data plus parity, in recd[] */
+   for (i=0; i<6; i++)  recd[i] = bb[i] ;
+   for (i=0; i<9; i++) recd[i+6] = data[i] ;
+
+/* Again, lets say that a middle element is changed */
+   recd[15-15/2] = 3 ;
+
+   n = rs_decode(rs, recd, 0, 0) ;
+
+   printf("Results for Reed-Solomon code (n=%3d, k=%3d, t= %3d), %d corrected\n\n",
+          15, 9, 3, n) ;
+   printf("  i  data[i]   recd[i](decoded)\n") ;
+   for (i=0; i<6; i++)
+     printf("%3d    %3d      %3d\n", i, bb[i], recd[i]) ;
+   for (i=6; i<15; i++)
+     printf("%3d    %3d      %3d\n", i, data[i-6], recd[i]) ;
+   rs_free(rs) ;
+ }
+
+
+static void pick(int *place, int n, int nn)
+/* n distinct random places below nn */
+ {
+   int i, j ;
+
+   for (i=0; i<n; i++)
+    { do
+       { place[i] = rand()%nn ;
+         for (j=0; j<i && place[j]!=place[i]; j++)
+           ;
+       } while (j<i) ;
+    }
+ }
+
+
+static int test_codewords(int mm, int poly, int nn, int kk, int trials)
+/* random data, random errors and erasures within 2*errors+erasures<=nn-kk */
+ {
+   RS *rs = rs_new(mm, poly, nn, kk) ;
+   unsigned char cw [255], recd [255] ;
+   int place [255], i, t, nerr, neras, bad = 0 ;
+
+   for (t=0; t<trials; t++)
+    { for (i=nn-kk; i<nn; i++)  cw[i] = rand()&((1<<mm)-1) ;
+      rs_encode(rs, cw+nn-kk, cw) ;
+      neras = rand()%(nn-kk+1) ;
+      nerr = (nn-kk-neras)/2 ;
+      nerr = nerr ? rand()%(nerr+1) : 0 ;
+      pick(place, nerr+neras, nn) ;
+      memcpy(recd, cw, nn) ;
+      for (i=0; i<nerr+neras; i++)
+        recd[place[i]] ^= 1+rand()%((1<<mm)-1) ;
+      if (rs_decode(rs, recd, place+nerr, neras)<0 || memcmp(recd, cw, nn))
+        bad++ ;
+    }
+   printf("(%d,%d) over GF(2**%d): %d of %d codewords wrong\n",
+          nn, kk, mm, bad, trials) ;
+   rs_free(rs) ;
+   return bad ;
+ }
+
+
+static unsigned char **shards(int nn, size_t len)
+ {
+   unsigned char **s = malloc(nn*sizeof *s) ;
+   int i ;
+
+   for (i=0; i<nn; i++)  s[i] = malloc(len) ;
+   return s ;
+ }
+
+
+static int test_shards(int nn, int kk, size_t len)
+/* lose a random nn-kk shards, then fewer plus scattered errors */
+ {
+   RS *rs = rs_new(8, 0x11d, nn, kk) ;
+   unsigned char **s = shards(nn, len), **orig = shards(nn, len) ;
+   int place [255], i, neras, bad = 0 ;
+   size_t j ;
+   long n ;
+
+   for (i=nn-kk; i<nn; i++)
+     for (j=0; j<len; j++)  s[i][j] = rand() ;
+   rs_encode_shards(rs, s+nn-kk, s, len) ;
+   for (i=0; i<nn; i++)  memcpy(orig[i], s[i], len) ;
+
+   for (neras=nn-kk; neras>=0; neras-=2)
+    { pick(place, neras, nn) ;
+      for (i=0; i<neras; i++)  memset(s[place[i]], 0xee, len) ;
+      if (neras<nn-kk)                 /* and 100 scattered errors */
+        for (j=0; j<100; j++)
+         { i = rand()%nn ;
+           s[i][rand()%len] ^= 1+rand()%255 ;
+         }
+      n = rs_decode_shards(rs, s, len, place, neras) ;
+      for (i=0; i<nn; i++)
+        if (memcmp(s[i], orig[i], len))  bad++ ;
+      printf("(%d,%d) shards of %lu bytes, %d lost: %ld codewords with errors, %s\n",
+             nn, kk, (unsigned long)len, neras, n, bad ? "wrong" : "rebuilt") ;
+      for (i=0; i<nn; i++)  memcpy(s[i], orig[i], len) ;
+    }
+   for (i=0; i<nn; i++)
+    { free(s[i]) ;
+      free(orig[i]) ;
+    }
+   free(s) ;
+   free(orig) ;
+   rs_free(rs) ;
+   return bad ;
+ }
+
+
+static double seconds(clock_t start)
+ {
+   return (double)(clock()-start)/CLOCKS_PER_SEC ;
+ }
+
+
+static void bench()
+/* 10 data and 4 parity shards of SHARD bytes */
+ {
+   RS *rs = rs_new(8, 0x11d, 14, 10) ;
+   unsigned char **s = shards(14, SHARD) ;
+   int eras [4] = { 0, 5, 9, 13 }, i, pass, passes = 100 ;
+   size_t j ;
+   clock_t start ;
+   double mb = 10.0*SHARD/(1<<20)*passes ;
+
+   for (i=4; i<14; i++)
+     for (j=0; j<SHARD; j++)  s[i][j] = rand() ;
+   start = clock() ;
+   for (pass=0; pass<passes; pass++)
+     rs_encode_shards(rs, s+4, s, SHARD) ;
+   printf("encode 10+4:         %8.1f MB of data/s\n", mb/seconds(start)) ;
+   start = clock() ;
+   for (pass=0; pass<passes; pass++)
+     rs_decode_shards(rs, s, SHARD, eras, 4) ;
+   printf("rebuild 4 of 10+4:   %8.1f MB of data/s\n", mb/seconds(start)) ;
+   start = clock() ;
+   for (pass=0; pass<passes; pass++)
+     rs_decode_shards(rs, s, SHARD, 0, 0) ;
+   printf("check 10+4:          %8.1f MB of data/s\n", mb/seconds(start)) ;
+   for (i=0; i<14; i++)  free(s[i]) ;
+   free(s) ;
+   rs_free(rs) ;
+ }
+
+
+int main(int argc, char **argv)
+ {
+   int bad = 0 ;
+
+   if (argc>1 && strcmp(argv[1], "-b")==0)
+    { bench() ;
+      return 0 ;
+    }
+   example() ;
+   printf("\n") ;
+   bad += test_codewords(4, 0x13, 15, 9, 10000) ;
+   bad += test_codewords(8, 0x11d, 255, 223, 1000) ;
+   bad += test_codewords(8, 0x11d, 40, 30, 10000) ;
+   bad += test_shards(14, 10, SHARD/16+3) ;
+   bad += test_shards(255, 223, 20000) ;
+   return bad!=0 ;
+ }
@@ -0,0 +1,637 @@
+/*             rs.c        */
+/* This is an encoder/decoder for Reed-Solomon codes. Encoding is in
+   systematic form, decoding via the Berlekamp iterative algorithm.
+   The symbol size mm, the irreducible polynomial used to generate GF(2**mm),
+   the codeword length nn and the number of data symbols kk are given to
+   rs_new at run time; nn-kk=2tt parity symbols correct up to tt errors.
+   The polynomial must be primitive -- these can be found in Lin and Costello,
+   and also Clark and Cain.  nn may be less than 2**mm -1, giving a shortened
+   code.
+
+   The representation of the elements of GF(2**m) is either in index form,
+   where the number is the power of the primitive element alpha, which is
+   convenient for multiplication (add the powers modulo 2**m-1) or in
+   polynomial form, where the bits represent the coefficients of the
+   polynomial representation of the number, which is the most convenient form
+   for addition.  The two forms are swapped between via lookup tables.
+   This leads to fairly messy looking expressions, but unfortunately, there
+   is no easy alternative when working with Galois arithmetic.
+
+   The code is not written in the most elegant way, but to the best
+   of my knowledge, (no absolute guarantees!), it works.
+
+   Erasures (symbols known to be bad, at known places) are handled by
+   starting the Berlekamp-Massey algorithm from the erasure locator
+   polynomial, so 2*errors+erasures <= nn-kk can be corrected.  It does not
+   attempt to decode past the BCH bound -- see Blahut "Theory and practice
+   of error control codes" for how to do this.
+
+              Simon Rockliff, University of Adelaide   21/9/89
+
+   26/6/91 Slight modifications to remove a compiler dependent bug which hadn't
+           previously surfaced. A few extra comments added for clarity.
+           Appears to all work fine, ready for posting to net!
+
+   The globals are now kept in an RS made by rs_new, so several codes can
+   be used at once and from several threads, and the example main() is in
+   main.c.  Besides one codeword at a time, whole shards of codewords can be
+   encoded and decoded (see rs.h).  Multiplying a vector of symbols by a
+   constant c is linear in the bits of each symbol, so it is two lookups in
+   16 entry tables -- c times the low nibble and c times the high nibble --
+   which PSHUFB does for 16 or 32 symbols at once.  Encoding shards is then
+   a matrix product of the data with the parity matrix and computing
+   syndromes is one with the powers of alpha, both done that way.
+
+                  Notice
+                 --------
+   This program may be freely modified and/or given to whoever wants it.
+   A condition of such distribution is that the author's contribution be
+   acknowledged by his name being left in the comments heading the program,
+   however no responsibility is accepted for any financial or other loss which
+   may result from some unforseen errors or malfunctioning of the program
+   during use.
+                                 Simon Rockliff, 26th June 1991
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rs.h"
+
+#define RS_BLOCK  8192     /* codewords per pass when working on shards */
+
+struct rs
+ { int mm, poly ;
+   int size ;              /* 2**mm -1, length of the unshortened code */
+   int nn, kk, nroots ;    /* nroots = nn-kk = 2*tt */
+   int alpha_to [256], index_of [256] ;
+   unsigned char gg [256] ;       /* generator polynomial, polynomial form */
+   unsigned char *enc ;    /* multiply tables for the parity matrix, see rs_new */
+ } ;
+
+
+static int gf_mul(const RS *rs, int a, int b)
+/* multiply a and b, both in polynomial form */
+ {
+   if (a==0 || b==0) return 0 ;
+   return rs->alpha_to[(rs->index_of[a]+rs->index_of[b])%rs->size] ;
+ }
+
+
+static int gf_div(const RS *rs, int a, int b)
+/* divide a by b, both in polynomial form, b!=0 */
+ {
+   if (a==0) return 0 ;
+   return rs->alpha_to[(rs->index_of[a]-rs->index_of[b]+rs->size)%rs->size] ;
+ }
+
+
+static int gf_pow(const RS *rs, long i)
+/* alpha**i in polynomial form, i>=0 */
+ {
+   return rs->alpha_to[i%rs->size] ;
+ }
+
+
+static void gf_table(const RS *rs, int c, unsigned char *tab)
+/* fill tab[0..15] with c times each low nibble and tab[16..31] with c
+   times each high nibble, so that c*x = tab[x&15]^tab[16+(x>>4)].
+   Works from c*alpha**b for each bit b by shifting and reducing rather
+   than by the log tables, so it is defined for every byte even when mm<8.
+*/
+ {
+   int cb[8], b, x ;
+
+   cb[0] = c ;
+   for (b=1; b<8; b++)
+    { cb[b] = cb[b-1]<<1 ;
+      if (cb[b] & (1<<rs->mm))  cb[b] ^= rs->poly ;
+    }
+   for (x=0; x<16; x++)
+    { tab[x] = tab[16+x] = 0 ;
+      for (b=0; b<4; b++)
+        if (x & (1<<b))
+         { tab[x] ^= cb[b] ;
+           tab[16+x] ^= cb[b+4] ;
+         }
+    }
+ }
+
+
+static void dot1(const unsigned char *tab, const unsigned char *const *src,
+                 int nsrc, unsigned char *dst, size_t n)
+ {
+   size_t k ;
+   int i, x, q ;
+
+   for (k=0; k<n; k++)
+    { q = dst[k] ;
+      for (i=0; i<nsrc; i++)
+       { x = src[i][k] ;
+         q ^= tab[32*i+(x&15)] ^ tab[32*i+16+(x>>4)] ;
+       }
+      dst[k] = q ;
+    }
+ }
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define RS_X86
+
+__attribute__((target("ssse3")))
+static void dot16(const unsigned char *tab, const unsigned char *const *src,
+                  int nsrc, unsigned char *dst, size_t n)
+ {
+   __m128i mask, x, q ;
+   const __m128i *t ;
+   size_t k ;
+   int i ;
+
+   mask = _mm_set1_epi8(0x0f) ;
+   for (k=0; k+16<=n; k+=16)
+    { q = _mm_loadu_si128((const __m128i *)(dst+k)) ;
+      for (i=0, t=(const __m128i *)tab; i<nsrc; i++, t+=2)
+       { x = _mm_loadu_si128((const __m128i *)(src[i]+k)) ;
+         q = _mm_xor_si128(q, _mm_xor_si128(
+               _mm_shuffle_epi8(_mm_loadu_si128(t), _mm_and_si128(x, mask)),
+               _mm_shuffle_epi8(_mm_loadu_si128(t+1),
+                 _mm_and_si128(_mm_srli_epi16(x, 4), mask)))) ;
+       }
+      _mm_storeu_si128((__m128i *)(dst+k), q) ;
+    }
+   if (k<n)
+    { const unsigned char *rest [255] ;
+
+      for (i=0; i<nsrc; i++)  rest[i] = src[i]+k ;
+      dot1(tab, rest, nsrc, dst+k, n-k) ;
+    }
+ }
+
+__attribute__((target("avx2")))
+static void dot32(const unsigned char *tab, const unsigned char *const *src,
+                  int nsrc, unsigned char *dst, size_t n)
+ {
+   __m256i mask, x, q ;
+   const __m128i *t ;
+   size_t k ;
+   int i ;
+
+   mask = _mm256_set1_epi8(0x0f) ;
+   for (k=0; k+32<=n; k+=32)
+    { q = _mm256_loadu_si256((const __m256i *)(dst+k)) ;
+      for (i=0, t=(const __m128i *)tab; i<nsrc; i++, t+=2)
+       { x = _mm256_loadu_si256((const __m256i *)(src[i]+k)) ;
+         q = _mm256_xor_si256(q, _mm256_xor_si256(
+               _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_loadu_si128(t)),
+                 _mm256_and_si256(x, mask)),
+               _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_loadu_si128(t+1)),
+                 _mm256_and_si256(_mm256_srli_epi16(x, 4), mask)))) ;
+       }
+      _mm256_storeu_si256((__m256i *)(dst+k), q) ;
+    }
+   if (k<n)
+    { const unsigned char *rest [255] ;
+
+      for (i=0; i<nsrc; i++)  rest[i] = src[i]+k ;
+      dot16(tab, rest, nsrc, dst+k, n-k) ;
+    }
+ }
+#endif
+
+
+static void gf_dot(const unsigned char *tab, const unsigned char *const *src,
+                   int nsrc, unsigned char *dst, size_t n)
+/* dst[k] ^= c[i]*src[i][k] summed over i<nsrc, for k<n, where the 32 bytes
+   at tab+32*i were filled for c[i] by gf_table.  Each dst vector is read
+   and written once however many sources there are */
+ {
+#ifdef RS_X86
+   if (__builtin_cpu_supports("avx2"))
+     dot32(tab, src, nsrc, dst, n) ;
+   else if (__builtin_cpu_supports("ssse3"))
+     dot16(tab, src, nsrc, dst, n) ;
+   else
+#endif
+     dot1(tab, src, nsrc, dst, n) ;
+ }
+
+
+static int generate_gf(RS *rs)
+/* generate GF(2**mm) from the irreducible polynomial p(X) in poly
+   lookup tables:  index->polynomial form   alpha_to[] contains j=alpha**i;
+                   polynomial form -> index form  index_of[j=alpha**i] = i
+   alpha=2 is the primitive element of GF(2**mm).  Returns -1 if p(X)
+   is not primitive, so that alpha comes back to 1 too soon.
+*/
+ {
+   int i, x ;
+
+   for (i=0; i<=rs->size; i++)  rs->index_of[i] = -1 ;
+   x = 1 ;
+   for (i=0; i<rs->size; i++)
+    { if (rs->index_of[x] != -1)  return -1 ;
+      rs->alpha_to[i] = x ;
+      rs->index_of[x] = i ;
+      x <<= 1 ;
+      if (x & (1<<rs->mm))  x ^= rs->poly ;
+    }
+   rs->alpha_to[rs->size] = rs->alpha_to[0] ;
+   return x==1 ? 0 : -1 ;
+ }
+
+
+static void gen_poly(RS *rs)
+/* Obtain the generator polynomial of the tt-error correcting Reed Solomon
+   code from the product of (X+alpha**i), i=1..2*tt.  Kept in polynomial form.
+*/
+ {
+   int i, j ;
+
+   rs->gg[0] = 2 ;    /* primitive element alpha = 2  for GF(2**mm)  */
+   rs->gg[1] = 1 ;    /* g(x) = (X+alpha) initially */
+   for (i=2; i<=rs->nroots; i++)
+    { rs->gg[i] = 1 ;
+      for (j=i-1; j>0; j--)
+        rs->gg[j] = rs->gg[j-1] ^ gf_mul(rs, rs->gg[j], gf_pow(rs, i)) ;
+      rs->gg[0] = gf_mul(rs, rs->gg[0], gf_pow(rs, i)) ;  /* gg[0] can never be zero */
+    }
+ }
+
+
+RS *rs_new(int mm, int poly, int nn, int kk)
+/* make a codec for the code of length nn with kk data symbols over the
+   GF(2**mm) generated by poly, the bits of which are the coefficients of
+   p(X) (so X**8+X**4+X**3+X**2+1 is 0x11d).  Returns 0 if the parameters
+   do not make sense or poly is not primitive.
+*/
+ {
+   RS *rs ;
+   unsigned char data [255], parity [255] ;
+   int i, r ;
+
+   if (mm<2 || mm>8 || (poly>>mm)!=1 || kk<1 || nn<=kk || nn>(1<<mm)-1)
+     return 0 ;
+   if ((rs = calloc(1, sizeof *rs)) == 0)  return 0 ;
+   rs->mm = mm ;
+   rs->poly = poly ;
+   rs->size = (1<<mm)-1 ;
+   rs->nn = nn ;
+   rs->kk = kk ;
+   rs->nroots = nn-kk ;
+   rs->enc = malloc((size_t)kk*rs->nroots*32) ;
+   if (rs->enc==0 || generate_gf(rs)<0)
+    { rs_free(rs) ;
+      return 0 ;
+    }
+   gen_poly(rs) ;
+
+/* the code is linear, so the parity of any data is the sum of the parities
+   of its symbols times those symbols; enc[] has the tables to multiply by
+   parity symbol r of a 1 in place i at enc+32*(r*kk+i) */
+   memset(data, 0, kk) ;
+   for (i=0; i<kk; i++)
+    { data[i] = 1 ;
+      rs_encode(rs, data, parity) ;
+      data[i] = 0 ;
+      for (r=0; r<rs->nroots; r++)
+        gf_table(rs, parity[r], rs->enc+32*(r*kk+i)) ;
+    }
+   return rs ;
+ }
+
+
+void rs_free(RS *rs)
+ {
+   if (rs==0)  return ;
+   free(rs->enc) ;
+   free(rs) ;
+ }
+
+
+void rs_encode(const RS *rs, const unsigned char *data, unsigned char *parity)
+/* take the string of symbols in data[i], i=0..(kk-1) and encode systematically
+   to produce 2*tt parity symbols in parity[0]..parity[2*tt-1]
+   data[] is input and parity[] is output in polynomial form.
+   Encoding is done by using a feedback shift register with appropriate
+   connections specified by the elements of gg[], which was generated above.
+   Codeword is   c(X) = data(X)*X**(nn-kk)+ b(X)          */
+ {
+   int i, j, feedback ;
+   int nroots = rs->nroots ;
+
+   for (i=0; i<nroots; i++)   parity[i] = 0 ;
+   for (i=rs->kk-1; i>=0; i--)
+    {  feedback = data[i]^parity[nroots-1] ;
+       for (j=nroots-1; j>0; j--)
+         parity[j] = parity[j-1]^gf_mul(rs, rs->gg[j], feedback) ;
+       parity[0] = gf_mul(rs, rs->gg[0], feedback) ;
+    }
+ }
+
+
+static int syndromes(const RS *rs, const unsigned char *cw, unsigned char *s)
+/* s[i] = cw(alpha**(i+1)), i=0..2tt-1, by Horner's rule.  Returns 0 if all
+   of them are zero, that is cw is a codeword */
+ {
+   int i, j, q, any = 0 ;
+
+   for (i=0; i<rs->nroots; i++)
+    { q = 0 ;
+      for (j=rs->nn-1; j>=0; j--)
+        q = gf_mul(rs, q, gf_pow(rs, i+1)) ^ cw[j] ;
+      s[i] = q ;
+      any |= q ;
+    }
+   return any ;
+ }
+
+
+int rs_decode(const RS *rs, unsigned char *recd, const int *eras, int neras)
+/* correct the codeword recd[0..nn-1] in place.  eras[0..neras-1] are the places
+   of symbols known to be wrong, whose values are ignored.
+   We first compute the 2*tt syndromes.  Then, starting from the erasure
+   locator polynomial, the product of (1+alpha**e X) over the erasures e, we
+   use the Berlekamp-Massey iteration to find the error location polynomial
+   elp.  Its roots, found by trying every place (the Chien search), are the
+   inverses of alpha**j for the places j in error, and if there are fewer
+   of them than its degree there were too many errors to correct.  The error
+   values come from Forney's formula, omega(X)/elp'(X) at each root, where
+   omega(X) is the syndrome polynomial times elp(X), modulo X**2tt.
+   Returns the number of symbols corrected, or -1, leaving recd as it was,
+   if the errors cannot be corrected.
+*/
+ {
+   int nroots = rs->nroots ;
+   unsigned char cw [255], s [255], lambda [256], b [256], t [256] ;
+   unsigned char omega [255], err [255] ;
+   int loc [255], i, j, r, el, deg_lambda, count ;
+   int x, q, num, den ;
+
+   if (neras<0 || neras>nroots)  return -1 ;
+   for (i=0; i<neras; i++)
+     if (eras[i]<0 || eras[i]>=rs->nn)  return -1 ;
+   memcpy(cw, recd, rs->nn) ;
+   for (i=0; i<neras; i++)
+     cw[eras[i]] = 0 ;
+   if (!syndromes(rs, cw, s))
+    { memcpy(recd, cw, rs->nn) ;     /* erased symbols were all 0 */
+      return 0 ;
+    }
+
+/* initialise elp to the erasure locator */
+   memset(lambda, 0, nroots+1) ;
+   lambda[0] = 1 ;
+   for (i=0; i<neras; i++)
+    { x = gf_pow(rs, eras[i]) ;
+      for (j=i+1; j>0; j--)
+        lambda[j] ^= gf_mul(rs, x, lambda[j-1]) ;
+    }
+   memcpy(b, lambda, nroots+1) ;
+
+/* Berlekamp-Massey: r is the step, el the degree of elp so far, b(X) the
+   correction polynomial; delta is the r'th discrepancy */
+   el = neras ;
+   for (r=neras+1; r<=nroots; r++)
+    { num = 0 ;
+      for (i=0; i<r; i++)
+        num ^= gf_mul(rs, lambda[i], s[r-i-1]) ;
+      if (num==0)
+       { memmove(b+1, b, nroots) ;
+         b[0] = 0 ;
+         continue ;
+       }
+      t[0] = lambda[0] ;
+      for (i=0; i<nroots; i++)
+        t[i+1] = lambda[i+1] ^ gf_mul(rs, num, b[i]) ;
+      if (2*el <= r+neras-1)
+       { el = r+neras-el ;
+         for (i=0; i<=nroots; i++)
+           b[i] = gf_div(rs, lambda[i], num) ;
+       }
+      else
+       { memmove(b+1, b, nroots) ;
+         b[0] = 0 ;
+       }
+      memcpy(lambda, t, nroots+1) ;
+    }
+
+   deg_lambda = 0 ;
+   for (i=0; i<=nroots; i++)
+     if (lambda[i]!=0)  deg_lambda = i ;
+   if (deg_lambda==0)  return -1 ;
+
+/* find roots of the error location polynomial: place j is in error if
+   elp(alpha**-j) == 0 */
+   count = 0 ;
+   for (j=0; j<rs->nn; j++)
+    { x = gf_pow(rs, rs->size-j%rs->size) ;
+      q = 0 ;
+      for (i=deg_lambda; i>=0; i--)
+        q = gf_mul(rs, q, x) ^ lambda[i] ;
+      if (q==0)
+        loc[count++] = j ;
+    }
+   if (count!=deg_lambda)  return -1 ;  /* > tt errors, cannot solve */
+
+/* omega(X) = s(X)*elp(X) mod X**2tt */
+   for (i=0; i<nroots; i++)
+    { omega[i] = 0 ;
+      for (j=0; j<=i && j<=deg_lambda; j++)
+        omega[i] ^= gf_mul(rs, s[i-j], lambda[j]) ;
+    }
+
+/* evaluate errors at locations given by error location numbers loc[i] */
+   for (i=0; i<count; i++)
+    { x = gf_pow(rs, rs->size-loc[i]%rs->size) ;  /* alpha**-loc */
+      num = 0 ;
+      for (j=nroots-1; j>=0; j--)
+        num = gf_mul(rs, num, x) ^ omega[j] ;
+      den = 0 ;                      /* elp'(X), only odd powers survive */
+      for (j=deg_lambda-(deg_lambda%2==0); j>=1; j-=2)
+        den = gf_mul(rs, den, gf_mul(rs, x, x)) ^ lambda[j] ;
+      if (den==0)  return -1 ;
+      err[i] = gf_div(rs, num, den) ;
+    }
+   for (i=0; i<count; i++)
+     cw[loc[i]] ^= err[i] ;
+
+/* beyond the BCH bound elp can still have the right number of roots, so
+   check that we really ended up with a codeword */
+   if (syndromes(rs, cw, s))  return -1 ;
+   memcpy(recd, cw, rs->nn) ;
+   return count ;
+ }
+
+
+void rs_encode_shards(const RS *rs, unsigned char *const *data,
+                      unsigned char *const *parity, size_t len)
+/* encode len codewords whose data symbols are data[0..kk-1][i], putting
+   the parity symbols in parity[0..nn-kk-1][i].  parity shard r is the sum
+   over i of parity symbol r of a 1 in place i times data shard i, taken
+   RS_BLOCK codewords at a time so the data being summed stays in cache */
+ {
+   const unsigned char *src [255] ;
+   size_t off, n ;
+   int i, r ;
+
+   for (off=0; off<len; off+=n)
+    { n = len-off<RS_BLOCK ? len-off : RS_BLOCK ;
+      for (i=0; i<rs->kk; i++)  src[i] = data[i]+off ;
+      for (r=0; r<rs->nroots; r++)
+       { memset(parity[r]+off, 0, n) ;
+         gf_dot(rs->enc+32*r*rs->kk, src, rs->kk, parity[r]+off, n) ;
+       }
+    }
+ }
+
+
+static int gf_invert(const RS *rs, unsigned char *a, unsigned char *inv, int n)
+/* invert the n by n matrix a[] into inv[] by Gauss-Jordan elimination,
+   destroying a[].  Returns -1 if it is singular */
+ {
+   int i, j, k, p, c ;
+
+   memset(inv, 0, n*n) ;
+   for (i=0; i<n; i++)  inv[i*n+i] = 1 ;
+   for (i=0; i<n; i++)
+    { for (p=i; p<n && a[p*n+i]==0; p++)
+        ;
+      if (p==n)  return -1 ;
+      for (k=0; k<n; k++)
+       { c = a[i*n+k] ; a[i*n+k] = a[p*n+k] ; a[p*n+k] = c ;
+         c = inv[i*n+k] ; inv[i*n+k] = inv[p*n+k] ; inv[p*n+k] = c ;
+       }
+      c = a[i*n+i] ;
+      for (k=0; k<n; k++)
+       { a[i*n+k] = gf_div(rs, a[i*n+k], c) ;
+         inv[i*n+k] = gf_div(rs, inv[i*n+k], c) ;
+       }
+      for (j=0; j<n; j++)
+        if (j!=i && (c = a[j*n+i])!=0)
+          for (k=0; k<n; k++)
+           { a[j*n+k] ^= gf_mul(rs, c, a[i*n+k]) ;
+             inv[j*n+k] ^= gf_mul(rs, c, inv[i*n+k]) ;
+           }
+    }
+   return 0 ;
+ }
+
+
+long rs_decode_shards(const RS *rs, unsigned char *const *shards, size_t len,
+                      const int *eras, int neras)
+/* correct len codewords held in shards[0..nn-1][i], in place.  The shards
+   eras[0..neras-1] are lost and are rebuilt; their contents are ignored.
+   The syndromes of RS_BLOCK codewords at a time are computed with vector
+   multiplies.  With only erasures, syndrome i is the sum over the erased
+   places e of (alpha**e)**(i+1) times the lost symbol, a Vandermonde system
+   in the first neras syndromes, so the lost shards are the inverse of that
+   matrix times those syndromes.  Codewords whose remaining syndromes are not
+   then explained by the lost symbols alone also had errors, and just those
+   are decoded one at a time by rs_decode.
+   Returns the number of codewords that had errors besides the erasures, or
+   -1 if any of them could not be corrected.
+*/
+ {
+   int nroots = rs->nroots, nn = rs->nn, nlive = nn-neras ;
+   unsigned char *buf, *syn, *solve, *resid, *flags, *a, *inv, *s ;
+   unsigned char lost [255], cw [255] ;
+   const unsigned char *live [255], *src [255] ;
+   int place [255] ;
+   size_t off, n, c ;
+   uint64_t w ;
+   long fixed = 0 ;
+   int i, j, e, failed = 0 ;
+
+   if (neras<0 || neras>nroots)  return -1 ;
+   memset(lost, 0, nn) ;
+   for (e=0; e<neras; e++)
+    { if (eras[e]<0 || eras[e]>=nn || lost[eras[e]])  return -1 ;
+      lost[eras[e]] = 1 ;
+    }
+   for (j=0, i=0; j<nn; j++)
+     if (!lost[j])  place[i++] = j ;
+
+/* one allocation for: syndrome tables, nroots*nlive; solve tables,
+   neras*neras; residual tables, nroots*neras; a flag per codeword of a
+   block; the matrix and its inverse; and the syndromes of a block */
+   buf = malloc(32*((size_t)nroots*nlive+neras*neras+nroots*neras)
+                +2*neras*neras+(size_t)(nroots+1)*RS_BLOCK) ;
+   if (buf==0)  return -1 ;
+   syn = buf ;
+   solve = syn+32*nroots*nlive ;
+   resid = solve+32*neras*neras ;
+   flags = resid+32*nroots*neras ;
+   a = flags+RS_BLOCK ;
+   inv = a+neras*neras ;
+   s = inv+neras*neras ;
+   for (i=0; i<nroots; i++)
+     for (j=0; j<nlive; j++)
+       gf_table(rs, gf_pow(rs, (long)(i+1)*place[j]), syn+32*(i*nlive+j)) ;
+   for (i=0; i<nroots; i++)
+     for (e=0; e<neras; e++)
+       gf_table(rs, gf_pow(rs, (long)(i+1)*eras[e]), resid+32*(i*neras+e)) ;
+   if (neras>0)
+    { for (i=0; i<neras; i++)
+        for (e=0; e<neras; e++)
+          a[i*neras+e] = gf_pow(rs, (long)(i+1)*eras[e]) ;
+      if (gf_invert(rs, a, inv, neras)<0)
+       { free(buf) ;
+         return -1 ;
+       }
+      for (e=0; e<neras; e++)
+        for (i=0; i<neras; i++)
+          gf_table(rs, inv[e*neras+i], solve+32*(e*neras+i)) ;
+    }
+
+   for (off=0; off<len; off+=n)
+    { n = len-off<RS_BLOCK ? len-off : RS_BLOCK ;
+      for (j=0; j<nlive; j++)  live[j] = shards[place[j]]+off ;
+      for (i=0; i<nroots; i++)
+       { memset(s+i*RS_BLOCK, 0, n) ;
+         gf_dot(syn+32*i*nlive, live, nlive, s+i*RS_BLOCK, n) ;
+       }
+
+/* lost symbols from the first neras syndromes, then take what they add to
+   the others away from those */
+      for (i=0; i<neras; i++)  src[i] = s+i*RS_BLOCK ;
+      for (e=0; e<neras; e++)
+       { memset(shards[eras[e]]+off, 0, n) ;
+         gf_dot(solve+32*e*neras, src, neras, shards[eras[e]]+off, n) ;
+       }
+      for (e=0; e<neras; e++)  src[e] = shards[eras[e]]+off ;
+      memset(flags, 0, n) ;
+      for (i=neras; i<nroots; i++)
+       { gf_dot(resid+32*i*neras, src, neras, s+i*RS_BLOCK, n) ;
+         for (c=0; c+8<=n; c+=8)
+          { uint64_t f, x ;
+
+            memcpy(&f, flags+c, 8) ;
+            memcpy(&x, s+i*RS_BLOCK+c, 8) ;
+            f |= x ;
+            memcpy(flags+c, &f, 8) ;
+          }
+         for (; c<n; c++)
+           flags[c] |= s[i*RS_BLOCK+c] ;
+       }
+
+      for (c=0; c<n; c++)
+       { if (c%8==0 && c+8<=n)         /* skip clean codewords 8 at a time */
+          { memcpy(&w, flags+c, 8) ;
+            if (w==0)
+             { c += 7 ;
+               continue ;
+             }
+          }
+         if (flags[c]==0)  continue ;
+         for (j=0; j<nn; j++)  cw[j] = shards[j][off+c] ;
+         if (rs_decode(rs, cw, eras, neras)<0)
+          { failed = 1 ;
+            continue ;
+          }
+         for (j=0; j<nn; j++)  shards[j][off+c] = cw[j] ;
+         fixed++ ;
+       }
+    }
+   free(buf) ;
+   return failed ? -1 : fixed ;
+ }
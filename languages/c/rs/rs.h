@@ -0,0 +1,32 @@
+/*             rs.h        */
+/* Reed-Solomon codec over GF(2**mm), mm<=8, see rs.c.
+
+   An RS is made once by rs_new and only read afterwards, so one codec can
+   be shared by any number of threads.  Symbols are bytes and must be less
+   than 2**mm.  A codeword is nn symbols with the nn-kk parity symbols first
+   and the kk data symbols after them, as in Rockliff's original program.
+
+   The shard functions work on many codewords at once: shard j holds symbol
+   j of every codeword, so byte i of each of the nn shards is codeword i.
+   That is the layout of data striped over disks, and it lets the GF(2**mm)
+   arithmetic run across a whole vector of codewords per instruction.
+*/
+#ifndef RS_H
+#define RS_H
+
+#include <stddef.h>
+
+typedef struct rs RS ;
+
+RS *rs_new(int mm, int poly, int nn, int kk) ;
+void rs_free(RS *rs) ;
+
+void rs_encode(const RS *rs, const unsigned char *data, unsigned char *parity) ;
+int rs_decode(const RS *rs, unsigned char *cw, const int *eras, int neras) ;
+
+void rs_encode_shards(const RS *rs, unsigned char *const *data,
+                      unsigned char *const *parity, size_t len) ;
+long rs_decode_shards(const RS *rs, unsigned char *const *shards, size_t len,
+                      const int *eras, int neras) ;
+
+#endif
@@ -0,0 +1,504 @@
+/*             stripe.c        */
+/* Erasure coded shard sets: split a file into k data and m parity shards
+   and get it back from any k of them.
+
+   Each shard file is a 64 byte header, a table of one 64 bit checksum per
+   chunk, and then, from the next 4096 byte boundary, its chunk of every
+   stripe.  The header holds k, m, the index of the shard, the size of the
+   file, the chunk size, the number of stripes, an id made afresh by each
+   encode, and a checksum of its own; all numbers are little endian.  A
+   shard whose id is not that of most of the set came from another encode
+   and is not used, however good its checksums.  The last stripe is padded with
+   zeros.
+
+   Files are mapped rather than read, and the stripes are handed out to a
+   pool of threads one at a time, each thread encoding or checking and
+   rebuilding whole stripes on its own, so large chunks (a megabyte by
+   default) keep every thread streaming through memory.  On decoding, chunks
+   that are missing or fail their checksum are erasures; with at most m of
+   them in a stripe rs_decode_shards rebuilds them from the rest.  With
+   repair set, shard files that are missing are made again and bad chunks
+   are rewritten in place, so a degraded set is whole again; without it the
+   shards are mapped copy on write, so nothing decode corrects reaches them.
+*/
+
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "rs.h"
+#include "stripe.h"
+
+#define STRIPE_MAGIC   "RSSTRIPE"
+#define STRIPE_VERSION 2
+#define STRIPE_HDR     64
+#define STRIPE_ALIGN   4096
+#define STRIPE_POLY    0x11d      /* X**8+X**4+X**3+X**2+1 */
+
+typedef struct
+ { int k, m, nn ;
+   uint64_t size ;        /* bytes in the file */
+   uint64_t chunk ;       /* bytes per shard per stripe */
+   uint64_t nstripes ;
+   uint64_t data ;        /* offset of the first chunk in a shard file */
+   uint64_t id ;          /* of the encode that made the shards */
+ } Layout ;
+
+typedef struct
+ { unsigned char *map ;   /* whole shard file, or 0 if it is missing */
+   size_t len ;
+   int fresh ;            /* made again by repair, so nothing in it is good */
+ } Shard ;
+
+typedef struct
+ { RS *rs ;
+   Layout l ;
+   Shard *sh ;            /* nn shard files, in file order */
+   const unsigned char *in ;      /* the file, when encoding */
+   unsigned char *out ;   /* the file, when decoding, or 0 */
+   int repair ;
+   uint64_t next ;        /* next stripe to hand out */
+   long rebuilt, failed ;
+ } Job ;
+
+
+static void put64(unsigned char *p, uint64_t x)
+ {
+   int i ;
+
+   for (i=0; i<8; i++)  p[i] = x>>(8*i) ;
+ }
+
+
+static uint64_t get64(const unsigned char *p)
+ {
+   uint64_t x = 0 ;
+   int i ;
+
+   for (i=7; i>=0; i--)  x = x<<8 | p[i] ;
+   return x ;
+ }
+
+
+/* checksum: four lanes of multiply and rotate over 32 bytes at a time, after
+   Yann Collet's xxHash64, so it runs at memory speed */
+#define P1  0x9e3779b185ebca87ULL
+#define P2  0xc2b2ae3d27d4eb4fULL
+#define P3  0x165667b19e3779f9ULL
+#define P4  0x85ebca77c2b2ae63ULL
+#define P5  0x27d4eb2f165667c5ULL
+#define ROTL(x, r)  ((x)<<(r) | (x)>>(64-(r)))
+
+static uint64_t round64(uint64_t acc, uint64_t x)
+ {
+   acc += x*P2 ;
+   acc = ROTL(acc, 31) ;
+   return acc*P1 ;
+ }
+
+
+static uint64_t stripe_sum(const unsigned char *p, size_t n)
+ {
+   uint64_t v[4] = { P1+P2, P2, 0, -P1 }, h, x ;
+   size_t i = 0 ;
+   int j ;
+
+   if (n>=32)
+    { for (; i+32<=n; i+=32)
+        for (j=0; j<4; j++)
+         { memcpy(&x, p+i+8*j, 8) ;
+           v[j] = round64(v[j], x) ;
+         }
+      h = ROTL(v[0], 1)+ROTL(v[1], 7)+ROTL(v[2], 12)+ROTL(v[3], 18) ;
+      for (j=0; j<4; j++)
+        h = (h^round64(0, v[j]))*P1+P4 ;
+    }
+   else
+     h = P5 ;
+   h += n ;
+   for (; i+8<=n; i+=8)
+    { memcpy(&x, p+i, 8) ;
+      h ^= round64(0, x) ;
+      h = ROTL(h, 27)*P1+P4 ;
+    }
+   for (; i<n; i++)
+    { h ^= p[i]*P5 ;
+      h = ROTL(h, 11)*P1 ;
+    }
+   h ^= h>>33 ;
+   h *= P2 ;
+   h ^= h>>29 ;
+   h *= P3 ;
+   return h^h>>32 ;
+ }
+
+
+static int layout(Layout *l, int k, int m, uint64_t size, uint64_t chunk)
+ {
+   if (k<1 || m<1 || k+m>255 || chunk==0)
+    { errno = EINVAL ;
+      return -1 ;
+    }
+   l->k = k ;
+   l->m = m ;
+   l->nn = k+m ;
+   l->size = size ;
+   l->chunk = chunk ;
+   l->nstripes = (size+k*chunk-1)/(k*chunk) ;
+   l->data = (STRIPE_HDR+8*l->nstripes+STRIPE_ALIGN-1)/STRIPE_ALIGN*STRIPE_ALIGN ;
+   return 0 ;
+ }
+
+
+static void put_header(unsigned char *h, const Layout *l, int index)
+ {
+   memset(h, 0, STRIPE_HDR) ;
+   memcpy(h, STRIPE_MAGIC, 8) ;
+   put64(h+8, STRIPE_VERSION) ;
+   put64(h+16, l->k | (uint64_t)l->m<<16 | (uint64_t)index<<32) ;
+   put64(h+24, l->size) ;
+   put64(h+32, l->chunk) ;
+   put64(h+40, l->nstripes) ;
+   put64(h+48, l->id) ;
+   put64(h+56, stripe_sum(h, 56)) ;
+ }
+
+
+static int get_header(const unsigned char *h, size_t len, Layout *l, int *index)
+/* read a shard header into l; -1 if it is not one or the file is short */
+ {
+   uint64_t shape ;
+
+   if (len<STRIPE_HDR || memcmp(h, STRIPE_MAGIC, 8)!=0
+       || get64(h+8)!=STRIPE_VERSION || get64(h+56)!=stripe_sum(h, 56))
+     return -1 ;
+   shape = get64(h+16) ;
+   if (layout(l, shape&0xffff, shape>>16&0xffff, get64(h+24), get64(h+32))<0
+       || l->nstripes!=get64(h+40) || len<l->data+l->nstripes*l->chunk)
+     return -1 ;
+   l->id = get64(h+48) ;
+   *index = shape>>32 ;
+   return 0 ;
+ }
+
+
+static uint64_t encode_id(void)
+ {
+   struct timespec ts ;
+   uint64_t x [3] ;
+
+   clock_gettime(CLOCK_REALTIME, &ts) ;
+   x[0] = ts.tv_sec ;
+   x[1] = ts.tv_nsec ;
+   x[2] = getpid() ;
+   return stripe_sum((const unsigned char *)x, sizeof x) ;
+ }
+
+
+static int same_set(const Layout *a, const Layout *b)
+ {
+   return a->id==b->id && a->k==b->k && a->m==b->m && a->size==b->size
+     && a->chunk==b->chunk ;
+ }
+
+
+static unsigned char *chunk_at(const Job *j, int f, uint64_t s)
+ {
+   return j->sh[f].map+j->l.data+s*j->l.chunk ;
+ }
+
+
+static unsigned char *sum_at(const Job *j, int f, uint64_t s)
+ {
+   return j->sh[f].map+STRIPE_HDR+8*s ;
+ }
+
+
+static void *encode_worker(void *arg)
+ {
+   Job *j = arg ;
+   const Layout *l = &j->l ;
+   unsigned char *data [255], *parity [255] ;
+   uint64_t s, off, n ;
+   int f ;
+
+   while ((s = __atomic_fetch_add(&j->next, 1, __ATOMIC_RELAXED)) < l->nstripes)
+    { off = s*l->k*l->chunk ;
+      for (f=0; f<l->k; f++)
+       { data[f] = chunk_at(j, f, s) ;
+         n = off+f*l->chunk>=l->size ? 0 : l->size-off-f*l->chunk ;
+         if (n>l->chunk)  n = l->chunk ;
+         memcpy(data[f], j->in+off+f*l->chunk, n) ;
+         memset(data[f]+n, 0, l->chunk-n) ;
+       }
+      for (f=0; f<l->m; f++)
+        parity[f] = chunk_at(j, l->k+f, s) ;
+      rs_encode_shards(j->rs, data, parity, l->chunk) ;
+      for (f=0; f<l->nn; f++)
+        put64(sum_at(j, f, s), stripe_sum(chunk_at(j, f, s), l->chunk)) ;
+    }
+   return 0 ;
+ }
+
+
+static void *decode_worker(void *arg)
+/* codeword places have the m parity symbols first, so data shard f is at
+   place m+f and parity shard f at place f-k */
+ {
+   Job *j = arg ;
+   const Layout *l = &j->l ;
+   unsigned char *cw [255], *scratch ;
+   int eras [255], lost [255], neras, f, place ;
+   uint64_t s, off, n ;
+   long fixed ;
+
+   if ((scratch = malloc(l->m*l->chunk)) == 0)
+    { __atomic_fetch_add(&j->failed, (long)l->nstripes, __ATOMIC_RELAXED) ;
+      return 0 ;
+    }
+   while ((s = __atomic_fetch_add(&j->next, 1, __ATOMIC_RELAXED)) < l->nstripes)
+    { neras = 0 ;
+      for (f=0; f<l->nn; f++)
+       { place = f<l->k ? l->m+f : f-l->k ;
+         lost[f] = j->sh[f].map==0 || j->sh[f].fresh
+           || get64(sum_at(j, f, s))!=stripe_sum(chunk_at(j, f, s), l->chunk) ;
+         if (!lost[f])
+           cw[place] = chunk_at(j, f, s) ;
+         else if (neras<l->m)
+           cw[place] = j->repair ? chunk_at(j, f, s) : scratch+neras*l->chunk ;
+         if (lost[f])  eras[neras++] = place ;
+       }
+      if (neras>l->m)
+       { __atomic_fetch_add(&j->failed, 1, __ATOMIC_RELAXED) ;
+         continue ;
+       }
+      if (neras>0)
+       { if ((fixed = rs_decode_shards(j->rs, cw, l->chunk, eras, neras))<0)
+          { __atomic_fetch_add(&j->failed, 1, __ATOMIC_RELAXED) ;
+            continue ;
+          }
+         __atomic_fetch_add(&j->rebuilt, (long)neras, __ATOMIC_RELAXED) ;
+/* corrections may also have gone into chunks that passed their checksum */
+         if (j->repair)
+           for (f=0; f<l->nn; f++)
+             if (lost[f] || fixed>0)
+               put64(sum_at(j, f, s), stripe_sum(chunk_at(j, f, s), l->chunk)) ;
+       }
+      if (j->out==0)  continue ;
+      off = s*l->k*l->chunk ;
+      for (f=0; f<l->k && off+f*l->chunk<l->size; f++)
+       { n = l->size-off-f*l->chunk ;
+         memcpy(j->out+off+f*l->chunk, cw[l->m+f], n<l->chunk ? n : l->chunk) ;
+       }
+    }
+   free(scratch) ;
+   return 0 ;
+ }
+
+
+static void run(Job *j, void *(*worker)(void *), int threads)
+ {
+   pthread_t *t ;
+   int i, n ;
+
+   if (threads<1)  threads = sysconf(_SC_NPROCESSORS_ONLN) ;
+   if (threads<1)  threads = 1 ;
+   if ((uint64_t)threads>j->l.nstripes)  threads = j->l.nstripes ? j->l.nstripes : 1 ;
+   j->next = 0 ;
+   if ((t = malloc(threads*sizeof *t)) == 0)
+    { worker(j) ;
+      return ;
+    }
+   for (n=0; n<threads-1; n++)
+     if (pthread_create(&t[n], 0, worker, j)!=0)  break ;
+   worker(j) ;            /* this thread works too */
+   for (i=0; i<n; i++)
+     pthread_join(t[i], 0) ;
+   free(t) ;
+ }
+
+
+static unsigned char *map_file(int fd, size_t len, int writable)
+/* writable is 0 for read only, 1 for writes that go to the file, or 2 for
+   writes to a private copy */
+ {
+   void *p ;
+
+   if (len==0)  return 0 ;
+   p = mmap(0, len, writable ? PROT_READ|PROT_WRITE : PROT_READ,
+            writable==2 ? MAP_PRIVATE : MAP_SHARED, fd, 0) ;
+   return p==MAP_FAILED ? 0 : p ;
+ }
+
+
+static void shard_name(char *name, size_t n, const char *prefix, int f)
+ {
+   snprintf(name, n, "%s.%d", prefix, f) ;
+ }
+
+
+static void unmap_shards(Shard *sh, int nn)
+ {
+   int f ;
+
+   for (f=0; f<nn; f++)
+     if (sh[f].map)  munmap(sh[f].map, sh[f].len) ;
+   free(sh) ;
+ }
+
+
+static int create_shard(Shard *sh, const char *prefix, int f, const Layout *l)
+/* make shard file f (again), full size, with its header */
+ {
+   char name [4096] ;
+   int fd ;
+
+   shard_name(name, sizeof name, prefix, f) ;
+   sh->len = l->data+l->nstripes*l->chunk ;
+   if ((fd = open(name, O_RDWR|O_CREAT, 0666))<0)  return -1 ;
+   if (ftruncate(fd, sh->len)<0 || (sh->map = map_file(fd, sh->len, 1))==0)
+    { close(fd) ;
+      return -1 ;
+    }
+   close(fd) ;
+   put_header(sh->map, l, f) ;
+   return 0 ;
+ }
+
+
+int stripe_encode(const char *file, const char *prefix, int k, int m,
+                  size_t chunk, int threads)
+/* write file out as shards prefix.0 .. prefix.k+m-1 */
+ {
+   Job j ;
+   struct stat st ;
+   unsigned char *in = 0 ;
+   int fd, f, err = 0 ;
+
+   memset(&j, 0, sizeof j) ;
+   if ((fd = open(file, O_RDONLY))<0)  return -1 ;
+   if (fstat(fd, &st)<0 || layout(&j.l, k, m, st.st_size, chunk)<0
+       || (st.st_size>0 && (in = map_file(fd, st.st_size, 0))==0))
+    { close(fd) ;
+      return -1 ;
+    }
+   close(fd) ;
+   j.in = in ;
+   j.l.id = encode_id() ;
+   if ((j.rs = rs_new(8, STRIPE_POLY, j.l.nn, k))==0
+       || (j.sh = calloc(j.l.nn, sizeof *j.sh))==0)
+     err = -1 ;
+   for (f=0; f<j.l.nn && err==0; f++)
+     err = create_shard(&j.sh[f], prefix, f, &j.l) ;
+   if (err==0)
+     run(&j, encode_worker, threads) ;
+   if (j.sh)  unmap_shards(j.sh, j.l.nn) ;
+   rs_free(j.rs) ;
+   if (in)  munmap(in, st.st_size) ;
+   return err ;
+ }
+
+
+int stripe_decode(const char *prefix, const char *file, int repair,
+                  int threads, StripeStats *stats)
+/* check the shards prefix.* and rebuild what was lost.  Writes the file out
+   if file is not 0, and rewrites lost shards if repair is set.  Returns -1
+   if no shard could be read or the file could not be written; stripes that
+   could not be rebuilt are counted in stats->failed. */
+ {
+   Job j ;
+   Layout *l ;
+   char name [4096] ;
+   struct stat st ;
+   unsigned char *p ;
+   int fd, f, g, index, votes, best = 0, found = -1, err = 0 ;
+
+   memset(&j, 0, sizeof j) ;
+   memset(stats, 0, sizeof *stats) ;
+   j.sh = calloc(255, sizeof *j.sh) ;
+   l = calloc(255, sizeof *l) ;
+   if (j.sh==0 || l==0)
+    { free(j.sh) ;
+      free(l) ;
+      return -1 ;
+    }
+
+/* map every shard that is there, then keep those of the set that most of
+   them belong to; a shard left over from another encode is as good as
+   missing */
+   for (f=0; f<255; f++)
+    { shard_name(name, sizeof name, prefix, f) ;
+      if ((fd = open(name, repair ? O_RDWR : O_RDONLY))<0)  continue ;
+      if (fstat(fd, &st)<0 || (p = map_file(fd, st.st_size, repair ? 1 : 2))==0)
+       { close(fd) ;
+         continue ;
+       }
+      close(fd) ;
+      if (get_header(p, st.st_size, &l[f], &index)<0 || index!=f
+          || f>=l[f].nn)
+       { munmap(p, st.st_size) ;
+         continue ;
+       }
+      j.sh[f].map = p ;
+      j.sh[f].len = st.st_size ;
+    }
+   for (f=0; f<255; f++)
+     if (j.sh[f].map)
+      { for (votes=0, g=0; g<255; g++)
+          votes += j.sh[g].map && same_set(&l[f], &l[g]) ;
+        if (votes>best)
+         { best = votes ;
+           found = f ;
+         }
+      }
+   if (found>=0)
+     j.l = l[found] ;
+   for (f=0; f<255; f++)
+     if (j.sh[f].map && (found<0 || !same_set(&l[f], &j.l)))
+      { munmap(j.sh[f].map, j.sh[f].len) ;
+        j.sh[f].map = 0 ;
+      }
+   free(l) ;
+   if (found<0)
+    { free(j.sh) ;
+      errno = ENOENT ;
+      return -1 ;
+    }
+   stats->nstripes = j.l.nstripes ;
+   stats->nshards = j.l.nn ;
+   for (f=0; f<j.l.nn; f++)
+     if (j.sh[f].map==0)
+      { stats->missing++ ;
+        if (repair && create_shard(&j.sh[f], prefix, f, &j.l)<0)
+          err = -1 ;
+        j.sh[f].fresh = 1 ;
+      }
+
+   if (err==0 && file)
+    { if ((fd = open(file, O_RDWR|O_CREAT|O_TRUNC, 0666))<0
+          || ftruncate(fd, j.l.size)<0
+          || (j.l.size>0 && (j.out = map_file(fd, j.l.size, 1))==0))
+        err = -1 ;
+      if (fd>=0)  close(fd) ;
+    }
+   if (err==0 && (j.rs = rs_new(8, STRIPE_POLY, j.l.nn, j.l.k))==0)
+     err = -1 ;
+   if (err==0)
+    { j.repair = repair ;
+      run(&j, decode_worker, threads) ;
+      stats->rebuilt = j.rebuilt ;
+      stats->failed = j.failed ;
+    }
+   if (j.out)  munmap(j.out, j.l.size) ;
+   rs_free(j.rs) ;
+   unmap_shards(j.sh, 255) ;
+   return err ;
+ }
@@ -0,0 +1,28 @@
+/*             stripe.h        */
+/* Erasure coded shard sets on top of rs.c, see stripe.c.
+
+   A file is cut into stripes of k chunks; each stripe gets m parity chunks
+   from a (k+m,k) Reed-Solomon code over GF(2**8), and chunk i of every
+   stripe goes to shard file prefix.i, data shards 0..k-1 and parity shards
+   k..k+m-1.  Every chunk has its own checksum, so any k good chunks of a
+   stripe give back the file.
+*/
+#ifndef STRIPE_H
+#define STRIPE_H
+
+#include <stddef.h>
+
+typedef struct
+ { unsigned long long nstripes ;
+   int nshards ;          /* k+m */
+   int missing ;          /* shard files that were missing or unreadable */
+   long rebuilt ;         /* chunks that were lost or failed their checksum */
+   long failed ;          /* stripes with more than m chunks lost */
+ } StripeStats ;
+
+int stripe_encode(const char *file, const char *prefix, int k, int m,
+                  size_t chunk, int threads) ;
+int stripe_decode(const char *prefix, const char *file, int repair,
+                  int threads, StripeStats *st) ;
+
+#endif
@@ -0,0 +1,75 @@
+/*             stripemain.c        */
+/* Command line front end for stripe.c.
+
+   stripe encode [-k data] [-m parity] [-c chunk] [-j threads] file prefix
+   stripe decode [-r] [-j threads] prefix file
+   stripe repair [-j threads] prefix
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "stripe.h"
+
+
+static void usage(const char *arg0)
+ {
+   fprintf(stderr, "usage: %s encode [-k data] [-m parity] [-c chunk] [-j threads] file prefix\n", arg0) ;
+   fprintf(stderr, "       %s decode [-r] [-j threads] prefix file\n", arg0) ;
+   fprintf(stderr, "       %s repair [-j threads] prefix\n", arg0) ;
+   fprintf(stderr, "\t-k\tdata shards (default 10)\n") ;
+   fprintf(stderr, "\t-m\tparity shards (default 4)\n") ;
+   fprintf(stderr, "\t-c\tbytes per shard per stripe (default 1048576)\n") ;
+   fprintf(stderr, "\t-j\tnumber of threads (default one per CPU)\n") ;
+   fprintf(stderr, "\t-r\talso rewrite missing and damaged shards\n") ;
+   exit(2) ;
+ }
+
+
+int main(int argc, char **argv)
+ {
+   const char *arg0 = argv[0], *cmd ;
+   int k = 10, m = 4, threads = 0, repair = 0, c ;
+   size_t chunk = 1<<20 ;
+   StripeStats st ;
+
+   if (argc<2)  usage(arg0) ;
+   cmd = argv[1] ;
+   argc-- ;
+   argv++ ;
+   while ((c = getopt(argc, argv, "k:m:c:j:r"))!=-1)
+     switch (c)
+      { case 'k':  k = atoi(optarg) ; break ;
+        case 'm':  m = atoi(optarg) ; break ;
+        case 'c':  chunk = strtoul(optarg, 0, 0) ; break ;
+        case 'j':  threads = atoi(optarg) ; break ;
+        case 'r':  repair = 1 ; break ;
+        default:   usage(arg0) ;
+      }
+   argc -= optind ;
+   argv += optind ;
+
+   if (strcmp(cmd, "encode")==0 && argc==2)
+    { if (stripe_encode(argv[0], argv[1], k, m, chunk, threads)<0)
+       { fprintf(stderr, "%s: %s: %s\n", arg0, argv[0], strerror(errno)) ;
+         return 1 ;
+       }
+      return 0 ;
+    }
+   if (strcmp(cmd, "decode")==0 && argc==2)
+     c = stripe_decode(argv[0], argv[1], repair, threads, &st) ;
+   else if (strcmp(cmd, "repair")==0 && argc==1)
+     c = stripe_decode(argv[0], 0, 1, threads, &st) ;
+   else
+     usage(arg0) ;
+   if (c<0)
+    { fprintf(stderr, "%s: %s: %s\n", arg0, argv[0], strerror(errno)) ;
+      return 1 ;
+    }
+   fprintf(stderr, "%llu stripes of %d shards, %d shards missing, "
+           "%ld chunks rebuilt, %ld stripes lost\n", st.nstripes, st.nshards,
+           st.missing, st.rebuilt, st.failed) ;
+   return st.failed!=0 ;
+ }
@@ -1,4 +1,7 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include "tea.h"
 #include "xtea.h"
 #include "xxtea.h"
@@ -6,7 +9,94 @@
 static uint32_t data[2] = {0x1234,0x5678};  
 static uint32_t key[4]  = {0x1,0x2,0x3,0x4};
 
-int main(void){
+#define BENCH_LEN (64*1024*1024)
+
+/* CTR against a block at a time with xtea_encrypt, at odd lengths and
+ * with a counter that wraps its low word */
+static int test_ctr(void){
+        /* several times the smallest piece xtea_ctr_mt gives a thread,
+           and an odd length, so the last piece is partial */
+        static uint8_t in[5*65536+13], out[5*65536+13], out2[5*65536+13];
+        uint64_t iv = 0xFFFFFFF0ull, iv2 = 0xFFFFFFFFull - 20000;
+        int threads;
+        uint32_t v[2];
+        size_t len, i;
+        int bad = 0;
+        for (i=0; i < sizeof in; i++)
+                in[i] = rand();
+        for (len=0; len < 300; len += 7) {
+                xtea_ctr(64, out, in, len, iv, key);
+                for (i=0; i < len; i++) {
+                        if (i % 8 == 0) {
+                                v[0] = (uint32_t)(iv + i/8);
+                                v[1] = (uint32_t)((iv + i/8) >> 32);
+                                xtea_encrypt(64, v, key);
+                        }
+                        if ((out[i] ^ in[i]) != (uint8_t)(v[i%8/4] >> (8*(i%4))))
+                                bad++;
+                }
+        }
+        /* iv2 carries into the high word in a later piece */
+        xtea_ctr(64, out, in, sizeof in, iv2, key);
+        for (threads=2; threads <= 5; threads++) {
+                xtea_ctr_mt(64, out2, in, sizeof in, iv2, key, threads);
+                bad += memcmp(out, out2, sizeof in) != 0;
+                xtea_ctr_mt(64, out2, out2, sizeof in, iv2, key, threads);
+                bad += memcmp(in, out2, sizeof in) != 0;
+        }
+        printf("/*xtea ctr*/\n%s\n", bad ? "wrong" : "matches xtea_encrypt");
+        return bad;
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+static uint64_t ticks(void){ return __rdtsc(); }
+#else
+/* no cycle counter: report nanoseconds instead */
+static uint64_t ticks(void){
+        struct timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return (uint64_t)t.tv_sec*1000000000u + t.tv_nsec;
+}
+#endif
+
+static void report(const char *name, uint64_t start, size_t bytes){
+        printf("%-22s %8.2f cycles/byte\n", name, (double)(ticks() - start) / bytes);
+}
+
+static void bench(void){
+        uint8_t *buf = calloc(BENCH_LEN, 1);
+        uint32_t v[2] = {0, 0};
+        size_t i, n = BENCH_LEN / 64;
+        uint64_t start;
+
+        start = ticks();
+        for (i=0; i < n/8; i++)
+                tea_encrypt(v, key);
+        report("tea", start, n);
+        start = ticks();
+        for (i=0; i < n/8; i++)
+                xtea_encrypt(64, v, key);
+        report("xtea", start, n);
+        start = ticks();
+        for (i=0; i < n/1024; i++)
+                xxtea_encrypt(256, (uint32_t *)buf, key);
+        report("xxtea, 1 KB blocks", start, n);
+        start = ticks();
+        xtea_ctr(64, buf, buf, BENCH_LEN/8, 0, key);
+        report("xtea ctr", start, BENCH_LEN/8);
+        start = ticks();
+        xtea_ctr_mt(64, buf, buf, BENCH_LEN, 0, key, 0);
+        report("xtea ctr, all CPUs", start, BENCH_LEN);
+        free(buf);
+}
+
+int main(int argc, char **argv){
+        if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+                bench();
+                return 0;
+        }
+
         printf("/*tea*/\n");
         printf("data = {0x%X, 0x%X};\n", data[0], data[1]);
         printf("key  = {0x%X, 0x%X, 0x%X, 0x%X};\n", key[0], key[1], key[2], key[3]);
@@ -31,9 +121,5 @@ int main(void){
         xxtea_decrypt(2, data, key);
         printf("decrypted = {0x%X, 0x%X};\n", data[0], data[1]);
 
-
-
-
-
-        return 0;
+        return test_ctr() != 0;
 }
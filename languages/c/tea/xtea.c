@@ -4,6 +4,9 @@
  *
  * 64 rounds is suggested.
  */
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
 #include "xtea.h"
  
 /* take 64 bits of data in v[0] and v[1] and 128 bits of key[0] - key[3] */
@@ -29,3 +32,141 @@ void xtea_decrypt(unsigned num_rounds, uint32_t v[2], uint32_t const key[4]){
         v[0]=v0; v[1]=v1;
 }
 
+
+/* CTR mode: block i of the keystream is XTEA of the 64 bit counter iv+i,
+ * low word in v[0], written out as v[0] then v[1], each little endian.
+ * Encryption and decryption are the same operation and out may equal in.
+ */
+#define XTEA_LANES 16               /* blocks per pass of the vector kernel */
+#define XTEA_MT_MIN (64*1024)       /* smallest piece worth a thread */
+
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__linux__)
+#define XTEA_CLONES __attribute__((target_clones("avx2", "default")))
+#else
+#define XTEA_CLONES
+#endif
+
+typedef uint32_t xtea_vec __attribute__((vector_size(4*XTEA_LANES/2)));
+
+static void put32(uint8_t *out, uint32_t w){
+        out[0] = (uint8_t)w;
+        out[1] = (uint8_t)(w >> 8);
+        out[2] = (uint8_t)(w >> 16);
+        out[3] = (uint8_t)(w >> 24);
+}
+
+static void xor32(uint8_t *out, const uint8_t *in, uint32_t w){
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        uint32_t v;
+        memcpy(&v, in, 4);
+        v ^= w;
+        memcpy(out, &v, 4);
+#else
+        out[0] = in[0] ^ (uint8_t)w;
+        out[1] = in[1] ^ (uint8_t)(w >> 8);
+        out[2] = in[2] ^ (uint8_t)(w >> 16);
+        out[3] = in[3] ^ (uint8_t)(w >> 24);
+#endif
+}
+
+/* whole groups of XTEA_LANES blocks, lane j encrypting counter ctr+j;
+ * returns the number of blocks done */
+XTEA_CLONES
+static size_t xtea_ctr_lanes(unsigned num_rounds, uint8_t *out, const uint8_t *in,
+                             size_t nblocks, uint64_t ctr, uint32_t const key[4]){
+        xtea_vec v0[2], v1[2];
+        uint32_t sum, k, delta=0x9E3779B9;
+        unsigned i, j, h = XTEA_LANES/2;
+        size_t b;
+        for (b=0; b + XTEA_LANES <= nblocks; b += XTEA_LANES) {
+                for (j=0; j < XTEA_LANES; j++) {
+                        v0[j/h][j%h] = (uint32_t)(ctr + b + j);
+                        v1[j/h][j%h] = (uint32_t)((ctr + b + j) >> 32);
+                }
+                sum = 0;
+                for (i=0; i < num_rounds; i++) {
+                        k = sum + key[sum & 3];
+                        v0[0] += (((v1[0] << 4) ^ (v1[0] >> 5)) + v1[0]) ^ k;
+                        v0[1] += (((v1[1] << 4) ^ (v1[1] >> 5)) + v1[1]) ^ k;
+                        sum += delta;
+                        k = sum + key[(sum>>11) & 3];
+                        v1[0] += (((v0[0] << 4) ^ (v0[0] >> 5)) + v0[0]) ^ k;
+                        v1[1] += (((v0[1] << 4) ^ (v0[1] >> 5)) + v0[1]) ^ k;
+                }
+                for (j=0; j < XTEA_LANES; j++) {
+                        xor32(out + 8*(b+j), in + 8*(b+j), v0[j/h][j%h]);
+                        xor32(out + 8*(b+j) + 4, in + 8*(b+j) + 4, v1[j/h][j%h]);
+                }
+        }
+        return b;
+}
+
+void xtea_ctr(unsigned num_rounds, uint8_t *out, const uint8_t *in, size_t len,
+              uint64_t iv, uint32_t const key[4]){
+        uint32_t v[2];
+        uint8_t ks[8];
+        size_t b, i, nblocks = len / 8;
+        b = xtea_ctr_lanes(num_rounds, out, in, nblocks, iv, key);
+        for (; b < (len + 7) / 8; b++) {
+                v[0] = (uint32_t)(iv + b);
+                v[1] = (uint32_t)((iv + b) >> 32);
+                xtea_encrypt(num_rounds, v, key);
+                put32(ks, v[0]);
+                put32(ks + 4, v[1]);
+                for (i=0; i < 8 && 8*b + i < len; i++)
+                        out[8*b + i] = in[8*b + i] ^ ks[i];
+        }
+}
+
+struct xtea_job {
+        unsigned num_rounds;
+        uint8_t *out;
+        const uint8_t *in;
+        size_t len;
+        uint64_t iv;
+        uint32_t const *key;
+};
+
+static void *xtea_worker(void *arg){
+        struct xtea_job *j = arg;
+        xtea_ctr(j->num_rounds, j->out, j->in, j->len, j->iv, j->key);
+        return 0;
+}
+
+/* xtea_ctr cut into one piece per thread; threads<=0 means one per CPU */
+void xtea_ctr_mt(unsigned num_rounds, uint8_t *out, const uint8_t *in, size_t len,
+                 uint64_t iv, uint32_t const key[4], int threads){
+        struct xtea_job job[64];
+        pthread_t tid[64];
+        int started[64];
+        size_t piece, off;
+        int t, n;
+        if (threads <= 0)
+                threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        if (threads > 64)
+                threads = 64;
+        if (threads > (int)(len / XTEA_MT_MIN))
+                threads = (int)(len / XTEA_MT_MIN);
+        if (threads <= 1) {
+                xtea_ctr(num_rounds, out, in, len, iv, key);
+                return;
+        }
+        piece = (len / threads + 8*XTEA_LANES - 1) / (8*XTEA_LANES) * (8*XTEA_LANES);
+        for (t=0, off=0; off < len; t++, off += piece) {
+                job[t].num_rounds = num_rounds;
+                job[t].out = out + off;
+                job[t].in = in + off;
+                job[t].len = len - off < piece ? len - off : piece;
+                job[t].iv = iv + off / 8;
+                job[t].key = key;
+        }
+        n = t;
+        for (t=1; t < n; t++)
+                started[t] = pthread_create(&tid[t], 0, xtea_worker, &job[t]) == 0;
+        xtea_worker(&job[0]);
+        for (t=1; t < n; t++)
+                if (started[t])
+                        pthread_join(tid[t], 0);
+                else
+                        xtea_worker(&job[t]);
+}
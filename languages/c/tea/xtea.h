@@ -5,11 +5,18 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
 #include <stdint.h>
 
 void xtea_encrypt(unsigned num_rounds, uint32_t v[2], uint32_t const key[4]);
 void xtea_decrypt(unsigned num_rounds, uint32_t v[2], uint32_t const key[4]);
 
+/* CTR mode over len bytes, see xtea.c; threads<=0 uses every CPU */
+void xtea_ctr(unsigned num_rounds, uint8_t *out, const uint8_t *in, size_t len,
+              uint64_t iv, uint32_t const key[4]);
+void xtea_ctr_mt(unsigned num_rounds, uint8_t *out, const uint8_t *in, size_t len,
+                 uint64_t iv, uint32_t const key[4], int threads);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,546 @@
+/* Self check and benchmark for tweetnacl.c.
+
+   With no arguments, signs and verifies a few messages one at a time and
+   in a batch, damaging one signature to see that only it is rejected, and
+   sees that signatures with a small-order part in R or A get the same
+   verdict both ways.  Then checks the streaming hash and secretbox
+   interfaces, Salsa20 and Poly1305 against known answers, and both at
+   every length up to a few blocks of the widest kernel against reference
+   code built on crypto_core_salsa20 and the original 8-bit limbs.  make check runs
+   this for the default build and for one with -DTWEETNACL_SMALL.
+   With -b, times the public key operations and reports handshakes per
+   second, a handshake being one side's ephemeral crypto_box keypair and
+   shared key plus signing its key and verifying the peer's.
+   With -h file, prints the SHA-512 of the file, read in pieces. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "tweetnacl.h"
+
+#define N      64     /* signatures per test and per batch timing */
+#define MLEN   100
+#define CHUNK  1000   /* bytes per chunk for the secretbox stream test */
+
+void randombytes(unsigned char *x, unsigned long long n)
+{
+  static FILE *f;
+  if (!f && !(f = fopen("/dev/urandom", "rb"))) {
+    perror("/dev/urandom");
+    exit(1);
+  }
+  if (fread(x, 1, n, f) != n) {
+    perror("/dev/urandom");
+    exit(1);
+  }
+}
+
+static unsigned char pk[N][32], sk[N][64], sm[N][MLEN+64], m[N][MLEN+64];
+static unsigned char *mp[N];
+static const unsigned char *smp[N], *pkp[N];
+static unsigned long long smlen[N], mlen[N];
+static int valid[N];
+
+static void sign_all(void)
+{
+  int i;
+  for (i = 0; i < N; i++) {
+    crypto_sign_keypair(pk[i], sk[i]);
+    randombytes(m[i], MLEN);
+    crypto_sign(sm[i], &smlen[i], m[i], MLEN, sk[i]);
+    mp[i] = m[i];
+    smp[i] = sm[i];
+    pkp[i] = pk[i];
+  }
+}
+
+static int check(void)
+{
+  int i, bad = 0, r;
+
+  sign_all();
+  for (i = 0; i < N; i++)
+    if (crypto_sign_open(m[i], &mlen[i], sm[i], smlen[i], pk[i]) || mlen[i] != MLEN)
+      bad++;
+  printf("%d of %d signatures rejected one at a time\n", bad, N);
+
+  r = crypto_sign_open_batch(mp, mlen, smp, smlen, pkp, valid, N);
+  for (i = 0; i < N; i++)
+    if (!valid[i] || mlen[i] != MLEN || memcmp(m[i], sm[i] + 64, MLEN))
+      bad++;
+  printf("batch of %d: %s\n", N, r ? "rejected" : "accepted");
+
+  sm[N/3][70] ^= 1;
+  r = crypto_sign_open_batch(mp, mlen, smp, smlen, pkp, valid, N);
+  for (i = 0; i < N; i++)
+    if (valid[i] != (i != N/3))
+      bad++;
+  printf("batch with signature %d damaged: %s, %d of %d valid\n", N/3,
+         r ? "rejected" : "accepted", N - 1, N);
+  return bad + !r;
+}
+
+/* modL from tweetnacl.c, to make signatures crypto_sign would not */
+static const long long L[32] = {
+  0xed, 0xd3, 0xf5, 0x5c, 0x1a, 0x63, 0x12, 0x58,
+  0xd6, 0x9c, 0xf7, 0xa2, 0xde, 0xf9, 0xde, 0x14,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x10
+};
+
+static void modL(unsigned char *r, long long x[64])
+{
+  long long carry;
+  int i, j;
+  for (i = 63; i >= 32; --i) {
+    carry = 0;
+    for (j = i - 32; j < i - 12; ++j) {
+      x[j] += carry - 16 * x[i] * L[j - (i - 32)];
+      carry = (x[j] + 128) >> 8;
+      x[j] -= carry << 8;
+    }
+    x[j] += carry;
+    x[i] = 0;
+  }
+  carry = 0;
+  for (j = 0; j < 32; j++) {
+    x[j] += carry - (x[31] >> 4) * L[j];
+    carry = x[j] >> 8;
+    x[j] &= 255;
+  }
+  for (j = 0; j < 32; j++) x[j] -= carry * L[j];
+  for (i = 0; i < 32; i++) {
+    x[i+1] += x[i] >> 8;
+    r[i] = x[i] & 255;
+  }
+}
+
+/* the encoding of P + (0,-1) = (-x,-y), given that of P = (x,y) with x
+   not zero: y becomes 2^255 - 19 - y and the sign of x flips */
+static void addtorsion(unsigned char *q, const unsigned char *p)
+{
+  int i, c = 0, sign = p[31] >> 7;
+  for (i = 0; i < 32; i++) {
+    c += (i == 0 ? 0xed : i == 31 ? 0x7f : 0xff) - (i == 31 ? p[i] & 0x7f : p[i]);
+    q[i] = c & 255;
+    c >>= 8;
+  }
+  q[31] |= !sign << 7;
+}
+
+/* Signs m with sk but with R = r*B + T for T = (0,-1), of order 2, taking
+   r*B from a fresh key pair, and S = r + H(R,A,m)*a as usual.  Then
+   8*S*B = 8*R + 8*h*A, but S*B = R + h*A does not hold. */
+static void sign_torsion(unsigned char *sm, const unsigned char *m,
+                         unsigned long long n, const unsigned char *sk)
+{
+  unsigned char a[64], r[64], h[64], rpk[32], rsk[64];
+  long long x[64];
+  int i, j;
+
+  crypto_sign_keypair(rpk, rsk);
+  crypto_hash(r, rsk, 32);
+  crypto_hash(a, sk, 32);
+  r[0] &= 248; r[31] &= 127; r[31] |= 64;
+  a[0] &= 248; a[31] &= 127; a[31] |= 64;
+  addtorsion(sm, rpk);
+  memcpy(sm + 32, sk + 32, 32);
+  memcpy(sm + 64, m, n);
+  crypto_hash(h, sm, n + 64);
+  for (i = 0; i < 64; i++) x[i] = h[i];
+  modL(h, x);
+  for (i = 0; i < 64; i++) x[i] = i < 32 ? r[i] : 0;
+  for (i = 0; i < 32; i++)
+    for (j = 0; j < 32; j++)
+      x[i+j] += h[i] * (long long) a[j];
+  modL(sm + 32, x);
+}
+
+/* Signatures with a small-order component in R or A must get the same
+   verdict one at a time as in a batch, whatever z the batch draws: made
+   with sign_torsion, or by crypto_sign for a key whose A has (0,-1)
+   added, they are accepted; with R changed after signing they are not.
+   Before verification was cofactored, the batch accepted the first two
+   kinds for about half of all z, and crypto_sign_open rejected them. */
+static int check_torsion(void)
+{
+  static unsigned char out[MLEN+64];
+  unsigned long long outlen;
+  int i, k, bad = 0, r, one;
+
+  for (i = 0; i < 3*16; i++) {
+    sign_all();
+    k = i % N;
+    if (i % 3 == 0)
+      sign_torsion(sm[k], m[k], MLEN, sk[k]);
+    else if (i % 3 == 1) {
+      addtorsion(pk[k], pk[k]);
+      memcpy(sk[k] + 32, pk[k], 32);
+      crypto_sign(sm[k], &smlen[k], m[k], MLEN, sk[k]);
+    } else
+      addtorsion(sm[k], sm[k]);
+    one = crypto_sign_open(out, &outlen, sm[k], smlen[k], pk[k]) == 0;
+    r = crypto_sign_open_batch(mp, mlen, smp, smlen, pkp, valid, N);
+    bad += one != (i % 3 != 2) || valid[k] != one || (r == 0) != one;
+  }
+  printf("small-order R and A: %s one at a time and in a batch\n",
+         bad ? "different verdicts" : "same verdict");
+  return bad;
+}
+
+static int check_streams(void)
+{
+  static unsigned char buf[3*CHUNK+100], c[4][CHUNK+16], box[CHUNK+32], out[CHUNK];
+  unsigned char h1[64], h2[64], k[32], n[24], hdr[16];
+  crypto_hash_state hs;
+  crypto_secretbox_stream_state ps, st;
+  unsigned long long i, j, len[4];
+  int bad = 0, f, r, last = 0;
+
+  randombytes(buf, sizeof buf);
+  crypto_hash(h1, buf, sizeof buf);
+  crypto_hash_init(&hs);
+  for (i = 0; i < sizeof buf; i += j) {
+    j = rand() % 300;
+    if (j > sizeof buf - i) j = sizeof buf - i;
+    crypto_hash_update(&hs, buf + i, j);
+  }
+  crypto_hash_final(&hs, h2);
+  r = memcmp(h1, h2, 64) != 0;
+  printf("streaming SHA-512: %s\n", r ? "wrong" : "same");
+  bad += r;
+
+  /* four chunks, the last one short */
+  randombytes(k, 32);
+  crypto_secretbox_stream_init_push(&ps, hdr, k);
+  for (i = 0; i < 4; i++) {
+    len[i] = i < 3 ? CHUNK : 100;
+    crypto_secretbox_stream_push(&ps, c[i], buf + i*CHUNK, len[i], i == 3);
+  }
+  r = crypto_secretbox_stream_push(&ps, c[0], buf, 1, 0) == 0;
+  for (i = 0; i < 16; i++)  n[i] = hdr[i];
+  for (i = 16; i < 24; i++)  n[i] = 0;
+  memset(box, 0, 32);
+  memcpy(box + 32, buf, CHUNK);
+  crypto_secretbox(box, box, CHUNK + 32, n, k);
+  r += memcmp(box + 16, c[0], CHUNK + 16) != 0;
+
+  crypto_secretbox_stream_init_pull(&st, hdr, k);
+  for (i = 0; i < 4; i++) {
+    if (crypto_secretbox_stream_pull(&st, out, c[i], len[i] + 16, &f)
+        || memcmp(out, buf + i*CHUNK, len[i]))
+      r++;
+    last = f;
+  }
+  r += !last;
+  printf("secretbox stream: %s\n", r ? "wrong" : "round trip");
+  bad += r;
+
+  r = 0;
+  crypto_secretbox_stream_init_pull(&st, hdr, k);
+  crypto_secretbox_stream_pull(&st, out, c[0], CHUNK + 16, &f);
+  r += crypto_secretbox_stream_pull(&st, out, c[2], CHUNK + 16, &f) == 0;
+  crypto_secretbox_stream_init_pull(&st, hdr, k);
+  crypto_secretbox_stream_pull(&st, out, c[0], CHUNK + 16, &f);
+  crypto_secretbox_stream_pull(&st, out, c[1], CHUNK + 16, &f);
+  crypto_secretbox_stream_pull(&st, out, c[2], CHUNK + 16, &f);
+  r += f;
+  c[3][20] ^= 1;
+  r += crypto_secretbox_stream_pull(&st, out, c[3], len[3] + 16, &f) == 0;
+  printf("secretbox stream: dropped, truncated and damaged chunks %s\n",
+         r ? "accepted" : "rejected");
+  return bad + r;
+}
+
+/* Known answers for Salsa20 and Poly1305.  shared, firstkey, nonce and
+   rs are from the NaCl tests: HSalsa20 of shared under a zero nonce is
+   firstkey, and rs is the first 32 bytes of its XSalsa20 stream under
+   nonce.  streamhash is the SHA-512 of the first 4194304 bytes of that
+   stream, polykey and polytag are the Poly1305 example of RFC 8439
+   section 2.5.2, and fftag is the authenticator of 1013 0xff bytes
+   under a key of 32 0xff bytes. */
+static const unsigned char shared[32] = {
+  0x4a, 0x5d, 0x9d, 0x5b, 0xa4, 0xce, 0x2d, 0xe1,
+  0x72, 0x8e, 0x3b, 0xf4, 0x80, 0x35, 0x0f, 0x25,
+  0xe0, 0x7e, 0x21, 0xc9, 0x47, 0xd1, 0x9e, 0x33,
+  0x76, 0xf0, 0x9b, 0x3c, 0x1e, 0x16, 0x17, 0x42
+};
+static const unsigned char firstkey[32] = {
+  0x1b, 0x27, 0x55, 0x64, 0x73, 0xe9, 0x85, 0xd4,
+  0x62, 0xcd, 0x51, 0x19, 0x7a, 0x9a, 0x46, 0xc7,
+  0x60, 0x09, 0x54, 0x9e, 0xac, 0x64, 0x74, 0xf2,
+  0x06, 0xc4, 0xee, 0x08, 0x44, 0xf6, 0x83, 0x89
+};
+static const unsigned char nonce[24] = {
+  0x69, 0x69, 0x6e, 0xe9, 0x55, 0xb6, 0x2b, 0x73,
+  0xcd, 0x62, 0xbd, 0xa8, 0x75, 0xfc, 0x73, 0xd6,
+  0x82, 0x19, 0xe0, 0x03, 0x6b, 0x7a, 0x0b, 0x37
+};
+static const unsigned char rs[32] = {
+  0xee, 0xa6, 0xa7, 0x25, 0x1c, 0x1e, 0x72, 0x91,
+  0x6d, 0x11, 0xc2, 0xcb, 0x21, 0x4d, 0x3c, 0x25,
+  0x25, 0x39, 0x12, 0x1d, 0x8e, 0x23, 0x4e, 0x65,
+  0x2d, 0x65, 0x1f, 0xa4, 0xc8, 0xcf, 0xf8, 0x80
+};
+static const unsigned char streamhash[64] = {
+  0x2b, 0xd8, 0xe7, 0xdb, 0x68, 0x77, 0x53, 0x9e,
+  0x4f, 0x2b, 0x29, 0x5e, 0xe4, 0x15, 0xcd, 0x37,
+  0x8a, 0xe2, 0x14, 0xaa, 0x3b, 0xeb, 0x3e, 0x08,
+  0xe9, 0x11, 0xa5, 0xbd, 0x4a, 0x25, 0xe6, 0xac,
+  0x16, 0xca, 0x28, 0x3c, 0x79, 0xc3, 0x4c, 0x08,
+  0xc9, 0x9f, 0x7b, 0xdb, 0x56, 0x01, 0x11, 0xe8,
+  0xca, 0xc1, 0xae, 0x65, 0xee, 0xa0, 0x8a, 0xc3,
+  0x84, 0xd7, 0xa5, 0x91, 0x46, 0x1a, 0xb6, 0xe3
+};
+static const unsigned char polykey[32] = {
+  0x85, 0xd6, 0xbe, 0x78, 0x57, 0x55, 0x6d, 0x33,
+  0x7f, 0x44, 0x52, 0xfe, 0x42, 0xd5, 0x06, 0xa8,
+  0x01, 0x03, 0x80, 0x8a, 0xfb, 0x0d, 0xb2, 0xfd,
+  0x4a, 0xbf, 0xf6, 0xaf, 0x41, 0x49, 0xf5, 0x1b
+};
+static const unsigned char polytag[16] = {
+  0xa8, 0x06, 0x1d, 0xc1, 0x30, 0x51, 0x36, 0xc6,
+  0xc2, 0x2b, 0x8b, 0xaf, 0x0c, 0x01, 0x27, 0xa9
+};
+static const unsigned char fftag[16] = {
+  0x4d, 0xca, 0x92, 0x42, 0x85, 0xb9, 0x48, 0xe5,
+  0xcb, 0x20, 0xec, 0x39, 0x0a, 0x9c, 0x1a, 0x10
+};
+
+static int check_known(void)
+{
+  static unsigned char s[4194304];
+  unsigned char k[32], h[64], t[16];
+  int r = 0;
+
+  memset(h, 0, 16);
+  crypto_core_hsalsa20(k, h, shared, (const unsigned char *) "expand 32-byte k");
+  r += memcmp(k, firstkey, 32) != 0;
+  crypto_stream(k, 32, nonce, firstkey);
+  r += memcmp(k, rs, 32) != 0;
+  crypto_stream(s, sizeof s, nonce, firstkey);
+  crypto_hash(h, s, sizeof s);
+  r += memcmp(h, streamhash, 64) != 0;
+  crypto_onetimeauth(t, (const unsigned char *) "Cryptographic Forum Research Group", 34, polykey);
+  r += memcmp(t, polytag, 16) != 0;
+  memset(s, 0xff, 1013);
+  memset(k, 0xff, 32);
+  crypto_onetimeauth(t, s, 1013, k);
+  r += memcmp(t, fftag, 16) != 0;
+  printf("Salsa20 and Poly1305 known answers: %s\n", r ? "wrong" : "right");
+  return r;
+}
+
+/* Poly1305 as in the original tweetnacl, seventeen limbs of 8 bits,
+   to check crypto_onetimeauth against whichever version it is built
+   with */
+static void add1305(unsigned int *h, const unsigned int *c)
+{
+  unsigned int j, u = 0;
+  for (j = 0; j < 17; j++) {
+    u += h[j] + c[j];
+    h[j] = u & 255;
+    u >>= 8;
+  }
+}
+
+static void poly1305(unsigned char *out, const unsigned char *m,
+                     unsigned long long n, const unsigned char *k)
+{
+  static const unsigned int minusp[17] = {
+    5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 252
+  };
+  unsigned int s, i, j, u, x[17], r[17], h[17], c[17], g[17];
+
+  for (j = 0; j < 17; j++) r[j] = h[j] = 0;
+  for (j = 0; j < 16; j++) r[j] = k[j];
+  r[3] &= 15; r[4] &= 252; r[7] &= 15; r[8] &= 252;
+  r[11] &= 15; r[12] &= 252; r[15] &= 15;
+  while (n > 0) {
+    for (j = 0; j < 17; j++) c[j] = 0;
+    for (j = 0; j < 16 && j < n; j++) c[j] = m[j];
+    c[j] = 1;
+    m += j; n -= j;
+    add1305(h, c);
+    for (i = 0; i < 17; i++) {
+      x[i] = 0;
+      for (j = 0; j < 17; j++)
+        x[i] += h[j] * (j <= i ? r[i - j] : 320 * r[i + 17 - j]);
+    }
+    u = 0;
+    for (j = 0; j < 16; j++) {
+      u += x[j];
+      h[j] = u & 255;
+      u >>= 8;
+    }
+    u += x[16]; h[16] = u & 3;
+    u = 5 * (u >> 2);
+    for (j = 0; j < 16; j++) {
+      u += h[j];
+      h[j] = u & 255;
+      u >>= 8;
+    }
+    u += h[16]; h[16] = u;
+  }
+  for (j = 0; j < 17; j++) g[j] = h[j];
+  add1305(h, minusp);
+  s = -(h[16] >> 7);
+  for (j = 0; j < 17; j++) h[j] ^= s & (g[j] ^ h[j]);
+  for (j = 0; j < 16; j++) c[j] = k[j + 16];
+  c[16] = 0;
+  add1305(h, c);
+  for (j = 0; j < 16; j++) out[j] = h[j];
+}
+
+/* Salsa20 keystream block by block with crypto_core_salsa20, which the
+   wide kernels of crypto_stream_salsa20_xor never replace */
+static void salsa20(unsigned char *c, unsigned long long d,
+                    const unsigned char *n, unsigned long long ic,
+                    const unsigned char *k)
+{
+  unsigned char in[16], x[64];
+  unsigned long long i;
+  int j;
+
+  memcpy(in, n, 8);
+  for (i = 0; i < d; i += 64) {
+    for (j = 0; j < 8; j++)
+      in[8+j] = (ic + i/64) >> 8*j;
+    crypto_core_salsa20(x, in, k, (const unsigned char *) "expand 32-byte k");
+    memcpy(c + i, x, d - i < 64 ? d - i : 64);
+  }
+}
+
+/* Every length from 0 to MAXLEN bytes, so each kernel is entered with
+   every remainder: crypto_stream_salsa20 and _xor (in place and not,
+   at an odd address) against salsa20 above, crypto_onetimeauth against
+   poly1305 above with random keys and with all-ones keys and messages,
+   and the first chunk of a secretbox stream, whose keystream starts at
+   block 1, against both. */
+#define MAXLEN 2100
+
+static int check_lengths(void)
+{
+  static unsigned char ref[MAXLEN+64], m[MAXLEN+1], c[MAXLEN+1], box[MAXLEN+16];
+  unsigned char k[32], n[8], t[16], u[16], hdr[16], sub[32], zero[16];
+  crypto_secretbox_stream_state st;
+  int r = 0, first = -1, len, i;
+
+  memset(zero, 0, 16);
+  for (len = 0; len <= MAXLEN; len++) {
+    randombytes(k, 32);
+    randombytes(n, 8);
+    randombytes(m, len + 1);
+    salsa20(ref, len, n, 0, k);
+    crypto_stream_salsa20(c, len, n, k);
+    r = memcmp(c, ref, len) != 0;
+    crypto_stream_salsa20_xor(c + 1, m + 1, len, n, k);
+    for (i = 0; i < len; i++)
+      r |= c[i+1] != (m[i+1] ^ ref[i]);
+    memcpy(c, m, len);
+    crypto_stream_salsa20_xor(c, c, len, n, k);
+    for (i = 0; i < len; i++)
+      r |= c[i] != (m[i] ^ ref[i]);
+
+    crypto_onetimeauth(t, m, len, k);
+    poly1305(u, m, len, k);
+    r |= memcmp(t, u, 16) != 0;
+    memset(c, 0xff, len);
+    memset(k, 0xff, 32);
+    crypto_onetimeauth(t, c, len, k);
+    poly1305(u, c, len, k);
+    r |= memcmp(t, u, 16) != 0;
+
+    crypto_secretbox_stream_init_push(&st, hdr, k);
+    crypto_secretbox_stream_push(&st, box, m, len, 0);
+    crypto_core_hsalsa20(sub, hdr, k, (const unsigned char *) "expand 32-byte k");
+    salsa20(ref, len + 32, zero, 0, sub);
+    for (i = 0; i < len; i++)
+      r |= box[16+i] != (m[i] ^ ref[32+i]);
+    poly1305(u, box + 16, len, ref);
+    r |= memcmp(box, u, 16) != 0;
+
+    if (r && first < 0)
+      first = len;
+  }
+  if (first < 0)
+    printf("Salsa20 and Poly1305 against the reference, 0 to %d bytes: same\n", MAXLEN);
+  else
+    printf("Salsa20 and Poly1305 against the reference: first differ at %d bytes\n", first);
+  return first >= 0;
+}
+
+static int hash_file(const char *name)
+{
+  static unsigned char buf[1<<16];
+  unsigned char h[64];
+  crypto_hash_state s;
+  FILE *f = fopen(name, "rb");
+  size_t n;
+  int i;
+
+  if (!f) {
+    perror(name);
+    return 1;
+  }
+  crypto_hash_init(&s);
+  while ((n = fread(buf, 1, sizeof buf, f)) > 0)
+    crypto_hash_update(&s, buf, n);
+  fclose(f);
+  crypto_hash_final(&s, h);
+  for (i = 0; i < 64; i++)
+    printf("%02x", h[i]);
+  printf("  %s\n", name);
+  return 0;
+}
+
+static double rate(clock_t start, int n)
+{
+  return n / ((double)(clock() - start) / CLOCKS_PER_SEC);
+}
+
+static void bench(void)
+{
+  unsigned char bpk[32], bsk[32], peer[32], k[32];
+  int i, n = 1000;
+  clock_t start;
+  double kp, nm, sg, vf, bv;
+
+  crypto_box_keypair(peer, bsk);
+  start = clock();
+  for (i = 0; i < n; i++)
+    crypto_box_keypair(bpk, bsk);
+  printf("crypto_box_keypair:     %9.0f/s\n", kp = rate(start, n));
+  start = clock();
+  for (i = 0; i < n; i++)
+    crypto_box_beforenm(k, peer, bsk);
+  printf("crypto_box_beforenm:    %9.0f/s\n", nm = rate(start, n));
+
+  sign_all();
+  start = clock();
+  for (i = 0; i < n; i++)
+    crypto_sign(sm[i%N], &smlen[i%N], m[i%N], MLEN, sk[i%N]);
+  printf("crypto_sign:            %9.0f/s\n", sg = rate(start, n));
+  start = clock();
+  for (i = 0; i < n; i++)
+    crypto_sign_open(m[i%N], &mlen[i%N], sm[i%N], smlen[i%N], pk[i%N]);
+  printf("crypto_sign_open:       %9.0f/s\n", vf = rate(start, n));
+  start = clock();
+  for (i = 0; i < n/N; i++)
+    crypto_sign_open_batch(mp, mlen, smp, smlen, pkp, valid, N);
+  printf("crypto_sign_open_batch: %9.0f/s\n", bv = rate(start, n/N*N));
+
+  printf("handshakes:             %9.0f/s\n", 1/(1/kp + 1/nm + 1/sg + 1/vf));
+  printf("  with batch verify:    %9.0f/s\n", 1/(1/kp + 1/nm + 1/sg + 1/bv));
+}
+
+int main(int argc, char **argv)
+{
+  if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+    bench();
+    return 0;
+  }
+  if (argc > 2 && strcmp(argv[1], "-h") == 0)
+    return hash_file(argv[2]);
+  return check() + check_torsion() + check_streams() + check_known() + check_lengths() != 0;
+}
@@ -6,12 +6,36 @@ typedef unsigned char u8;
 typedef unsigned long u32;
 typedef unsigned long long u64;
 typedef long long i64;
-typedef i64 gf[16];
 extern void randombytes(u8 *,u64);
 
+/* With 128-bit products field elements are five 51-bit limbs; otherwise,
+   or with -DTWEETNACL_SMALL, the reference sixteen 16-bit limbs. */
+#if !defined(TWEETNACL_SMALL) && defined(__SIZEOF_INT128__)
+#define FAST128
+typedef unsigned __int128 u128;
+typedef u64 gf[5];
+#else
+typedef i64 gf[16];
+#endif
+typedef gf ge[4];
+
+static const u8
+  _0[16];
+#ifndef FAST128
 static const u8
-  _0[16],
   _9[32] = {9};
+#endif
+#ifdef FAST128
+static const gf
+  gf0,
+  gf1 = {1},
+  _121665 = {121665},
+  D = {0x34dca135978a3, 0x1a8283b156ebd, 0x5e7a26001c029, 0x739c663a03cbb, 0x52036cee2b6ff},
+  D2 = {0x69b9426b2f159, 0x35050762add7a, 0x3cf44c0038052, 0x6738cc7407977, 0x2406d9dc56dff},
+  X = {0x62d608f25d51a, 0x412a4b4f6592a, 0x75b7171a4b31d, 0x1ff60527118fe, 0x216936d3cd6e5},
+  Y = {0x6666666666658, 0x4cccccccccccc, 0x1999999999999, 0x3333333333333, 0x6666666666666},
+  I = {0x61b274a0ea0b0, 0xd5a5fc8f189d, 0x7ef5e9cbd0c60, 0x78595a6804c9e, 0x2b8324804fc1d};
+#else
 static const gf
   gf0,
   gf1 = {1},
@@ -21,6 +45,7 @@ static const gf
   X = {0xd51a, 0x8f25, 0x2d60, 0xc956, 0xa7b2, 0x9525, 0xc760, 0x692c, 0xdc5c, 0xfdd6, 0xe231, 0xc0a4, 0x53fe, 0xcd6e, 0x36d3, 0x2169},
   Y = {0x6658, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666},
   I = {0xa0b0, 0x4a0e, 0x1b27, 0xc4ee, 0xe478, 0xad2f, 0x1806, 0x2f43, 0xd7a7, 0x3dfb, 0x0099, 0x2b4d, 0xdf0b, 0x4fc1, 0x2480, 0x2b83};
+#endif
 
 static u32 L32(u32 x,int c) { return (x << c) | ((x&0xffffffff) >> (32 - c)); }
 
@@ -122,13 +147,149 @@ int crypto_core_hsalsa20(u8 *out,const u8 *in,const u8 *k,const u8 *c)
 
 static const u8 sigma[16] = "expand 32-byte k";
 
-int crypto_stream_salsa20_xor(u8 *c,const u8 *m,u64 b,const u8 *n,const u8 *k)
+sv st64(u8 *x,u64 u)
+{
+  st32(x,u);
+  st32(x+4,u >> 32);
+}
+
+/* Several Salsa20 blocks at once, block j of a group in lane j of every word,
+   for the bulk of crypto_stream_salsa20_xor.  Build with -DTWEETNACL_SMALL
+   to leave only the reference code. */
+#if !defined(TWEETNACL_SMALL) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SALSA20_X86
+#include <immintrin.h>
+
+static u64 ld64(const u8 *x)
+{
+  return ld32(x) | (u64) ld32(x+4) << 32;
+}
+
+typedef unsigned int v4u __attribute__((vector_size(16)));
+typedef unsigned int v8u __attribute__((vector_size(32)));
+
+#define RV(v,c) (((v) << (c)) | ((v) >> (32 - (c))))
+#define QR(a,b,c,d) \
+  x[b] ^= RV(x[a]+x[d], 7); \
+  x[c] ^= RV(x[b]+x[a], 9); \
+  x[d] ^= RV(x[c]+x[b],13); \
+  x[a] ^= RV(x[d]+x[c],18)
+#define DOUBLEROUND \
+  QR( 0, 4, 8,12); QR( 5, 9,13, 1); QR(10,14, 2, 6); QR(15, 3, 7,11); \
+  QR( 0, 1, 2, 3); QR( 5, 6, 7, 4); QR(10,11, 8, 9); QR(15,12,13,14)
+
+__attribute__((target("sse2")))
+static u64 salsa20_x4(u8 *c,const u8 *m,u64 b,u64 ctr,const unsigned int *s)
+{
+  v4u x[16],y[16];
+  __m128i t[4],u[4];
+  u64 d = 0;
+  int i,j,g;
+  while (b - d >= 256) {
+    FOR(i,16) y[i] = (v4u) {s[i],s[i],s[i],s[i]};
+    FOR(j,4) {
+      y[8][j] = ctr + j;
+      y[9][j] = (ctr + j) >> 32;
+    }
+    FOR(i,16) x[i] = y[i];
+    FOR(i,10) { DOUBLEROUND; }
+    FOR(i,16) x[i] += y[i];
+    FOR(g,4) {
+      t[0] = _mm_unpacklo_epi32((__m128i) x[4*g],(__m128i) x[4*g+1]);
+      t[1] = _mm_unpacklo_epi32((__m128i) x[4*g+2],(__m128i) x[4*g+3]);
+      t[2] = _mm_unpackhi_epi32((__m128i) x[4*g],(__m128i) x[4*g+1]);
+      t[3] = _mm_unpackhi_epi32((__m128i) x[4*g+2],(__m128i) x[4*g+3]);
+      u[0] = _mm_unpacklo_epi64(t[0],t[1]);
+      u[1] = _mm_unpackhi_epi64(t[0],t[1]);
+      u[2] = _mm_unpacklo_epi64(t[2],t[3]);
+      u[3] = _mm_unpackhi_epi64(t[2],t[3]);
+      FOR(j,4) {
+        if (m) u[j] = _mm_xor_si128(u[j],_mm_loadu_si128((const __m128i *) (m+d+64*j+16*g)));
+        _mm_storeu_si128((__m128i *) (c+d+64*j+16*g),u[j]);
+      }
+    }
+    ctr += 4;
+    d += 256;
+  }
+  return d;
+}
+
+__attribute__((target("avx2")))
+static u64 salsa20_x8(u8 *c,const u8 *m,u64 b,u64 ctr,const unsigned int *s)
+{
+  v8u x[16],y[16];
+  __m256i t[4],u[4][4],v[2];
+  u64 d = 0;
+  int i,j,g,h;
+  while (b - d >= 512) {
+    FOR(i,16) y[i] = (v8u) {s[i],s[i],s[i],s[i],s[i],s[i],s[i],s[i]};
+    FOR(j,8) {
+      y[8][j] = ctr + j;
+      y[9][j] = (ctr + j) >> 32;
+    }
+    FOR(i,16) x[i] = y[i];
+    FOR(i,10) { DOUBLEROUND; }
+    FOR(i,16) x[i] += y[i];
+    FOR(g,4) {
+      t[0] = _mm256_unpacklo_epi32((__m256i) x[4*g],(__m256i) x[4*g+1]);
+      t[1] = _mm256_unpacklo_epi32((__m256i) x[4*g+2],(__m256i) x[4*g+3]);
+      t[2] = _mm256_unpackhi_epi32((__m256i) x[4*g],(__m256i) x[4*g+1]);
+      t[3] = _mm256_unpackhi_epi32((__m256i) x[4*g+2],(__m256i) x[4*g+3]);
+      u[g][0] = _mm256_unpacklo_epi64(t[0],t[1]);
+      u[g][1] = _mm256_unpackhi_epi64(t[0],t[1]);
+      u[g][2] = _mm256_unpacklo_epi64(t[2],t[3]);
+      u[g][3] = _mm256_unpackhi_epi64(t[2],t[3]);
+    }
+    /* low lanes hold blocks 0..3, high lanes blocks 4..7 */
+    FOR(j,4) FOR(g,2) {
+      v[0] = _mm256_permute2x128_si256(u[2*g][j],u[2*g+1][j],0x20);
+      v[1] = _mm256_permute2x128_si256(u[2*g][j],u[2*g+1][j],0x31);
+      FOR(h,2) {
+        i = 64*(j+4*h)+32*g;
+        if (m) v[h] = _mm256_xor_si256(v[h],_mm256_loadu_si256((const __m256i *) (m+d+i)));
+        _mm256_storeu_si256((__m256i *) (c+d+i),v[h]);
+      }
+    }
+    ctr += 8;
+    d += 512;
+  }
+  return d;
+}
+
+static u64 salsa20_blocks(u8 *c,const u8 *m,u64 b,u8 *z,const u8 *k)
+{
+  unsigned int s[16];
+  u64 ctr = ld64(z+8),d = 0;
+  int i;
+  FOR(i,4) {
+    s[5*i] = ld32(sigma+4*i);
+    s[1+i] = ld32(k+4*i);
+    s[11+i] = ld32(k+16+4*i);
+  }
+  s[6] = ld32(z);
+  s[7] = ld32(z+4);
+  if (__builtin_cpu_supports("avx2")) d = salsa20_x8(c,m,b,ctr,s);
+  if (__builtin_cpu_supports("sse2")) d += salsa20_x4(c+d,m?m+d:0,b-d,ctr+d/64,s);
+  st64(z+8,ctr+d/64);
+  return d;
+}
+#endif
+
+static int stream_salsa20_xor(u8 *c,const u8 *m,u64 b,const u8 *n,u64 ic,const u8 *k)
 {
   u8 z[16],x[64];
   u32 u,i;
   if (!b) return 0;
-  FOR(i,16) z[i] = 0;
   FOR(i,8) z[i] = n[i];
+  st64(z+8,ic);
+#ifdef SALSA20_X86
+  if (b >= 256) {
+    u64 d = salsa20_blocks(c,m,b,z,k);
+    b -= d;
+    c += d;
+    if (m) m += d;
+  }
+#endif
   while (b >= 64) {
     crypto_core_salsa20(x,z,k,sigma);
     FOR(i,64) c[i] = (m?m[i]:0) ^ x[i];
@@ -149,6 +310,11 @@ int crypto_stream_salsa20_xor(u8 *c,const u8 *m,u64 b,const u8 *n,const u8 *k)
   return 0;
 }
 
+int crypto_stream_salsa20_xor(u8 *c,const u8 *m,u64 b,const u8 *n,const u8 *k)
+{
+  return stream_salsa20_xor(c,m,b,n,0,k);
+}
+
 int crypto_stream_salsa20(u8 *c,u64 d,const u8 *n,const u8 *k)
 {
   return crypto_stream_salsa20_xor(c,0,d,n,k);
@@ -168,6 +334,78 @@ int crypto_stream_xor(u8 *c,const u8 *m,u64 d,const u8 *n,const u8 *k)
   return crypto_stream_salsa20_xor(c,m,d,n+16,s);
 }
 
+/* Poly1305 in three 44/44/42-bit limbs with 128-bit products; the 17-limb
+   radix 2^8 version below is the reference. */
+#ifdef FAST128
+#define M44 0xfffffffffffULL
+#define M42 0x3ffffffffffULL
+
+int crypto_onetimeauth(u8 *out,const u8 *m,u64 n,const u8 *k)
+{
+  u64 r0,r1,r2,s1,s2,h0 = 0,h1 = 0,h2 = 0,g0,g1,g2,c,t0,t1,hibit;
+  u128 d0,d1,d2;
+  u8 x[16];
+  u32 i;
+
+  t0 = ld64(k);
+  t1 = ld64(k+8);
+  r0 = t0 & 0xffc0fffffffULL;
+  r1 = ((t0 >> 44) | (t1 << 20)) & 0xfffffc0ffffULL;
+  r2 = (t1 >> 24) & 0x00ffffffc0fULL;
+  s1 = r1 * 20;
+  s2 = r2 * 20;
+
+  while (n > 0) {
+    hibit = 1ULL << 40;
+    if (n < 16) {
+      FOR(i,16) x[i] = i < n ? m[i] : i == n;
+      hibit = 0;
+      m = x;
+      n = 16;
+    }
+    t0 = ld64(m);
+    t1 = ld64(m+8);
+    h0 += t0 & M44;
+    h1 += ((t0 >> 44) | (t1 << 20)) & M44;
+    h2 += ((t1 >> 24) & M42) | hibit;
+    d0 = (u128) h0 * r0 + (u128) h1 * s2 + (u128) h2 * s1;
+    d1 = (u128) h0 * r1 + (u128) h1 * r0 + (u128) h2 * s2;
+    d2 = (u128) h0 * r2 + (u128) h1 * r1 + (u128) h2 * r0;
+    c = d0 >> 44; h0 = (u64) d0 & M44;
+    d1 += c; c = d1 >> 44; h1 = (u64) d1 & M44;
+    d2 += c; c = d2 >> 42; h2 = (u64) d2 & M42;
+    h0 += c * 5; c = h0 >> 44; h0 &= M44;
+    h1 += c;
+    m += 16;
+    n -= 16;
+  }
+
+  c = h1 >> 44; h1 &= M44;
+  h2 += c; c = h2 >> 42; h2 &= M42;
+  h0 += c * 5; c = h0 >> 44; h0 &= M44;
+  h1 += c; c = h1 >> 44; h1 &= M44;
+  h2 += c; c = h2 >> 42; h2 &= M42;
+  h0 += c * 5; c = h0 >> 44; h0 &= M44;
+  h1 += c;
+
+  g0 = h0 + 5; c = g0 >> 44; g0 &= M44;
+  g1 = h1 + c; c = g1 >> 44; g1 &= M44;
+  g2 = h2 + c - (1ULL << 42);
+  c = (g2 >> 63) - 1;
+  h0 = (h0 & ~c) | (g0 & c);
+  h1 = (h1 & ~c) | (g1 & c);
+  h2 = (h2 & ~c) | (g2 & c);
+
+  t0 = ld64(k+16);
+  t1 = ld64(k+24);
+  h0 += t0 & M44; c = h0 >> 44; h0 &= M44;
+  h1 += (((t0 >> 44) | (t1 << 20)) & M44) + c; c = h1 >> 44; h1 &= M44;
+  h2 += ((t1 >> 24) & M42) + c;
+  st64(out,h0 | (h1 << 44));
+  st64(out+8,(h1 >> 20) | (h2 << 24));
+  return 0;
+}
+#else
 sv add1305(u32 *h,const u32 *c)
 {
   u32 j,u = 0;
@@ -234,6 +472,7 @@ int crypto_onetimeauth(u8 *out,const u8 *m,u64 n,const u8 *k)
   FOR(j,16) out[j] = h[j];
   return 0;
 }
+#endif
 
 int crypto_onetimeauth_verify(const u8 *h,const u8 *m,u64 n,const u8 *k)
 {
@@ -264,6 +503,264 @@ int crypto_secretbox_open(u8 *m,const u8 *c,u64 d,const u8 *n,const u8 *k)
   return 0;
 }
 
+/* secretbox without the zero padding: the d bytes at c are the ciphertext
+   and the 16 at a their authenticator, exactly as crypto_secretbox lays
+   them out after its 16 zero bytes */
+sv secretbox_xor(u8 *c,const u8 *m,u64 d,const u8 *n,const u8 *k,u8 *x)
+{
+  u8 s[32];
+  u64 i;
+  crypto_core_hsalsa20(s,n,k,sigma);
+  crypto_stream_salsa20(x,64,n+16,s);
+  FOR(i,32) if (i < d) c[i] = m[i] ^ x[i+32];
+  if (d > 32) stream_salsa20_xor(c+32,m+32,d-32,n+16,1,s);
+}
+
+sv secretbox_detached(u8 *a,u8 *c,const u8 *m,u64 d,const u8 *n,const u8 *k)
+{
+  u8 x[64];
+  secretbox_xor(c,m,d,n,k,x);
+  crypto_onetimeauth(a,c,d,x);
+}
+
+static int secretbox_open_detached(u8 *m,const u8 *a,const u8 *c,u64 d,const u8 *n,const u8 *k)
+{
+  u8 s[32],x[64];
+  crypto_core_hsalsa20(s,n,k,sigma);
+  crypto_stream_salsa20(x,32,n+16,s);
+  if (crypto_onetimeauth_verify(a,c,d,x) != 0) return -1;
+  secretbox_xor(m,c,d,n,k,x);
+  return 0;
+}
+
+/* A stream of chunks, each a secretbox under the key with nonce
+   header || chunk number, whose top bit marks the final chunk, so chunks
+   cannot be dropped, reordered or cut off at the end.  push writes the
+   16 byte authenticator and then the ciphertext to c; pull reads them
+   back.  c + 16 may equal m. */
+#define STREAM_FINAL (1ULL << 63)
+
+int crypto_secretbox_stream_init_pull(crypto_secretbox_stream_state *st,const u8 *h,const u8 *k)
+{
+  int i;
+  FOR(i,32) st->k[i] = k[i];
+  FOR(i,16) st->n[i] = h[i];
+  st->i = 0;
+  return 0;
+}
+
+int crypto_secretbox_stream_init_push(crypto_secretbox_stream_state *st,u8 *h,const u8 *k)
+{
+  randombytes(h,16);
+  return crypto_secretbox_stream_init_pull(st,h,k);
+}
+
+int crypto_secretbox_stream_push(crypto_secretbox_stream_state *st,u8 *c,const u8 *m,u64 d,int final)
+{
+  if (st->i & STREAM_FINAL) return -1;
+  if (final) st->i |= STREAM_FINAL;
+  st64(st->n+16,st->i);
+  secretbox_detached(c,c+16,m,d,st->n,st->k);
+  st->i++;
+  return 0;
+}
+
+int crypto_secretbox_stream_pull(crypto_secretbox_stream_state *st,u8 *m,const u8 *c,u64 d,int *final)
+{
+  int f;
+  if (d < 16 || (st->i & STREAM_FINAL)) return -1;
+  FOR(f,2) {
+    st64(st->n+16,st->i | (f ? STREAM_FINAL : 0));
+    if (secretbox_open_detached(m,c,c+16,d-16,st->n,st->k) == 0) {
+      if (final) *final = f;
+      st->i = f ? STREAM_FINAL : st->i + 1;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+#ifdef FAST128
+#define M51 0x7ffffffffffffULL
+
+sv set25519(gf r, const gf a)
+{
+  int i;
+  FOR(i,5) r[i]=a[i];
+}
+
+sv car25519(gf o)
+{
+  int i;
+  FOR(i,4) {
+    o[i+1]+=o[i]>>51;
+    o[i]&=M51;
+  }
+  o[0]+=19*(o[4]>>51);
+  o[4]&=M51;
+}
+
+sv sel25519(gf p,gf q,int b)
+{
+  u64 t,c=-(u64)b;
+  int i;
+  FOR(i,5) {
+    t= c&(p[i]^q[i]);
+    p[i]^=t;
+    q[i]^=t;
+  }
+}
+
+sv pack25519(u8 *o,const gf n)
+{
+  int i;
+  u64 q;
+  gf t;
+  FOR(i,5) t[i]=n[i];
+  car25519(t);
+  car25519(t);
+  q=(t[0]+19)>>51;
+  FOR(i,4) q=(t[i+1]+q)>>51;
+  t[0]+=19*q;
+  FOR(i,4) {
+    t[i+1]+=t[i]>>51;
+    t[i]&=M51;
+  }
+  t[4]&=M51;
+  st64(o,t[0]|t[1]<<51);
+  st64(o+8,t[1]>>13|t[2]<<38);
+  st64(o+16,t[2]>>26|t[3]<<25);
+  st64(o+24,t[3]>>39|t[4]<<12);
+}
+
+static int neq25519(const gf a, const gf b)
+{
+  u8 c[32],d[32];
+  pack25519(c,a);
+  pack25519(d,b);
+  return crypto_verify_32(c,d);
+}
+
+static u8 par25519(const gf a)
+{
+  u8 d[32];
+  pack25519(d,a);
+  return d[0]&1;
+}
+
+sv unpack25519(gf o, const u8 *n)
+{
+  o[0]=ld64(n)&M51;
+  o[1]=(ld64(n+6)>>3)&M51;
+  o[2]=(ld64(n+12)>>6)&M51;
+  o[3]=(ld64(n+19)>>1)&M51;
+  o[4]=(ld64(n+24)>>12)&M51;
+}
+
+/* Limbs stay below 2^52 except for the output of A, which goes straight
+   into M or S or as the first operand of Z. */
+sv A(gf o,const gf a,const gf b)
+{
+  int i;
+  FOR(i,5) o[i]=a[i]+b[i];
+}
+
+sv Z(gf o,const gf a,const gf b)
+{
+  o[0]=a[0]+0x1fffffffffffb4ULL-b[0];
+  o[1]=a[1]+0x1ffffffffffffcULL-b[1];
+  o[2]=a[2]+0x1ffffffffffffcULL-b[2];
+  o[3]=a[3]+0x1ffffffffffffcULL-b[3];
+  o[4]=a[4]+0x1ffffffffffffcULL-b[4];
+  car25519(o);
+}
+
+sv M(gf o,const gf a,const gf b)
+{
+  u128 t[5];
+  u64 c,b1=19*b[1],b2=19*b[2],b3=19*b[3],b4=19*b[4];
+  t[0]=(u128)a[0]*b[0]+(u128)a[1]*b4+(u128)a[2]*b3+(u128)a[3]*b2+(u128)a[4]*b1;
+  t[1]=(u128)a[0]*b[1]+(u128)a[1]*b[0]+(u128)a[2]*b4+(u128)a[3]*b3+(u128)a[4]*b2;
+  t[2]=(u128)a[0]*b[2]+(u128)a[1]*b[1]+(u128)a[2]*b[0]+(u128)a[3]*b4+(u128)a[4]*b3;
+  t[3]=(u128)a[0]*b[3]+(u128)a[1]*b[2]+(u128)a[2]*b[1]+(u128)a[3]*b[0]+(u128)a[4]*b4;
+  t[4]=(u128)a[0]*b[4]+(u128)a[1]*b[3]+(u128)a[2]*b[2]+(u128)a[3]*b[1]+(u128)a[4]*b[0];
+  t[1]+=(u64)(t[0]>>51); o[0]=(u64)t[0]&M51;
+  t[2]+=(u64)(t[1]>>51); o[1]=(u64)t[1]&M51;
+  t[3]+=(u64)(t[2]>>51); o[2]=(u64)t[2]&M51;
+  t[4]+=(u64)(t[3]>>51); o[3]=(u64)t[3]&M51;
+  c=t[4]>>51; o[4]=(u64)t[4]&M51;
+  t[0]=(u128)c*19+o[0];
+  o[0]=(u64)t[0]&M51;
+  o[1]+=(u64)(t[0]>>51);
+}
+
+sv S(gf o,const gf a)
+{
+  u128 t[5];
+  u64 c,a0=2*a[0],a1=2*a[1],a3=19*a[3],a4=19*a[4];
+  t[0]=(u128)a[0]*a[0]+(u128)a1*a4+(u128)(2*a[2])*a3;
+  t[1]=(u128)a0*a[1]+(u128)(2*a[2])*a4+(u128)a[3]*a3;
+  t[2]=(u128)a0*a[2]+(u128)a[1]*a[1]+(u128)(2*a[3])*a4;
+  t[3]=(u128)a0*a[3]+(u128)a1*a[2]+(u128)a[4]*a4;
+  t[4]=(u128)a0*a[4]+(u128)a1*a[3]+(u128)a[2]*a[2];
+  t[1]+=(u64)(t[0]>>51); o[0]=(u64)t[0]&M51;
+  t[2]+=(u64)(t[1]>>51); o[1]=(u64)t[1]&M51;
+  t[3]+=(u64)(t[2]>>51); o[2]=(u64)t[2]&M51;
+  t[4]+=(u64)(t[3]>>51); o[3]=(u64)t[3]&M51;
+  c=t[4]>>51; o[4]=(u64)t[4]&M51;
+  t[0]=(u128)c*19+o[0];
+  o[0]=(u64)t[0]&M51;
+  o[1]+=(u64)(t[0]>>51);
+}
+
+sv Sn(gf o,const gf a,int n)
+{
+  S(o,a);
+  while (--n > 0) S(o,o);
+}
+
+/* i^(2^250-1) for the two exponentiations below */
+sv pow250(gf o,gf i11,const gf i)
+{
+  gf a,b,c;
+  S(a,i);
+  Sn(b,a,2);
+  M(b,b,i);
+  M(i11,b,a);
+  S(a,i11);
+  M(b,a,b);
+  Sn(a,b,5);
+  M(b,a,b);
+  Sn(a,b,10);
+  M(c,a,b);
+  Sn(a,c,20);
+  M(a,a,c);
+  Sn(a,a,10);
+  M(b,a,b);
+  Sn(a,b,50);
+  M(c,a,b);
+  Sn(a,c,100);
+  M(a,a,c);
+  Sn(a,a,50);
+  M(o,a,b);
+}
+
+sv inv25519(gf o,const gf i)
+{
+  gf a,i11;
+  pow250(a,i11,i);
+  Sn(a,a,5);
+  M(o,a,i11);
+}
+
+sv pow2523(gf o,const gf i)
+{
+  gf a,i11;
+  pow250(a,i11,i);
+  Sn(a,a,2);
+  M(o,a,i);
+}
+#else
 sv set25519(gf r, const gf a)
 {
   int i;
@@ -390,21 +887,21 @@ sv pow2523(gf o,const gf i)
   }
   FOR(a,16) o[a]=c[a];
 }
+#endif
 
 int crypto_scalarmult(u8 *q,const u8 *n,const u8 *p)
 {
   u8 z[32];
-  i64 x[80],r,i;
-  gf a,b,c,d,e,f;
+  i64 r,i;
+  gf x,a,b,c,d,e,f;
   FOR(i,31) z[i]=n[i];
   z[31]=(n[31]&127)|64;
   z[0]&=248;
   unpack25519(x,p);
-  FOR(i,16) {
-    b[i]=x[i];
-    d[i]=a[i]=c[i]=0;
-  }
-  a[0]=d[0]=1;
+  set25519(a,gf1);
+  set25519(b,x);
+  set25519(c,gf0);
+  set25519(d,gf1);
   for(i=254;i>=0;--i) {
     r=(z[i>>3]>>(i&7))&1;
     sel25519(a,b,r);
@@ -430,22 +927,18 @@ int crypto_scalarmult(u8 *q,const u8 *n,const u8 *p)
     sel25519(a,b,r);
     sel25519(c,d,r);
   }
-  FOR(i,16) {
-    x[i+16]=a[i];
-    x[i+32]=c[i];
-    x[i+48]=b[i];
-    x[i+64]=d[i];
-  }
-  inv25519(x+32,x+32);
-  M(x+16,x+16,x+32);
-  pack25519(q,x+16);
+  inv25519(c,c);
+  M(a,a,c);
+  pack25519(q,a);
   return 0;
 }
 
+#ifndef FAST128
 int crypto_scalarmult_base(u8 *q,const u8 *n)
 { 
   return crypto_scalarmult(q,n,_9);
 }
+#endif
 
 int crypto_box_keypair(u8 *y,u8 *x)
 {
@@ -559,32 +1052,62 @@ static const u8 iv[64] = {
   0x5b,0xe0,0xcd,0x19,0x13,0x7e,0x21,0x79
 } ;
 
-int crypto_hash(u8 *out,const u8 *m,u64 n)
+int crypto_hash_init(crypto_hash_state *s)
 {
-  u8 h[64],x[256];
-  u64 i,b = n;
-
-  FOR(i,64) h[i] = iv[i];
+  int i;
+  FOR(i,64) s->h[i] = iv[i];
+  s->n = 0;
+  return 0;
+}
 
-  crypto_hashblocks(h,m,n);
+int crypto_hash_update(crypto_hash_state *s,const u8 *m,u64 n)
+{
+  u64 i,r = s->n & 127;
+
+  s->n += n;
+  if (r) {
+    for (i = 0;i < n && r < 128;++i) s->x[r++] = m[i];
+    if (r < 128) return 0;
+    crypto_hashblocks(s->h,s->x,128);
+    m += i;
+    n -= i;
+  }
+  crypto_hashblocks(s->h,m,n);
   m += n;
   n &= 127;
   m -= n;
+  FOR(i,n) s->x[i] = m[i];
+  return 0;
+}
+
+int crypto_hash_final(crypto_hash_state *s,u8 *out)
+{
+  u8 x[256];
+  u64 i,n = s->n & 127;
 
   FOR(i,256) x[i] = 0;
-  FOR(i,n) x[i] = m[i];
+  FOR(i,n) x[i] = s->x[i];
   x[n] = 128;
 
   n = 256-128*(n<112);
-  x[n-9] = b >> 61;
-  ts64(x+n-8,b<<3);
-  crypto_hashblocks(h,x,n);
+  x[n-9] = s->n >> 61;
+  ts64(x+n-8,s->n<<3);
+  crypto_hashblocks(s->h,x,n);
 
-  FOR(i,64) out[i] = h[i];
+  FOR(i,64) out[i] = s->h[i];
 
   return 0;
 }
 
+int crypto_hash(u8 *out,const u8 *m,u64 n)
+{
+  crypto_hash_state s;
+  crypto_hash_init(&s);
+  crypto_hash_update(&s,m,n);
+  return crypto_hash_final(&s,out);
+}
+
+#ifndef FAST128
 sv add(gf p[4],gf q[4])
 {
   gf a,b,c,d,t,e,f,g,h;
@@ -616,6 +1139,7 @@ sv cswap(gf p[4],gf q[4],u8 b)
   FOR(i,4)
     sel25519(p[i],q[i],b);
 }
+#endif
 
 sv pack(u8 *r,gf p[4])
 {
@@ -627,6 +1151,7 @@ sv pack(u8 *r,gf p[4])
   r[31] ^= par25519(tx) << 7;
 }
 
+#ifndef FAST128
 sv scalarmult(gf p[4],gf q[4],const u8 *s)
 {
   int i;
@@ -652,6 +1177,180 @@ sv scalarbase(gf p[4],const u8 *s)
   M(q[3],X,Y);
   scalarmult(p,q,s);
 }
+#else
+/* Points are added in the cached form (Y-X,Y+X,2Z,2dT); scalars below
+   2^255 are cut into 64 signed radix-16 digits. */
+sv dbl(ge p)
+{
+  gf a,b,c,e,f,g,h;
+  S(a,p[0]);
+  S(b,p[1]);
+  S(c,p[2]);
+  A(c,c,c);
+  A(h,a,b);
+  A(e,p[0],p[1]);
+  S(e,e);
+  Z(e,h,e);
+  Z(g,a,b);
+  A(f,c,g);
+  M(p[0],e,f);
+  M(p[1],g,h);
+  M(p[2],f,g);
+  M(p[3],e,h);
+}
+
+sv cache(ge q,ge p)
+{
+  Z(q[0],p[1],p[0]);
+  A(q[1],p[1],p[0]);
+  A(q[2],p[2],p[2]);
+  M(q[3],p[3],D2);
+}
+
+sv addc(ge p,ge q)
+{
+  gf a,b,c,d,e,f,g,h;
+  Z(a,p[1],p[0]);
+  M(a,a,q[0]);
+  A(b,p[0],p[1]);
+  M(b,b,q[1]);
+  M(c,p[3],q[3]);
+  M(d,p[2],q[2]);
+  Z(e,b,a);
+  Z(f,d,c);
+  A(g,d,c);
+  A(h,b,a);
+  M(p[0],e,f);
+  M(p[1],h,g);
+  M(p[2],g,f);
+  M(p[3],e,h);
+}
+
+sv zero(ge p)
+{
+  set25519(p[0],gf0);
+  set25519(p[1],gf1);
+  set25519(p[2],gf1);
+  set25519(p[3],gf0);
+}
+
+/* t[j] = (j+1)*p */
+sv table(ge *t,ge p)
+{
+  ge q;
+  int i;
+  cache(t[0],p);
+  FOR(i,4) set25519(q[i],p[i]);
+  for (i = 1;i < 8;++i) {
+    addc(q,t[0]);
+    cache(t[i],q);
+  }
+}
+
+/* basetab[i][j] = (j+1)*16^i*B */
+static ge basetab[64][8];
+
+__attribute__((constructor)) sv basetab_init(void)
+{
+  ge p;
+  int i,j;
+  set25519(p[0],X);
+  set25519(p[1],Y);
+  set25519(p[2],gf1);
+  M(p[3],X,Y);
+  FOR(i,64) {
+    table(basetab[i],p);
+    FOR(j,4) dbl(p);
+  }
+}
+
+sv recode(signed char *e,const u8 *s)
+{
+  int i,c = 0;
+  FOR(i,32) {
+    e[2*i] = s[i] & 15;
+    e[2*i+1] = s[i] >> 4;
+  }
+  FOR(i,63) {
+    e[i] += c;
+    c = (e[i] + 8) >> 4;
+    e[i] -= c << 4;
+  }
+  e[63] += c;
+}
+
+sv cmov(ge p,ge q,int b)
+{
+  u64 c = -(u64)b;
+  int i,j;
+  FOR(i,4) FOR(j,5) p[i][j] ^= c & (p[i][j] ^ q[i][j]);
+}
+
+/* constant time in s, which must be below 2^255 */
+sv scalarbase(ge p,const u8 *s)
+{
+  signed char e[64];
+  ge t;
+  gf n;
+  int i,j,b,neg;
+  recode(e,s);
+  zero(p);
+  FOR(i,64) {
+    neg = (u8) e[i] >> 7;
+    b = (e[i] ^ -neg) + neg;
+    set25519(t[0],gf1);
+    set25519(t[1],gf1);
+    A(t[2],gf1,gf1);
+    set25519(t[3],gf0);
+    FOR(j,8) cmov(t,basetab[i][j],(unsigned) ((b ^ (j + 1)) - 1) >> 31);
+    sel25519(t[0],t[1],neg);
+    Z(n,gf0,t[3]);
+    sel25519(t[3],n,neg);
+    addc(p,t);
+  }
+}
+
+/* p = sum of e[k]*P[k] over n points given by their tables; variable time,
+   for public data only */
+sv msm(ge p,ge *const *t,signed char (*e)[64],int n)
+{
+  ge q;
+  int i,k,d;
+  zero(p);
+  for (i = 63;i >= 0;--i) {
+    if (i < 63) FOR(k,4) dbl(p);
+    FOR(k,n) {
+      d = e[k][i];
+      if (d > 0) addc(p,t[k][d-1]);
+      if (d < 0) {
+        set25519(q[0],t[k][-d-1][1]);
+        set25519(q[1],t[k][-d-1][0]);
+        set25519(q[2],t[k][-d-1][2]);
+        Z(q[3],gf0,t[k][-d-1][3]);
+        addc(p,q);
+      }
+    }
+  }
+}
+
+int crypto_scalarmult_base(u8 *q,const u8 *n)
+{
+  u8 z[32];
+  gf a,b;
+  ge p;
+  int i;
+  FOR(i,31) z[i]=n[i];
+  z[31]=(n[31]&127)|64;
+  z[0]&=248;
+  scalarbase(p,z);
+  A(a,p[2],p[1]);
+  Z(b,p[2],p[1]);
+  inv25519(b,b);
+  M(a,a,b);
+  pack25519(q,a);
+  return 0;
+}
+#endif
 
 int crypto_sign_keypair(u8 *pk, u8 *sk)
 {
@@ -776,29 +1475,130 @@ static int unpackneg(gf r[4],const u8 p[32])
   return 0;
 }
 
+/* -R from the first 32 bytes of a signature, which must be the canonical
+   encoding of a point, as comparing them with the packed S*B - h*A used
+   to require */
+static int unpacksig(gf r[4],const u8 *sm)
+{
+  u8 x[32];
+  int i,d = 0;
+  if (unpackneg(r,sm)) return -1;
+  pack25519(x,r[1]);
+  x[31] |= sm[31] & 128;
+  if (crypto_verify_32(x,sm)) return -1;
+  pack25519(x,r[0]);
+  FOR(i,32) d |= x[i];
+  return !d && sm[31] >> 7 ? -1 : 0;
+}
+
+/* the encoding of the neutral point (0,1) */
+static const u8 neutral[32] = {1};
+
+#define BATCH 16
+
+#ifdef FAST128
+/* p = h*q + s*B */
+sv dsm(ge p,ge q,const u8 *h,const u8 *s)
+{
+  u8 r[64];
+  ge t[8],*tab[2];
+  signed char e[2][64];
+  int i;
+  FOR(i,64) r[i] = i < 32 ? s[i] : 0;
+  reduce(r);
+  recode(e[0],h);
+  recode(e[1],r);
+  table(t,q);
+  tab[0] = t;
+  tab[1] = basetab[0];
+  msm(p,tab,e,2);
+}
+
+/* Checks that 8 times the sum of z*(S*B - h*A - R) over the b signatures is
+   zero for random 128-bit z, leaving each m as crypto_sign_open would.
+   Without the 8 a small-order component of some A or R would be missed
+   whenever z happened to be a multiple of its order, so the batch would
+   accept signatures one at a time rejected; both now use the cofactored
+   equation. */
+static int batch(u8 *const *m,const u8 *const *sm,const u64 *n,const u8 *const *pk,int b)
+{
+  ge p,a[BATCH],r[BATCH],t[2*BATCH][8],*tab[2*BATCH+1];
+  signed char e[2*BATCH+1][64];
+  u8 z[16*BATCH],h[64],x[32];
+  i64 s[64],w[64];
+  u64 i,j;
+  int k;
+
+  randombytes(z,16*b);
+  FOR(i,64) s[i] = 0;
+  FOR(k,b) {
+    if (n[k] < 64 || unpackneg(a[k],pk[k]) || unpacksig(r[k],sm[k])) return -1;
+    FOR(i,n[k]) m[k][i] = sm[k][i];
+    FOR(i,32) m[k][i+32] = pk[k][i];
+    crypto_hash(h,m[k],n[k]);
+    reduce(h);
+    FOR(i,64) w[i] = 0;
+    FOR(i,16) FOR(j,32) w[i+j] += z[16*k+i] * (i64) h[j];
+    modL(x,w);
+    recode(e[2*k],x);
+    FOR(i,32) x[i] = i < 16 ? z[16*k+i] : 0;
+    recode(e[2*k+1],x);
+    FOR(i,16) FOR(j,32) s[i+j] += z[16*k+i] * (i64) sm[k][j+32];
+    table(t[2*k],a[k]);
+    table(t[2*k+1],r[k]);
+    tab[2*k] = t[2*k];
+    tab[2*k+1] = t[2*k+1];
+  }
+  FOR(i,63) {
+    s[i+1] += s[i] >> 8;
+    s[i] &= 255;
+  }
+  modL(x,s);
+  recode(e[2*b],x);
+  tab[2*b] = basetab[0];
+  msm(p,tab,e,2*b+1);
+  FOR(k,3) dbl(p);
+
+  pack(x,p);
+  return crypto_verify_32(x,neutral);
+}
+#endif
+
+/* Accepts when 8*(S*B - h*A - R) is the neutral point, as RFC 8032 allows,
+   rather than only when S*B - h*A encodes to R, so that a signature is
+   accepted here exactly when crypto_sign_open_batch accepts it. */
 int crypto_sign_open(u8 *m,u64 *mlen,const u8 *sm,u64 n,const u8 *pk)
 {
   int i;
   u8 t[32],h[64];
-  gf p[4],q[4];
+  gf p[4],q[4],r[4];
 
   *mlen = -1;
   if (n < 64) return -1;
 
-  if (unpackneg(q,pk)) return -1;
+  if (unpackneg(q,pk) || unpacksig(r,sm)) return -1;
 
   FOR(i,n) m[i] = sm[i];
   FOR(i,32) m[i+32] = pk[i];
   crypto_hash(h,m,n);
   reduce(h);
+#ifdef FAST128
+  dsm(p,q,h,sm + 32);
+  cache(q,r);
+  addc(p,q);
+  FOR(i,3) dbl(p);
+#else
   scalarmult(p,q,h);
 
   scalarbase(q,sm + 32);
   add(p,q);
+  add(p,r);
+  FOR(i,3) add(p,p);
+#endif
   pack(t,p);
 
   n -= 64;
-  if (crypto_verify_32(sm, t)) {
+  if (crypto_verify_32(t, neutral)) {
     FOR(i,n) m[i] = 0;
     return -1;
   }
@@ -807,3 +1607,28 @@ int crypto_sign_open(u8 *m,u64 *mlen,const u8 *sm,u64 n,const u8 *pk)
   *mlen = n;
   return 0;
 }
+
+int crypto_sign_open_batch(u8 *const *m,u64 *mlen,const u8 *const *sm,const u64 *n,const u8 *const *pk,int *valid,u64 num)
+{
+  u64 i,k,b;
+  int r = 0;
+  for (i = 0;i < num;i += b) {
+    b = num - i < BATCH ? num - i : BATCH;
+#ifdef FAST128
+    if (b > 1 && batch(m + i,sm + i,n + i,pk + i,b) == 0) {
+      u64 j;
+      FOR(k,b) {
+        FOR(j,n[i+k] - 64) m[i+k][j] = sm[i+k][j + 64];
+        mlen[i+k] = n[i+k] - 64;
+        valid[i+k] = 1;
+      }
+      continue;
+    }
+#endif
+    FOR(k,b) {
+      valid[i+k] = crypto_sign_open(m[i+k],mlen + i + k,sm[i+k],n[i+k],pk[i+k]) == 0;
+      if (!valid[i+k]) r = -1;
+    }
+  }
+  return r;
+}
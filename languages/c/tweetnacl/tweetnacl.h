@@ -120,13 +120,25 @@ extern int crypto_hashblocks_sha256_tweet(unsigned char *,const unsigned char *,
 #define crypto_hashblocks_sha256_IMPLEMENTATION "crypto_hashblocks/sha256/tweet"
 #define crypto_hash_PRIMITIVE "sha512"
 #define crypto_hash crypto_hash_sha512
+#define crypto_hash_state crypto_hash_sha512_state
+#define crypto_hash_init crypto_hash_sha512_init
+#define crypto_hash_update crypto_hash_sha512_update
+#define crypto_hash_final crypto_hash_sha512_final
 #define crypto_hash_BYTES crypto_hash_sha512_BYTES
 #define crypto_hash_IMPLEMENTATION crypto_hash_sha512_IMPLEMENTATION
 #define crypto_hash_VERSION crypto_hash_sha512_VERSION
 #define crypto_hash_sha512_tweet_BYTES 64
 extern int crypto_hash_sha512_tweet(unsigned char *,const unsigned char *,unsigned long long);
+typedef struct { unsigned char h[64],x[128]; unsigned long long n; } crypto_hash_sha512_tweet_state;
+extern int crypto_hash_sha512_tweet_init(crypto_hash_sha512_tweet_state *);
+extern int crypto_hash_sha512_tweet_update(crypto_hash_sha512_tweet_state *,const unsigned char *,unsigned long long);
+extern int crypto_hash_sha512_tweet_final(crypto_hash_sha512_tweet_state *,unsigned char *);
 #define crypto_hash_sha512_tweet_VERSION "-"
 #define crypto_hash_sha512 crypto_hash_sha512_tweet
+#define crypto_hash_sha512_state crypto_hash_sha512_tweet_state
+#define crypto_hash_sha512_init crypto_hash_sha512_tweet_init
+#define crypto_hash_sha512_update crypto_hash_sha512_tweet_update
+#define crypto_hash_sha512_final crypto_hash_sha512_tweet_final
 #define crypto_hash_sha512_BYTES crypto_hash_sha512_tweet_BYTES
 #define crypto_hash_sha512_VERSION crypto_hash_sha512_tweet_VERSION
 #define crypto_hash_sha512_IMPLEMENTATION "crypto_hash/sha512/tweet"
@@ -178,6 +190,13 @@ extern int crypto_scalarmult_curve25519_tweet_base(unsigned char *,const unsigne
 #define crypto_secretbox_open crypto_secretbox_xsalsa20poly1305_open
 #define crypto_secretbox_KEYBYTES crypto_secretbox_xsalsa20poly1305_KEYBYTES
 #define crypto_secretbox_NONCEBYTES crypto_secretbox_xsalsa20poly1305_NONCEBYTES
+#define crypto_secretbox_stream_state crypto_secretbox_xsalsa20poly1305_stream_state
+#define crypto_secretbox_stream_init_push crypto_secretbox_xsalsa20poly1305_stream_init_push
+#define crypto_secretbox_stream_init_pull crypto_secretbox_xsalsa20poly1305_stream_init_pull
+#define crypto_secretbox_stream_push crypto_secretbox_xsalsa20poly1305_stream_push
+#define crypto_secretbox_stream_pull crypto_secretbox_xsalsa20poly1305_stream_pull
+#define crypto_secretbox_stream_HEADERBYTES crypto_secretbox_xsalsa20poly1305_stream_HEADERBYTES
+#define crypto_secretbox_stream_ABYTES crypto_secretbox_xsalsa20poly1305_stream_ABYTES
 #define crypto_secretbox_ZEROBYTES crypto_secretbox_xsalsa20poly1305_ZEROBYTES
 #define crypto_secretbox_BOXZEROBYTES crypto_secretbox_xsalsa20poly1305_BOXZEROBYTES
 #define crypto_secretbox_IMPLEMENTATION crypto_secretbox_xsalsa20poly1305_IMPLEMENTATION
@@ -186,11 +205,25 @@ extern int crypto_scalarmult_curve25519_tweet_base(unsigned char *,const unsigne
 #define crypto_secretbox_xsalsa20poly1305_tweet_NONCEBYTES 24
 #define crypto_secretbox_xsalsa20poly1305_tweet_ZEROBYTES 32
 #define crypto_secretbox_xsalsa20poly1305_tweet_BOXZEROBYTES 16
+#define crypto_secretbox_xsalsa20poly1305_tweet_stream_HEADERBYTES 16
+#define crypto_secretbox_xsalsa20poly1305_tweet_stream_ABYTES 16
 extern int crypto_secretbox_xsalsa20poly1305_tweet(unsigned char *,const unsigned char *,unsigned long long,const unsigned char *,const unsigned char *);
 extern int crypto_secretbox_xsalsa20poly1305_tweet_open(unsigned char *,const unsigned char *,unsigned long long,const unsigned char *,const unsigned char *);
+typedef struct { unsigned char k[32],n[24]; unsigned long long i; } crypto_secretbox_xsalsa20poly1305_tweet_stream_state;
+extern int crypto_secretbox_xsalsa20poly1305_tweet_stream_init_push(crypto_secretbox_xsalsa20poly1305_tweet_stream_state *,unsigned char *,const unsigned char *);
+extern int crypto_secretbox_xsalsa20poly1305_tweet_stream_init_pull(crypto_secretbox_xsalsa20poly1305_tweet_stream_state *,const unsigned char *,const unsigned char *);
+extern int crypto_secretbox_xsalsa20poly1305_tweet_stream_push(crypto_secretbox_xsalsa20poly1305_tweet_stream_state *,unsigned char *,const unsigned char *,unsigned long long,int);
+extern int crypto_secretbox_xsalsa20poly1305_tweet_stream_pull(crypto_secretbox_xsalsa20poly1305_tweet_stream_state *,unsigned char *,const unsigned char *,unsigned long long,int *);
 #define crypto_secretbox_xsalsa20poly1305_tweet_VERSION "-"
 #define crypto_secretbox_xsalsa20poly1305 crypto_secretbox_xsalsa20poly1305_tweet
 #define crypto_secretbox_xsalsa20poly1305_open crypto_secretbox_xsalsa20poly1305_tweet_open
+#define crypto_secretbox_xsalsa20poly1305_stream_state crypto_secretbox_xsalsa20poly1305_tweet_stream_state
+#define crypto_secretbox_xsalsa20poly1305_stream_init_push crypto_secretbox_xsalsa20poly1305_tweet_stream_init_push
+#define crypto_secretbox_xsalsa20poly1305_stream_init_pull crypto_secretbox_xsalsa20poly1305_tweet_stream_init_pull
+#define crypto_secretbox_xsalsa20poly1305_stream_push crypto_secretbox_xsalsa20poly1305_tweet_stream_push
+#define crypto_secretbox_xsalsa20poly1305_stream_pull crypto_secretbox_xsalsa20poly1305_tweet_stream_pull
+#define crypto_secretbox_xsalsa20poly1305_stream_HEADERBYTES crypto_secretbox_xsalsa20poly1305_tweet_stream_HEADERBYTES
+#define crypto_secretbox_xsalsa20poly1305_stream_ABYTES crypto_secretbox_xsalsa20poly1305_tweet_stream_ABYTES
 #define crypto_secretbox_xsalsa20poly1305_KEYBYTES crypto_secretbox_xsalsa20poly1305_tweet_KEYBYTES
 #define crypto_secretbox_xsalsa20poly1305_NONCEBYTES crypto_secretbox_xsalsa20poly1305_tweet_NONCEBYTES
 #define crypto_secretbox_xsalsa20poly1305_ZEROBYTES crypto_secretbox_xsalsa20poly1305_tweet_ZEROBYTES
@@ -200,6 +233,7 @@ extern int crypto_secretbox_xsalsa20poly1305_tweet_open(unsigned char *,const un
 #define crypto_sign_PRIMITIVE "ed25519"
 #define crypto_sign crypto_sign_ed25519
 #define crypto_sign_open crypto_sign_ed25519_open
+#define crypto_sign_open_batch crypto_sign_ed25519_open_batch
 #define crypto_sign_keypair crypto_sign_ed25519_keypair
 #define crypto_sign_BYTES crypto_sign_ed25519_BYTES
 #define crypto_sign_PUBLICKEYBYTES crypto_sign_ed25519_PUBLICKEYBYTES
@@ -212,9 +246,11 @@ extern int crypto_secretbox_xsalsa20poly1305_tweet_open(unsigned char *,const un
 extern int crypto_sign_ed25519_tweet(unsigned char *,unsigned long long *,const unsigned char *,unsigned long long,const unsigned char *);
 extern int crypto_sign_ed25519_tweet_open(unsigned char *,unsigned long long *,const unsigned char *,unsigned long long,const unsigned char *);
 extern int crypto_sign_ed25519_tweet_keypair(unsigned char *,unsigned char *);
+extern int crypto_sign_ed25519_tweet_open_batch(unsigned char *const *,unsigned long long *,const unsigned char *const *,const unsigned long long *,const unsigned char *const *,int *,unsigned long long);
 #define crypto_sign_ed25519_tweet_VERSION "-"
 #define crypto_sign_ed25519 crypto_sign_ed25519_tweet
 #define crypto_sign_ed25519_open crypto_sign_ed25519_tweet_open
+#define crypto_sign_ed25519_open_batch crypto_sign_ed25519_tweet_open_batch
 #define crypto_sign_ed25519_keypair crypto_sign_ed25519_tweet_keypair
 #define crypto_sign_ed25519_BYTES crypto_sign_ed25519_tweet_BYTES
 #define crypto_sign_ed25519_PUBLICKEYBYTES crypto_sign_ed25519_tweet_PUBLICKEYBYTES
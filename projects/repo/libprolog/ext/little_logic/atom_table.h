@@ -0,0 +1,52 @@
+//
+//  atom_table.h
+//  little_logic
+//
+//  Atoms are interned as they are parsed, so that the rest of the system
+//  can compare them as integers. Atom numbers start from 1; 0 stands for
+//  a variable.
+//
+
+#ifndef atom_table_h
+#define atom_table_h
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+class atom_table
+{
+   std::vector<std::string> names;
+   std::unordered_map<std::string, int> identifiers;
+public:
+   atom_table():names {""}
+   {
+   }
+
+   int intern(const std::string& name)
+   {
+      auto it = identifiers.find(name);
+      if(it != identifiers.end())
+      {
+         return it->second;
+      }
+      int atom = names.size();
+      names.push_back(name);
+      identifiers[name] = atom;
+      return atom;
+   }
+
+   const std::string& name(int atom) const
+   {
+      return names[atom];
+   }
+};
+
+//the table shared by every parser and runtime
+inline atom_table& atoms()
+{
+   static atom_table table;
+   return table;
+}
+
+#endif /* atom_table_h */
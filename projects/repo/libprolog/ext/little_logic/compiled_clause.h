@@ -9,6 +9,8 @@
 #ifndef compiled_clause_h
 #define compiled_clause_h
 
+#include <unordered_map>
+
 class compiled_predicate
 {
 public:
@@ -41,6 +43,76 @@ public:
    conjunction requirements;
 };
 
-typedef std::vector<compiled_clause_body> compiled_clause_collection;
+//the clauses of one predicate, indexed on the atom in their first
+//parameter; each clause is numbered by its position in the collection
+class compiled_clause_collection
+{
+   std::vector<compiled_clause_body> clauses;
+   std::vector<int> all_clauses;
+   std::vector<int> variable_clauses; //first parameter is a variable
+   std::unordered_map<int, std::vector<int>> atom_clauses; //with the variable ones, in order
+public:
+   typedef std::vector<compiled_clause_body>::const_iterator const_iterator;
+
+   const_iterator begin() const
+   {
+      return clauses.begin();
+   }
+
+   const_iterator end() const
+   {
+      return clauses.end();
+   }
+
+   int size() const
+   {
+      return clauses.size();
+   }
+
+   const compiled_clause_body& operator[](int n) const
+   {
+      return clauses[n];
+   }
+
+   //add a clause whose first parameter is atom, or 0 for a variable
+   void push_back(const compiled_clause_body& body, int atom)
+   {
+      int n = clauses.size();
+      clauses.push_back(body);
+      all_clauses.push_back(n);
+      if(atom == 0)
+      {
+         variable_clauses.push_back(n);
+         for(auto& entry : atom_clauses)
+         {
+            entry.second.push_back(n);
+         }
+      }
+      else
+      {
+         auto it = atom_clauses.find(atom);
+         if(it == atom_clauses.end())
+         {
+            it = atom_clauses.insert({atom, variable_clauses}).first;
+         }
+         it->second.push_back(n);
+      }
+   }
+
+   //the clauses that can match a first argument of atom, or 0 if unbound
+   const std::vector<int>& candidates(int atom) const
+   {
+      if(atom == 0)
+      {
+         return all_clauses;
+      }
+      auto it = atom_clauses.find(atom);
+      if(it == atom_clauses.end())
+      {
+         return variable_clauses;
+      }
+      return it->second;
+   }
+};
 
 #endif /* compiled_clause_h */
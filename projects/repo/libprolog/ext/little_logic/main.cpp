@@ -20,8 +20,15 @@
 #include "parser.h"
 #include "compiled_clause.h"
 #include "runtime.h"
+#include "trail_runtime.h"
 
-void enumerate_predicate(const std::string& src_string, runtime& rt)
+#ifdef CLASSIC_RUNTIME
+typedef runtime logic_runtime;
+#else
+typedef trail_runtime logic_runtime;
+#endif
+
+void enumerate_predicate(const std::string& src_string, logic_runtime& rt)
 {
    parser p;
 	text_predicate src = p.parse_predicate(src_string);
@@ -30,7 +37,7 @@ void enumerate_predicate(const std::string& src_string, runtime& rt)
    int position = 0;
    auto pred = rt.compile_predicate(src, first_occurrence, position);
    
-   std::vector<variable_handle> arguments = rt.instantiate_predicate_arguments(pred);
+   auto arguments = rt.instantiate_predicate_arguments(pred);
    rt.prove(pred, arguments,[&](){
       std::cout << "success:" << std::endl;
       for(auto prm: first_occurrence)
@@ -45,7 +52,7 @@ void enumerate_predicate(const std::string& src_string, runtime& rt)
    rt.unstack_arguments(arguments);
 }
 
-void run_predicate(const std::string& src_string, runtime& rt)
+void run_predicate(const std::string& src_string, logic_runtime& rt)
 {
    parser p;
 	text_predicate src = p.parse_predicate(src_string);
@@ -54,7 +61,7 @@ void run_predicate(const std::string& src_string, runtime& rt)
    int position = 0;
    auto pred = rt.compile_predicate(src, first_occurrence, position);
    
-   std::vector<variable_handle> arguments = rt.instantiate_predicate_arguments(pred);
+   auto arguments = rt.instantiate_predicate_arguments(pred);
    rt.prove(pred, arguments,[&](){
       std::cout << "success:" << std::endl;
       for(auto prm: first_occurrence)
@@ -69,7 +76,7 @@ void run_predicate(const std::string& src_string, runtime& rt)
    rt.unstack_arguments(arguments);
 }
 
-void execute_program(const text_program& program, runtime& rt)
+void execute_program(const text_program& program, logic_runtime& rt)
 {
    for(auto def:program)
    {
@@ -109,7 +116,7 @@ int main(int argc, char* argv[])
 	"ancestor(X, Y) :- parent(X, Z), ancestor(Z, Y).\n"
 	;
 
-   runtime rt;
+   logic_runtime rt;
 	std::stringstream ssprogram(program);
    parser p;
 	execute_program(p.parse_program(ssprogram), rt);
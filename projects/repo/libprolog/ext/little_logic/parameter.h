@@ -18,6 +18,11 @@ public:
       parm = p;
    }
    
+   int get_code() const
+   {
+      return parm;
+   }
+   
    variable_handle instantiate_argument(int base, std::vector<std::shared_ptr<variable>>& stack)
    {
       if(parm == 0) //unbound variable
@@ -79,7 +79,9 @@ public:
             char c = is.peek();
             if(isalnum(c) || (c == '_'))
             {
-               result.parameters.push_back(parse_atom(is));
+               std::string parm = parse_atom(is);
+               result.parameters.push_back(parm);
+               result.atoms.push_back((c >= 'A' && c <= 'Z') ? 0 : atoms().intern(parm));
             }
             else
             {
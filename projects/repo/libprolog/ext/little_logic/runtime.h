@@ -18,6 +18,7 @@ class runtime
 {
    std::vector<compiled_clause_collection> clause_db;
    std::vector<std::shared_ptr<variable>> stack;
+   std::vector<int> atom_slots; //stack position of each atom's constant, or 0
    
    std::vector<std::string> predicate_names;
    std::map<std::string, int> predicate_identifiers;
@@ -154,8 +155,19 @@ public:
    bool unify_clause(int predicate, const std::vector<variable_handle>& arguments, const std::function<bool()>& thenwhat)
    {
       int base = stack.size();
-      for(const auto& clause: clause_db[predicate])
+      int atom = 0;
+      if(!arguments.empty())
       {
+         variable* first = variable_handle(arguments[0]).get_value(stack);
+         if(first != nullptr && first->type == value_value)
+         {
+            atom = ((string_variant*)((value_variable*)first)->value.get())->atom;
+         }
+      }
+      const compiled_clause_collection& clauses = clause_db[predicate];
+      for(int n: clauses.candidates(atom))
+      {
+         const compiled_clause_body& clause = clauses[n];
          if(unify_parameters(base, 0, clause.goal_parameters, arguments, [&](){
                return unify_conjunction(base, 0, clause.requirements, thenwhat);
             }))
@@ -184,11 +196,12 @@ public:
          predicate_id = it->second;
       }
       
-      for(auto parm : pred.parameters)
+      for(int n = 0; n < pred.parameters.size(); n++)
       {
+         const std::string& parm = pred.parameters[n];
+         int atom = pred.get_atom(n);
          position ++;
-         char c = parm[0];
-         if(c >= 'A' && c <= 'Z') //variable
+         if(atom == 0) //variable
          {
             auto first = first_occurrence.find(parm);
             int parm_id = 0;
@@ -204,8 +217,16 @@ public:
          }
          else
          {
-            result.push_back(stack.size());
-            stack.push_back(std::make_shared<value_variable>(std::make_shared<string_variant>(parm)));
+            if(atom >= atom_slots.size())
+            {
+               atom_slots.resize(atom + 1);
+            }
+            if(atom_slots[atom] == 0) //constants are never rebound, so share them
+            {
+               atom_slots[atom] = stack.size();
+               stack.push_back(std::make_shared<value_variable>(std::make_shared<string_variant>(parm, atom)));
+            }
+            result.push_back(atom_slots[atom]);
          }
       }
       return compiled_predicate(predicate_id, result);
@@ -320,7 +341,13 @@ public:
       compiled_clause_body body;
       body.goal_parameters = compiled.goal.parameters;
       body.requirements = compiled.requirements;
-      clause_db[compiled.goal.predicate_index].push_back(body);
+      int first_atom = 0;
+      if(!body.goal_parameters.empty() && body.goal_parameters[0].get_code() > 0)
+      {
+         variable* first = stack[body.goal_parameters[0].get_code()].get();
+         first_atom = ((string_variant*)((value_variable*)first)->value.get())->atom;
+      }
+      clause_db[compiled.goal.predicate_index].push_back(body, first_atom);
    }
 };
 
@@ -9,11 +9,25 @@
 #ifndef text_clause_h
 #define text_clause_h
 
+#include "atom_table.h"
+
 class text_predicate
 {
 public:
    std::string predicate_name;
    std::vector<std::string> parameters;
+   std::vector<int> atoms; //interned atom for each parameter, 0 for a variable
+
+   //the atom for parameter n, interning it here if the parser didn't
+   int get_atom(int n) const
+   {
+      if(n < atoms.size())
+      {
+         return atoms[n];
+      }
+      char c = parameters[n][0];
+      return (c >= 'A' && c <= 'Z') ? 0 : ::atoms().intern(parameters[n]);
+   }
 };
 
 class text_clause
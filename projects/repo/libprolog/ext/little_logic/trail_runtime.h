@@ -0,0 +1,657 @@
+//
+//  trail_runtime.h
+//  little_logic
+//
+//  An alternative to runtime that keeps the same query interface, but
+//  solves goals with an explicit trail and choice point stack instead of
+//  nested continuations, so neither unification nor backtracking allocates
+//  and deep recursion doesn't use the C++ stack.
+//
+//  Terms live in a single arena of tagged words. A word with the low bit
+//  set is an atom, numbered by the atom table; otherwise it refers to
+//  another cell of the arena, and a cell that refers to itself is an
+//  unbound variable.
+//
+
+#ifndef trail_runtime_h
+#define trail_runtime_h
+
+#include "compiled_clause.h"
+#include <functional>
+
+typedef unsigned int term_word;
+
+inline bool is_atom(term_word w)
+{
+   return (w & 1) != 0;
+}
+
+inline term_word make_atom(int atom)
+{
+   return ((term_word)atom << 1) | 1;
+}
+
+inline term_word make_ref(int cell)
+{
+   return (term_word)cell << 1;
+}
+
+inline int word_value(term_word w)
+{
+   return (int)(w >> 1);
+}
+
+class term_arena
+{
+public:
+   std::vector<term_word> cells;
+
+   term_word deref(term_word w) const
+   {
+      while(!is_atom(w))
+      {
+         term_word v = cells[word_value(w)];
+         if(v == w)
+            break;
+         w = v;
+      }
+      return w;
+   }
+};
+
+class cell_handle
+{
+   int cell;
+public:
+   cell_handle(int c)
+   {
+      cell = c;
+   }
+
+   int get_cell() const
+   {
+      return cell;
+   }
+
+   void print(const term_arena& arena) const
+   {
+      term_word w = arena.deref(make_ref(cell));
+      if(is_atom(w))
+      {
+         std::cout << "\"" << atoms().name(word_value(w)) << "\"";
+      }
+      else
+      {
+         std::cout << "V" << word_value(w);
+      }
+   }
+};
+
+class trail_runtime
+{
+   //a literal's arguments are atoms, or variables numbered from 0 within
+   //the clause; in a clause head, the first occurrence of each variable
+   //is marked so that matching can simply store the argument
+   enum argument_kind
+   {
+      atom_argument,
+      first_variable,
+      variable_argument
+   };
+
+   struct code_argument
+   {
+      argument_kind kind;
+      int value; //atom number or variable number
+   };
+
+   struct code_literal
+   {
+      int predicate_index;
+      std::vector<code_argument> arguments;
+   };
+
+   struct clause_code
+   {
+      int variable_count;
+      std::vector<code_argument> head;
+      std::vector<code_literal> body;
+   };
+
+   //a frame is an activation of a clause: its variables start at env in
+   //the arena, and when its body is done execution continues with goal
+   //cont_goal of frame cont_frame
+   struct frame
+   {
+      const clause_code* clause;
+      int env;
+      int cont_frame;
+      int cont_goal;
+   };
+
+   //a choice point records the state before trying candidate next_clause
+   //of predicate for goal number goal of frame
+   struct choice_point
+   {
+      int predicate_index;
+      const std::vector<int>* candidates; //clause numbers from the index
+      int next_clause;
+      int frame_index;
+      int goal;
+      int cell_top;
+      int trail_top;
+      int frame_top;
+   };
+
+   std::vector<compiled_clause_collection> clause_db;
+   std::vector<std::vector<clause_code>> code_db;
+
+   std::vector<std::string> predicate_names;
+   std::map<std::string, int> predicate_identifiers;
+
+   term_arena arena;
+   std::vector<int> trail;
+   std::vector<choice_point> choices;
+   std::vector<frame> frames;
+   int query_top; //cells older than this belong to the caller
+   int choice_floor; //choice points below this belong to the caller
+
+   //the current goal
+   int current_frame;
+   int current_goal;
+
+   int new_cell(term_word w)
+   {
+      arena.cells.push_back(w);
+      return arena.cells.size() - 1;
+   }
+
+   int new_variable()
+   {
+      return new_cell(make_ref(arena.cells.size()));
+   }
+
+   void bind(int cell, term_word value)
+   {
+      arena.cells[cell] = value;
+      int boundary = (choices.size() > choice_floor) ? choices.back().cell_top : query_top;
+      if(cell < boundary)
+      {
+         trail.push_back(cell);
+      }
+   }
+
+   bool unify_words(term_word w1, term_word w2)
+   {
+      w1 = arena.deref(w1);
+      w2 = arena.deref(w2);
+      if(w1 == w2)
+      {
+         return true;
+      }
+      if(!is_atom(w1))
+      {
+         if(!is_atom(w2) && word_value(w2) > word_value(w1))
+         {
+            bind(word_value(w2), w1); //bind the younger variable
+         }
+         else
+         {
+            bind(word_value(w1), w2);
+         }
+         return true;
+      }
+      if(!is_atom(w2))
+      {
+         bind(word_value(w2), w1);
+         return true;
+      }
+      return false; //different atoms
+   }
+
+   term_word argument_word(const code_argument& arg, int env) const
+   {
+      if(arg.kind == atom_argument)
+      {
+         return make_atom(arg.value);
+      }
+      return arena.deref(make_ref(env + arg.value));
+   }
+
+   void undo_to(const choice_point& choice)
+   {
+      while(trail.size() > choice.trail_top)
+      {
+         int cell = trail.back();
+         trail.pop_back();
+         arena.cells[cell] = make_ref(cell);
+      }
+      arena.cells.resize(choice.cell_top);
+      frames.resize(choice.frame_top);
+   }
+
+   //match the head of a clause against the current goal, and enter its body
+   bool try_clause(int frame_index, int goal, const clause_code& clause)
+   {
+      const frame& caller = frames[frame_index];
+      const code_literal& literal = caller.clause->body[goal];
+      if(clause.head.size() != literal.arguments.size())
+      {
+         return false;
+      }
+      int caller_env = caller.env;
+      int env = arena.cells.size();
+      for(int n = 0; n < clause.variable_count; n++)
+      {
+         new_variable();
+      }
+
+      for(int n = 0; n < clause.head.size(); n++)
+      {
+         term_word argument = argument_word(literal.arguments[n], caller_env);
+         const code_argument& parm = clause.head[n];
+         if(parm.kind == first_variable)
+         {
+            arena.cells[env + parm.value] = argument;
+         }
+         else if(!unify_words(argument_word(parm, env), argument))
+         {
+            return false;
+         }
+      }
+
+      if(clause.body.empty())
+      {
+         current_frame = frame_index;
+         current_goal = goal + 1;
+      }
+      else
+      {
+         frames.push_back(frame{&clause, env, frame_index, goal + 1});
+         current_frame = frames.size() - 1;
+         current_goal = 0;
+      }
+      return true;
+   }
+
+   //start on the current goal; false if no clause matches
+   bool call_goal()
+   {
+      const code_literal& literal = frames[current_frame].clause->body[current_goal];
+      int atom = 0;
+      if(!literal.arguments.empty())
+      {
+         term_word first = arena.deref(argument_word(literal.arguments[0], frames[current_frame].env));
+         if(is_atom(first))
+         {
+            atom = word_value(first);
+         }
+      }
+      const std::vector<int>& candidates = clause_db[literal.predicate_index].candidates(atom);
+      if(candidates.empty())
+      {
+         return false;
+      }
+      if(candidates.size() > 1)
+      {
+         choices.push_back(choice_point{literal.predicate_index, &candidates, 1, current_frame, current_goal,
+            (int)arena.cells.size(), (int)trail.size(), (int)frames.size()});
+      }
+      return try_clause(current_frame, current_goal, code_db[literal.predicate_index][candidates[0]]);
+   }
+
+   //resume from the newest choice point above floor; false if there are none
+   bool backtrack(int floor)
+   {
+      while(choices.size() > floor)
+      {
+         choice_point& choice = choices.back();
+         undo_to(choice);
+         const clause_code& clause = code_db[choice.predicate_index][(*choice.candidates)[choice.next_clause++]];
+         int frame_index = choice.frame_index;
+         int goal = choice.goal;
+         if(choice.next_clause == choice.candidates->size())
+         {
+            choices.pop_back();
+         }
+         if(try_clause(frame_index, goal, clause))
+         {
+            return true;
+         }
+      }
+      return false;
+   }
+
+   //solve the body of a query clause whose variables start at env
+   bool solve(const clause_code& query, int env, const std::function<bool()>& thenwhat)
+   {
+      int saved_query_top = query_top;
+      int saved_choice_floor = choice_floor;
+      int floor = choices.size();
+      choice_point start{-1, nullptr, 0, -1, 0, (int)arena.cells.size(), (int)trail.size(), (int)frames.size()};
+      query_top = start.cell_top;
+      choice_floor = floor;
+
+      frames.push_back(frame{&query, env, -1, 0});
+      current_frame = frames.size() - 1;
+      current_goal = 0;
+
+      bool result = false;
+      for(;;)
+      {
+         const frame& f = frames[current_frame];
+         bool ok = true;
+         if(current_goal == f.clause->body.size())
+         {
+            if(f.cont_frame < 0)
+            {
+               if(thenwhat())
+               {
+                  result = true;
+                  break;
+               }
+               ok = false;
+            }
+            else
+            {
+               current_goal = f.cont_goal;
+               current_frame = f.cont_frame;
+               continue;
+            }
+         }
+         else
+         {
+            ok = call_goal();
+         }
+
+         if(!ok && !backtrack(floor))
+         {
+            break;
+         }
+      }
+
+      choices.resize(floor);
+      undo_to(start);
+      query_top = saved_query_top;
+      choice_floor = saved_choice_floor;
+      return result;
+   }
+
+   code_argument translate_parameter(parameter parm, std::vector<int>& variable_at, int& position, int& variable_count)
+   {
+      code_argument result;
+      int code = parm.get_code();
+      position ++;
+      if(code > 0)
+      {
+         result.kind = atom_argument;
+         result.value = code;
+      }
+      else if(code == 0)
+      {
+         variable_at.resize(position + 1, 0);
+         variable_at[position] = variable_count;
+         result.kind = first_variable;
+         result.value = variable_count++;
+      }
+      else
+      {
+         result.kind = variable_argument;
+         result.value = variable_at[-code];
+      }
+      return result;
+   }
+
+   clause_code make_code(const std::vector<parameter>& head, const conjunction& body)
+   {
+      clause_code result;
+      std::vector<int> variable_at;
+      int position = 0;
+      result.variable_count = 0;
+      for(auto parm : head)
+      {
+         result.head.push_back(translate_parameter(parm, variable_at, position, result.variable_count));
+      }
+      for(const auto& pred : body)
+      {
+         code_literal literal;
+         literal.predicate_index = pred.predicate_index;
+         for(auto parm : pred.parameters)
+         {
+            code_argument arg = translate_parameter(parm, variable_at, position, result.variable_count);
+            if(arg.kind == first_variable)
+            {
+               arg.kind = variable_argument; //fresh cells start out unbound
+            }
+            literal.arguments.push_back(arg);
+         }
+         result.body.push_back(literal);
+      }
+      return result;
+   }
+
+public:
+   trail_runtime()
+   {
+      query_top = 0;
+      choice_floor = 0;
+      current_frame = -1;
+      current_goal = 0;
+   }
+
+   const term_arena& get_stack() const
+   {
+      return arena;
+   }
+
+   std::vector<cell_handle> instantiate_predicate_arguments(const compiled_predicate& predicate)
+   {
+      int base = arena.cells.size();
+      std::vector<cell_handle> arguments;
+      for(auto parm : predicate.parameters)
+      {
+         int code = parm.get_code();
+         if(code > 0)
+         {
+            arguments.push_back(new_cell(make_atom(code)));
+         }
+         else if(code == 0)
+         {
+            arguments.push_back(new_variable());
+         }
+         else
+         {
+            arguments.push_back(new_cell(make_ref(base - code - 1)));
+         }
+      }
+      return arguments;
+   }
+
+   void unstack_arguments(const std::vector<cell_handle>& arguments)
+   {
+      arena.cells.resize(arena.cells.size() - arguments.size());
+   }
+
+   compiled_predicate compile_predicate(const text_predicate& pred, std::map<std::string, int>& first_occurrence, int &position)
+   {
+      int predicate_id = 0;
+      std::vector<parameter> result;
+      auto it = predicate_identifiers.find(pred.predicate_name);
+      if(it == predicate_identifiers.end())
+      {
+         predicate_id = predicate_names.size();
+         predicate_names.push_back(pred.predicate_name);
+         predicate_identifiers[pred.predicate_name] = predicate_id;
+         clause_db.push_back({});
+         code_db.push_back({});
+      }
+      else
+      {
+         predicate_id = it->second;
+      }
+
+      for(int n = 0; n < pred.parameters.size(); n++)
+      {
+         const std::string& parm = pred.parameters[n];
+         int atom = pred.get_atom(n);
+         position ++;
+         if(atom == 0) //variable
+         {
+            auto first = first_occurrence.find(parm);
+            int parm_id = 0;
+            if(first == first_occurrence.end())
+            {
+               first_occurrence[parm] = position;
+            }
+            else
+            {
+               parm_id = -first->second;
+            }
+            result.push_back(parm_id);
+         }
+         else
+         {
+            result.push_back(atom); //atoms are numbered from 1
+         }
+      }
+      return compiled_predicate(predicate_id, result);
+   }
+
+   compiled_predicate compile_predicate(const text_predicate& pred)
+   {
+      int position = 0;
+      std::map<std::string, int> first_occurrence;
+      return compile_predicate(pred, first_occurrence, position);
+   }
+
+   compiled_clause compile_clause(const text_clause& clause)
+   {
+      std::map<std::string, int> first_occurrence;
+
+      compiled_clause result;
+      int position = 0;
+      if(clause.goal.predicate_name != "")
+      {
+         result.goal = compile_predicate(clause.goal, first_occurrence, position);
+      }
+
+      for(auto pred : clause.requirements)
+      {
+         result.requirements.push_back(compile_predicate(pred, first_occurrence, position));
+      }
+
+      return result;
+   }
+
+   bool prove(const conjunction& conj)
+   {
+      clause_code query = make_code({}, conj);
+      int env = arena.cells.size();
+      for(int n = 0; n < query.variable_count; n++)
+      {
+         new_variable();
+      }
+      bool result = solve(query, env, []{
+         return true;
+      });
+      arena.cells.resize(env);
+      return result;
+   }
+
+   bool prove(const compiled_predicate& pred, std::vector<cell_handle>& arguments, const std::function<bool()>& thenwhat)
+   {
+      //the goal's arguments are the caller's cells, so refer to them
+      //as variables of a frame whose variables start at cell 0
+      clause_code query;
+      query.variable_count = 0;
+      code_literal literal;
+      literal.predicate_index = pred.predicate_index;
+      for(auto argument : arguments)
+      {
+         literal.arguments.push_back(code_argument{variable_argument, argument.get_cell()});
+      }
+      query.body.push_back(literal);
+      return solve(query, 0, thenwhat);
+   }
+
+   bool prove(const compiled_predicate& pred)
+   {
+      std::vector<cell_handle> arguments = instantiate_predicate_arguments(pred);
+
+      bool result = prove(pred, arguments, [](){
+         return true;
+      });
+
+      unstack_arguments(arguments);
+      return result;
+   }
+
+   void print_predicate(int predicate, const std::vector<parameter>& parameters, int& position)
+   {
+      std::cout << predicate_names[predicate] << "(";
+      bool bfirst = true;
+      for(parameter parm : parameters)
+      {
+         position ++;
+         if(bfirst)
+            bfirst = false;
+         else
+            std::cout << ",";
+
+         int code = parm.get_code();
+         if(code > 0)
+            std::cout << "\"" << atoms().name(code) << "\"";
+         else if(code == 0)
+            std::cout << "P" << position;
+         else
+            std::cout << "P" << -code;
+      }
+      std::cout << ")";
+   }
+
+   void dump_clause(int predicate, const compiled_clause_body& body)
+   {
+      int position = 0;
+      print_predicate(predicate, body.goal_parameters, position);
+
+      if(body.requirements.size() > 0)
+      {
+         bool first_conjuction = true;
+         std::cout << " :- ";
+         for(compiled_predicate pred: body.requirements)
+         {
+            if(first_conjuction)
+               first_conjuction = false;
+            else
+               std::cout << ", ";
+
+            print_predicate(pred.predicate_index, pred.parameters, position);
+         }
+      }
+
+      std::cout << "." << std::endl;
+   }
+
+   void dump_program()
+   {
+      for(int a = 0; a < predicate_names.size(); a++)
+      {
+         for(compiled_clause_body c: clause_db[a])
+         {
+            dump_clause(a, c);
+         }
+      }
+   }
+
+   void install_clause(const compiled_clause& compiled)
+   {
+      compiled_clause_body body;
+      body.goal_parameters = compiled.goal.parameters;
+      body.requirements = compiled.requirements;
+      int first_atom = body.goal_parameters.empty() ? 0 : std::max(body.goal_parameters[0].get_code(), 0);
+      clause_db[compiled.goal.predicate_index].push_back(body, first_atom);
+      code_db[compiled.goal.predicate_index].push_back(make_code(body.goal_parameters, body.requirements));
+   }
+};
+
+#endif /* trail_runtime_h */
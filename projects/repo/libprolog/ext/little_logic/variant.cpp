@@ -15,6 +15,10 @@ bool variant::compare(variant *v1, variant* v2)
       switch (v1->type)
       {
          case string_value:
+            if((((string_variant*)v1)->atom != 0) && (((string_variant*)v2)->atom != 0))
+            {
+               return ((string_variant*)v1)->atom == ((string_variant*)v2)->atom;
+            }
             if(((string_variant*)v1)->value == ((string_variant*)v2)->value)
             {
                return true;
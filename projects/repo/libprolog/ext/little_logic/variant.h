@@ -33,7 +33,8 @@ class string_variant: public variant
 {
 public:
    std::string value;
-   string_variant(const std::string& v): variant(string_value), value(v)
+   int atom; //interned number of value, or 0
+   string_variant(const std::string& v, int a = 0): variant(string_value), value(v), atom(a)
    {
    }
 };
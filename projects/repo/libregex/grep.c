@@ -1,18 +1,407 @@
-#include "regex.h"
+/* grep: print the lines of each file that match a regular expression.
+ *
+ * Files are mapped into memory and cut into chunks of about CHUNK bytes
+ * that end on a newline. The chunks are matched by a pool of threads,
+ * each with its own DFA cache over one shared compiled regex (see
+ * languages/c/regex/dfa1.c), and the main thread writes out the results
+ * of each chunk in the order the chunks came in, so the output is the
+ * same as a single threaded grep. At most SLOTS chunks per thread are
+ * in flight, which bounds the memory used however big the files are.
+ * Input that cannot be mapped, such as standard input, is read into
+ * chunks instead. */
+#define _POSIX_C_SOURCE 200809L
+#include "dfa1.h"
+#include "memfind.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
-void usage(const char *arg0)
+#define CHUNK (1u << 20)
+#define SLOTS 4
+
+typedef struct {
+	char *p;
+	size_t n, cap;
+} buffer_t;
+
+typedef struct {
+	const char *name;
+	char *text;      /* chunk of the file to match */
+	size_t n;
+	void *map;       /* mapping to remove, or */
+	size_t mapn;
+	char *mem;       /* memory to free, once the chunk is written out */
+	int last;        /* last chunk of the file */
+	int done;        /* set by the worker that matched it */
+	long matches;
+	size_t skipped;
+	buffer_t out;
+} chunk_t;
+
+typedef struct {
+	Regexp *re;
+	int count;       /* only count the matching lines */
+	int names;       /* prefix lines with the file name */
+	pthread_mutex_t lock;
+	pthread_cond_t work, done;
+	chunk_t *ring;
+	size_t nslot;
+	size_t head;     /* next chunk to write out */
+	size_t next;     /* next chunk for a worker */
+	size_t tail;     /* next free slot */
+	int quit;
+	long file_matches;
+	long matches;
+	size_t bytes;
+	size_t skipped;
+	int files;
+} pool_t;
+
+typedef struct {
+	pool_t *pool;
+	Cache *cache;
+	pthread_t thread;
+} worker_t;
+
+static void usage(const char *arg0)
 {
-	fprintf(stderr, "usage: %s regex string\n", arg0);
+	fprintf(stderr, "usage: %s [-c] [-f] [-S] [-j threads] regex [file...]\n", arg0);
+	fprintf(stderr, "\t-c\tprint only a count of matching lines\n");
+	fprintf(stderr, "\t-f\tbuild the whole DFA before matching\n");
+	fprintf(stderr, "\t-S\tprint statistics and throughput to stderr\n");
+	fprintf(stderr, "\t-j\tnumber of threads to match with\n");
+}
+
+static void append(buffer_t *b, const char *s, size_t n)
+{
+	char *p;
+	size_t cap;
+	if(b->n + n > b->cap) {
+		for(cap = b->cap ? b->cap : 4096; cap < b->n + n; cap *= 2)
+			;
+		if(!(p = realloc(b->p, cap))) {
+			fprintf(stderr, "grep: out of memory\n");
+			exit(2);
+		}
+		b->p = p;
+		b->cap = cap;
+	}
+	memcpy(b->p + b->n, s, n);
+	b->n += n;
+}
+
+/* scan: match the lines of a chunk one by one, first skipping to the
+ * next line holding the regex's literal if it has one */
+static void scan(worker_t *w, chunk_t *ck)
+{
+	pool_t *pl = w->pool;
+	char *lit, *p = ck->text, *e = ck->text + ck->n, *q, *l;
+	int nlit = reliteral(pl->re, &lit);
+	while(p < e) {
+		if(nlit > 0) {
+			if(!(l = memfind(p, e - p, lit, nlit))) {
+				ck->skipped += e - p;
+				break;
+			}
+			while(l > p && l[-1] != '\n')
+				l--;
+			ck->skipped += l - p;
+			p = l;
+		}
+		if(!(q = memchr(p, '\n', e - p)))
+			q = e;
+		if(rematch(w->cache, p, q - p)) {
+			ck->matches++;
+			if(!pl->count) {
+				if(pl->names) {
+					append(&ck->out, ck->name, strlen(ck->name));
+					append(&ck->out, ":", 1);
+				}
+				append(&ck->out, p, q - p);
+				append(&ck->out, "\n", 1);
+			}
+		}
+		p = q + 1;
+	}
+}
+
+static void *work(void *arg)
+{
+	worker_t *w = arg;
+	pool_t *pl = w->pool;
+	chunk_t *ck;
+	pthread_mutex_lock(&pl->lock);
+	for(;;) {
+		while(pl->next == pl->tail && !pl->quit)
+			pthread_cond_wait(&pl->work, &pl->lock);
+		if(pl->next == pl->tail)
+			break;
+		ck = &pl->ring[pl->next++ % pl->nslot];
+		pthread_mutex_unlock(&pl->lock);
+		scan(w, ck);
+		pthread_mutex_lock(&pl->lock);
+		ck->done = 1;
+		pthread_cond_broadcast(&pl->done);
+	}
+	pthread_mutex_unlock(&pl->lock);
+	return NULL;
+}
+
+/* emit: write out a finished chunk and release its memory */
+static void emit(pool_t *pl, chunk_t *ck)
+{
+	if(ck->out.n)
+		fwrite(ck->out.p, 1, ck->out.n, stdout);
+	pl->matches += ck->matches;
+	pl->file_matches += ck->matches;
+	pl->skipped += ck->skipped;
+	pl->bytes += ck->n;
+	if(ck->last) {
+		if(pl->count) {
+			if(pl->names)
+				printf("%s:", ck->name);
+			printf("%ld\n", pl->file_matches);
+		}
+		pl->file_matches = 0;
+		pl->files++;
+	}
+	if(ck->map)
+		munmap(ck->map, ck->mapn);
+	free(ck->mem);
+	free(ck->out.p);
+}
+
+/* drain: write out finished chunks in order, waiting for them until
+ * there is a free slot, or until there are none left if all is set;
+ * called with the lock held */
+static void drain(pool_t *pl, int all)
+{
+	chunk_t *ck;
+	while(pl->head < pl->tail && (all || pl->tail - pl->head == pl->nslot)) {
+		ck = &pl->ring[pl->head % pl->nslot];
+		while(!ck->done)
+			pthread_cond_wait(&pl->done, &pl->lock);
+		pthread_mutex_unlock(&pl->lock);
+		emit(pl, ck);
+		pthread_mutex_lock(&pl->lock);
+		pl->head++;
+	}
+}
+
+static void submit(pool_t *pl, chunk_t *c)
+{
+	pthread_mutex_lock(&pl->lock);
+	drain(pl, 0);
+	pl->ring[pl->tail++ % pl->nslot] = *c;
+	pthread_cond_signal(&pl->work);
+	pthread_mutex_unlock(&pl->lock);
+}
+
+/* chunks: cut the n bytes at text into chunks that end on a newline */
+static void chunks(pool_t *pl, chunk_t *tmpl, char *text, size_t n)
+{
+	chunk_t c;
+	char *e = text + n, *q;
+	do {
+		c = *tmpl;
+		c.text = text;
+		if(e - text > CHUNK && (q = memchr(text + CHUNK, '\n', e - text - CHUNK)))
+			c.n = q + 1 - text;
+		else
+			c.n = e - text;
+		text += c.n;
+		c.last = text == e;
+		if(!c.last)
+			c.map = NULL, c.mem = NULL;
+		submit(pl, &c);
+	} while(text < e);
+}
+
+/* readfd: for input that cannot be mapped, read it a chunk at a time,
+ * carrying any partial last line over to the next chunk */
+static int readfd(pool_t *pl, const char *name, int fd)
+{
+	chunk_t c;
+	char *buf, *q;
+	size_t n = 0, cap = 2 * CHUNK, keep;
+	ssize_t r;
+	if(!(buf = malloc(cap)))
+		return -1;
+	for(;;) {
+		r = read(fd, buf + n, cap - n);
+		if(r < 0) {
+			if(errno == EINTR)
+				continue;
+			free(buf);
+			return -1;
+		}
+		n += r;
+		if(r > 0 && n < cap)
+			continue;
+		keep = 0;
+		if(r > 0) {
+			for(q = buf + n; q > buf && q[-1] != '\n'; q--)
+				;
+			if(q == buf) { /* a line longer than the buffer */
+				char *nb = realloc(buf, cap * 2);
+				if(!nb) {
+					free(buf);
+					return -1;
+				}
+				buf = nb;
+				cap *= 2;
+				continue;
+			}
+			keep = buf + n - q;
+		}
+		memset(&c, 0, sizeof c);
+		c.name = name;
+		c.text = buf;
+		c.n = n - keep;
+		c.mem = buf;
+		c.last = r == 0;
+		submit(pl, &c);
+		if(r == 0)
+			return 0;
+		q = buf + n - keep;
+		if(!(buf = malloc(cap)))
+			return -1;
+		memcpy(buf, q, keep);
+		n = keep;
+	}
+}
+
+static int grep(pool_t *pl, const char *name)
+{
+	chunk_t c;
+	struct stat st;
+	void *map;
+	int fd, r = 0;
+	if(!strcmp(name, "-"))
+		return readfd(pl, "(standard input)", STDIN_FILENO);
+	if((fd = open(name, O_RDONLY)) < 0)
+		return -1;
+	if(fstat(fd, &st) < 0) {
+		close(fd);
+		return -1;
+	}
+	memset(&c, 0, sizeof c);
+	c.name = name;
+	if(!S_ISREG(st.st_mode)) {
+		r = readfd(pl, name, fd);
+	} else if(st.st_size == 0) {
+		c.last = 1;
+		submit(pl, &c);
+	} else if((map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) != MAP_FAILED) {
+		c.map = map;
+		c.mapn = st.st_size;
+		chunks(pl, &c, map, st.st_size);
+	} else {
+		r = readfd(pl, name, fd);
+	}
+	close(fd);
+	return r;
 }
 
 int main(int argc, char **argv)
 {
-	if(argc != 3) {
+	pool_t pl;
+	worker_t *w;
+	CacheStats cs;
+	struct timespec t0, t1;
+	double secs;
+	long i, nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	int opt, full = 0, stats = 0, errors = 0;
+	memset(&pl, 0, sizeof pl);
+	while((opt = getopt(argc, argv, "cfSj:")) != -1) {
+		switch(opt) {
+		case 'c': pl.count = 1; break;
+		case 'f': full = 1; break;
+		case 'S': stats = 1; break;
+		case 'j': nthreads = atol(optarg); break;
+		default:
+			usage(argv[0]);
+			exit(2);
+		}
+	}
+	if(optind >= argc) {
 		usage(argv[0]);
-		exit(EXIT_FAILURE);
+		exit(2);
+	}
+	if(nthreads < 1)
+		nthreads = 1;
+	if(!(pl.re = recompile(argv[optind], 0))) {
+		fprintf(stderr, "grep: bad regex '%s'\n", argv[optind]);
+		exit(2);
+	}
+	if(full)
+		refull(pl.re, 0);
+	optind++;
+	pl.names = argc - optind > 1;
+	pl.nslot = SLOTS * nthreads;
+	pl.ring = calloc(pl.nslot, sizeof pl.ring[0]);
+	w = calloc(nthreads, sizeof w[0]);
+	if(!pl.ring || !w) {
+		fprintf(stderr, "grep: out of memory\n");
+		exit(2);
+	}
+	pthread_mutex_init(&pl.lock, NULL);
+	pthread_cond_init(&pl.work, NULL);
+	pthread_cond_init(&pl.done, NULL);
+	for(i = 0; i < nthreads; i++) {
+		w[i].pool = &pl;
+		if(!(w[i].cache = cachenew(pl.re, 0))) {
+			fprintf(stderr, "grep: out of memory\n");
+			exit(2);
+		}
+		if(pthread_create(&w[i].thread, NULL, work, &w[i])) {
+			fprintf(stderr, "grep: cannot create thread\n");
+			exit(2);
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if(optind == argc && readfd(&pl, "(standard input)", STDIN_FILENO) < 0) {
+		fprintf(stderr, "grep: (standard input): %s\n", strerror(errno));
+		errors++;
+	}
+	for(; optind < argc; optind++) {
+		if(grep(&pl, argv[optind]) < 0) {
+			fprintf(stderr, "grep: %s: %s\n", argv[optind], strerror(errno));
+			errors++;
+		}
+	}
+	pthread_mutex_lock(&pl.lock);
+	drain(&pl, 1);
+	pl.quit = 1;
+	pthread_cond_broadcast(&pl.work);
+	pthread_mutex_unlock(&pl.lock);
+	for(i = 0; i < nthreads; i++)
+		pthread_join(w[i].thread, NULL);
+	fflush(stdout);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	if(stats) {
+		secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+		for(i = 0; i < nthreads; i++) {
+			cachestats(w[i].cache, &cs);
+			pl.skipped += cs.nskip;
+		}
+		fprintf(stderr, "files:\t%d\nbytes:\t%zu\nmatches:\t%ld\nskipped:\t%zu\nthreads:\t%ld\nseconds:\t%.3f\nMB/s:\t%.1f\n",
+			pl.files, pl.bytes, pl.matches, pl.skipped, nthreads, secs,
+			secs > 0 ? pl.bytes / secs / 1e6 : 0.0);
 	}
-	fprintf(stdout, "regex:\t%s\nstring:\t%s\n%s\n", argv[1], argv[2], match(argv[1], argv[2]) ? "match" : "no match");
-	return 0;
+	for(i = 0; i < nthreads; i++)
+		cachefree(w[i].cache);
+	free(w);
+	free(pl.ring);
+	refree(pl.re);
+	return errors ? 2 : pl.matches ? 0 : 1;
 }
@@ -1,14 +1,77 @@
 #include "regex.h"
+#include "memfind.h"
+#include <string.h>
 
 /* see http://www.cs.princeton.edu/courses/archive/spr09/cos333/beautiful.html */
 static int matchhere(char *regexp, char *text);
 static int matchstar(int c, char *regexp, char *text);
 
+/* findlit: find the longest run of plain characters in regexp that every
+ * match must contain, returning its length and setting *lit to it and
+ * *prefix if every match starts with it */
+static size_t findlit(char *regexp, char **lit, int *prefix)
+{
+	size_t i = 0, run = 0, best = 0;
+	*prefix = 0;
+	while (regexp[i] != '\0') {
+		if (regexp[i + 1] == '*') {
+			run = 0;
+			i += 2;
+			continue;
+		}
+		if (regexp[i] == '.' || (regexp[i] == '$' && regexp[i + 1] == '\0')) {
+			run = 0;
+			i++;
+			continue;
+		}
+		if (++run > best) {
+			best = run;
+			*lit = regexp + i + 1 - run;
+			*prefix = *lit == regexp;
+		}
+		i++;
+	}
+	return best;
+}
+
 /* match: search for regexp anywhere in text */
 int match(char *regexp, char *text)
 {
+	return match_skip(regexp, text, NULL);
+}
+
+/* match_skip: as match, but look for the literal part of regexp first so
+ * that only the places it occurs are tried, adding the number of bytes of
+ * text passed over without trying to *skipped if it is not NULL */
+int match_skip(char *regexp, char *text, size_t *skipped)
+{
+	char *lit = NULL, *end, *next;
+	size_t nlit, n;
+	int prefix;
 	if (regexp[0] == '^')
 		return matchhere(regexp + 1, text);
+	nlit = findlit(regexp, &lit, &prefix);
+	if (nlit > 0) {
+		n = strlen(text);
+		end = text + n;
+		if (!(next = memfind(text, n, lit, nlit))) {
+			if (skipped)
+				*skipped += n + 1;
+			return 0;
+		}
+		if (prefix) {
+			do {
+				if (skipped)
+					*skipped += next - text;
+				if (matchhere(regexp, next))
+					return 1;
+				text = next + 1;
+			} while (text < end && (next = memfind(text, end - text, lit, nlit)));
+			if (skipped)
+				*skipped += end - text + 1;
+			return 0;
+		}
+	}
 	do {			/* must look even if string is empty */
 		if (matchhere(regexp, text))
 			return 1;
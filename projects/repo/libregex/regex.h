@@ -1,6 +1,9 @@
 #ifndef REGEX_H
 #define REGEX_H
 
+#include <stddef.h>
+
 int match(char *regexp, char *text);
+int match_skip(char *regexp, char *text, size_t *skipped);
 
 #endif